@@ -5,27 +5,53 @@
 #define SMMU_ADDRESS_SPACE_H
 
 #include "smmu/types.h"
+#include "smmu/radix_page_table.h"
+#include "smmu/extent_tree.h"
+#include "smmu/memory_pool.h"
+#include "smmu/dirty_bitmap.h"
 #include <unordered_map>
 #include <memory>
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <utility>
+#include <functional>
 #include <cstddef>
 
 namespace smmu {
 
+// Mutators may be called from any thread; they serialize on an internal
+// lock, one writer at a time. With PageTableBackend::Radix, translatePage,
+// isPageMapped and getPagePermissions take no lock and run alongside that
+// writer (see RadixPageTable); the Hash and Extent backends' node-based
+// containers cannot be read during an update, so their lookups take the
+// lock briefly.
+//
+// Copies are O(1): they share the source's storage and diverge as either
+// side writes. Radix tables copy only the nodes on the path of a change;
+// Hash and Extent storage is copied whole by the first write after sharing.
 class AddressSpace {
 public:
     AddressSpace();
+    // Hash backend storage is charged to budget; Radix and Extent storage
+    // is not charged anywhere
+    explicit AddressSpace(PageTableBackend backend, TranslationGranule granule = TranslationGranule::Size4KB,
+                          std::shared_ptr<MemoryBudget> budget = MemoryBudget::defaultBudget());
     ~AddressSpace();
     
-    // Page mapping operations
+    // Page mapping operations - a page is one granule (4KB, 16KB or 64KB)
     VoidResult mapPage(IOVA iova, PA pa, const PagePermissions& permissions, SecurityState securityState = SecurityState::NonSecure);
     VoidResult unmapPage(IOVA iova);
     
+    // Block mapping (2MB/1GB, 32MB/64GB or 4TB/512MB for the 4KB, 16KB and 64KB
+    // granules); iova and pa must be aligned to blockSize. Replaces any smaller
+    // mappings it covers.
+    VoidResult mapBlock(IOVA iova, PA pa, uint64_t blockSize, const PagePermissions& permissions, SecurityState securityState = SecurityState::NonSecure);
+    
     // Translation operations
     TranslationResult translatePage(IOVA iova, AccessType accessType, SecurityState securityState = SecurityState::NonSecure) const;
     
-    // Address range mapping operations
+    // Address range mapping operations - mapRange uses the largest aligned block for each chunk
     VoidResult mapRange(IOVA startIova, IOVA endIova, PA startPa, const PagePermissions& permissions);
     VoidResult unmapRange(IOVA startIova, IOVA endIova);
     
@@ -45,24 +71,112 @@ public:
     
     // Management operations
     VoidResult clear();
+    PageTableBackend getPageTableBackend() const;
+    TranslationGranule getGranule() const;
+    uint64_t getGranuleSize() const;  // Page size, and the size of translatePage results outside blocks
     
     // Copy constructor and assignment operator for C++11
     AddressSpace(const AddressSpace& other);
     AddressSpace& operator=(const AddressSpace& other);
     
+    // Read-only copy of the current mappings; queries on it, getMappedRanges
+    // included, see one consistent state while writers carry on here
+    std::shared_ptr<const AddressSpace> snapshot() const;
+    
     // Cache invalidation mechanisms
     void invalidateRange(IOVA startIova, IOVA endIova);
     void invalidateAll();
     void invalidateCache();
     void invalidatePage(IOVA iova);
     
+    // Dirty page logging, as SMMU HTTU dirty state (CD.HD) would keep it:
+    // while enabled, every write translatePage allows marks its page dirty,
+    // or the whole block for a block mapping, and the result carries the
+    // dirty-log epoch so cached copies know when to walk again. Enable it
+    // before the space translates anything, or invalidate cached
+    // translations afterwards, as after changing a context descriptor.
+    // Copies start with an empty log.
+    void setDirtyTracking(bool enabled);
+    bool isDirtyTrackingEnabled() const;
+    
+    // Collect and clear the dirty bits of the pages in [startIova, endIova]:
+    // bit i is the page at (startIova rounded down to the granule) + i pages.
+    // Safe alongside translations. Taking any bit starts a new dirty-log
+    // epoch for this address space, so its cached translations send their
+    // next write through translatePage again to be logged.
+    Result<std::vector<uint64_t>> getAndClearDirtyBitmap(IOVA startIova, IOVA endIova);
+    uint64_t getDirtyLogEpoch() const;
+    
+    // Whether a TranslationData::dirtyEpoch stamp from any address space is
+    // still that space's current epoch
+    static bool isDirtyLogEpochCurrent(uint64_t dirtyEpoch);
+    
+    // Largest range one getAndClearDirtyBitmap call covers (a 512MB bitmap)
+    static const uint64_t MAX_DIRTY_BITMAP_PAGES = 1ULL << 32;
+    
 private:
-    // Sparse page table using hash map for efficiency
-    std::unordered_map<uint64_t, PageEntry> pageTable;
+    // Block descriptor levels, smallest first: [0] = level 2 block, [1] = level 1 block
+    static const size_t BLOCK_LEVELS = 2;
+    
+    // Hash nodes come from the slab pools
+    using DescriptorMap = std::unordered_map<uint64_t, PageDescriptor, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                             PoolAllocator<std::pair<const uint64_t, PageDescriptor>>>;
+    
+    struct HashTables {
+        // Charged for the nodes below, so it must outlive them
+        std::shared_ptr<MemoryBudget> budget;
+        
+        // Sparse page table using hash map for efficiency
+        DescriptorMap pageTable;
+    
+        // Block descriptors keyed by block number (iova >> block shift). Mappings
+        // never overlap: mapping or unmapping a page inside a block splits it first.
+        DescriptorMap blockTables[BLOCK_LEVELS];
+        
+        explicit HashTables(std::shared_ptr<MemoryBudget> budget);
+        HashTables(const HashTables& other, std::shared_ptr<MemoryBudget> budget);
+    };
+    
+    // Budget of the SMMU that created this space; copies keep their own
+    std::shared_ptr<MemoryBudget> budget;
+    
+    // PageTableBackend::Hash storage, shared with copies until written
+    std::shared_ptr<HashTables> hashTables;
+    
+    // PageTableBackend::Radix keeps pages and blocks here instead of the hash
+    // maps above, which then stay empty; its nodes are shared with copies
+    std::unique_ptr<RadixPageTable> radixTable;
+    
+    // PageTableBackend::Extent keeps whole mapped intervals here instead;
+    // range operations then cost O(log n) in the number of extents. Shared
+    // with copies until written.
+    std::shared_ptr<ExtentTree> extentTree;
+    
+    TranslationGranule granule;
+    unsigned pageShift;  // log2 of the granule page size
+    
+    // Held by every mutator and by Hash/Extent lookups
+    mutable std::mutex tableMutex;
+    
+    // Dirty log, one bit per granule page; marked from const translatePage
+    mutable DirtyBitmap dirtyPages;
+    std::atomic<bool> dirtyTracking;
+    size_t dirtyEpochSlot;  // Never changes; copies get their own
     
     // Helper methods
     uint64_t pageNumber(IOVA iova) const;
-    bool checkPermissions(const PagePermissions& perms, AccessType accessType) const;
+    uint64_t granuleMask() const;
+    unsigned blockShift(size_t level) const;
+    uint64_t blockSizeForLevel(size_t level) const;
+    void unshareTables();
+    bool hasBlocks() const;
+    bool hashTablesFull() const;
+    PageDescriptor findMapping(IOVA iova, uint64_t& mappingSize) const;
+    bool hasMappingsIn(IOVA startIova, IOVA endIova) const;
+    void splitBlock(size_t level, uint64_t blockNum);
+    void splitCoveringBlocks(IOVA iova, uint64_t mappingSize);
+    void eraseCoveredMappings(IOVA base, size_t level);
+    void erasePages(uint64_t startPageNum, uint64_t endPageNum);
 };
 
 } // namespace smmu
@@ -49,25 +49,50 @@ struct CacheConfiguration {
     size_t tlbCacheSize;        // TLB cache size in entries (default: 1024)
     uint32_t cacheMaxAge;       // Maximum cache entry age in milliseconds (default: 5000)
     bool enableCaching;         // Enable/disable caching globally (default: true)
+    bool enableCacheAging;      // Expire TLB entries after cacheMaxAge; false relies purely on
+                                // explicit invalidation (default: true)
+    size_t tlbShardCount;       // TLB lock stripes, power of two; 1 = unsharded (default: 1)
+                                // Fixed when the SMMU is constructed
+    TLBBackend tlbBackend;      // TLB storage organisation (default: LRUList)
+                                // Fixed when the SMMU is constructed
+    size_t microTlbEntries;     // Per-thread L0 micro-TLB entries, 0 or [16, 64] (default: 0 = off)
+    size_t walkCacheEntries;    // Table walk cache entries, 0 (off) or [16, 65536], rounded up to
+                                // a power of two (default: 256)
     
     // Constructor with default values
     CacheConfiguration()
         : tlbCacheSize(DEFAULT_TLB_CACHE_SIZE),
           cacheMaxAge(DEFAULT_CACHE_MAX_AGE),
-          enableCaching(true) {
+          enableCaching(true),
+          enableCacheAging(true),
+          tlbShardCount(DEFAULT_TLB_SHARD_COUNT),
+          tlbBackend(TLBBackend::LRUList),
+          microTlbEntries(0),
+          walkCacheEntries(DEFAULT_WALK_CACHE_ENTRIES) {
     }
     
     // Constructor with custom values
-    CacheConfiguration(size_t cacheSize, uint32_t maxAge, bool enable)
+    CacheConfiguration(size_t cacheSize, uint32_t maxAge, bool enable, size_t shardCount = DEFAULT_TLB_SHARD_COUNT)
         : tlbCacheSize(cacheSize),
           cacheMaxAge(maxAge),
-          enableCaching(enable) {
+          enableCaching(enable),
+          enableCacheAging(true),
+          tlbShardCount(shardCount),
+          tlbBackend(TLBBackend::LRUList),
+          microTlbEntries(0),
+          walkCacheEntries(DEFAULT_WALK_CACHE_ENTRIES) {
     }
     
     // Validation method
     bool isValid() const {
         return tlbCacheSize >= MIN_CACHE_SIZE && tlbCacheSize <= MAX_CACHE_SIZE &&
-               cacheMaxAge >= MIN_CACHE_AGE && cacheMaxAge <= MAX_CACHE_AGE;
+               cacheMaxAge >= MIN_CACHE_AGE && cacheMaxAge <= MAX_CACHE_AGE &&
+               tlbShardCount >= MIN_SHARD_COUNT && tlbShardCount <= MAX_SHARD_COUNT &&
+               (tlbShardCount & (tlbShardCount - 1)) == 0 &&
+               (microTlbEntries == 0 ||
+                (microTlbEntries >= MIN_MICRO_TLB_ENTRIES && microTlbEntries <= MAX_MICRO_TLB_ENTRIES)) &&
+               (walkCacheEntries == 0 ||
+                (walkCacheEntries >= MIN_WALK_CACHE_ENTRIES && walkCacheEntries <= MAX_WALK_CACHE_ENTRIES));
     }
     
 private:
@@ -77,6 +102,14 @@ private:
     static const uint32_t MAX_CACHE_AGE = 3600000; // 1 hour
     static const size_t DEFAULT_TLB_CACHE_SIZE = 1024;
     static const uint32_t DEFAULT_CACHE_MAX_AGE = 5000; // 5 seconds
+    static const size_t MIN_SHARD_COUNT = 1;
+    static const size_t MAX_SHARD_COUNT = 256;
+    static const size_t DEFAULT_TLB_SHARD_COUNT = 1;
+    static const size_t MIN_MICRO_TLB_ENTRIES = 16;
+    static const size_t MAX_MICRO_TLB_ENTRIES = 64;
+    static const size_t MIN_WALK_CACHE_ENTRIES = 16;
+    static const size_t MAX_WALK_CACHE_ENTRIES = 65536;
+    static const size_t DEFAULT_WALK_CACHE_ENTRIES = 256;
 };
 
 // Address space configuration structure
@@ -255,6 +288,7 @@ private:
     static uint64_t parseUInt64(const std::string& value);
     static uint32_t parseUInt32(const std::string& value);
     static size_t parseSize(const std::string& value);
+    static TLBBackend parseTLBBackend(const std::string& value);
     
     // Helper methods for validation
     bool validateQueueConfiguration() const;
@@ -267,6 +301,7 @@ private:
     std::string uint64ToString(uint64_t value) const;
     std::string uint32ToString(uint32_t value) const;
     std::string sizeToString(size_t value) const;
+    std::string tlbBackendToString(TLBBackend value) const;
 };
 
 // Configuration validation error types
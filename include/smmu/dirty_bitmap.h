@@ -0,0 +1,73 @@
+// ARM SMMU v3 Dirty Page Bitmap
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_DIRTY_BITMAP_H
+#define SMMU_DIRTY_BITMAP_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// Sparse bitmap with one bit per page number, up to 2^40 pages (a 52-bit
+// IOVA space of 4KB pages).
+//
+// Bits live in 64-bit words grouped into leaves of 32768 pages, reached
+// through two directory levels that, like the leaves, are allocated on the
+// first set below them and kept until the bitmap is destroyed. Nothing is
+// ever unlinked, so set, test and collect take no lock and may run on any
+// number of threads at once; collect hands each word's bits to exactly one
+// caller.
+class DirtyBitmap {
+public:
+    static const unsigned PAGE_NUMBER_BITS = 40;
+    
+    DirtyBitmap();
+    ~DirtyBitmap();
+    
+    void set(uint64_t page);
+    void setRange(uint64_t firstPage, uint64_t pageCount);
+    bool test(uint64_t page) const;
+    
+    // Clear the bits of [firstPage, firstPage + pageCount) and return them:
+    // bit i of the result is page firstPage + i. Works a word at a time and
+    // skips leaves that were never set.
+    std::vector<uint64_t> collect(uint64_t firstPage, uint64_t pageCount);
+    
+    void clear();
+
+private:
+    static const unsigned LEAF_BITS = 15;     // Pages per leaf, as a shift
+    static const unsigned MIDDLE_BITS = 12;   // Leaves per middle directory
+    static const unsigned ROOT_BITS = PAGE_NUMBER_BITS - LEAF_BITS - MIDDLE_BITS;
+    static const size_t LEAF_WORDS = (static_cast<size_t>(1) << LEAF_BITS) / 64;
+    
+    struct Leaf {
+        std::atomic<uint64_t> words[LEAF_WORDS];
+        Leaf();
+    };
+    struct Middle {
+        std::atomic<Leaf*> leaves[static_cast<size_t>(1) << MIDDLE_BITS];
+        Middle();
+        ~Middle();
+    };
+    struct Root {
+        std::atomic<Middle*> middles[static_cast<size_t>(1) << ROOT_BITS];
+        Root();
+        ~Root();
+    };
+    
+    std::atomic<Root*> root;
+    
+    Leaf* findLeaf(uint64_t page) const;
+    Leaf* leafForWrite(uint64_t page);
+    
+    DirtyBitmap(const DirtyBitmap&);
+    DirtyBitmap& operator=(const DirtyBitmap&);
+};
+
+} // namespace smmu
+
+#endif // SMMU_DIRTY_BITMAP_H
@@ -0,0 +1,62 @@
+// ARM SMMU v3 Epoch-Based Memory Reclamation
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_EPOCH_RECLAIMER_H
+#define SMMU_EPOCH_RECLAIMER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+struct EpochThreadRecord;
+
+// Read-side critical section for structures whose writer frees memory
+// through an EpochReclaimer. While a thread holds a guard, nothing retired
+// after the guard was taken is freed, so it may follow pointers it loaded
+// from the structure without locks. Guards nest and are cheap: the outermost
+// one publishes the thread's epoch and issues one fence.
+class EpochGuard {
+public:
+    EpochGuard();
+    ~EpochGuard();
+
+private:
+    EpochThreadRecord* record;
+    
+    EpochGuard(const EpochGuard&);
+    EpochGuard& operator=(const EpochGuard&);
+};
+
+// Deferred deletion for one writer at a time (callers serialize retire and
+// reclaim). Retired objects are unlinked already but may still be in use by
+// readers inside an EpochGuard; they are freed once the global epoch has
+// advanced twice past their retirement, which every thread that could have
+// seen them must have allowed by leaving its guard.
+class EpochReclaimer {
+public:
+    typedef void (*Deleter)(void* object);
+    
+    EpochReclaimer();
+    ~EpochReclaimer();  // Frees everything still pending: no reader may remain
+    
+    void retire(void* object, Deleter deleter);
+    void reclaim();     // Free whatever no reader can reach any more
+    size_t getPendingCount() const;
+
+private:
+    struct Retired {
+        void* object;
+        Deleter deleter;
+        uint64_t epoch;   // Global epoch when the object was retired
+    };
+    std::vector<Retired> pending;
+    
+    EpochReclaimer(const EpochReclaimer&);
+    EpochReclaimer& operator=(const EpochReclaimer&);
+};
+
+} // namespace smmu
+
+#endif // SMMU_EPOCH_RECLAIMER_H
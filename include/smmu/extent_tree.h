@@ -0,0 +1,71 @@
+// ARM SMMU v3 Extent Tree Storage
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_EXTENT_TREE_H
+#define SMMU_EXTENT_TREE_H
+
+#include "smmu/types.h"
+#include <map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// Interval storage behind PageTableBackend::Extent.
+//
+// Each extent maps a granule-aligned IOVA interval onto a contiguous PA
+// interval with one set of permissions and one security state. Extents never
+// overlap and are kept in an ordered tree keyed by their first IOVA, so a
+// lookup is one tree search and map, unmap and overlap queries cost
+// O(log n + k) for n extents of which k are touched - independent of how
+// many pages the interval spans. Mapping next to a compatible extent (same
+// attributes, contiguous PA) extends it instead of adding a node.
+// Not thread-safe: AddressSpace callers serialize access.
+class ExtentTree {
+public:
+    explicit ExtentTree(TranslationGranule granule = TranslationGranule::Size4KB);
+    
+    // Map [iova, iova + size) to entry.physicalAddress onwards; iova and size
+    // must be granule-aligned. Replaces whatever the interval covered.
+    void map(IOVA iova, uint64_t size, const PageEntry& entry);
+    
+    // Extent covering iova, or nullptr. Its physicalAddress maps extentBase,
+    // and the extent spans extentSize bytes.
+    const PageEntry* find(IOVA iova, IOVA& extentBase, uint64_t& extentSize) const;
+    
+    // Remove every mapping in [firstIova, lastIova] widened to whole granule
+    // pages, trimming extents that straddle either end. Returns the number of
+    // granule pages removed.
+    uint64_t unmap(IOVA firstIova, IOVA lastIova);
+    
+    bool hasMappings(IOVA firstIova, IOVA lastIova) const;
+    std::vector<AddressRange> getMappedRanges() const;  // Sorted, adjacent extents merged
+    bool getBounds(IOVA& lowest, IOVA& highest) const;  // false when empty
+    
+    uint64_t getPageCount() const;  // Granule pages covered by all extents
+    size_t getExtentCount() const;
+    void clear();
+
+private:
+    struct Extent {
+        uint64_t size;    // Bytes, a multiple of the granule
+        PageEntry entry;  // PA of the first byte, permissions, security state
+        
+        Extent(uint64_t bytes, const PageEntry& pageEntry) : size(bytes), entry(pageEntry) {
+        }
+    };
+    typedef std::map<IOVA, Extent> ExtentMap;
+    
+    ExtentMap extents;
+    uint64_t mappedBytes;
+    unsigned pageShift;
+    
+    static bool canMerge(const ExtentMap::value_type& lower, const ExtentMap::value_type& upper);
+    uint64_t carve(IOVA firstIova, IOVA lastIova);
+    void mergeNeighbours(ExtentMap::iterator it);
+};
+
+} // namespace smmu
+
+#endif // SMMU_EXTENT_TREE_H
@@ -5,16 +5,18 @@
 #define SMMU_FAULT_HANDLER_H
 
 #include "smmu/types.h"
+#include "smmu/memory_pool.h"
 #include <vector>
 #include <deque>
 #include <mutex>
+#include <memory>
 #include <cstddef>
 
 namespace smmu {
 
 class FaultHandler {
 public:
-    FaultHandler();
+    explicit FaultHandler(std::shared_ptr<MemoryBudget> budget = MemoryBudget::defaultBudget());
     ~FaultHandler();
     
     // Fault recording
@@ -52,8 +54,9 @@ public:
     void reset();  // Complete reset
     
 private:
-    // Event queue (thread-safe)
-    std::deque<FaultRecord> eventQueue;
+    // Event queue (thread-safe); deque blocks come from the slab pools
+    std::shared_ptr<MemoryBudget> budget;
+    std::deque<FaultRecord, PoolAllocator<FaultRecord>> eventQueue;
     mutable std::mutex queueMutex;
     
     // Configuration
@@ -0,0 +1,237 @@
+// ARM SMMU v3 Memory Pools
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_MEMORY_POOL_H
+#define SMMU_MEMORY_POOL_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <limits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// Account of the memory held by pooled containers and object pools, checked
+// against ResourceLimits::maxMemoryUsage. Each SMMU owns one budget and hands
+// it to the containers it creates, so one instance's limit never squeezes
+// another's. A limit of 0 means unlimited. Thread-safe.
+//
+// Container allocations cannot fail, so containers admit new elements only
+// while isExhausted() is false: the TLB caches evict instead of growing,
+// event and fault queues drop their oldest record, the command queue refuses
+// commands and hash address spaces refuse new mappings. MemoryPool growth
+// fails outright once it would pass the limit. Radix and Extent address
+// spaces (RadixPageTable nodes, ExtentTree intervals) allocate outside any
+// budget, so maxMemoryUsage does not bound them.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limit = 0);
+    
+    void setLimit(uint64_t bytes);
+    uint64_t getLimit() const;
+    uint64_t getUsage() const;
+    bool isExhausted() const;
+    
+    bool tryCharge(size_t bytes);  // Fails rather than pass the limit
+    void charge(size_t bytes);     // Always succeeds
+    void credit(size_t bytes);
+    
+    // Unlimited budget for containers no SMMU owns. Never destroyed, so
+    // static containers may outlive every other object.
+    static const std::shared_ptr<MemoryBudget>& defaultBudget();
+
+private:
+    std::atomic<uint64_t> limit;
+    std::atomic<uint64_t> usage;
+    
+    MemoryBudget(const MemoryBudget&);
+    MemoryBudget& operator=(const MemoryBudget&);
+};
+
+// Fixed-size slab pools shared by the process, one per 16-byte size class up
+// to MAX_BLOCK_SIZE. Each thread keeps a short free list per class and only
+// takes the pool's lock to move a batch of blocks in or out, so steady-state
+// node churn never locks. Slabs are kept for reuse and never returned to
+// the system. Larger or over-aligned requests go to operator new. The
+// allocator keeps no account: PoolAllocator charges blockSize() for each
+// block a container holds, so blocks cached on thread free lists and unused
+// slab space (see getReservedBytes) are never charged to any MemoryBudget.
+class SlabAllocator {
+public:
+    static const size_t BLOCK_ALIGNMENT = 16;
+    static const size_t MAX_BLOCK_SIZE = 512;
+    static const size_t SLAB_SIZE = 16 * 1024;
+    
+    static void* allocate(size_t bytes, size_t alignment);
+    static void deallocate(void* block, size_t bytes, size_t alignment);
+    static size_t blockSize(size_t bytes, size_t alignment);  // Memory a request takes
+    
+    static uint64_t getReservedBytes();  // Slabs allocated so far
+};
+
+// Standard allocator over SlabAllocator, for node-based containers. Blocks
+// are charged to the allocator's budget, which must outlive the container;
+// the budget follows the container on copy, move and swap.
+template <typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    
+    PoolAllocator() : budget(MemoryBudget::defaultBudget().get()) {
+    }
+    
+    explicit PoolAllocator(MemoryBudget* budget) : budget(budget) {
+    }
+    
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : budget(other.getBudget()) {
+    }
+    
+    T* allocate(size_t count) {
+        if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        void* block = SlabAllocator::allocate(count * sizeof(T), alignof(T));
+        budget->charge(SlabAllocator::blockSize(count * sizeof(T), alignof(T)));
+        return static_cast<T*>(block);
+    }
+    
+    void deallocate(T* block, size_t count) {
+        SlabAllocator::deallocate(block, count * sizeof(T), alignof(T));
+        budget->credit(SlabAllocator::blockSize(count * sizeof(T), alignof(T)));
+    }
+    
+    MemoryBudget* getBudget() const {
+        return budget;
+    }
+
+private:
+    MemoryBudget* budget;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+    return lhs.getBudget() == rhs.getBudget();
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+    return !(lhs == rhs);
+}
+
+// Object pool for one type. Objects are carved from chunks of growBy slots,
+// charged to the pool's MemoryBudget; released slots are reused most recent first.
+// acquire returns nullptr when the pool must grow and the budget refuses.
+// Objects still acquired when the pool is destroyed are not destroyed.
+// Thread-safe.
+template <typename T>
+class MemoryPool {
+public:
+    static const size_t DEFAULT_INITIAL_SIZE = 64;
+    static const size_t DEFAULT_GROW_BY = 64;
+    
+    explicit MemoryPool(size_t initialSize = DEFAULT_INITIAL_SIZE, size_t growBy = DEFAULT_GROW_BY,
+                        std::shared_ptr<MemoryBudget> budget = MemoryBudget::defaultBudget())
+        : freeList(nullptr), growBy(growBy != 0 ? growBy : 1), totalCapacity(0), usedCount(0),
+          budget(budget) {
+        if (initialSize != 0) {
+            grow(initialSize);
+        }
+    }
+    
+    ~MemoryPool() {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            ::operator delete(chunks[i].first);
+            budget->credit(chunks[i].second * sizeof(Slot));
+        }
+    }
+    
+    template <typename... Args>
+    T* acquire(Args&&... args) {
+        Slot* slot;
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            if (!freeList && !grow(growBy)) {
+                return nullptr;
+            }
+            slot = freeList;
+            freeList = slot->next;
+            ++usedCount;
+        }
+        return new (slot) T(std::forward<Args>(args)...);
+    }
+    
+    void release(T* object) {
+        if (!object) {
+            return;
+        }
+        object->~T();
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        std::lock_guard<std::mutex> lock(poolMutex);
+        slot->next = freeList;
+        freeList = slot;
+        --usedCount;
+    }
+    
+    size_t getTotalCapacity() const {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        return totalCapacity;
+    }
+    
+    size_t getUsedCount() const {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        return usedCount;
+    }
+    
+    size_t getFreeCount() const {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        return totalCapacity - usedCount;
+    }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+    
+    Slot* freeList;
+    std::vector<std::pair<Slot*, size_t>> chunks;  // Chunk and its slot count
+    size_t growBy;
+    size_t totalCapacity;
+    size_t usedCount;
+    std::shared_ptr<MemoryBudget> budget;
+    mutable std::mutex poolMutex;
+    
+    bool grow(size_t count) {
+        if (count > std::numeric_limits<size_t>::max() / sizeof(Slot) ||
+            !budget->tryCharge(count * sizeof(Slot))) {
+            return false;
+        }
+        Slot* chunk = static_cast<Slot*>(::operator new(count * sizeof(Slot)));
+        chunks.push_back(std::make_pair(chunk, count));
+        
+        // Thread the new slots so the lowest address is handed out first
+        for (size_t i = count; i > 0; --i) {
+            chunk[i - 1].next = freeList;
+            freeList = &chunk[i - 1];
+        }
+        totalCapacity += count;
+        return true;
+    }
+    
+    MemoryPool(const MemoryPool&);
+    MemoryPool& operator=(const MemoryPool&);
+};
+
+} // namespace smmu
+
+#endif // SMMU_MEMORY_POOL_H
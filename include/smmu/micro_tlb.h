@@ -0,0 +1,140 @@
+// ARM SMMU v3 Per-Thread Micro-TLB
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_MICRO_TLB_H
+#define SMMU_MICRO_TLB_H
+
+#include "smmu/types.h"
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// Micro-TLB entry - one translated page plus the invalidation epochs that were
+// current before the translation was looked up
+struct MicroTLBEntry {
+    IOVA page;                  // Page-aligned IOVA
+    PA pageBase;                // Page-aligned PA
+    StreamID streamID;
+    PASID pasid;
+    uint64_t globalEpoch;       // SMMU-wide invalidation epoch at fill time
+    uint64_t streamEpoch;       // Per-stream invalidation epoch at fill time
+    uint64_t dirtyEpoch;        // TranslationData::dirtyEpoch of the translation
+    PagePermissions permissions;
+    SecurityState securityState;
+    bool valid;
+    
+    MicroTLBEntry() : page(0), pageBase(0), streamID(0), pasid(0), globalEpoch(0), streamEpoch(0),
+                      dirtyEpoch(DIRTY_UNTRACKED), securityState(SecurityState::NonSecure), valid(false) {
+    }
+};
+
+// Hit counter owned by one thread's micro-TLB. Only that thread writes it, so
+// it is updated with a plain load/store; the SMMU sums the counters on demand.
+// Padded to a cache line so neighbouring threads' counters do not false-share.
+struct MicroTLBHitCounter {
+    std::atomic<uint64_t> hits;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+    
+    MicroTLBHitCounter() : hits(0) {
+    }
+    
+    void increment() {
+        hits.store(hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+// Small fully associative L0 translation cache, intended to be thread-local.
+// It is never shared between threads and needs no locking. Coherence comes from
+// the epochs stored in each entry: an entry only hits while both the SMMU-wide
+// and the per-stream invalidation epochs still match, so an invalidation is a
+// single counter increment on the SMMU side.
+class MicroTLB {
+public:
+    static const size_t MIN_ENTRIES = 16;
+    static const size_t MAX_ENTRIES = 64;
+    
+    MicroTLB() : ownerID(0), capacity(0), nextVictim(0) {
+    }
+    
+    // Attach to an SMMU instance; entries from any previous owner are dropped
+    void bind(uint64_t newOwnerID, size_t newCapacity, const std::shared_ptr<MicroTLBHitCounter>& counter) {
+        ownerID = newOwnerID;
+        capacity = newCapacity < MAX_ENTRIES ? newCapacity : MAX_ENTRIES;
+        hitCounter = counter;
+        clear();
+    }
+    
+    uint64_t getOwner() const {
+        return ownerID;
+    }
+    
+    size_t getCapacity() const {
+        return capacity;
+    }
+    
+    const MicroTLBEntry* lookup(StreamID streamID, PASID pasid, IOVA page, SecurityState securityState,
+                                uint64_t globalEpoch, uint64_t streamEpoch) const {
+        for (size_t i = 0; i < capacity; ++i) {
+            const MicroTLBEntry& entry = entries[i];
+            if (entry.page == page && entry.streamID == streamID && entry.pasid == pasid &&
+                entry.securityState == securityState && entry.valid) {
+                // A stale epoch means an invalidation happened since the fill
+                if (entry.globalEpoch == globalEpoch && entry.streamEpoch == streamEpoch) {
+                    return &entry;
+                }
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+    
+    void insert(const MicroTLBEntry& newEntry) {
+        if (capacity == 0) {
+            return;
+        }
+        
+        // Refill a stale copy of the same page in place, otherwise round-robin
+        size_t slot = nextVictim;
+        for (size_t i = 0; i < capacity; ++i) {
+            const MicroTLBEntry& entry = entries[i];
+            if (entry.valid && entry.page == newEntry.page && entry.streamID == newEntry.streamID &&
+                entry.pasid == newEntry.pasid && entry.securityState == newEntry.securityState) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot == nextVictim) {
+            nextVictim = (nextVictim + 1) % capacity;
+        }
+        
+        entries[slot] = newEntry;
+        entries[slot].valid = true;
+    }
+    
+    void recordHit() {
+        if (hitCounter) {
+            hitCounter->increment();
+        }
+    }
+    
+    void clear() {
+        for (size_t i = 0; i < MAX_ENTRIES; ++i) {
+            entries[i].valid = false;
+        }
+        nextVictim = 0;
+    }
+
+private:
+    MicroTLBEntry entries[MAX_ENTRIES];
+    std::shared_ptr<MicroTLBHitCounter> hitCounter;
+    uint64_t ownerID;
+    size_t capacity;
+    size_t nextVictim;
+};
+
+} // namespace smmu
+
+#endif // SMMU_MICRO_TLB_H
@@ -0,0 +1,151 @@
+// ARM SMMU v3 Translation Table Walker
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_PAGE_TABLE_WALKER_H
+#define SMMU_PAGE_TABLE_WALKER_H
+
+#include "smmu/types.h"
+#include "smmu/physical_memory.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+class AddressSpace;
+
+// Cost of one walk
+struct WalkTrace {
+    int startLevel;            // Root level, or a lower one when the walk cache supplied the table
+    int finalLevel;            // Level of the leaf or faulting descriptor
+    unsigned depth;            // Levels from the root to finalLevel
+    unsigned descriptorReads;  // Descriptors fetched from memory; depth minus the levels the walk cache skipped
+    
+    WalkTrace() : startLevel(0), finalLevel(0), depth(0), descriptorReads(0) {
+    }
+};
+
+struct WalkStatistics {
+    uint64_t walks;
+    uint64_t faults;
+    uint64_t totalDepth;        // Sum of WalkTrace::depth
+    uint64_t descriptorReads;   // Sum of WalkTrace::descriptorReads
+    uint64_t walkCacheHits;     // Walks that started below the root
+    uint64_t walkCacheMisses;   // Walks that probed the walk cache and started at the root
+    
+    WalkStatistics() : walks(0), faults(0), totalDepth(0), descriptorReads(0), walkCacheHits(0), walkCacheMisses(0) {
+    }
+};
+
+// VMSAv8-64 Stage-1 walker over tables held in PhysicalMemory.
+//
+// The context descriptor supplies TTBR0/TTBR1 and the TCR fields that shape
+// the walk: inputAddressSize (T0SZ/T1SZ) picks the start level and which
+// TTBR an address belongs to, granuleSize the table geometry, and
+// outputAddressSize the limit for table and output addresses. Descriptors
+// follow the architecture: bits [1:0] 0b11 for a table or level 3 page,
+// 0b01 for a level 1 (4KB granule) or level 2 block, AF at bit 10, AP[2] at
+// bit 7, PXN at bit 53, and APTable[1]/PXNTable at bits 62/59 unless
+// hierarchicalPermDisable is set. Transactions are treated as privileged.
+// With 64KB granules and a 52-bit output size, bits [15:12] hold OA[51:48].
+//
+// Table descriptors reached on a walk are kept in a direct-mapped walk cache
+// keyed by context (ASID, root table and Stage-2 tables), level and the IOVA
+// bits above that level, so the next walk under the same prefix starts at
+// the deepest cached table. Contexts with tcr.walkCacheDisable set neither
+// use nor fill it. Nested walks pass a Stage-2 AddressSpace that descriptor
+// addresses (IPAs) go through; cached tables stay IPAs, so Stage-2 changes
+// need no walk cache invalidation. Thread-safe.
+class PageTableWalker {
+public:
+    static const size_t DEFAULT_WALK_CACHE_ENTRIES = 256;
+    
+    // walkCacheEntries is rounded up to a power of two; 0 disables the cache
+    explicit PageTableWalker(std::shared_ptr<PhysicalMemory> memory,
+                             size_t walkCacheEntries = DEFAULT_WALK_CACHE_ENTRIES);
+    
+    TranslationResult walk(const ContextDescriptor& context, IOVA iova, AccessType accessType,
+                           SecurityState securityState, const AddressSpace* stage2 = nullptr,
+                           WalkTrace* trace = nullptr);
+    
+    // Drop cached table descriptors, e.g. after the tables were edited
+    void invalidateWalkCache();
+    void invalidateWalkCache(ASID asid);
+    
+    // Changing the size empties the cache
+    void resizeWalkCache(size_t walkCacheEntries);
+    size_t getWalkCacheCapacity() const;
+    
+    std::shared_ptr<PhysicalMemory> getPhysicalMemory() const;
+    WalkStatistics getStatistics() const;
+    void resetStatistics();
+
+private:
+    // Table geometry of one context, as in RadixPageTable
+    struct Geometry {
+        unsigned pageShift;
+        unsigned bitsPerLevel;
+        unsigned inputBits;
+        PA outputLimit;
+        int startLevel;
+        
+        unsigned levelShift(int level) const;
+        size_t indexAt(uint64_t inputAddress, int level) const;
+    };
+    
+    // Hierarchical restrictions gathered from table descriptors
+    static const uint8_t TABLE_NO_WRITE = 1;
+    static const uint8_t TABLE_NO_EXECUTE = 2;
+    
+    // Context a walk cache entry belongs to
+    struct WalkContext {
+        PA root;
+        const AddressSpace* stage2;
+        ASID asid;
+    };
+    
+    struct WalkCacheEntry {
+        PA root;
+        const AddressSpace* stage2;
+        uint64_t prefix;       // Input address >> levelShift(level - 1)
+        PA table;              // Table for `level`, as an IPA in nested walks
+        ASID asid;
+        int8_t level;
+        uint8_t pageShift;
+        uint8_t restrictions;  // TABLE_NO_WRITE / TABLE_NO_EXECUTE from the levels above
+        bool valid;
+    };
+    
+    // Entry i is guarded by walkCacheLocks[i % WALK_CACHE_STRIPES], so walks
+    // of different streams rarely contend. Resizing holds every stripe.
+    static const size_t WALK_CACHE_STRIPES = 64;
+    
+    std::shared_ptr<PhysicalMemory> memory;
+    std::vector<WalkCacheEntry> walkCache;
+    std::atomic<size_t> walkCacheMask;
+    mutable std::mutex walkCacheLocks[WALK_CACHE_STRIPES];
+    
+    std::atomic<uint64_t> walkCount;
+    std::atomic<uint64_t> faultCount;
+    std::atomic<uint64_t> totalDepth;
+    std::atomic<uint64_t> descriptorReadCount;
+    std::atomic<uint64_t> walkCacheHitCount;
+    std::atomic<uint64_t> walkCacheMissCount;
+    
+    static Geometry geometryFor(const TranslationControlRegister& tcr);
+    static PA outputAddress(uint64_t descriptor, const Geometry& geometry);
+    TranslationResult walkFrom(const ContextDescriptor& context, IOVA iova, AccessType accessType,
+                               SecurityState securityState, const AddressSpace* stage2, WalkTrace& trace);
+    static size_t walkCacheIndex(const WalkContext& context, int level, uint64_t prefix, size_t mask);
+    bool lookupWalkCache(const WalkContext& context, const Geometry& geometry, uint64_t inputAddress, PA& table,
+                         int& level, uint8_t& restrictions);
+    void fillWalkCache(const WalkContext& context, const Geometry& geometry, uint64_t inputAddress, PA table,
+                       int level, uint8_t restrictions);
+};
+
+} // namespace smmu
+
+#endif // SMMU_PAGE_TABLE_WALKER_H
@@ -0,0 +1,72 @@
+// ARM SMMU v3 PASID Table
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_PASID_TABLE_H
+#define SMMU_PASID_TABLE_H
+
+#include "smmu/types.h"
+#include "smmu/address_space.h"
+#include "smmu/epoch_reclaimer.h"
+#include <memory>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// PASID -> Stage-1 context of one stream, laid out like a 2-level CD table:
+// L1 descriptors indexed by PASID >> SPLIT point at L2 tables of 2^SPLIT
+// entries. The L1 table grows to cover the highest PASID in use and L2
+// tables are allocated when their first PASID is added.
+//
+// find() takes no lock. A reader must hold an EpochGuard for as long as it
+// uses the entry it got back: replaced and removed entries, and L1 tables
+// outgrown, are retired and only freed once every such reader has left.
+// Everything else is for writers, which the caller serializes. Each change
+// touches one entry, so it costs the same however many PASIDs the stream has.
+class PASIDTable {
+public:
+    static const unsigned SPLIT = 6;   // 64 CDs per L2 table (4KB of CDs, S1FMT=1)
+    
+    // One CD. Published entries are never modified.
+    struct Entry {
+        std::shared_ptr<AddressSpace> addressSpace;   // Null when bound to tables in memory
+        ContextDescriptor contextDescriptor;          // Valid when addressSpace is null
+    };
+    
+    PASIDTable();
+    ~PASIDTable();  // No reader may remain
+    
+    const Entry* find(PASID pasid) const;
+    
+    // Publish a PASID's context, retiring the one it replaces
+    void publish(PASID pasid, std::shared_ptr<AddressSpace> addressSpace);
+    void publish(PASID pasid, const ContextDescriptor& contextDescriptor);
+    void remove(PASID pasid);
+    void clear();
+
+private:
+    typedef std::atomic<const Entry*> Slot;
+    
+    struct Level1 {
+        size_t count;
+        std::unique_ptr<std::atomic<Slot*>[]> tables;
+        
+        explicit Level1(size_t count);
+    };
+    
+    std::atomic<Level1*> level1;   // Null until the first PASID is added
+    EpochReclaimer reclaimer;
+    
+    Slot* slotForWrite(PASID pasid);
+    void store(PASID pasid, const Entry* entry);
+    static void releaseEntry(void* object);
+    static void releaseLevel1(void* object);
+    
+    PASIDTable(const PASIDTable&);
+    PASIDTable& operator=(const PASIDTable&);
+};
+
+} // namespace smmu
+
+#endif // SMMU_PASID_TABLE_H
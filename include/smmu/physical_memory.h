@@ -0,0 +1,53 @@
+// ARM SMMU v3 Simulated Physical Memory
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_PHYSICAL_MEMORY_H
+#define SMMU_PHYSICAL_MEMORY_H
+
+#include "smmu/types.h"
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// Sparse byte store standing in for system memory, so translation tables
+// can live at physical addresses and be walked as the hardware would.
+//
+// Memory is allocated in 4KB frames on first write; bytes never written
+// read as zero. 64-bit accesses are little-endian and must be naturally
+// aligned, like a descriptor fetch. Every access is atomic with respect to
+// the others, so tables may be edited while translations walk them.
+class PhysicalMemory {
+public:
+    PhysicalMemory();
+    
+    Result<uint64_t> read64(PA address) const;
+    VoidResult write64(PA address, uint64_t value);
+    
+    // Byte ranges may span frames; the whole range must lie below
+    // MAX_PHYSICAL_ADDRESS
+    VoidResult read(PA address, void* buffer, size_t length) const;
+    VoidResult write(PA address, const void* data, size_t length);
+    
+    size_t getFrameCount() const;
+    size_t getResidentBytes() const;  // Frames allocated so far
+    void clear();
+
+private:
+    static const unsigned FRAME_SHIFT = 12;
+    static const size_t FRAME_SIZE = static_cast<size_t>(1) << FRAME_SHIFT;
+    
+    std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> frames;  // Keyed by address >> FRAME_SHIFT
+    mutable std::mutex memoryMutex;
+    
+    static bool isValidRange(PA address, size_t length);
+    const uint8_t* findFrame(uint64_t frameNumber) const;
+    uint8_t* frameForWrite(uint64_t frameNumber);
+};
+
+} // namespace smmu
+
+#endif // SMMU_PHYSICAL_MEMORY_H
@@ -0,0 +1,116 @@
+// ARM SMMU v3 Radix Page Table Storage
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_RADIX_PAGE_TABLE_H
+#define SMMU_RADIX_PAGE_TABLE_H
+
+#include "smmu/types.h"
+#include "smmu/epoch_reclaimer.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// VMSAv8-64 style multi-level table behind PageTableBackend::Radix.
+//
+// Level 3 resolves the granule page and every level above it resolves
+// (granule shift - 3) more IOVA bits: 512, 2048 or 8192-entry nodes for the
+// 4KB, 16KB and 64KB granules. The root is the level that reaches bit 51:
+// a 16-entry level -1 (as with FEAT_LPA2) for 4KB, a 32-entry level 0 for
+// 16KB and a 1024-entry level 1 for 64KB. Level 1 and level 2 entries can
+// hold block descriptors (1GB/2MB, 64GB/32MB, 4TB/512MB). Nodes are
+// allocated on first use and freed when their last entry goes, so every
+// live node leads to at least one mapping.
+//
+// As in a hardware table each slot is one 64-bit word: a PageDescriptor
+// (valid bit set), a next-level table pointer, or zero. Every change is a
+// single atomic store of a fully built word, so find() runs without locks
+// alongside one writer; removed tables are freed through an EpochReclaimer
+// once no find() can still be walking them. All other members, the
+// const queries included, must be serialized with the writer.
+//
+// Copies share structure: copying a table takes a reference on the root
+// instead of duplicating nodes, and a writer copies a shared node (sharing
+// that node's children in turn) the first time a change passes through it,
+// so copies diverge one walk path at a time. Copying must be serialized
+// with the source table's writer.
+class RadixPageTable {
+public:
+    explicit RadixPageTable(TranslationGranule granule = TranslationGranule::Size4KB);
+    ~RadixPageTable();
+    RadixPageTable(const RadixPageTable& other);
+    RadixPageTable& operator=(const RadixPageTable& other);
+    
+    // Install a granule page or level 1/2 block descriptor; iova must be
+    // aligned to size. Replaces the mappings it covers and splits a larger
+    // block that covers it.
+    void map(IOVA iova, uint64_t size, const PageDescriptor& descriptor);
+    
+    // Descriptor covering iova, invalid if none; mappingSize receives its
+    // size. Safe to call concurrently with the writer.
+    PageDescriptor find(IOVA iova, uint64_t& mappingSize) const;
+    
+    // Remove every mapping in [firstIova, lastIova], splitting blocks that
+    // straddle either end. Returns the number of granule pages removed.
+    uint64_t unmap(IOVA firstIova, IOVA lastIova);
+    
+    // Range queries - visit only nodes that overlap the range
+    bool hasMappings(IOVA firstIova, IOVA lastIova) const;
+    std::vector<AddressRange> getMappedRanges() const;  // Sorted, adjacent mappings merged
+    bool getBounds(IOVA& lowest, IOVA& highest) const;  // false when empty
+    
+    uint64_t getPageCount() const;  // Blocks count as the granule pages they cover
+    size_t getNodeCount() const;        // Nodes reachable from this table, shared ones included
+    size_t getMemoryFootprint() const;  // Bytes held by those nodes
+    void clear();
+
+private:
+    static const int LEAF_LEVEL = 3;
+    
+    struct Node {
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;  // Descriptor, table pointer or zero
+        size_t slotCount;
+        size_t live;                                      // Non-zero slots
+        uint64_t pages;                                   // Granule pages mapped below this node
+        std::atomic<size_t> refs;                         // Parent slots and roots linking it, across copies
+        
+        explicit Node(size_t entryCount);
+    };
+    
+    std::atomic<Node*> root;
+    size_t nodeCount;
+    EpochReclaimer reclaimer;
+    unsigned pageShift;      // 12, 14 or 16
+    unsigned bitsPerLevel;   // pageShift - 3
+    int rootLevel;           // -1, 0 or 1
+    
+    unsigned levelShift(int level) const;
+    size_t entryCount(int level) const;
+    size_t indexAt(IOVA iova, int level) const;
+    int levelForSize(uint64_t size) const;
+    uint64_t pagesPerEntry(int level) const;
+    static bool isDescriptor(uint64_t slot);
+    static Node* tableOf(uint64_t slot);
+    static uint64_t tableSlot(const Node* table);
+    static uint64_t slotAt(const Node& node, size_t index);
+    static bool isShared(const Node& node);
+    static void releaseTable(void* table);
+    
+    Node* newNode(int level);
+    Node* copyNode(const Node& node, int level);
+    Node* writableRoot();
+    Node* writableTable(Node& node, int level, size_t index);
+    void retireTable(Node* table);
+    void splitBlock(Node& node, int level, size_t index);
+    int64_t mapAt(Node& node, int level, IOVA iova, int targetLevel, const PageDescriptor& descriptor);
+    uint64_t unmapAt(Node& node, int level, IOVA nodeBase, IOVA firstIova, IOVA lastIova);
+    bool hasMappingsAt(const Node& node, int level, IOVA nodeBase, IOVA firstIova, IOVA lastIova) const;
+    void collectRanges(const Node& node, int level, IOVA nodeBase, std::vector<AddressRange>& ranges) const;
+};
+
+} // namespace smmu
+
+#endif // SMMU_RADIX_PAGE_TABLE_H
@@ -0,0 +1,110 @@
+// ARM SMMU v3 Set-Associative TLB Storage
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_SET_ASSOCIATIVE_TLB_H
+#define SMMU_SET_ASSOCIATIVE_TLB_H
+
+#include "smmu/types.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// Flat N-way set-associative storage behind TLBBackend::SetAssociative.
+//
+// Tags and entries live in two contiguous, cache-line-aligned arrays that are
+// allocated once. A lookup selects one set from the key hash and compares at
+// most N compact tags; replacement within a set uses CLOCK (second chance).
+// Not thread-safe: TLBCache calls it with the owning shard lock held.
+class SetAssociativeTLB {
+public:
+    static const size_t DEFAULT_WAYS = 8;
+    
+    explicit SetAssociativeTLB(size_t capacity, size_t ways = DEFAULT_WAYS);
+    ~SetAssociativeTLB();
+    
+    // Mix (StreamID, PASID, page) into a 64-bit hash; low bits select the set
+    static uint64_t hashKey(StreamID streamID, PASID pasid, IOVA iova);
+    
+    // Lookup and update - hash must come from hashKey() for the same key
+    TLBEntry* find(uint64_t hash, StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState);
+    void insert(uint64_t hash, const TLBEntry& entry);
+    bool erase(uint64_t hash, StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState);
+    
+    // Bulk invalidation by tag scan
+    size_t eraseRange(StreamID streamID, PASID pasid, IOVA firstPage, IOVA lastIova);
+    
+    // Erase every valid entry for which predicate(const TLBEntry&) is true
+    template<typename Predicate> size_t eraseIf(Predicate predicate);
+    
+    // Erase one page in every security state - one set probe
+    size_t erasePage(uint64_t hash, StreamID streamID, PASID pasid, IOVA iova);
+    size_t eraseSecurityState(SecurityState securityState);
+    void clear();
+    
+    // Rebuild for a new capacity, re-inserting live entries
+    void resize(size_t capacity);
+    
+    size_t size() const;
+    size_t capacity() const;
+    size_t getWays() const;
+    size_t getSetCount() const;
+
+private:
+    // Compact 16-byte tag so four ways share one cache line
+    struct WayTag {
+        IOVA iova;
+        StreamID streamID;
+        uint32_t pasidAndFlags;  // PASID[20:0], SecurityState[22:21], valid[30], referenced[31]
+    };
+    
+    // One bit wider than MAX_PASID so TLBCache::VMID_KEY_PASID fits
+    static const uint32_t PASID_FIELD_MASK = 0x001FFFFFu;
+    static const uint32_t SECURITY_SHIFT = 21;
+    static const uint32_t VALID_FLAG = 1u << 30;
+    static const uint32_t REFERENCED_FLAG = 1u << 31;
+    static const uint32_t MATCH_MASK = ~REFERENCED_FLAG;
+    static const size_t CACHE_LINE_SIZE = 64;
+    
+    std::vector<unsigned char> storage;  // Backing memory for tags and entries
+    WayTag* tags;                        // setCount * ways, one contiguous run per set
+    TLBEntry* entries;                   // Parallel to tags
+    std::vector<uint8_t> clockHands;     // Next CLOCK victim candidate per set
+    size_t configuredWays;
+    size_t ways;
+    size_t setMask;
+    size_t validCount;
+    
+    void allocate(size_t capacity);
+    size_t setIndex(uint64_t hash) const;
+    static uint32_t makeTagBits(PASID pasid, SecurityState securityState);
+    size_t findWay(size_t base, StreamID streamID, IOVA iova, uint32_t tagBits) const;
+    size_t chooseVictim(size_t set);
+    template<typename Predicate> size_t eraseMatching(Predicate predicate);
+};
+
+template<typename Predicate>
+size_t SetAssociativeTLB::eraseIf(Predicate predicate) {
+    return eraseMatching([&predicate](const WayTag&, const TLBEntry& entry) {
+        return predicate(entry);
+    });
+}
+
+template<typename Predicate>
+size_t SetAssociativeTLB::eraseMatching(Predicate predicate) {
+    size_t erased = 0;
+    size_t slots = (setMask + 1) * ways;
+    for (size_t i = 0; i < slots; ++i) {
+        if ((tags[i].pasidAndFlags & VALID_FLAG) && predicate(tags[i], entries[i])) {
+            tags[i].pasidAndFlags = 0;
+            ++erased;
+        }
+    }
+    validCount -= erased;
+    return erased;
+}
+
+} // namespace smmu
+
+#endif // SMMU_SET_ASSOCIATIVE_TLB_H
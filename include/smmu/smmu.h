@@ -6,9 +6,15 @@
 
 #include "smmu/types.h"
 #include "smmu/stream_context.h"
+#include "smmu/stream_table.h"
+#include "smmu/translation_engine.h"
 #include "smmu/fault_handler.h"
 #include "smmu/tlb_cache.h"
 #include "smmu/configuration.h"
+#include "smmu/micro_tlb.h"
+#include "smmu/physical_memory.h"
+#include "smmu/page_table_walker.h"
+#include "smmu/memory_pool.h"
 #include <unordered_map>
 #include <vector>
 #include <memory>
@@ -32,6 +38,25 @@ public:
     // Main translation API
     TranslationResult translate(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType, SecurityState securityState = SecurityState::NonSecure);
     
+    // Translate count requests into results[i] for requests[i], as translate()
+    // would; pages repeated within the batch are translated once
+    void translateBatch(const TranslationRequest* requests, TranslationResult* results, size_t count);
+    
+    // Translate [iova, iova + length) into physically contiguous segments,
+    // stopping at the first fault; error only if the range wraps
+    Result<RangeTranslation> translateRange(StreamID streamID, PASID pasid, IOVA iova, size_t length,
+                                            AccessType accessType, SecurityState securityState = SecurityState::NonSecure);
+    
+    // Asynchronous translation. Micro-TLB and TLB hits complete at once on the
+    // calling thread; misses are walked by a worker pool of
+    // ResourceLimits::maxThreadCount threads, started on first use, whose
+    // callbacks fail with SMMUError::Timeout once a request has waited
+    // timeoutMs. Callbacks must not update the configuration or resource
+    // limits.
+    VoidResult translateAsync(const TranslationRequest& request, TranslationCallback callback);
+    void waitForAsyncTranslations();  // Until every submitted callback has run
+    size_t getAsyncWorkerCount() const;  // 0 until the pool starts
+    
     // Stream management
     VoidResult configureStream(StreamID streamID, const StreamConfig& config);
     VoidResult removeStream(StreamID streamID);
@@ -44,9 +69,30 @@ public:
     VoidResult createStreamPASID(StreamID streamID, PASID pasid);
     VoidResult removeStreamPASID(StreamID streamID, PASID pasid);
     
+    // Translation context tags - VMID for Stage-2, ASID for a PASID's Stage-1.
+    // All streams attached to one VMID must use the same Stage-2 tables; the
+    // enabled Stage-2-only streams among them share one set of TLB entries.
+    VoidResult setStreamStage2(StreamID streamID, VMID vmid, std::shared_ptr<AddressSpace> stage2AddressSpace);
+    VoidResult setStreamASID(StreamID streamID, PASID pasid, ASID asid);
+    
+    // Stage-1 granule for PASIDs created on the stream from now on. A 16KB or
+    // 64KB granule maps, caches and invalidates one entry per 16KB/64KB page.
+    VoidResult setStreamGranule(StreamID streamID, TranslationGranule granule);
+    
+    // Translation tables in simulated physical memory. Once memory is
+    // attached, a PASID given a context descriptor is translated by walking
+    // the tables its TTBRs point at instead of through an AddressSpace.
+    // Software edits tables directly, so follow edits with a TLB invalidation.
+    void setPhysicalMemory(std::shared_ptr<PhysicalMemory> memory);
+    std::shared_ptr<PhysicalMemory> getPhysicalMemory() const;
+    VoidResult setStreamContextDescriptor(StreamID streamID, PASID pasid, const ContextDescriptor& contextDescriptor);
+    
     // Page mapping operations
     VoidResult mapPage(StreamID streamID, PASID pasid, IOVA iova, PA pa, const PagePermissions& permissions, SecurityState securityState = SecurityState::NonSecure);
+    VoidResult mapBlock(StreamID streamID, PASID pasid, IOVA iova, PA pa, uint64_t blockSize, const PagePermissions& permissions, SecurityState securityState = SecurityState::NonSecure);  // e.g. 2MB or 1GB with 4KB pages
     VoidResult unmapPage(StreamID streamID, PASID pasid, IOVA iova);
+    VoidResult unmapRange(StreamID streamID, PASID pasid, IOVA startIova, IOVA endIova);  // endIova inclusive
+    VoidResult unmapPages(StreamID streamID, PASID pasid, const std::vector<IOVA>& iovas);
     
     // Event management
     Result<std::vector<FaultRecord>> getEvents();  // Returns Result - error on event queue corruption or system failure
@@ -63,11 +109,26 @@ public:
     VoidResult updateCacheConfiguration(const CacheConfiguration& cacheConfig);
     VoidResult updateAddressConfiguration(const AddressConfiguration& addressConfig);
     VoidResult updateResourceLimits(const ResourceLimits& resourceLimits);
+    const MemoryBudget& getMemoryBudget() const;  // Usage against ResourceLimits::maxMemoryUsage
     
     // Cache management operations (Task 5.2)
     void invalidateTranslationCache();
     void invalidateStreamCache(StreamID streamID);
     void invalidatePASIDCache(StreamID streamID, PASID pasid);
+    void invalidateVMIDCache(VMID vmid);
+    void invalidateASIDCache(VMID vmid, ASID asid);  // Streams without a VMID match any vmid
+    // Stage-2-only entries of a VMID overlapping [startIpa, endIpa]: the IPA->PA
+    // cache and the VM's shared TLB entries. Combined Stage-1+2 entries stay;
+    // as on hardware, follow up with a VMID or ASID invalidation for those.
+    void invalidateStage2Cache(VMID vmid, IPA startIpa, IPA endIpa);
+    
+    // TLB aging maintenance. Entries expire once the coarse age tick has moved
+    // more than cacheMaxAge past their insertion; a TLB hit only compares ticks.
+    // performCacheMaintenance() advances the tick by the clock time elapsed and
+    // also runs on every TLB fill; advanceCacheAgeTick() steps it explicitly.
+    void performCacheMaintenance();
+    void advanceCacheAgeTick(uint64_t ticks = 1);
+    uint64_t getCacheAgeTick() const;
     
     // Task 5.3: Event and Command Processing
     // Event queue management (Task 5.3.1)
@@ -103,13 +164,24 @@ public:
     uint64_t getTranslationCount() const;
     uint64_t getCacheHitCount() const;
     uint64_t getCacheMissCount() const;
+    uint64_t getMicroTLBHitCount() const;
+    uint64_t getStage2CacheHitCount() const;
+    uint64_t getStage2CacheMissCount() const;
+    uint64_t getWalkCacheHitCount() const;
+    uint64_t getWalkCacheMissCount() const;
     CacheStatistics getCacheStatistics() const;
+    WalkStatistics getWalkStatistics() const;  // Zero until physical memory is attached
     void resetStatistics();
     void reset();
     
 private:
-    // StreamID to StreamContext mapping
-    std::unordered_map<StreamID, std::unique_ptr<StreamContext>> streamMap;
+    // Memory held by this instance's caches, queues and hash address spaces;
+    // declared first so it outlives all of them
+    std::shared_ptr<MemoryBudget> memoryBudget;
+    
+    // StreamID to StreamContext mapping, sized from maxStreamCount. Lookups
+    // take no lock; inserts and removals hold sMMUMutex.
+    StreamTable streamTable;
     
     // Event handling
     std::shared_ptr<FaultHandler> faultHandler;
@@ -117,30 +189,80 @@ private:
     // TLB Cache system (Task 5.2)
     std::unique_ptr<TLBCache> tlbCache;
     
+    // IPA -> PA cache for nested translation, keyed like the shared TLB
+    // entries: (VMID, VMID_KEY_PASID) for tagged Stage-2 contexts, else
+    // (StreamID, 0). Entry iova fields hold the IPA.
+    std::unique_ptr<TLBCache> stage2Cache;
+    
+    // Walker shared by every stream, null without physical memory. Accessed
+    // through std::atomic_load/atomic_store so invalidation needs no lock.
+    std::shared_ptr<PageTableWalker> tableWalker;
+    
     // SMMU Configuration
     SMMUConfiguration configuration;
     
-    // Global configuration
-    FaultMode globalFaultMode;
-    bool cachingEnabled;
+    // Global configuration; read by translations outside sMMUMutex
+    std::atomic<FaultMode> globalFaultMode;
+    std::atomic<bool> cachingEnabled;
     
     // Statistics - Thread-safe atomic counters
     mutable std::atomic<uint64_t> translationCount;
     mutable std::atomic<uint64_t> cacheHits;
     mutable std::atomic<uint64_t> cacheMisses;
     
-    // Task 5.3: Event and Command Processing private members
-    std::deque<EventEntry> eventQueue;
-    std::deque<CommandEntry> commandQueue;  
-    std::deque<PRIEntry> priQueue;
+    // Per-thread micro-TLB (L0) state. Invalidation bumps an epoch instead of
+    // touching other threads' L0 entries; hits are counted per thread.
+    static const uint32_t STREAM_EPOCH_SLOT_BITS = 10;
+    static const size_t STREAM_EPOCH_SLOTS = 1u << STREAM_EPOCH_SLOT_BITS;
+    uint64_t instanceID;
+    std::atomic<size_t> microTLBEntries;  // 0 disables the L0
+    std::atomic<uint64_t> globalInvalidationEpoch;
+    std::unique_ptr<std::atomic<uint64_t>[]> streamInvalidationEpochs;  // Hashed by StreamID
+    mutable std::mutex microTLBCounterMutex;
+    std::vector<std::shared_ptr<MicroTLBHitCounter>> microTLBCounters;
+    uint64_t microTLBRetiredHits;   // Hits from counters no thread holds any more
+    uint64_t microTLBHitBaseline;   // Hit total at the last resetStatistics()
+    
+    // TLB aging state - one tick per CACHE_AGE_TICK_MS of steady_clock time
+    static const uint32_t CACHE_AGE_TICK_MS = 100;
+    std::atomic<uint64_t> cacheAgeTick;
+    std::atomic<uint64_t> cacheAgeTickTime;   // steady_clock microseconds at the start of the current tick
+    std::atomic<uint64_t> cacheMaxAgeTicks;
+    std::atomic<bool> cacheAgingEnabled;
+    
+    // Enabled Stage-2-only streams whose TLB entries live under their VMID's
+    // key; written with the stream's lock held. TLB lookups never take
+    // sharedStage2Mutex: they read the flag each StreamContext carries, and
+    // only while the count says some stream shares.
+    mutable std::mutex sharedStage2Mutex;
+    std::unordered_map<StreamID, VMID> sharedStage2Streams;
+    std::atomic<size_t> sharedStage2StreamCount;
+    
+    // Task 5.3: Event and Command Processing private members; deque blocks
+    // come from the slab pools, charged to memoryBudget
+    std::deque<EventEntry, PoolAllocator<EventEntry>> eventQueue;
+    std::deque<CommandEntry, PoolAllocator<CommandEntry>> commandQueue;
+    std::deque<PRIEntry, PoolAllocator<PRIEntry>> priQueue;
     
     size_t maxEventQueueSize;
     size_t maxCommandQueueSize;
     size_t maxPRIQueueSize;
     
-    // Thread safety protection for SMMU controller
+    // Asynchronous translation pool; created with sMMUMutex held by the first
+    // translateAsync() and kept until destruction
+    std::atomic<TranslationEngine*> asyncEngine;
+    std::mutex asyncConfigMutex;  // Orders pool resizes
+    
+    // Serializes configuration and stream table updates; translations and
+    // stream queries do not take it
     mutable std::mutex sMMUMutex;
     
+    // Control-plane operations on one stream (mapping, PASIDs, enable) lock
+    // only that stream, hashed into a fixed set of locks. Adding, removing or
+    // re-attaching a stream takes sMMUMutex first, then the stream's lock.
+    static const uint32_t STREAM_LOCK_BITS = 6;
+    mutable std::mutex streamLocks[1u << STREAM_LOCK_BITS];
+    
     // Helper methods
     void recordFault(const FaultRecord& fault);
     void recordSecurityFault(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType, SecurityState expectedState, SecurityState actualState);
@@ -168,22 +290,60 @@ private:
     void recordCacheHit() const;
     void recordCacheMiss() const;
     
+    // Micro-TLB helpers
+    void initializeMicroTLB();
+    MicroTLB* acquireMicroTLB();
+    std::atomic<uint64_t>& streamInvalidationEpoch(StreamID streamID) const;
+    std::mutex& streamLock(StreamID streamID) const;
+    void bumpGlobalInvalidationEpoch();
+    void bumpStreamInvalidationEpoch(StreamID streamID);
+    uint64_t sumMicroTLBHits() const;
+    
+    // TLB aging helpers
+    void configureCacheAging(const CacheConfiguration& cacheConfig);
+    void configureWalkCache(const CacheConfiguration& cacheConfig);
+    void invalidateWalkCache();
+    uint64_t cacheFreshnessFloor() const;
+    void updateSharedStage2(StreamID streamID, StreamContext* streamContext);
+    void prefetchStreamConfig(StreamID streamID);
+    bool findSharedStage2VMID(StreamID streamID, VMID& vmid) const;
+    void resolveCacheKey(StreamID streamID, PASID pasid, StreamID& keyStreamID, PASID& keyPASID) const;
+    void cacheStage2Translation(StreamID keyStreamID, PASID keyPASID, IPA ipa, const TranslationData& data,
+                                const TLBCache::Generation& generation);
+    
     // Enhanced translation helpers (Task 5.2)
+    bool lookupMicroTLB(MicroTLB* microTLB, StreamID streamID, PASID pasid, IOVA iova, AccessType accessType,
+                        SecurityState securityState, uint64_t globalEpoch, uint64_t streamEpoch,
+                        TranslationResult& result) const;
+    TranslationResult translateMiss(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType,
+                                    SecurityState securityState, MicroTLB* microTLB,
+                                    uint64_t globalEpoch, uint64_t streamEpoch);
+    bool lookupTLB(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType,
+                   SecurityState securityState, MicroTLB* microTLB,
+                   uint64_t globalEpoch, uint64_t streamEpoch, TranslationResult& result);
+    TranslationResult translateWalk(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType,
+                                    SecurityState securityState, MicroTLB* microTLB,
+                                    uint64_t globalEpoch, uint64_t streamEpoch);
+    TranslationEngine* acquireAsyncEngine();
+    void configureAsyncEngine();
     TranslationResult performTwoStageTranslation(StreamID streamID, PASID pasid, IOVA iova, 
                                                AccessType accessType, SecurityState securityState, StreamContext* streamContext);
     bool isTranslationCacheable(const TranslationResult& result) const;
     void cacheTranslationResult(StreamID streamID, PASID pasid, IOVA iova, 
-                               const TranslationResult& result);
+                               const TranslationResult& result, const TLBCache::Generation& generation);
     TranslationResult lookupTranslationCache(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState);
     void generateCacheKey(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState, uint64_t& cacheKey) const;
     
-    // Stage-specific translation methods (Task 5.2)
+    // Stage-specific translation methods (Task 5.2) - dispatched on the stream's cached descriptor
     TranslationResult performBothStagesTranslation(StreamID streamID, PASID pasid, IOVA iova,
-                                                  AccessType accessType, SecurityState securityState, StreamContext* streamContext);
+                                                  AccessType accessType, SecurityState securityState,
+                                                  const TranslationDescriptor& descriptor);
     TranslationResult performStage1OnlyTranslation(StreamID streamID, PASID pasid, IOVA iova,
-                                                  AccessType accessType, SecurityState securityState, StreamContext* streamContext);
+                                                  AccessType accessType, SecurityState securityState, StreamContext* streamContext,
+                                                  const TranslationDescriptor& descriptor);
     TranslationResult performStage2OnlyTranslation(StreamID streamID, PASID pasid, IOVA iova,
-                                                  AccessType accessType, SecurityState securityState, StreamContext* streamContext);
+                                                  AccessType accessType, SecurityState securityState, StreamContext* streamContext,
+                                                  const TranslationDescriptor& descriptor);
     bool validateAccessPermissions(const PagePermissions& permissions, AccessType accessType) const;
     
     // Enhanced error handling and fault recovery methods (Task 5.2)
@@ -7,29 +7,92 @@
 #include "smmu/types.h"
 #include "smmu/address_space.h"
 #include "smmu/fault_handler.h"
+#include "smmu/page_table_walker.h"
+#include "smmu/pasid_table.h"
 #include <unordered_map>
 #include <memory>
+#include <vector>
 #include <cstddef>
 #include <mutex>
+#include <atomic>
 
 namespace smmu {
 
+// Pre-decoded STE state for the translate path. A published descriptor is
+// never modified: StreamContext swaps in a new one when its configuration
+// changes, and readers load it atomically without taking contextMutex.
+// Per-PASID state stays in the stream's PASID table, which the descriptor
+// points at and which is updated in place one CD at a time.
+struct TranslationDescriptor {
+    // Stage handler the SMMU dispatches to, decoded from config
+    enum class Mode {
+        Bypass,         // translationEnabled == false
+        Stage1Only,
+        Stage2Only,
+        BothStages,
+        NoStages        // Translation enabled with no stage - configuration error
+    };
+    
+    Mode mode;
+    StreamConfig config;    // As last applied by updateConfiguration()
+    bool stage1Enabled;     // Live stage flags (setStage1Enabled/setStage2Enabled)
+    bool stage2Enabled;
+    bool streamEnabled;
+    bool vmidValid;
+    VMID vmid;
+    std::shared_ptr<AddressSpace> stage2AddressSpace;
+    std::shared_ptr<const PASIDTable> pasidTable;  // Current CDs, not a snapshot
+    std::shared_ptr<PageTableWalker> tableWalker;
+    
+    std::shared_ptr<AddressSpace> findStage1AddressSpace(PASID pasid) const;
+    
+    // IOVA -> IPA through the PASID's context descriptor or AddressSpace
+    TranslationResult translateStage1(PASID pasid, IOVA iova, AccessType accessType,
+                                      SecurityState securityState) const;
+};
+
 class StreamContext {
 public:
-    StreamContext();
+    // PASID address spaces created here are charged to budget
+    explicit StreamContext(std::shared_ptr<MemoryBudget> budget = MemoryBudget::defaultBudget());
     ~StreamContext();
     
     // PASID management
     VoidResult createPASID(PASID pasid);
     VoidResult removePASID(PASID pasid);
     void addPASID(PASID pasid, std::shared_ptr<AddressSpace> addressSpace);
+    VoidResult clonePASID(PASID sourcePasid, PASID targetPasid);  // Fork: O(1) copy-on-write duplicate
+    
+    // Bind a PASID to translation tables in physical memory, replacing any
+    // AddressSpace it had; translations then walk the tables through the
+    // walker given to setTableWalker
+    VoidResult setContextDescriptor(PASID pasid, const ContextDescriptor& contextDescriptor);
+    void setTableWalker(std::shared_ptr<PageTableWalker> walker);
     
     // Page mapping operations
     VoidResult mapPage(PASID pasid, IOVA iova, PA pa, const PagePermissions& permissions, SecurityState securityState = SecurityState::NonSecure);
+    VoidResult mapBlock(PASID pasid, IOVA iova, PA pa, uint64_t blockSize, const PagePermissions& permissions, SecurityState securityState = SecurityState::NonSecure);
     VoidResult unmapPage(PASID pasid, IOVA iova);
+    VoidResult unmapRange(PASID pasid, IOVA startIova, IOVA endIova);
+    VoidResult unmapPages(PASID pasid, const std::vector<IOVA>& iovas);
     
     // Translation operations
     TranslationResult translate(PASID pasid, IOVA iova, AccessType accessType, SecurityState securityState = SecurityState::NonSecure);
+    TranslationResult translate(const TranslationDescriptor& descriptor, PASID pasid, IOVA iova, AccessType accessType,
+                                SecurityState securityState);
+    
+    // Translation descriptor cache. Configuration updates and stream
+    // enable/disable publish a new descriptor; stage changes drop it and the
+    // next reader (or prefetchTranslationDescriptor) rebuilds it. PASID
+    // changes go straight to the PASID table and keep the descriptor.
+    std::shared_ptr<const TranslationDescriptor> getTranslationDescriptor() const;
+    void prefetchTranslationDescriptor() const;
+    bool isTranslationDescriptorCached() const;
+    
+    // VMID whose shared TLB entries this stream uses, set by the SMMU while
+    // the stream qualifies; read without a lock on every TLB probe
+    void setSharedStage2VMID(bool shared, VMID vmid);
+    bool getSharedStage2VMID(VMID& vmid) const;
     
     // Configuration
     void setStage1Enabled(bool enabled);
@@ -37,6 +100,16 @@ public:
     void setStage2AddressSpace(std::shared_ptr<AddressSpace> addressSpace);
     void setFaultMode(FaultMode mode);
     
+    // Stage-1 translation granule (STE S1 granule / CD.TG0) given to the
+    // address spaces createPASID makes; existing PASIDs keep theirs
+    void setStage1Granule(TranslationGranule granule);
+    TranslationGranule getStage1Granule() const;
+    
+    // Translation context tags. The VMID names the Stage-2 context and each
+    // PASID's ASID names its Stage-1 context; TLB invalidation can target either.
+    void setVMID(VMID vmid);
+    VoidResult setASID(PASID pasid, ASID asid);
+    
     // Query operations
     bool hasPASID(PASID pasid) const;
     bool isStage1Enabled() const;
@@ -44,6 +117,10 @@ public:
     size_t getPASIDCount() const;
     AddressSpace* getPASIDAddressSpace(PASID pasid);
     AddressSpace* getStage2AddressSpace();
+    uint64_t getGranuleSize(PASID pasid) const;  // Smallest page of the enabled stages; 4KB if none
+    bool hasVMID() const;
+    VMID getVMID() const;
+    std::vector<PASID> getPASIDsWithASID(ASID asid) const;
     
     // Management operations
     VoidResult clearAllPASIDs();  // Returns VoidResult - error on PASID map corruption or thread safety issues
@@ -204,6 +281,10 @@ public:
 private:
     // PASID to AddressSpace mapping for Stage-1
     std::unordered_map<PASID, std::shared_ptr<AddressSpace>> pasidMap;
+    std::unordered_map<PASID, ASID> asidMap;  // Only PASIDs given an ASID
+    std::unordered_map<PASID, ContextDescriptor> contextDescriptors;  // Disjoint from pasidMap
+    std::shared_ptr<PASIDTable> pasidTable;  // Both of the above, for lock-free readers
+    std::shared_ptr<PageTableWalker> tableWalker;
     
     // Stage-2 AddressSpace (potentially shared across streams)
     std::shared_ptr<AddressSpace> stage2AddressSpace;
@@ -212,6 +293,10 @@ private:
     bool stage1Enabled;
     bool stage2Enabled;
     FaultMode faultMode;
+    bool vmidValid;
+    VMID vmid;
+    TranslationGranule stage1Granule;
+    std::shared_ptr<MemoryBudget> budget;
     
     // Task 4.2: Stream Operations Support Members
     StreamConfig currentConfiguration;
@@ -223,7 +308,23 @@ private:
     // Thread safety synchronization
     mutable std::mutex contextMutex;
     
+    // Current descriptor, null when it must be rebuilt. Accessed only through
+    // std::atomic_load/atomic_store; built and replaced with contextMutex held.
+    mutable std::shared_ptr<const TranslationDescriptor> descriptor;
+    
+    // Translation statistics updated outside contextMutex
+    std::atomic<uint64_t> translationCounter;
+    std::atomic<uint64_t> translationFaultCounter;
+    std::atomic<uint64_t> lastTranslationTimestamp;
+    
+    // SHARED_STAGE2_BIT | VMID while sharing, else 0
+    static const uint32_t SHARED_STAGE2_BIT = 1u << 16;
+    std::atomic<uint32_t> sharedStage2Key;
+    
     // Helper methods
+    std::shared_ptr<const TranslationDescriptor> buildDescriptor() const;
+    void publishDescriptor();
+    void invalidateDescriptor();
     // Note: Fault recording moved to SMMU controller for proper StreamID handling
 };
 
@@ -0,0 +1,105 @@
+// ARM SMMU v3 Stream Table
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_STREAM_TABLE_H
+#define SMMU_STREAM_TABLE_H
+
+#include "smmu/types.h"
+#include "smmu/stream_context.h"
+#include "smmu/epoch_reclaimer.h"
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// STRTAB_BASE_CFG.FMT
+enum class StreamTableFormat {
+    Linear,     // One array of STEs indexed by StreamID
+    TwoLevel    // L1 descriptors pointing at L2 STE arrays of 2^SPLIT entries
+};
+
+// StreamID -> StreamContext table, laid out like the SMMU's stream table and
+// sized from AddressConfiguration::maxStreamCount: linear up to
+// LINEAR_MAX_STREAMS entries, 2-level above that with L2 tables allocated
+// when their first stream is configured.
+//
+// find() takes no lock. A reader must hold an EpochGuard for as long as it
+// uses the context it got back: removed contexts, and layouts replaced by
+// resize(), are retired and only freed once every such reader has left.
+// Everything else is for writers, which the caller serializes.
+//
+// StreamIDs at or above the table size, which hardware would reject with
+// C_BAD_STREAMID, are kept in a copy-on-write map so existing users of the
+// full 32-bit StreamID range keep working; finding those costs a shared_ptr
+// load.
+class StreamTable {
+public:
+    static const unsigned SPLIT = 8;                       // STRTAB_BASE_CFG.SPLIT
+    static const uint32_t LINEAR_MAX_STREAMS = 1u << 12;   // 32KB of STE pointers
+    
+    explicit StreamTable(uint32_t streamCount);
+    ~StreamTable();  // No reader may remain
+    
+    StreamContext* find(StreamID streamID) const;
+    
+    // Takes ownership and publishes the context; any previous one is retired
+    StreamContext* insert(StreamID streamID, std::unique_ptr<StreamContext> streamContext);
+    bool remove(StreamID streamID);
+    void clear();
+    
+    // Re-lay the table for a new maxStreamCount; configured streams stay
+    void resize(uint32_t streamCount);
+    
+    // Writer-side enumeration of every configured stream
+    template <typename Visitor>
+    void forEach(Visitor visitor) const {
+        for (auto it = streams.begin(); it != streams.end(); ++it) {
+            visitor(it->first, it->second);
+        }
+    }
+    
+    size_t size() const;
+    uint32_t getTableSize() const;                 // StreamIDs direct-indexed
+    StreamTableFormat getFormat() const;
+    size_t getLevel2TableCount() const;
+    static StreamTableFormat formatFor(uint32_t streamCount);
+
+private:
+    typedef std::atomic<StreamContext*> Entry;  // One STE
+    typedef std::unordered_map<StreamID, StreamContext*> OverflowMap;
+    
+    struct Layout {
+        StreamTableFormat format;
+        uint32_t tableSize;
+        size_t level1Count;                            // Linear: STEs; 2-level: L1 descriptors
+        std::unique_ptr<Entry[]> linear;
+        std::unique_ptr<std::atomic<Entry*>[]> level1;
+        
+        explicit Layout(uint32_t tableSize);
+        ~Layout();
+    };
+    
+    std::atomic<Layout*> layout;
+    std::shared_ptr<const OverflowMap> overflow;       // std::atomic_load/atomic_store
+    std::atomic<size_t> configuredCount;
+    std::unordered_map<StreamID, StreamContext*> streams;  // Owned; writers only
+    EpochReclaimer reclaimer;
+    
+    Entry* findEntry(const Layout* table, StreamID streamID) const;
+    Entry* entryForWrite(Layout* table, StreamID streamID);
+    void publish(StreamID streamID, StreamContext* streamContext);
+    void retireContext(StreamContext* streamContext);
+    void publishOverflow(uint32_t firstStreamID);
+    static void releaseLayout(void* object);
+    
+    StreamTable(const StreamTable&);
+    StreamTable& operator=(const StreamTable&);
+};
+
+} // namespace smmu
+
+#endif // SMMU_STREAM_TABLE_H
@@ -5,12 +5,18 @@
 #define SMMU_TLB_CACHE_H
 
 #include "smmu/types.h"
+#include "smmu/set_associative_tlb.h"
+#include "smmu/memory_pool.h"
 #include <unordered_map>
+#include <map>
 #include <list>
 #include <utility>
+#include <functional>
 #include <cstddef>
 #include <mutex>
 #include <atomic>
+#include <vector>
+#include <memory>
 
 namespace smmu {
 
@@ -109,20 +115,54 @@ struct StreamPASIDKeyHash {
 class TLBCache {
 public:
     explicit TLBCache(size_t maxSize = 1024);
+    
+    // Sharded (lock-striped) cache: entries are partitioned by a hash of
+    // (StreamID, PASID, page) and every shard has its own lock and LRU list.
+    // shardCount is rounded up to a power of two; 1 gives the unsharded cache.
+    // TLBBackend::SetAssociative replaces each shard's list and indices with a
+    // flat N-way set-associative array (see SetAssociativeTLB). List nodes
+    // and indices are charged to budget.
+    TLBCache(size_t maxSize, size_t shardCount, TLBBackend backend = TLBBackend::LRUList,
+             std::shared_ptr<MemoryBudget> budget = MemoryBudget::defaultBudget());
     ~TLBCache();
     
+    // Stream and (stream, PASID) generations at some instant. Taking one before
+    // the page walk and inserting with it makes an invalidation that lands
+    // during the walk also cover the entry built from it.
+    struct Generation {
+        uint32_t stream;
+        uint32_t pasid;
+    };
+    Generation currentGeneration(StreamID streamID, PASID pasid) const;
+    
+    // Translations shared by all Stage-2-only streams of one VM are keyed by
+    // (StreamID = VMID, PASID = VMID_KEY_PASID). No real PASID exceeds
+    // MAX_PASID, so these keys never alias a stream's own entries.
+    static const PASID VMID_KEY_PASID = MAX_PASID + 1;
+    
     // Cache operations - Result<T> error handling pattern
     Result<TLBEntry> lookupEntry(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState = SecurityState::NonSecure);
-    void insert(const TLBEntry& entry);
+    void insert(const TLBEntry& entry);  // Stamps the current generation
+    void insert(const TLBEntry& entry, const Generation& generation);
     Result<CacheEntry> lookupCacheEntry(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState = SecurityState::NonSecure);
     void insert(StreamID streamID, PASID pasid, const CacheEntry& entry);
     
-    // Legacy interfaces for backward compatibility - deprecated
-    TLBEntry* lookup(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState = SecurityState::NonSecure);
+    // Copies the entry out under the shard lock; safe against concurrent
+    // inserts and evictions. An entry whose timestamp is below minTimestamp has
+    // expired: it is erased and the lookup counts as a miss.
+    bool lookup(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState, uint64_t minTimestamp,
+                TLBEntry& entry);
+    
+    // Legacy interfaces for backward compatibility - deprecated. The returned
+    // pointer is only valid until the next insert or eviction in its shard.
+    TLBEntry* lookup(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState = SecurityState::NonSecure,
+                     uint64_t minTimestamp = 0);
     bool lookup(StreamID streamID, PASID pasid, IOVA iova, CacheEntry& entry);
     void remove(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState = SecurityState::NonSecure);
     
     // Invalidation operations
+    // Stream and PASID invalidation only bump a generation counter: stale
+    // entries miss at once and are reclaimed lazily (see reclaimStale)
     void invalidate(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState = SecurityState::NonSecure);
     void invalidateBySecurityState(SecurityState securityState);
     void invalidateByStream(StreamID streamID);
@@ -130,6 +170,10 @@ public:
     void invalidateAll();
     void invalidateStream(StreamID streamID);  // Alias
     void invalidatePASID(StreamID streamID, PASID pasid);  // Alias
+    void invalidateVMID(VMID vmid);  // Entries under the VMID key only
+    // Drop every cached page or block of (streamID, pasid) overlapping [startIova, endIova];
+    // cost follows the number of cached entries in the range, not its length
+    void invalidateRange(StreamID streamID, PASID pasid, IOVA startIova, IOVA endIova);
     void invalidatePage(StreamID streamID, PASID pasid, IOVA iova);  // Alias
     void clear();  // Clear all entries
     
@@ -138,9 +182,11 @@ public:
     uint64_t getMissCount() const;
     uint64_t getTotalLookups() const;
     double getHitRate() const;
-    size_t getSize() const;
+    size_t getSize() const;  // Live entries; reclaims stale ones first
     size_t getCapacity() const;
     size_t getMaxSize() const;  // Alias for getCapacity
+    size_t getShardCount() const;
+    TLBBackend getBackend() const;
     void resetStatistics();
     void reset();  // Complete reset
     
@@ -159,40 +205,107 @@ public:
     void setMaxSize(size_t maxSize);
     
 private:
-    // Cache storage using LRU policy with TLBEntry
-    using TLBCacheMap = std::unordered_map<CacheKey, std::list<std::pair<CacheKey, TLBEntry>>::iterator, CacheKeyHash>;
-    using TLBCacheList = std::list<std::pair<CacheKey, TLBEntry>>;
+    // Cache storage using LRU policy with TLBEntry; nodes come from the slab pools
+    using TLBCacheList = std::list<std::pair<CacheKey, TLBEntry>, PoolAllocator<std::pair<CacheKey, TLBEntry>>>;
+    using TLBCacheMap = std::unordered_map<CacheKey, TLBCacheList::iterator, CacheKeyHash, std::equal_to<CacheKey>,
+                                           PoolAllocator<std::pair<const CacheKey, TLBCacheList::iterator>>>;
     
     // Legacy cache storage for backward compatibility
     using CacheMap = std::unordered_map<CacheKey, std::list<std::pair<CacheKey, CacheEntry>>::iterator, CacheKeyHash>;
     using CacheList = std::list<std::pair<CacheKey, CacheEntry>>;
     
-    TLBCacheMap tlbCacheMap;
-    TLBCacheList tlbCacheList;
-    size_t maxSize;
+    // Cached pages of one (StreamID, PASID), ordered by IOVA for range invalidation
+    using PageIndex = std::multimap<IOVA, TLBCacheList::iterator, std::less<IOVA>,
+                                    PoolAllocator<std::pair<const IOVA, TLBCacheList::iterator>>>;
+    using SecurityIndex = std::unordered_multimap<SecurityState, TLBCacheList::iterator, std::hash<SecurityState>,
+                                                  std::equal_to<SecurityState>,
+                                                  PoolAllocator<std::pair<const SecurityState, TLBCacheList::iterator>>>;
+    using PASIDIndex = std::unordered_map<StreamPASIDKey, PageIndex, StreamPASIDKeyHash, std::equal_to<StreamPASIDKey>,
+                                          PoolAllocator<std::pair<const StreamPASIDKey, PageIndex>>>;
     
-    // Secondary indices for O(1) invalidation operations
-    // These enable fast invalidation by StreamID, PASID, or SecurityState
-    std::unordered_multimap<StreamID, typename TLBCacheList::iterator> streamIndex;
-    std::unordered_multimap<StreamPASIDKey, typename TLBCacheList::iterator, StreamPASIDKeyHash> pasidIndex;
-    std::unordered_multimap<SecurityState, typename TLBCacheList::iterator> securityIndex;
+    // One lock stripe of the cache. Each shard owns its LRU list, primary map,
+    // secondary indices, hit/miss counters and mutex so that lookups landing in
+    // different shards never contend on the same lock or counter.
+    // With the set-associative backend only flatStore is used.
+    struct Shard {
+        std::unique_ptr<SetAssociativeTLB> flatStore;
+        TLBCacheMap tlbCacheMap;
+        TLBCacheList tlbCacheList;
+        size_t maxSize;
+        
+        // Secondary indices for range and SecurityState invalidation
+        PASIDIndex pasidIndex;
+        SecurityIndex securityIndex;
+        
+        // Statistics - atomic for thread safety
+        std::atomic<uint64_t> hitCount;
+        std::atomic<uint64_t> missCount;
+        
+        // Value of generationBumps when this shard was last swept
+        uint64_t sweptBumps;
+        
+        // Thread safety
+        mutable std::mutex cacheMutex;
+        
+        Shard(size_t capacity, MemoryBudget* budget)
+            : tlbCacheMap(0, CacheKeyHash(), std::equal_to<CacheKey>(), TLBCacheMap::allocator_type(budget)),
+              tlbCacheList(TLBCacheList::allocator_type(budget)), maxSize(capacity),
+              pasidIndex(0, StreamPASIDKeyHash(), std::equal_to<StreamPASIDKey>(), PASIDIndex::allocator_type(budget)),
+              securityIndex(0, std::hash<SecurityState>(), std::equal_to<SecurityState>(),
+                            SecurityIndex::allocator_type(budget)),
+              hitCount(0), missCount(0), sweptBumps(0) {
+        }
+    };
+    
+    std::shared_ptr<MemoryBudget> budget;   // Outlives the shards
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t shardMask;
+    size_t maxSize;
+    TLBBackend backend;
     
-    // Statistics - atomic for thread safety
-    mutable std::atomic<uint64_t> hitCount;
-    mutable std::atomic<uint64_t> missCount;
+    // Block and 16KB/64KB granule entries (TLBEntry::blockSize > PAGE_SIZE) are
+    // keyed by their base IOVA. One bit per entry size ever inserted tells
+    // lookups and invalidations which bases to probe; with only 4KB pages
+    // cached a lookup is one probe.
+    // Bits are set under the inserting shard's lock and only cleared by
+    // clear() and reset() with every shard lock held and the cache empty, so
+    // a racing insert can never hide an entry.
+    std::atomic<uint32_t> blockSizesPresent;
     
-    // Thread safety
-    mutable std::mutex cacheMutex;
+    // Generation counters, hashed by StreamID and by (StreamID, PASID). Two keys
+    // sharing a slot only means one invalidation also drops the other's entries.
+    static const uint32_t STREAM_GENERATION_BITS = 10;
+    static const uint32_t PASID_GENERATION_BITS = 12;
+    std::unique_ptr<std::atomic<uint32_t>[]> streamGenerations;
+    std::unique_ptr<std::atomic<uint32_t>[]> pasidGenerations;
+    std::atomic<uint64_t> generationBumps;  // Total bumps; shards sweep when behind
     
     // Helper methods
-    void evictLRU();
-    void moveToFront(typename TLBCacheList::iterator it);
+    Shard& shardFor(uint64_t hash) const;
+    size_t shardCapacity(size_t totalSize) const;
+    TLBEntry* findCovering(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState, TLBEntry* copy,
+                           uint64_t minTimestamp = 0);
+    TLBEntry* findFresh(Shard& shard, uint64_t hash, const CacheKey& key, uint64_t minTimestamp);
+    void initializeGenerations();
+    std::atomic<uint32_t>& streamGeneration(StreamID streamID) const;
+    std::atomic<uint32_t>& pasidGeneration(StreamID streamID, PASID pasid) const;
+    bool isStale(const TLBEntry& entry) const;
+    void reclaimStale(Shard& shard) const;
+    TLBEntry* findEntry(Shard& shard, uint64_t hash, const CacheKey& key);
+    void insertEntry(Shard& shard, uint64_t hash, const CacheKey& key, const TLBEntry& entry);
+    void removeEntry(Shard& shard, uint64_t hash, const CacheKey& key);
+    size_t shardSize(const Shard& shard) const;
+    void evictLRU(Shard& shard);
+    void moveToFront(Shard& shard, typename TLBCacheList::iterator it);
+    void eraseEntry(Shard& shard, typename TLBCacheList::iterator it) const;
+    void clearShard(Shard& shard);
+    std::vector<std::unique_lock<std::mutex>> lockAllShards() const;
     uint64_t getCurrentTimestamp() const;
     CacheKey makeKey(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState = SecurityState::NonSecure) const;
     
     // Secondary index maintenance helpers
-    void addToSecondaryIndices(const CacheKey& key, typename TLBCacheList::iterator it);
-    void removeFromSecondaryIndices(const CacheKey& key, typename TLBCacheList::iterator it);
+    void addToSecondaryIndices(Shard& shard, const CacheKey& key, typename TLBCacheList::iterator it);
+    void removeFromSecondaryIndices(Shard& shard, const CacheKey& key, typename TLBCacheList::iterator it) const;
 };
 
 } // namespace smmu
@@ -0,0 +1,123 @@
+// ARM SMMU v3 Asynchronous Translation Engine
+// Copyright (c) 2024 John Greninger
+
+#ifndef SMMU_TRANSLATION_ENGINE_H
+#define SMMU_TRANSLATION_ENGINE_H
+
+#include "smmu/types.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace smmu {
+
+// Completion of an asynchronous translation
+typedef std::function<void(const TranslationRequest& request, const TranslationResult& result)> TranslationCallback;
+
+// Worker pool behind SMMU::translateAsync.
+//
+// Every worker owns a queue. A submitting thread always feeds the same queue,
+// the way a CPU feeds its own, and a worker whose queue is empty steals the
+// oldest job from the others, so one busy submitter still keeps the whole
+// pool walking. Jobs still queued timeoutMs after submission complete with
+// SMMUError::Timeout instead of being translated. A deadline thread sleeps
+// until the earliest such deadline and expires overdue jobs itself, so the
+// timeout is reported on time even while every worker is stuck in a walk.
+//
+// Callbacks run on the workers, or on the deadline thread for jobs it
+// expires. They may submit more work, but must not resize or destroy the
+// engine.
+class TranslationEngine {
+public:
+    typedef std::function<TranslationResult(const TranslationRequest& request)> Translator;
+    
+    static const size_t MAX_WORKERS = 256;   // ResourceLimits::maxThreadCount bound
+    
+    TranslationEngine(Translator translator, size_t workerCount, uint32_t timeoutMs);
+    ~TranslationEngine();  // Completes everything queued, then joins the workers
+    
+    void submit(const TranslationRequest& request, TranslationCallback callback);
+    void drain();  // Wait until every submitted job has completed
+    
+    // Restart the pool with a new worker count. Waits for the jobs being run;
+    // queued jobs are kept for the new workers.
+    void resize(size_t workerCount);
+    void setTimeout(uint32_t timeoutMs);  // 0 disables timeouts
+    
+    size_t getWorkerCount() const;
+    uint64_t getCompletedCount() const;
+    uint64_t getTimeoutCount() const;
+    uint64_t getStealCount() const;
+
+private:
+    struct Job {
+        TranslationRequest request;
+        TranslationCallback callback;
+        std::chrono::steady_clock::time_point submitted;
+    };
+    
+    struct WorkQueue {
+        std::mutex queueMutex;
+        std::deque<Job> jobs;
+    };
+    
+    Translator translator;
+    std::atomic<uint32_t> timeoutMs;
+    
+    // Queues are created as workers first need them and kept, so a job left
+    // in the queue of a worker removed by resize() is still stolen
+    std::unique_ptr<WorkQueue> queues[MAX_WORKERS];
+    std::atomic<size_t> activeWorkers;   // Queues submitters feed
+    std::atomic<size_t> queueLimit;      // Queues ever created; thieves scan these
+    
+    std::mutex resizeMutex;
+    std::vector<std::thread> workers;
+    
+    // Idle workers sleep on workAvailable; submitters only take sleepMutex
+    // when one does
+    std::mutex sleepMutex;
+    std::condition_variable workAvailable;
+    std::atomic<size_t> sleepingWorkers;
+    std::atomic<bool> retiring;          // Set under sleepMutex
+    
+    // Deadline thread; like a worker it announces an idle sleep in
+    // sweeperIdle so submitters only wake it when no job was queued
+    std::thread sweeper;
+    std::mutex sweepMutex;
+    std::condition_variable sweepWake;
+    std::atomic<bool> sweeperIdle;
+    bool sweeperStopping;                // Guarded by sweepMutex
+    
+    std::atomic<size_t> queuedCount;     // Jobs in any queue
+    std::atomic<size_t> pendingCount;    // Jobs submitted but not completed
+    std::mutex drainMutex;
+    std::condition_variable drained;
+    
+    std::atomic<uint64_t> completedCount;
+    std::atomic<uint64_t> timeoutCount;
+    std::atomic<uint64_t> stealCount;
+    
+    void startWorkers(size_t workerCount);
+    void stopWorkers();
+    void workerLoop(size_t index);
+    bool takeJob(size_t index, Job& job);
+    void runJob(Job& job);
+    void completeJob(Job& job, const TranslationResult& result);
+    void sweeperLoop();
+    bool expireJobs(std::chrono::steady_clock::time_point& nextDeadline);
+    
+    TranslationEngine(const TranslationEngine&);
+    TranslationEngine& operator=(const TranslationEngine&);
+};
+
+} // namespace smmu
+
+#endif // SMMU_TRANSLATION_ENGINE_H
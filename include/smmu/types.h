@@ -22,6 +22,7 @@
 #include <cstddef>
 #include <utility>
 #include <type_traits>
+#include <vector>
 
 namespace smmu {
 
@@ -84,6 +85,8 @@ enum class SMMUError {
     AddressSpaceExhausted,
     /// @brief Access type violates page permissions (Permission Fault)
     PagePermissionViolation,
+    /// @brief Descriptor access flag is clear and not updated by hardware (Access Flag Fault)
+    AccessFlagFault,
     
     // Cache and TLB errors
     /// @brief TLB cache operation failed
@@ -120,6 +123,8 @@ enum class SMMUError {
     // System-level errors
     /// @brief System resources exhausted
     ResourceExhausted,
+    /// @brief Operation not completed within ResourceLimits::timeoutMs
+    Timeout,
     /// @brief Internal SMMU implementation error
     InternalError,
     /// @brief Feature not yet implemented
@@ -437,6 +442,14 @@ using IPA = uint64_t;
 /// @details 64-bit physical address for memory access
 using PA = uint64_t;
 
+/// @brief Virtual Machine ID - tags a Stage-2 translation context
+/// @details 16-bit identifier; streams with the same VMID share one set of Stage-2 tables
+using VMID = uint16_t;
+
+/// @brief Address Space ID - tags a Stage-1 translation context
+/// @details 16-bit identifier carried by the Context Descriptor of a PASID
+using ASID = uint16_t;
+
 ///@}
 
 /**
@@ -715,6 +728,25 @@ struct PagePermissions {
     }
 };
 
+// TranslationData::dirtyEpoch values besides a dirty-log epoch (see
+// AddressSpace::getAndClearDirtyBitmap). A cached translation may serve a
+// write without a walk only while its epoch is untracked or current.
+constexpr uint64_t DIRTY_UNTRACKED = 0;   // The address space logs no dirty pages
+constexpr uint64_t DIRTY_CLEAN = ~0ULL;   // Not marked dirty: the next write must walk
+
+// Dirty state of a two-stage translation: a cached copy may serve writes
+// only while both stages would let it. Two tracked stages carry different
+// address spaces' stamps, so their writes always walk.
+inline uint64_t combineDirtyEpochs(uint64_t stage1, uint64_t stage2) {
+    if (stage1 == DIRTY_UNTRACKED) {
+        return stage2;
+    }
+    if (stage2 == DIRTY_UNTRACKED || stage1 == stage2) {
+        return stage1;
+    }
+    return DIRTY_CLEAN;
+}
+
 /**
  * @struct TranslationData
  * @brief Translation result data structure
@@ -734,12 +766,17 @@ struct TranslationData {
     PagePermissions permissions;
     /// @brief Security state of the translated address
     SecurityState securityState;
+    /// @brief Size of the page or block that produced the translation (4KB, 2MB or 1GB)
+    uint64_t blockSize;
+    /// @brief Dirty logging state: DIRTY_UNTRACKED, DIRTY_CLEAN, or the dirty-log
+    ///        epoch in which the write that produced this translation marked the page
+    uint64_t dirtyEpoch;
     
     /**
      * @brief Default constructor
      * @details Physical address = 0, NonSecure state, no permissions.
      */
-    TranslationData() : physicalAddress(0), securityState(SecurityState::NonSecure) {
+    TranslationData() : physicalAddress(0), securityState(SecurityState::NonSecure), blockSize(4096), dirtyEpoch(DIRTY_UNTRACKED) {
     }
     
     /**
@@ -747,7 +784,7 @@ struct TranslationData {
      * @param pa Physical address
      * @details Security state defaults to NonSecure, no permissions.
      */
-    TranslationData(PA pa) : physicalAddress(pa), securityState(SecurityState::NonSecure) {
+    TranslationData(PA pa) : physicalAddress(pa), securityState(SecurityState::NonSecure), blockSize(4096), dirtyEpoch(DIRTY_UNTRACKED) {
     }
     
     /**
@@ -756,7 +793,7 @@ struct TranslationData {
      * @param perms Page permissions
      * @details Security state defaults to NonSecure.
      */
-    TranslationData(PA pa, PagePermissions perms) : physicalAddress(pa), permissions(perms), securityState(SecurityState::NonSecure) {
+    TranslationData(PA pa, PagePermissions perms) : physicalAddress(pa), permissions(perms), securityState(SecurityState::NonSecure), blockSize(4096), dirtyEpoch(DIRTY_UNTRACKED) {
     }
     
     /**
@@ -765,7 +802,17 @@ struct TranslationData {
      * @param perms Page permissions
      * @param secState Security state
      */
-    TranslationData(PA pa, PagePermissions perms, SecurityState secState) : physicalAddress(pa), permissions(perms), securityState(secState) {
+    TranslationData(PA pa, PagePermissions perms, SecurityState secState) : physicalAddress(pa), permissions(perms), securityState(secState), blockSize(4096), dirtyEpoch(DIRTY_UNTRACKED) {
+    }
+    
+    /**
+     * @brief Constructor for a translation through a block mapping
+     * @param pa Physical address
+     * @param perms Page permissions
+     * @param secState Security state
+     * @param size Block size in bytes (power of two, at least 4KB)
+     */
+    TranslationData(PA pa, PagePermissions perms, SecurityState secState, uint64_t size) : physicalAddress(pa), permissions(perms), securityState(secState), blockSize(size), dirtyEpoch(DIRTY_UNTRACKED) {
     }
 };
 
@@ -789,6 +836,63 @@ struct TranslationData {
  */
 using TranslationResult = Result<TranslationData>;
 
+/**
+ * @struct TranslationRequest
+ * @brief One input of a batched translation (SMMU::translateBatch)
+ * @details Carries the same arguments as a single SMMU::translate call.
+ */
+struct TranslationRequest {
+    StreamID streamID;
+    PASID pasid;
+    IOVA iova;
+    AccessType accessType;
+    SecurityState securityState;
+    
+    TranslationRequest() : streamID(0), pasid(0), iova(0), accessType(AccessType::Read),
+                           securityState(SecurityState::NonSecure) {
+    }
+    
+    TranslationRequest(StreamID sid, PASID pid, IOVA va, AccessType access,
+                       SecurityState secState = SecurityState::NonSecure)
+        : streamID(sid), pasid(pid), iova(va), accessType(access), securityState(secState) {
+    }
+};
+
+/**
+ * @struct TranslationSegment
+ * @brief One physically contiguous piece of a translated IOVA range
+ */
+struct TranslationSegment {
+    PA physicalAddress;
+    uint64_t length;
+    
+    TranslationSegment() : physicalAddress(0), length(0) {
+    }
+    
+    TranslationSegment(PA pa, uint64_t len) : physicalAddress(pa), length(len) {
+    }
+};
+
+/**
+ * @struct RangeTranslation
+ * @brief Output of SMMU::translateRange
+ * @details Segments cover [iova, iova + translatedLength) in IOVA order, with
+ *          physically contiguous pages merged. Translation stops at the first
+ *          fault: faultAddress is the first IOVA that did not translate and
+ *          faultError the error translate() returned for it; the fault itself
+ *          is recorded as for a single translation.
+ */
+struct RangeTranslation {
+    std::vector<TranslationSegment> segments;
+    uint64_t translatedLength;
+    bool faulted;
+    IOVA faultAddress;
+    SMMUError faultError;
+    
+    RangeTranslation() : translatedLength(0), faulted(false), faultAddress(0), faultError(SMMUError::Success) {
+    }
+};
+
 /**
  * @brief Map FaultType to SMMUError for backward compatibility
  * @param faultType The fault type to convert
@@ -824,8 +928,10 @@ inline SMMUError faultTypeToSMMUError(FaultType faultType) {
         case FaultType::ConfigurationCacheFault:
             return SMMUError::CacheOperationFailed;
             
-        case FaultType::AccessFault:
         case FaultType::AccessFlagFault:
+            return SMMUError::AccessFlagFault;
+            
+        case FaultType::AccessFault:
         case FaultType::DirtyBitFault:
         case FaultType::TLBConflictFault:
         case FaultType::ExternalAbort:
@@ -870,6 +976,18 @@ inline TranslationResult makeTranslationSuccess(PA physicalAddress, PagePermissi
     return makeSuccess(TranslationData(physicalAddress, permissions, securityState));
 }
 
+/**
+ * @brief Create successful translation through a page or block mapping
+ * @param physicalAddress Physical address result
+ * @param permissions Page permissions
+ * @param securityState Security state
+ * @param blockSize Bytes covered by the mapping (a granule page or one of its block sizes)
+ * @return TranslationResult containing the translation data
+ */
+inline TranslationResult makeTranslationSuccess(PA physicalAddress, PagePermissions permissions, SecurityState securityState, uint64_t blockSize) {
+    return makeSuccess(TranslationData(physicalAddress, permissions, securityState, blockSize));
+}
+
 /**
  * @brief Create translation error with SMMUError
  * @param error The error code
@@ -921,6 +1039,8 @@ inline FaultType smmUErrorToFaultType(SMMUError error) {
             return FaultType::TranslationFault;
         case SMMUError::PagePermissionViolation:
             return FaultType::PermissionFault;
+        case SMMUError::AccessFlagFault:
+            return FaultType::AccessFlagFault;
         case SMMUError::InvalidAddress:
             return FaultType::AddressSizeFault;
         case SMMUError::InvalidSecurityState:
@@ -960,6 +1080,76 @@ struct PageEntry {
     }
 };
 
+// Packed page descriptor layout, after the VMSAv8-64 descriptor: the output
+// address keeps its bit positions [51:12] and the attributes use low bits
+constexpr uint64_t DESCRIPTOR_VALID = 1ULL << 0;
+constexpr unsigned DESCRIPTOR_SECURITY_SHIFT = 1;                       // bits [2:1]
+constexpr uint64_t DESCRIPTOR_SECURITY_MASK = 3ULL << DESCRIPTOR_SECURITY_SHIFT;
+constexpr uint64_t DESCRIPTOR_READ = 1ULL << 3;                         // bit 3 + AccessType:
+constexpr uint64_t DESCRIPTOR_WRITE = 1ULL << 4;                        // Read, Write, Execute
+constexpr uint64_t DESCRIPTOR_EXECUTE = 1ULL << 5;
+constexpr uint64_t DESCRIPTOR_ADDRESS_MASK = 0x000FFFFFFFFFF000ULL;     // bits [51:12]
+
+// Page or block descriptor packed into one 64-bit word - half the size of a
+// PageEntry. Used by the page table storage; PageEntry stays the API type.
+struct PageDescriptor {
+    uint64_t bits;
+    
+    PageDescriptor() : bits(0) {
+    }
+    
+    PageDescriptor(PA pa, const PagePermissions& perms, SecurityState secState = SecurityState::NonSecure)
+        : bits((pa & DESCRIPTOR_ADDRESS_MASK) | DESCRIPTOR_VALID |
+               (static_cast<uint64_t>(secState) << DESCRIPTOR_SECURITY_SHIFT) |
+               (perms.read ? DESCRIPTOR_READ : 0) | (perms.write ? DESCRIPTOR_WRITE : 0) |
+               (perms.execute ? DESCRIPTOR_EXECUTE : 0)) {
+    }
+    
+    explicit PageDescriptor(const PageEntry& entry)
+        : bits(entry.valid ? PageDescriptor(entry.physicalAddress, entry.permissions, entry.securityState).bits : 0) {
+    }
+    
+    bool isValid() const {
+        return (bits & DESCRIPTOR_VALID) != 0;
+    }
+    
+    PA getPhysicalAddress() const {
+        return bits & DESCRIPTOR_ADDRESS_MASK;
+    }
+    
+    SecurityState getSecurityState() const {
+        return static_cast<SecurityState>((bits & DESCRIPTOR_SECURITY_MASK) >> DESCRIPTOR_SECURITY_SHIFT);
+    }
+    
+    PagePermissions getPermissions() const {
+        return PagePermissions((bits & DESCRIPTOR_READ) != 0, (bits & DESCRIPTOR_WRITE) != 0,
+                               (bits & DESCRIPTOR_EXECUTE) != 0);
+    }
+    
+    // Same attributes, output address moved on by offset (a multiple of 4KB)
+    PageDescriptor offsetBy(uint64_t offset) const {
+        PageDescriptor moved;
+        moved.bits = bits + offset;
+        return moved;
+    }
+    
+    // Bit that must be set to allow accessType; unknown types get bit 63,
+    // which no descriptor sets, so they are denied
+    static uint64_t accessBit(AccessType accessType) {
+        unsigned index = static_cast<unsigned>(accessType);
+        return index <= static_cast<unsigned>(AccessType::Execute) ? DESCRIPTOR_READ << index : 1ULL << 63;
+    }
+    
+    // Valid, in securityState and allowing accessType - one mask and compare.
+    // A security state value too wide for its field never matches.
+    bool permits(AccessType accessType, SecurityState securityState) const {
+        uint64_t access = accessBit(accessType);
+        uint64_t state = static_cast<uint64_t>(securityState) << DESCRIPTOR_SECURITY_SHIFT;
+        uint64_t mask = DESCRIPTOR_VALID | DESCRIPTOR_SECURITY_MASK | access;
+        return (((bits & mask) ^ (DESCRIPTOR_VALID | state | access)) | (state & ~DESCRIPTOR_SECURITY_MASK)) == 0;
+    }
+};
+
 // ARM SMMU v3 comprehensive fault record structure
 struct FaultRecord {
     StreamID streamID;          // Source stream identifier
@@ -1031,19 +1221,25 @@ struct AddressRange {
 struct TLBEntry {
     StreamID streamID;
     PASID pasid;
-    IOVA iova;
-    PA physicalAddress;
+    IOVA iova;                  // Base of the page or block
+    PA physicalAddress;         // Base of the page or block
     PagePermissions permissions;
     SecurityState securityState;
     bool valid;
-    uint64_t timestamp;
+    uint64_t timestamp;         // Insertion time; the SMMU stores its cache-age tick here
+    uint64_t blockSize;         // Bytes covered: a 4KB/16KB/64KB granule page or a block
+    uint32_t streamGeneration;  // Stamped by TLBCache on insert; the entry is stale once
+    uint32_t pasidGeneration;   // the stream or (stream, PASID) generation moves on
+    uint64_t dirtyEpoch;        // TranslationData::dirtyEpoch of the walk that filled it
     
     TLBEntry() : streamID(0), pasid(0), iova(0), physicalAddress(0), 
-                 securityState(SecurityState::NonSecure), valid(false), timestamp(0) {
+                 securityState(SecurityState::NonSecure), valid(false), timestamp(0), blockSize(4096),
+                 streamGeneration(0), pasidGeneration(0), dirtyEpoch(DIRTY_UNTRACKED) {
     }
     
     TLBEntry(StreamID sid, PASID p, IOVA iva, PA pa, PagePermissions perms, SecurityState secState) 
-        : streamID(sid), pasid(p), iova(iva), physicalAddress(pa), permissions(perms), securityState(secState), valid(true), timestamp(0) {
+        : streamID(sid), pasid(p), iova(iva), physicalAddress(pa), permissions(perms), securityState(secState), valid(true), timestamp(0),
+          blockSize(4096), streamGeneration(0), pasidGeneration(0), dirtyEpoch(DIRTY_UNTRACKED) {
     }
 };
 
@@ -1085,6 +1281,19 @@ struct CacheStatistics {
     }
 };
 
+// TLB cache storage organisation
+enum class TLBBackend {
+    LRUList,        // Linked LRU list with hash map and secondary indices
+    SetAssociative  // Flat N-way set-associative array with CLOCK replacement
+};
+
+// AddressSpace page table storage organisation
+enum class PageTableBackend {
+    Hash,   // Hash maps keyed by page and block number
+    Radix,  // VMSAv8-style multi-level table with 512-entry nodes
+    Extent  // Ordered tree of contiguous (IOVA, PA) intervals
+};
+
 // Task 5.3: Event and Command Processing - Command types for SMMU command queue
 enum class CommandType {
     PREFETCH_CONFIG,
@@ -1094,6 +1303,9 @@ enum class CommandType {
     TLBI_NH_ALL,    // TLB invalidation non-secure hyp all
     TLBI_EL2_ALL,   // TLB invalidation EL2 all
     TLBI_S12_VMALL, // TLB invalidation stage 1&2 VM all
+    TLBI_S12_VMID,  // TLB invalidation stage 1&2 by VMID
+    TLBI_NH_ASID,   // TLB invalidation stage 1 by ASID within a VMID
+    TLBI_S2_IPA,    // TLB invalidation stage 2 by IPA range within a VMID
     ATC_INV,        // Address Translation Cache invalidation
     PRI_RESP,       // Page Request Interface response
     RESUME,         // Resume processing
@@ -1108,15 +1320,17 @@ struct CommandEntry {
     IOVA startAddress;
     IOVA endAddress;
     uint32_t flags;
+    VMID vmid;      // TLBI_S12_VMID / TLBI_NH_ASID / TLBI_S2_IPA
+    ASID asid;      // TLBI_NH_ASID
     uint64_t timestamp;
     
     CommandEntry() : type(CommandType::SYNC), streamID(0), pasid(0), 
-                    startAddress(0), endAddress(0), flags(0), timestamp(0) {
+                    startAddress(0), endAddress(0), flags(0), vmid(0), asid(0), timestamp(0) {
     }
     
     CommandEntry(CommandType cmdType, StreamID sid, PASID p, IOVA start, IOVA end) 
         : type(cmdType), streamID(sid), pasid(p), startAddress(start), endAddress(end), 
-          flags(0), timestamp(0) {
+          flags(0), vmid(0), asid(0), timestamp(0) {
     }
 };
 
@@ -1343,6 +1557,26 @@ constexpr uint64_t PAGE_SIZE = 4096;
 /// @details Used for page-aligned address calculations
 constexpr uint64_t PAGE_MASK = PAGE_SIZE - 1;
 
+/// @brief Level 2 block size for the 4KB granule (2MB)
+/// @details One block descriptor / TLB entry covers 512 pages
+constexpr uint64_t BLOCK_SIZE_2MB = 2ULL * 1024 * 1024;
+
+/// @brief Level 1 block size for the 4KB granule (1GB)
+/// @details One block descriptor / TLB entry covers 512 level 2 blocks
+constexpr uint64_t BLOCK_SIZE_1GB = 1024ULL * 1024 * 1024;
+
+/// @brief log2 of the page size of a translation granule (12, 14 or 16)
+/// @details Each table level then resolves (shift - 3) IOVA bits, so a level 2
+/// block is 2MB, 32MB or 512MB and a level 1 block 1GB, 64GB or 4TB
+constexpr unsigned granuleShift(TranslationGranule granule) {
+    return granule == TranslationGranule::Size64KB ? 16 : (granule == TranslationGranule::Size16KB ? 14 : 12);
+}
+
+/// @brief Page size of a translation granule (4KB, 16KB or 64KB)
+constexpr uint64_t granulePageSize(TranslationGranule granule) {
+    return 1ULL << granuleShift(granule);
+}
+
 /// @brief Maximum supported virtual address space (52-bit)
 /// @details ARM SMMU v3 specification supports up to 52-bit address spaces
 constexpr uint64_t MAX_VIRTUAL_ADDRESS = 0x000FFFFFFFFFFFFFULL;
@@ -3,36 +3,102 @@
 
 #include "smmu/address_space.h"
 #include <algorithm>  // Required for std::sort in getMappedRanges()
+#include <atomic>
 
 namespace smmu {
 
+const uint64_t AddressSpace::MAX_DIRTY_BITMAP_PAGES;
+
+namespace {
+
+// Dirty-log epochs, one slot per address space; once there are more spaces
+// than slots they share, which only costs each other extra walks. A stamp
+// carries its slot in the top bits, so a cached translation is checked
+// without reaching the address space that produced it.
+const unsigned DIRTY_EPOCH_SLOT_BITS = 10;
+const unsigned DIRTY_EPOCH_SHIFT = 64 - DIRTY_EPOCH_SLOT_BITS;
+const size_t DIRTY_EPOCH_SLOTS = static_cast<size_t>(1) << DIRTY_EPOCH_SLOT_BITS;
+std::atomic<uint64_t> dirtyLogEpochs[DIRTY_EPOCH_SLOTS];
+std::atomic<size_t> nextDirtyEpochSlot(0);
+
+size_t assignDirtyEpochSlot() {
+    return nextDirtyEpochSlot.fetch_add(1, std::memory_order_relaxed) & (DIRTY_EPOCH_SLOTS - 1);
+}
+
+// +1 keeps slot 0's first stamp clear of DIRTY_UNTRACKED
+uint64_t dirtyEpochStamp(size_t slot) {
+    return (static_cast<uint64_t>(slot) << DIRTY_EPOCH_SHIFT) | (dirtyLogEpochs[slot].load() + 1);
+}
+
+} // anonymous namespace
+
+AddressSpace::HashTables::HashTables(std::shared_ptr<MemoryBudget> budget)
+    : budget(budget), pageTable(DescriptorMap::allocator_type(budget.get())),
+      blockTables{DescriptorMap(DescriptorMap::allocator_type(budget.get())),
+                  DescriptorMap(DescriptorMap::allocator_type(budget.get()))} {
+}
+
+AddressSpace::HashTables::HashTables(const HashTables& other, std::shared_ptr<MemoryBudget> budget)
+    : budget(budget), pageTable(other.pageTable, DescriptorMap::allocator_type(budget.get())),
+      blockTables{DescriptorMap(other.blockTables[0], DescriptorMap::allocator_type(budget.get())),
+                  DescriptorMap(other.blockTables[1], DescriptorMap::allocator_type(budget.get()))} {
+}
+
 // Constructor - initializes empty sparse page table
-AddressSpace::AddressSpace() {
+AddressSpace::AddressSpace()
+    : budget(MemoryBudget::defaultBudget()), hashTables(std::make_shared<HashTables>(budget)), granule(TranslationGranule::Size4KB),
+      pageShift(granuleShift(TranslationGranule::Size4KB)), dirtyTracking(false), dirtyEpochSlot(assignDirtyEpochSlot()) {
     // Empty sparse page table - no initialization required for std::unordered_map
     // This provides efficient O(1) average case lookups with minimal memory overhead
 }
 
+// Constructor - selects the page table storage and translation granule;
+// Hash with the 4KB granule matches the default constructor
+AddressSpace::AddressSpace(PageTableBackend backend, TranslationGranule granule,
+                           std::shared_ptr<MemoryBudget> budget)
+    : budget(budget), hashTables(std::make_shared<HashTables>(budget)),
+      radixTable(backend == PageTableBackend::Radix ? new RadixPageTable(granule) : nullptr),
+      extentTree(backend == PageTableBackend::Extent ? std::make_shared<ExtentTree>(granule) : nullptr),
+      granule(granule), pageShift(granuleShift(granule)), dirtyTracking(false),
+      dirtyEpochSlot(assignDirtyEpochSlot()) {
+}
+
 // Destructor - automatic cleanup via RAII
 AddressSpace::~AddressSpace() {
-    // std::unordered_map automatically cleans up all PageEntry objects
+    // std::unordered_map automatically cleans up all descriptors
     // No manual cleanup required due to RAII design
 }
 
-// Copy constructor - deep copy of page table for C++11 compliance
+// Copy constructor - O(1), sharing other's storage until either side
+// writes; the assignment takes other's lock so a concurrent writer cannot
+// tear the copy
 AddressSpace::AddressSpace(const AddressSpace& other) 
-    : pageTable(other.pageTable) {
-    // std::unordered_map copy constructor performs deep copy of all entries
-    // Each PageEntry is copied, maintaining independent page tables
+    : budget(other.budget), granule(other.granule), pageShift(other.pageShift), dirtyTracking(false),
+      dirtyEpochSlot(assignDirtyEpochSlot()) {
+    *this = other;
 }
 
-// Assignment operator - safe copy with self-assignment protection
+// Assignment operator - shares other's storage, with self-assignment protection
 AddressSpace& AddressSpace::operator=(const AddressSpace& other) {
     if (this != &other) {
-        pageTable = other.pageTable;  // Deep copy via map assignment
+        std::lock(tableMutex, other.tableMutex);
+        std::lock_guard<std::mutex> lock(tableMutex, std::adopt_lock);
+        std::lock_guard<std::mutex> otherLock(other.tableMutex, std::adopt_lock);
+        
+        hashTables = other.hashTables;
+        radixTable.reset(other.radixTable ? new RadixPageTable(*other.radixTable) : nullptr);  // Shares nodes
+        extentTree = other.extentTree;
+        granule = other.granule;
+        pageShift = other.pageShift;
+        dirtyTracking.store(other.dirtyTracking.load(std::memory_order_relaxed), std::memory_order_relaxed);
     }
     return *this;
 }
 
+std::shared_ptr<const AddressSpace> AddressSpace::snapshot() const {
+    return std::make_shared<const AddressSpace>(*this);
+}
+
 // Map a page with specified permissions
 // Implements sparse page table storage for ARM SMMU v3 address translation
 VoidResult AddressSpace::mapPage(IOVA iova, PA pa, const PagePermissions& permissions, SecurityState securityState) {
@@ -58,17 +124,36 @@ VoidResult AddressSpace::mapPage(IOVA iova, PA pa, const PagePermissions& permis
         return makeVoidError(SMMUError::InvalidSecurityState);
     }
     
+    std::lock_guard<std::mutex> lock(tableMutex);
+    unshareTables();
+    if (radixTable) {
+        radixTable->map(iova & ~granuleMask(), getGranuleSize(), PageDescriptor(pa & ~granuleMask(), permissions, securityState));
+        return makeVoidSuccess();
+    }
+    if (extentTree) {
+        extentTree->map(iova & ~granuleMask(), getGranuleSize(), PageEntry(pa & ~granuleMask(), permissions, securityState));
+        return makeVoidSuccess();
+    }
+    
+    if (hashTablesFull()) {
+        return makeVoidError(SMMUError::ResourceExhausted);
+    }
+    
     // Convert IOVA to page-aligned page number for sparse indexing
     uint64_t pageNum = pageNumber(iova);
     
-    // Create new page entry with physical address and permissions
+    // A page inside a block mapping replaces just that page of the block
+    if (hasBlocks()) {
+        splitCoveringBlocks(iova, getGranuleSize());
+    }
+    
+    // Create new page descriptor with physical address and permissions
     // ARM SMMU v3 spec: Each page entry contains PA, permissions, and validity
-    PageEntry entry(pa & ~PAGE_MASK, permissions, securityState);  // Align PA to page boundary
-    entry.valid = true;
+    PageDescriptor descriptor(pa & ~granuleMask(), permissions, securityState);  // Align PA to page boundary
     
     // Insert or update entry in sparse page table
     // Using [] operator allows both insertion and update operations
-    pageTable[pageNum] = entry;
+    hashTables->pageTable[pageNum] = descriptor;
     
     // Note: TLB cache integration is handled at higher levels (SMMU/StreamContext)
     // AddressSpace maintains the authoritative page table mapping
@@ -82,69 +167,193 @@ VoidResult AddressSpace::unmapPage(IOVA iova) {
         return makeVoidError(SMMUError::InvalidAddress);
     }
     
+    std::lock_guard<std::mutex> lock(tableMutex);
+    unshareTables();
+    if (radixTable) {
+        uint64_t mappingSize = getGranuleSize();
+        if (!radixTable->find(iova, mappingSize).isValid()) {
+            return makeVoidError(SMMUError::PageNotMapped);
+        }
+        radixTable->unmap(iova, iova | granuleMask());  // Splits a covering block
+        return makeVoidSuccess();
+    }
+    if (extentTree) {
+        if (extentTree->unmap(iova, iova) == 0) {  // Splits a covering extent
+            return makeVoidError(SMMUError::PageNotMapped);
+        }
+        return makeVoidSuccess();
+    }
+    
     uint64_t pageNum = pageNumber(iova);
     
+    // Unmapping one page of a block leaves the rest of the block mapped
+    if (hasBlocks()) {
+        splitCoveringBlocks(iova, getGranuleSize());
+    }
+    
     // Check if page is actually mapped before attempting to unmap
-    auto it = pageTable.find(pageNum);
-    if (it == pageTable.end() || !it->second.valid) {
+    auto it = hashTables->pageTable.find(pageNum);
+    if (it == hashTables->pageTable.end() || !it->second.isValid()) {
         // ARM SMMU v3 spec: Unmapping non-existent page can be considered an error
         return makeVoidError(SMMUError::PageNotMapped);
     }
     
     // Remove entry from sparse page table
     // ARM SMMU v3 spec: Unmapping should clean up translation state
-    pageTable.erase(pageNum);
+    hashTables->pageTable.erase(pageNum);
     
     // Note: TLB invalidation is coordinated at higher levels
     // AddressSpace focuses on maintaining authoritative mapping state
     return makeVoidSuccess();
 }
 
-// Translate virtual address to physical address with ARM SMMU v3 semantics
-TranslationResult AddressSpace::translatePage(IOVA iova, AccessType accessType, SecurityState securityState) const {
-    uint64_t pageNum = pageNumber(iova);
+// Map a level 1 or level 2 block of this granule with a single descriptor
+VoidResult AddressSpace::mapBlock(IOVA iova, PA pa, uint64_t blockSize, const PagePermissions& permissions, SecurityState securityState) {
+    if (blockSize == getGranuleSize()) {
+        return mapPage(iova, pa, permissions, securityState);
+    }
     
-    // Look up page entry in sparse page table
-    auto it = pageTable.find(pageNum);
-    if (it == pageTable.end()) {
-        // ARM SMMU v3 fault: Translation fault when no mapping exists
-        return makeTranslationError(FaultType::TranslationFault);
+    size_t level = BLOCK_LEVELS;
+    for (size_t candidate = 0; candidate < BLOCK_LEVELS; ++candidate) {
+        if (blockSizeForLevel(candidate) == blockSize) {
+            level = candidate;
+        }
+    }
+    if (level == BLOCK_LEVELS) {
+        return makeVoidError(SMMUError::InvalidAddress);  // Not a block size of this granule
     }
     
-    const PageEntry& entry = it->second;
+    // Block descriptors need input and output addresses aligned to the block size
+    if ((iova & (blockSize - 1)) != 0 || (pa & (blockSize - 1)) != 0) {
+        return makeVoidError(SMMUError::InvalidAddress);
+    }
+    if (iova > MAX_VIRTUAL_ADDRESS - (blockSize - 1) || pa > MAX_PHYSICAL_ADDRESS - (blockSize - 1)) {
+        return makeVoidError(SMMUError::InvalidAddress);
+    }
     
-    // Prefetch hint for likely next sequential page access
-    // This improves performance for sequential memory access patterns common in ARM SMMU v3
-#ifdef __GNUC__
-    auto nextIt = pageTable.find(pageNum + 1);
-    if (nextIt != pageTable.end()) {
-        __builtin_prefetch(&nextIt->second, 0, 1);  // Read prefetch with low temporal locality
+    if (!permissions.read && !permissions.write && !permissions.execute) {
+        return makeVoidError(SMMUError::InvalidPermissions);
     }
-#endif
     
-    // Verify page entry is valid
-    if (!entry.valid) {
-        return makeTranslationError(FaultType::TranslationFault);
+    if (securityState != SecurityState::NonSecure && 
+        securityState != SecurityState::Secure && 
+        securityState != SecurityState::Realm) {
+        return makeVoidError(SMMUError::InvalidSecurityState);
     }
     
-    // Security state validation - ensure page security matches request
-    if (entry.securityState != securityState) {
-        // Security fault: requested security state doesn't match page security state
-        return makeTranslationError(FaultType::SecurityFault);
+    std::lock_guard<std::mutex> lock(tableMutex);
+    unshareTables();
+    if (radixTable) {
+        radixTable->map(iova, blockSize, PageDescriptor(pa, permissions, securityState));
+        return makeVoidSuccess();
+    }
+    if (extentTree) {
+        extentTree->map(iova, blockSize, PageEntry(pa, permissions, securityState));
+        return makeVoidSuccess();
+    }
+    
+    if (hashTablesFull()) {
+        return makeVoidError(SMMUError::ResourceExhausted);
+    }
+    
+    // Keep mappings disjoint: carve the block out of any larger block, then
+    // drop the smaller mappings it replaces
+    splitCoveringBlocks(iova, blockSize);
+    eraseCoveredMappings(iova, level);
+    
+    hashTables->blockTables[level][iova >> blockShift(level)] = PageDescriptor(pa, permissions, securityState);
+    return makeVoidSuccess();
+}
+
+// Translate virtual address to physical address with ARM SMMU v3 semantics
+TranslationResult AddressSpace::translatePage(IOVA iova, AccessType accessType, SecurityState securityState) const {
+    uint64_t pageNum = pageNumber(iova);
+    uint64_t mappingSize = getGranuleSize();
+    PageDescriptor descriptor;
+    
+    if (radixTable) {
+        descriptor = radixTable->find(iova, mappingSize);  // Lock-free, epoch protected
+    } else {
+        // The hash maps and extent tree cannot be read during an update
+        std::lock_guard<std::mutex> lock(tableMutex);
+        if (extentTree) {
+            IOVA extentBase = 0;
+            uint64_t extentSize = 0;
+            const PageEntry* extent = extentTree->find(iova, extentBase, extentSize);
+            if (extent) {
+                // Report the largest block the extent covers whole with matching
+                // IOVA and PA alignment, so the TLB can cache it as one entry
+                size_t level = BLOCK_LEVELS;
+                while (level > 0) {
+                    --level;
+                    uint64_t candidate = blockSizeForLevel(level);
+                    IOVA candidateBase = iova & ~(candidate - 1);
+                    if (candidateBase >= extentBase && extentSize >= candidate &&
+                        candidateBase - extentBase <= extentSize - candidate &&
+                        ((extent->physicalAddress - extentBase) & (candidate - 1)) == 0) {
+                        mappingSize = candidate;
+                        break;
+                    }
+                }
+                descriptor = PageDescriptor(extent->physicalAddress + ((iova & ~(mappingSize - 1)) - extentBase),
+                                            extent->permissions, extent->securityState);
+            }
+        } else {
+            // Look up page entry in sparse page table
+            auto it = hashTables->pageTable.find(pageNum);
+            if (it != hashTables->pageTable.end()) {
+                descriptor = it->second;
+            
+                // Prefetch hint for likely next sequential page access
+                // This improves performance for sequential memory access patterns common in ARM SMMU v3
+#ifdef __GNUC__
+                auto nextIt = hashTables->pageTable.find(pageNum + 1);
+                if (nextIt != hashTables->pageTable.end()) {
+                    __builtin_prefetch(&nextIt->second, 0, 1);  // Read prefetch with low temporal locality
+                }
+#endif
+            } else if (hasBlocks()) {
+                descriptor = findMapping(iova, mappingSize);
+            }
+        }
     }
     
-    // Check access permissions according to ARM SMMU v3 specification
-    if (!checkPermissions(entry.permissions, accessType)) {
+    // Valid, matching security state and allowing the access: one mask test
+    // on the packed descriptor. Only a failing access pays for classifying
+    // the fault.
+    if (!descriptor.permits(accessType, securityState)) {
+        if (!descriptor.isValid()) {
+            // ARM SMMU v3 fault: Translation fault when no mapping exists
+            return makeTranslationError(FaultType::TranslationFault);
+        }
+        if (descriptor.getSecurityState() != securityState) {
+            // Security fault: requested security state doesn't match page security state
+            return makeTranslationError(FaultType::SecurityFault);
+        }
         // ARM SMMU v3 fault: Permission fault when access not allowed
         return makeTranslationError(FaultType::PermissionFault);
     }
     
-    // Successful translation - combine page PA with offset
-    uint64_t pageOffset = iova & PAGE_MASK;
-    PA translatedPA = entry.physicalAddress + pageOffset;
+    // Successful translation - combine page/block PA with offset
+    uint64_t pageOffset = iova & (mappingSize - 1);
+    PA translatedPA = descriptor.getPhysicalAddress() + pageOffset;
     
-    // Create successful translation result
-    return makeTranslationSuccess(translatedPA, entry.permissions, entry.securityState);
+    // Create successful translation result; the size lets the TLB cache whole blocks
+    TranslationData data(translatedPA, descriptor.getPermissions(), descriptor.getSecurityState(), mappingSize);
+    if (dirtyTracking.load(std::memory_order_relaxed)) {
+        data.dirtyEpoch = DIRTY_CLEAN;
+        if (accessType == AccessType::Write) {
+            // Read the epoch before marking: if a collection takes the bit
+            // in between, the epoch moves on and this result is already stale
+            data.dirtyEpoch = dirtyEpochStamp(dirtyEpochSlot);
+            if (mappingSize == getGranuleSize()) {
+                dirtyPages.set(pageNum);
+            } else {
+                dirtyPages.setRange((iova & ~(mappingSize - 1)) >> pageShift, mappingSize >> pageShift);
+            }
+        }
+    }
+    return TranslationResult(data);
 }
 
 // Query if a specific page is mapped
@@ -155,10 +364,12 @@ Result<bool> AddressSpace::isPageMapped(IOVA iova) const {
     }
     
     try {
-        uint64_t pageNum = pageNumber(iova);
-        auto it = pageTable.find(pageNum);
-        bool mapped = (it != pageTable.end() && it->second.valid);
-        return Result<bool>(mapped);
+        std::unique_lock<std::mutex> lock(tableMutex, std::defer_lock);
+        if (!radixTable) {
+            lock.lock();
+        }
+        uint64_t mappingSize = getGranuleSize();
+        return Result<bool>(findMapping(iova, mappingSize).isValid());
     } catch (...) {
         return makeError<bool>(SMMUError::InternalError);
     }
@@ -172,11 +383,15 @@ Result<PagePermissions> AddressSpace::getPagePermissions(IOVA iova) const {
     }
     
     try {
-        uint64_t pageNum = pageNumber(iova);
-        auto it = pageTable.find(pageNum);
+        std::unique_lock<std::mutex> lock(tableMutex, std::defer_lock);
+        if (!radixTable) {
+            lock.lock();
+        }
+        uint64_t mappingSize = getGranuleSize();
+        PageDescriptor mapping = findMapping(iova, mappingSize);
         
-        if (it != pageTable.end() && it->second.valid) {
-            return Result<PagePermissions>(it->second.permissions);
+        if (mapping.isValid()) {
+            return Result<PagePermissions>(mapping.getPermissions());
         }
         
         // Page not mapped
@@ -189,10 +404,18 @@ Result<PagePermissions> AddressSpace::getPagePermissions(IOVA iova) const {
 // Get count of mapped pages for statistics and management
 Result<size_t> AddressSpace::getPageCount() const {
     try {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        if (radixTable) {
+            return Result<size_t>(static_cast<size_t>(radixTable->getPageCount()));  // Maintained on map/unmap
+        }
+        if (extentTree) {
+            return Result<size_t>(static_cast<size_t>(extentTree->getPageCount()));
+        }
+        
         // Count only valid entries in sparse page table
         size_t count = 0;
-        for (const auto& pair : pageTable) {
-            if (pair.second.valid) {
+        for (const auto& pair : hashTables->pageTable) {
+            if (pair.second.isValid()) {
                 count++;
                 // Check for potential overflow
                 if (count == SIZE_MAX) {
@@ -200,6 +423,16 @@ Result<size_t> AddressSpace::getPageCount() const {
                 }
             }
         }
+        
+        // Blocks count as the granule pages they cover
+        for (size_t level = 0; level < BLOCK_LEVELS; ++level) {
+            size_t pagesPerBlock = static_cast<size_t>(blockSizeForLevel(level) / getGranuleSize());
+            for (const auto& pair : hashTables->blockTables[level]) {
+                if (pair.second.isValid()) {
+                    count += pagesPerBlock;
+                }
+            }
+        }
         return Result<size_t>(count);
     } catch (...) {
         return makeError<size_t>(SMMUError::InternalError);
@@ -210,7 +443,16 @@ Result<size_t> AddressSpace::getPageCount() const {
 VoidResult AddressSpace::clear() {
     // Clear entire sparse page table
     // ARM SMMU v3 spec: Complete invalidation of translation context
-    pageTable.clear();
+    // Fresh storage rather than emptied storage, so copies sharing the old
+    // tables keep their mappings
+    std::lock_guard<std::mutex> lock(tableMutex);
+    hashTables = std::make_shared<HashTables>(budget);
+    if (radixTable) {
+        radixTable->clear();
+    }
+    if (extentTree) {
+        extentTree = std::make_shared<ExtentTree>(granule);
+    }
     
     // Clear operation should always succeed for in-memory data structures
     return makeVoidSuccess();
@@ -231,6 +473,46 @@ void AddressSpace::invalidatePage(IOVA iova) {
     (void)iova;  // Suppress unused parameter warning in C++11
 }
 
+void AddressSpace::setDirtyTracking(bool enabled) {
+    dirtyTracking.store(enabled, std::memory_order_relaxed);
+}
+
+bool AddressSpace::isDirtyTrackingEnabled() const {
+    return dirtyTracking.load(std::memory_order_relaxed);
+}
+
+// Takes no lock: translations keep marking pages while the bits are collected
+Result<std::vector<uint64_t>> AddressSpace::getAndClearDirtyBitmap(IOVA startIova, IOVA endIova) {
+    if (endIova < startIova || endIova > MAX_VIRTUAL_ADDRESS) {
+        return makeError<std::vector<uint64_t>>(SMMUError::InvalidAddress);
+    }
+    uint64_t firstPage = startIova >> pageShift;
+    uint64_t pageCount = (endIova >> pageShift) - firstPage + 1;
+    if (pageCount > MAX_DIRTY_BITMAP_PAGES) {
+        return makeError<std::vector<uint64_t>>(SMMUError::InvalidAddress);
+    }
+    
+    std::vector<uint64_t> bitmap = dirtyPages.collect(firstPage, pageCount);
+    
+    // A cached translation stamped with the current epoch may have had its
+    // page's bit taken just now; moving the epoch on makes its next write walk
+    for (size_t i = 0; i < bitmap.size(); ++i) {
+        if (bitmap[i] != 0) {
+            dirtyLogEpochs[dirtyEpochSlot].fetch_add(1);
+            break;
+        }
+    }
+    return Result<std::vector<uint64_t>>(std::move(bitmap));
+}
+
+uint64_t AddressSpace::getDirtyLogEpoch() const {
+    return dirtyEpochStamp(dirtyEpochSlot);
+}
+
+bool AddressSpace::isDirtyLogEpochCurrent(uint64_t dirtyEpoch) {
+    return dirtyEpoch != DIRTY_CLEAN && dirtyEpoch == dirtyEpochStamp(dirtyEpoch >> DIRTY_EPOCH_SHIFT);
+}
+
 // Map an address range with contiguous physical addresses
 // ARM SMMU v3 spec: Efficient mapping of large contiguous regions
 VoidResult AddressSpace::mapRange(IOVA startIova, IOVA endIova, PA startPa, const PagePermissions& permissions) {
@@ -261,25 +543,58 @@ VoidResult AddressSpace::mapRange(IOVA startIova, IOVA endIova, PA startPa, cons
     }
     
     // Align start addresses to page boundaries
-    IOVA alignedStartIova = startIova & ~PAGE_MASK;
-    PA alignedStartPa = startPa & ~PAGE_MASK;
+    IOVA alignedStartIova = startIova & ~granuleMask();
+    PA alignedStartPa = startPa & ~granuleMask();
     
-    // Calculate range in pages, ensuring we cover the entire requested range
-    uint64_t startPageNum = pageNumber(alignedStartIova);
-    uint64_t endPageNum = pageNumber(endIova);
+    std::lock_guard<std::mutex> lock(tableMutex);
+    unshareTables();
+    
+    // One extent covers the whole range, whatever its length
+    if (extentTree) {
+        extentTree->map(alignedStartIova, (endIova | granuleMask()) - alignedStartIova + 1,
+                        PageEntry(alignedStartPa, permissions));
+        return makeVoidSuccess();
+    }
+    if (hashTablesFull()) {
+        return makeVoidError(SMMUError::ResourceExhausted);
+    }
     
-    // Map each page in the range with contiguous physical addresses
+    // Walk the range, using the largest block whose IOVA and PA are both
+    // aligned and which fits in what is left; the ragged ends become pages
+    IOVA currentIova = alignedStartIova;
     PA currentPa = alignedStartPa;
-    for (uint64_t pageNum = startPageNum; pageNum <= endPageNum; ++pageNum) {
-        // Create page entry with current physical address and permissions
-        PageEntry entry(currentPa, permissions);
-        entry.valid = true;
-        
-        // Insert into sparse page table
-        pageTable[pageNum] = entry;
+    while (currentIova <= endIova) {
+        uint64_t remaining = endIova - currentIova + 1;
+        uint64_t chunkSize = getGranuleSize();
+        size_t level = BLOCK_LEVELS;
+        while (level > 0) {
+            --level;
+            uint64_t candidate = blockSizeForLevel(level);
+            if (((currentIova | currentPa) & (candidate - 1)) == 0 && remaining >= candidate) {
+                chunkSize = candidate;
+                break;
+            }
+        }
+    
+        if (radixTable) {
+            radixTable->map(currentIova, chunkSize, PageDescriptor(currentPa, permissions));
+        } else if (chunkSize == getGranuleSize()) {
+            if (hasBlocks()) {
+                splitCoveringBlocks(currentIova, getGranuleSize());
+            }
+            hashTables->pageTable[pageNumber(currentIova)] = PageDescriptor(currentPa, permissions);
+        } else {
+            splitCoveringBlocks(currentIova, chunkSize);
+            eraseCoveredMappings(currentIova, level);
+            hashTables->blockTables[level][currentIova >> blockShift(level)] = PageDescriptor(currentPa, permissions);
+        }
         
-        // Advance to next page physical address
-        currentPa += PAGE_SIZE;
+        // Advance, stopping if the address space wraps
+        if (currentIova + chunkSize < currentIova) {
+            break;
+        }
+        currentIova += chunkSize;
+        currentPa += chunkSize;
     }
     
     return makeVoidSuccess();
@@ -298,30 +613,51 @@ VoidResult AddressSpace::unmapRange(IOVA startIova, IOVA endIova) {
         return makeVoidError(SMMUError::InvalidAddress);
     }
     
-    // Calculate page numbers for the range
-    uint64_t startPageNum = pageNumber(startIova);
-    uint64_t endPageNum = pageNumber(endIova);
+    std::lock_guard<std::mutex> lock(tableMutex);
     
     // Check if any pages in the range are actually mapped
-    bool anyMapped = false;
-    for (uint64_t pageNum = startPageNum; pageNum <= endPageNum; ++pageNum) {
-        auto it = pageTable.find(pageNum);
-        if (it != pageTable.end() && it->second.valid) {
-            anyMapped = true;
-            break;
-        }
-    }
-    
-    if (!anyMapped) {
+    if (!hasMappingsIn(startIova, endIova)) {
         // ARM SMMU v3 spec: Unmapping non-existent pages can be considered an error
         return makeVoidError(SMMUError::PageNotMapped);
     }
     
-    // Unmap each page in the range
-    for (uint64_t pageNum = startPageNum; pageNum <= endPageNum; ++pageNum) {
-        pageTable.erase(pageNum);
+    unshareTables();
+    if (radixTable) {
+        radixTable->unmap(startIova, endIova);
+        return makeVoidSuccess();
+    }
+    if (extentTree) {
+        extentTree->unmap(startIova, endIova);
+        return makeVoidSuccess();
+    }
+    
+    // Blocks fully inside the range go whole; blocks straddling an end are
+    // split and their pieces handled at the next level down
+    IOVA firstPage = startIova & ~granuleMask();
+    IOVA lastByte = endIova | granuleMask();
+    size_t level = BLOCK_LEVELS;
+    while (level > 0) {
+        --level;
+        unsigned shift = blockShift(level);
+        std::vector<uint64_t> overlapping;
+        for (const auto& pair : hashTables->blockTables[level]) {
+            if (pair.first >= (firstPage >> shift) && pair.first <= (lastByte >> shift)) {
+                overlapping.push_back(pair.first);
+            }
+        }
+        for (size_t i = 0; i < overlapping.size(); ++i) {
+            IOVA blockStart = overlapping[i] << shift;
+            IOVA blockEnd = blockStart + blockSizeForLevel(level) - 1;
+            if (blockStart >= firstPage && blockEnd <= lastByte) {
+                hashTables->blockTables[level].erase(overlapping[i]);
+            } else {
+                splitBlock(level, overlapping[i]);
+            }
+        }
     }
     
+    erasePages(pageNumber(startIova), pageNumber(endIova));
+    
     return makeVoidSuccess();
 }
 
@@ -333,9 +669,17 @@ VoidResult AddressSpace::mapPages(const std::vector<std::pair<IOVA, PA>>& mappin
         return makeVoidError(SMMUError::InvalidPermissions);
     }
     
+    std::lock_guard<std::mutex> lock(tableMutex);
+    unshareTables();
+    if (hashTablesFull()) {
+        return makeVoidError(SMMUError::ResourceExhausted);
+    }
+    
     // Optimize hash table capacity for bulk insertion
     // Reserve space to avoid rehashing during bulk operations
-    pageTable.reserve(pageTable.size() + mappings.size());
+    if (!radixTable && !extentTree) {
+        hashTables->pageTable.reserve(hashTables->pageTable.size() + mappings.size());
+    }
     
     // Validate all mappings before processing any
     for (const auto& mapping : mappings) {
@@ -368,12 +712,21 @@ VoidResult AddressSpace::mapPages(const std::vector<std::pair<IOVA, PA>>& mappin
         
         // Convert to page number and align physical address
         uint64_t pageNum = pageNumber(iova);
-        PA alignedPa = pa & ~PAGE_MASK;
+        PA alignedPa = pa & ~granuleMask();
+        if (radixTable) {
+            radixTable->map(iova & ~granuleMask(), getGranuleSize(), PageDescriptor(alignedPa, permissions));
+            continue;
+        }
+        if (extentTree) {
+            extentTree->map(iova & ~granuleMask(), getGranuleSize(), PageEntry(alignedPa, permissions));
+            continue;
+        }
+        if (hasBlocks()) {
+            splitCoveringBlocks(iova, getGranuleSize());
+        }
         
-        // Create and insert page entry
-        PageEntry entry(alignedPa, permissions);
-        entry.valid = true;
-        pageTable[pageNum] = entry;
+        // Create and insert page descriptor
+        hashTables->pageTable[pageNum] = PageDescriptor(alignedPa, permissions);
     }
     
     return makeVoidSuccess();
@@ -390,12 +743,13 @@ VoidResult AddressSpace::unmapPages(const std::vector<IOVA>& iovas) {
         }
     }
     
+    std::lock_guard<std::mutex> lock(tableMutex);
+    
     // Check if at least some of the pages are actually mapped
     bool anyMapped = false;
     for (IOVA iova : iovas) {
-        uint64_t pageNum = pageNumber(iova);
-        auto it = pageTable.find(pageNum);
-        if (it != pageTable.end() && it->second.valid) {
+        uint64_t mappingSize = getGranuleSize();
+        if (findMapping(iova, mappingSize).isValid()) {
             anyMapped = true;
             break;
         }
@@ -405,6 +759,7 @@ VoidResult AddressSpace::unmapPages(const std::vector<IOVA>& iovas) {
         // ARM SMMU v3 spec: Unmapping non-existent pages can be considered an error
         return makeVoidError(SMMUError::PageNotMapped);
     }
+    unshareTables();
     
     // All validation passed - now unmap all pages with prefetching
     for (size_t i = 0; i < iovas.size(); ++i) {
@@ -417,8 +772,19 @@ VoidResult AddressSpace::unmapPages(const std::vector<IOVA>& iovas) {
         }
 #endif
         
+        if (radixTable) {
+            radixTable->unmap(iova, iova | granuleMask());
+            continue;
+        }
+        if (extentTree) {
+            extentTree->unmap(iova, iova);
+            continue;
+        }
+        if (hasBlocks()) {
+            splitCoveringBlocks(iova, getGranuleSize());
+        }
         uint64_t pageNum = pageNumber(iova);
-        pageTable.erase(pageNum);
+        hashTables->pageTable.erase(pageNum);
     }
     
     return makeVoidSuccess();
@@ -427,45 +793,56 @@ VoidResult AddressSpace::unmapPages(const std::vector<IOVA>& iovas) {
 // Get all mapped address ranges in sorted order
 // ARM SMMU v3 spec: Address space introspection for management
 std::vector<AddressRange> AddressSpace::getMappedRanges() const {
-    std::vector<AddressRange> ranges;
-    
-    if (pageTable.empty()) {
-        return ranges;  // No mappings exist
+    std::lock_guard<std::mutex> lock(tableMutex);
+    if (radixTable) {
+        return radixTable->getMappedRanges();  // Table order is address order
+    }
+    if (extentTree) {
+        return extentTree->getMappedRanges();
     }
     
-    // Collect all valid page numbers and sort them
-    std::vector<uint64_t> sortedPageNums;
-    sortedPageNums.reserve(pageTable.size());
+    std::vector<AddressRange> ranges;
+    
+    // Collect every valid mapping as a (start, size) interval and sort them
+    std::vector<std::pair<IOVA, uint64_t>> mappings;
+    mappings.reserve(hashTables->pageTable.size());
     
-    for (const auto& pair : pageTable) {
-        if (pair.second.valid) {
-            sortedPageNums.push_back(pair.first);
+    for (const auto& pair : hashTables->pageTable) {
+        if (pair.second.isValid()) {
+            mappings.push_back(std::make_pair(pair.first << pageShift, getGranuleSize()));
+        }
+    }
+    for (size_t level = 0; level < BLOCK_LEVELS; ++level) {
+        for (const auto& pair : hashTables->blockTables[level]) {
+            if (pair.second.isValid()) {
+                mappings.push_back(std::make_pair(pair.first << blockShift(level), blockSizeForLevel(level)));
+            }
         }
     }
     
-    // Sort page numbers for range consolidation (C++11 compatible)
-    std::sort(sortedPageNums.begin(), sortedPageNums.end());
+    // Sort by start address for range consolidation (C++11 compatible)
+    std::sort(mappings.begin(), mappings.end());
     
-    if (sortedPageNums.empty()) {
+    if (mappings.empty()) {
         return ranges;  // No valid mappings
     }
     
-    // Consolidate consecutive pages into ranges
-    IOVA rangeStart = sortedPageNums[0] << 12;  // Convert page number to address
-    IOVA rangeEnd = rangeStart + PAGE_SIZE - 1;
+    // Consolidate consecutive mappings into ranges
+    IOVA rangeStart = mappings[0].first;
+    IOVA rangeEnd = rangeStart + mappings[0].second - 1;
     
-    for (size_t i = 1; i < sortedPageNums.size(); ++i) {
-        IOVA currentPageAddr = sortedPageNums[i] << 12;
+    for (size_t i = 1; i < mappings.size(); ++i) {
+        IOVA currentAddr = mappings[i].first;
         
-        // Check if this page is consecutive with current range
-        if (currentPageAddr == rangeEnd + 1) {
+        // Check if this mapping is consecutive with current range
+        if (currentAddr == rangeEnd + 1) {
             // Extend current range
-            rangeEnd = currentPageAddr + PAGE_SIZE - 1;
+            rangeEnd = currentAddr + mappings[i].second - 1;
         } else {
-            // Non-consecutive page - complete current range and start new one
+            // Gap - complete current range and start new one
             ranges.push_back(AddressRange(rangeStart, rangeEnd));
-            rangeStart = currentPageAddr;
-            rangeEnd = rangeStart + PAGE_SIZE - 1;
+            rangeStart = currentAddr;
+            rangeEnd = rangeStart + mappings[i].second - 1;
         }
     }
     
@@ -478,24 +855,38 @@ std::vector<AddressRange> AddressSpace::getMappedRanges() const {
 // Get total address space size covered by mappings
 // ARM SMMU v3 spec: Address space utilization metrics
 uint64_t AddressSpace::getAddressSpaceSize() const {
-    if (pageTable.empty()) {
-        return 0;
+    std::lock_guard<std::mutex> lock(tableMutex);
+    if (radixTable) {
+        IOVA lowest = 0;
+        IOVA highest = 0;
+        return radixTable->getBounds(lowest, highest) ? highest - lowest + 1 : 0;
+    }
+    if (extentTree) {
+        IOVA lowest = 0;
+        IOVA highest = 0;
+        return extentTree->getBounds(lowest, highest) ? highest - lowest + 1 : 0;
     }
     
-    // Find minimum and maximum page numbers with valid entries
-    uint64_t minPageNum = UINT64_MAX;
-    uint64_t maxPageNum = 0;
+    // Find lowest and highest mapped addresses across pages and blocks
+    uint64_t minAddress = UINT64_MAX;
+    uint64_t maxAddress = 0;
     bool hasValidEntries = false;
     
-    for (const auto& pair : pageTable) {
-        if (pair.second.valid) {
+    for (const auto& pair : hashTables->pageTable) {
+        if (pair.second.isValid()) {
             hasValidEntries = true;
-            uint64_t pageNum = pair.first;
-            if (pageNum < minPageNum) {
-                minPageNum = pageNum;
-            }
-            if (pageNum > maxPageNum) {
-                maxPageNum = pageNum;
+            uint64_t start = pair.first << pageShift;
+            minAddress = std::min(minAddress, start);
+            maxAddress = std::max(maxAddress, start + getGranuleSize() - 1);
+        }
+    }
+    for (size_t level = 0; level < BLOCK_LEVELS; ++level) {
+        for (const auto& pair : hashTables->blockTables[level]) {
+            if (pair.second.isValid()) {
+                hasValidEntries = true;
+                uint64_t start = pair.first << blockShift(level);
+                minAddress = std::min(minAddress, start);
+                maxAddress = std::max(maxAddress, start + blockSizeForLevel(level) - 1);
             }
         }
     }
@@ -504,29 +895,58 @@ uint64_t AddressSpace::getAddressSpaceSize() const {
         return 0;
     }
     
-    // Calculate address space size from min to max page
-    uint64_t minAddress = minPageNum << 12;
-    uint64_t maxAddress = (maxPageNum << 12) + PAGE_SIZE - 1;
-    
     return maxAddress - minAddress + 1;
 }
 
 // Check for overlapping mappings in specified range
 // ARM SMMU v3 spec: Conflict detection for mapping operations
 bool AddressSpace::hasOverlappingMappings(IOVA startIova, IOVA endIova) const {
+    std::lock_guard<std::mutex> lock(tableMutex);
+    return hasMappingsIn(startIova, endIova);
+}
+
+// hasOverlappingMappings with tableMutex already held
+bool AddressSpace::hasMappingsIn(IOVA startIova, IOVA endIova) const {
     // Validate input parameters
     if (endIova < startIova) {
         return false;  // Invalid range
     }
     
+    if (radixTable) {
+        return radixTable->hasMappings(startIova, endIova);
+    }
+    if (extentTree) {
+        return extentTree->hasMappings(startIova, endIova);
+    }
+    
     // Calculate page numbers for the range
     uint64_t startPageNum = pageNumber(startIova);
     uint64_t endPageNum = pageNumber(endIova);
     
+    // Blocks are few; check each one against the range
+    for (size_t level = 0; level < BLOCK_LEVELS; ++level) {
+        unsigned shift = blockShift(level);
+        for (const auto& pair : hashTables->blockTables[level]) {
+            if (pair.second.isValid() && pair.first >= (startIova >> shift) && pair.first <= (endIova >> shift)) {
+                return true;
+            }
+        }
+    }
+    
+    // Scan whichever is smaller - the range or the page table
+    if (endPageNum - startPageNum >= hashTables->pageTable.size()) {
+        for (const auto& pair : hashTables->pageTable) {
+            if (pair.second.isValid() && pair.first >= startPageNum && pair.first <= endPageNum) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
     // Check each page in the range for existing mappings
     for (uint64_t pageNum = startPageNum; pageNum <= endPageNum; ++pageNum) {
-        auto it = pageTable.find(pageNum);
-        if (it != pageTable.end() && it->second.valid) {
+        auto it = hashTables->pageTable.find(pageNum);
+        if (it != hashTables->pageTable.end() && it->second.isValid()) {
             return true;  // Found overlapping mapping
         }
     }
@@ -560,31 +980,163 @@ void AddressSpace::invalidateAll() {
     // commands through the SMMU controller interface
 }
 
-// Convert IOVA to page number for sparse indexing
-// ARM SMMU v3 spec: 4KB page granularity with 64-bit address space
-uint64_t AddressSpace::pageNumber(IOVA iova) const {
-    // Right shift by page size bits (12 for 4KB pages)
-    // This provides efficient sparse indexing for large address spaces
-    return iova >> 12;  // PAGE_SIZE = 4096 = 2^12
+PageTableBackend AddressSpace::getPageTableBackend() const {
+    if (extentTree) {
+        return PageTableBackend::Extent;
+    }
+    return radixTable ? PageTableBackend::Radix : PageTableBackend::Hash;
 }
 
-// Check if requested access type is permitted by page permissions
-// ARM SMMU v3 specification permission checking semantics
-bool AddressSpace::checkPermissions(const PagePermissions& perms, AccessType accessType) const {
-    switch (accessType) {
-        case AccessType::Read:
-            return perms.read;
-            
-        case AccessType::Write:
-            return perms.write;
-            
-        case AccessType::Execute:
-            return perms.execute;
-            
-        default:
-            // Unknown access type - deny by default for security
-            return false;
+TranslationGranule AddressSpace::getGranule() const {
+    return granule;
+}
+
+uint64_t AddressSpace::getGranuleSize() const {
+    return 1ULL << pageShift;
+}
+
+uint64_t AddressSpace::granuleMask() const {
+    return (1ULL << pageShift) - 1;
+}
+
+// Block level helpers: level 0 holds translation table level 2 blocks
+// (2MB/32MB/512MB), level 1 holds level 1 blocks (1GB/64GB/4TB)
+unsigned AddressSpace::blockShift(size_t level) const {
+    return pageShift + (pageShift - 3) * static_cast<unsigned>(level + 1);
+}
+
+uint64_t AddressSpace::blockSizeForLevel(size_t level) const {
+    return 1ULL << blockShift(level);
+}
+
+// Copy the Hash or Extent storage before changing it if a copy of this
+// space still shares it. Radix tables unshare node by node themselves.
+void AddressSpace::unshareTables() {
+    if (extentTree) {
+        if (extentTree.use_count() > 1) {
+            extentTree = std::make_shared<ExtentTree>(*extentTree);
+        }
+    } else if (!radixTable && hashTables.use_count() > 1) {
+        hashTables = std::make_shared<HashTables>(*hashTables, budget);
+    }
+    // A count of one may come from a copy that just let go of the storage
+    // under its own lock; order its last reads before our writes
+    std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+bool AddressSpace::hasBlocks() const {
+    return !hashTables->blockTables[0].empty() || !hashTables->blockTables[1].empty();
+}
+
+// Hash backend mappings take no new descriptors once the memory budget is spent
+bool AddressSpace::hashTablesFull() const {
+    return !radixTable && !extentTree && budget->isExhausted();
+}
+
+// Find the page or block mapping covering iova; mappings never overlap.
+// An invalid descriptor means nothing is mapped there. Callers hold
+// tableMutex unless the backend is Radix.
+PageDescriptor AddressSpace::findMapping(IOVA iova, uint64_t& mappingSize) const {
+    if (radixTable) {
+        return radixTable->find(iova, mappingSize);
+    }
+    if (extentTree) {
+        IOVA extentBase = 0;
+        const PageEntry* extent = extentTree->find(iova, extentBase, mappingSize);  // mappingSize: the whole extent
+        return extent ? PageDescriptor(*extent) : PageDescriptor();
+    }
+    
+    auto it = hashTables->pageTable.find(pageNumber(iova));
+    if (it != hashTables->pageTable.end()) {
+        mappingSize = getGranuleSize();
+        return it->second;
+    }
+    
+    for (size_t level = 0; level < BLOCK_LEVELS; ++level) {
+        auto blockIt = hashTables->blockTables[level].find(iova >> blockShift(level));
+        if (blockIt != hashTables->blockTables[level].end()) {
+            mappingSize = blockSizeForLevel(level);
+            return blockIt->second;
+        }
+    }
+    return PageDescriptor();
+}
+
+// Replace one block with the table of next-smaller mappings covering the same range
+void AddressSpace::splitBlock(size_t level, uint64_t blockNum) {
+    auto it = hashTables->blockTables[level].find(blockNum);
+    if (it == hashTables->blockTables[level].end()) {
+        return;
+    }
+    
+    PageDescriptor block = it->second;
+    hashTables->blockTables[level].erase(it);
+    
+    IOVA base = blockNum << blockShift(level);
+    uint64_t childSize = level == 0 ? getGranuleSize() : blockSizeForLevel(level - 1);
+    uint64_t childCount = blockSizeForLevel(level) / childSize;
+    if (level == 0) {
+        hashTables->pageTable.reserve(hashTables->pageTable.size() + childCount);
+    }
+    
+    for (uint64_t i = 0; i < childCount; ++i) {
+        PageDescriptor child = block.offsetBy(i * childSize);
+        IOVA childIova = base + i * childSize;
+        if (level == 0) {
+            hashTables->pageTable[pageNumber(childIova)] = child;
+        } else {
+            hashTables->blockTables[level - 1][childIova >> blockShift(level - 1)] = child;
+        }
+    }
+}
+
+// Split every block larger than mappingSize that covers iova, largest first
+void AddressSpace::splitCoveringBlocks(IOVA iova, uint64_t mappingSize) {
+    size_t level = BLOCK_LEVELS;
+    while (level > 0) {
+        --level;
+        if (blockSizeForLevel(level) > mappingSize) {
+            splitBlock(level, iova >> blockShift(level));
+        }
+    }
+}
+
+// Drop pages and smaller blocks lying inside the block at base
+void AddressSpace::eraseCoveredMappings(IOVA base, size_t level) {
+    IOVA end = base + blockSizeForLevel(level) - 1;
+    for (size_t lower = 0; lower < level; ++lower) {
+        unsigned shift = blockShift(lower);
+        for (uint64_t blockNum = base >> shift; blockNum <= (end >> shift); ++blockNum) {
+            hashTables->blockTables[lower].erase(blockNum);
+        }
+    }
+    erasePages(pageNumber(base), pageNumber(end));
+}
+
+// Erase pages in [startPageNum, endPageNum], walking whichever is smaller
+void AddressSpace::erasePages(uint64_t startPageNum, uint64_t endPageNum) {
+    if (endPageNum - startPageNum >= hashTables->pageTable.size()) {
+        for (auto it = hashTables->pageTable.begin(); it != hashTables->pageTable.end(); ) {
+            if (it->first >= startPageNum && it->first <= endPageNum) {
+                it = hashTables->pageTable.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return;
     }
+    
+    for (uint64_t pageNum = startPageNum; pageNum <= endPageNum; ++pageNum) {
+        hashTables->pageTable.erase(pageNum);
+    }
+}
+
+// Convert IOVA to page number for sparse indexing
+// ARM SMMU v3 spec: one entry per 4KB, 16KB or 64KB granule page
+uint64_t AddressSpace::pageNumber(IOVA iova) const {
+    // Right shift by page size bits (12, 14 or 16)
+    // This provides efficient sparse indexing for large address spaces
+    return iova >> pageShift;
 }
 
 } // namespace smmu
\ No newline at end of file
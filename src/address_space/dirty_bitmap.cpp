@@ -0,0 +1,201 @@
+// ARM SMMU v3 Dirty Page Bitmap Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/dirty_bitmap.h"
+
+namespace smmu {
+
+const unsigned DirtyBitmap::PAGE_NUMBER_BITS;
+
+DirtyBitmap::Leaf::Leaf() {
+    for (size_t i = 0; i < LEAF_WORDS; ++i) {
+        words[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+DirtyBitmap::Middle::Middle() {
+    for (size_t i = 0; i < (static_cast<size_t>(1) << MIDDLE_BITS); ++i) {
+        leaves[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+DirtyBitmap::Middle::~Middle() {
+    for (size_t i = 0; i < (static_cast<size_t>(1) << MIDDLE_BITS); ++i) {
+        delete leaves[i].load(std::memory_order_relaxed);
+    }
+}
+
+DirtyBitmap::Root::Root() {
+    for (size_t i = 0; i < (static_cast<size_t>(1) << ROOT_BITS); ++i) {
+        middles[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+DirtyBitmap::Root::~Root() {
+    for (size_t i = 0; i < (static_cast<size_t>(1) << ROOT_BITS); ++i) {
+        delete middles[i].load(std::memory_order_relaxed);
+    }
+}
+
+DirtyBitmap::DirtyBitmap() : root(nullptr) {
+}
+
+DirtyBitmap::~DirtyBitmap() {
+    delete root.load(std::memory_order_relaxed);
+}
+
+namespace {
+
+// Install a freshly built node unless another thread got there first
+template <typename T>
+T* installNode(std::atomic<T*>& slot) {
+    T* node = slot.load(std::memory_order_acquire);
+    if (node) {
+        return node;
+    }
+    T* created = new T();
+    if (slot.compare_exchange_strong(node, created, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        return created;
+    }
+    delete created;
+    return node;
+}
+
+// Bits of the 64-page word starting at wordBase that fall in [first, end)
+uint64_t wordMask(uint64_t wordBase, uint64_t first, uint64_t end) {
+    uint64_t mask = ~0ULL;
+    if (wordBase < first) {
+        mask &= ~0ULL << (first - wordBase);
+    }
+    if (wordBase + 64 > end) {
+        mask &= ~0ULL >> (wordBase + 64 - end);
+    }
+    return mask;
+}
+
+} // anonymous namespace
+
+DirtyBitmap::Leaf* DirtyBitmap::findLeaf(uint64_t page) const {
+    Root* rootNode = root.load(std::memory_order_acquire);
+    if (!rootNode) {
+        return nullptr;
+    }
+    Middle* middle = rootNode->middles[page >> (LEAF_BITS + MIDDLE_BITS)].load(std::memory_order_acquire);
+    if (!middle) {
+        return nullptr;
+    }
+    return middle->leaves[(page >> LEAF_BITS) & ((1ULL << MIDDLE_BITS) - 1)].load(std::memory_order_acquire);
+}
+
+DirtyBitmap::Leaf* DirtyBitmap::leafForWrite(uint64_t page) {
+    Root* rootNode = installNode(root);
+    Middle* middle = installNode(rootNode->middles[page >> (LEAF_BITS + MIDDLE_BITS)]);
+    return installNode(middle->leaves[(page >> LEAF_BITS) & ((1ULL << MIDDLE_BITS) - 1)]);
+}
+
+void DirtyBitmap::set(uint64_t page) {
+    page &= (1ULL << PAGE_NUMBER_BITS) - 1;
+    Leaf* leaf = findLeaf(page);
+    if (!leaf) {
+        leaf = leafForWrite(page);
+    }
+    
+    // Pages written repeatedly only read the shared word
+    std::atomic<uint64_t>& word = leaf->words[(page >> 6) & (LEAF_WORDS - 1)];
+    uint64_t bit = 1ULL << (page & 63);
+    if ((word.load() & bit) == 0) {
+        word.fetch_or(bit);
+    }
+}
+
+void DirtyBitmap::setRange(uint64_t firstPage, uint64_t pageCount) {
+    if (pageCount == 0 || firstPage >= (1ULL << PAGE_NUMBER_BITS)) {
+        return;
+    }
+    uint64_t endPage = firstPage + pageCount;
+    if (endPage > (1ULL << PAGE_NUMBER_BITS) || endPage < firstPage) {
+        endPage = 1ULL << PAGE_NUMBER_BITS;
+    }
+    
+    for (uint64_t page = firstPage; page < endPage;) {
+        uint64_t leafEnd = (page | ((1ULL << LEAF_BITS) - 1)) + 1;
+        if (leafEnd > endPage) {
+            leafEnd = endPage;
+        }
+        Leaf* leaf = leafForWrite(page);
+        for (uint64_t wordBase = page & ~63ULL; wordBase < leafEnd; wordBase += 64) {
+            std::atomic<uint64_t>& word = leaf->words[(wordBase >> 6) & (LEAF_WORDS - 1)];
+            uint64_t mask = wordMask(wordBase, page, leafEnd);
+            if ((word.load() & mask) != mask) {
+                word.fetch_or(mask);
+            }
+        }
+        page = leafEnd;
+    }
+}
+
+bool DirtyBitmap::test(uint64_t page) const {
+    page &= (1ULL << PAGE_NUMBER_BITS) - 1;
+    Leaf* leaf = findLeaf(page);
+    return leaf && (leaf->words[(page >> 6) & (LEAF_WORDS - 1)].load() & (1ULL << (page & 63))) != 0;
+}
+
+std::vector<uint64_t> DirtyBitmap::collect(uint64_t firstPage, uint64_t pageCount) {
+    std::vector<uint64_t> bitmap(static_cast<size_t>((pageCount + 63) / 64), 0);
+    if (pageCount == 0 || !root.load(std::memory_order_acquire) || firstPage >= (1ULL << PAGE_NUMBER_BITS)) {
+        return bitmap;
+    }
+    uint64_t endPage = firstPage + pageCount;
+    if (endPage > (1ULL << PAGE_NUMBER_BITS) || endPage < firstPage) {
+        endPage = 1ULL << PAGE_NUMBER_BITS;
+    }
+    
+    for (uint64_t page = firstPage; page < endPage;) {
+        uint64_t leafEnd = (page | ((1ULL << LEAF_BITS) - 1)) + 1;
+        if (leafEnd > endPage) {
+            leafEnd = endPage;
+        }
+        Leaf* leaf = findLeaf(page);
+        for (uint64_t wordBase = page & ~63ULL; leaf && wordBase < leafEnd; wordBase += 64) {
+            std::atomic<uint64_t>& word = leaf->words[(wordBase >> 6) & (LEAF_WORDS - 1)];
+            uint64_t mask = wordMask(wordBase, page, leafEnd);
+            if ((word.load() & mask) == 0) {
+                continue;
+            }
+            uint64_t taken = (mask == ~0ULL ? word.exchange(0) : word.fetch_and(~mask)) & mask;
+            
+            // Shift the word's bits to where the range puts them
+            if (wordBase < firstPage) {
+                bitmap[0] |= taken >> (firstPage - wordBase);
+                continue;
+            }
+            uint64_t offset = wordBase - firstPage;
+            size_t index = static_cast<size_t>(offset >> 6);
+            unsigned shift = static_cast<unsigned>(offset & 63);
+            bitmap[index] |= taken << shift;
+            if (shift != 0 && index + 1 < bitmap.size()) {
+                bitmap[index + 1] |= taken >> (64 - shift);
+            }
+        }
+        page = leafEnd;
+    }
+    return bitmap;
+}
+
+void DirtyBitmap::clear() {
+    Root* rootNode = root.load(std::memory_order_acquire);
+    if (!rootNode) {
+        return;
+    }
+    for (size_t m = 0; m < (static_cast<size_t>(1) << ROOT_BITS); ++m) {
+        Middle* middle = rootNode->middles[m].load(std::memory_order_acquire);
+        for (size_t l = 0; middle && l < (static_cast<size_t>(1) << MIDDLE_BITS); ++l) {
+            Leaf* leaf = middle->leaves[l].load(std::memory_order_acquire);
+            for (size_t w = 0; leaf && w < LEAF_WORDS; ++w) {
+                leaf->words[w].store(0);
+            }
+        }
+    }
+}
+
+} // namespace smmu
@@ -0,0 +1,171 @@
+// ARM SMMU v3 Extent Tree Storage Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/extent_tree.h"
+
+namespace smmu {
+
+ExtentTree::ExtentTree(TranslationGranule granule) : mappedBytes(0), pageShift(granuleShift(granule)) {
+}
+
+void ExtentTree::map(IOVA iova, uint64_t size, const PageEntry& entry) {
+    if (size == 0) {
+        return;
+    }
+    
+    carve(iova, iova + (size - 1));
+    PageEntry stored = entry;
+    stored.valid = true;
+    ExtentMap::iterator it = extents.insert(std::make_pair(iova, Extent(size, stored))).first;
+    mappedBytes += size;
+    mergeNeighbours(it);
+}
+
+// The only candidate is the last extent starting at or before iova
+const PageEntry* ExtentTree::find(IOVA iova, IOVA& extentBase, uint64_t& extentSize) const {
+    ExtentMap::const_iterator it = extents.upper_bound(iova);
+    if (it == extents.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (iova - it->first >= it->second.size) {
+        return nullptr;
+    }
+    
+    extentBase = it->first;
+    extentSize = it->second.size;
+    return &it->second.entry;
+}
+
+uint64_t ExtentTree::unmap(IOVA firstIova, IOVA lastIova) {
+    if (lastIova < firstIova) {
+        return 0;
+    }
+    uint64_t pageMask = (1ULL << pageShift) - 1;
+    return carve(firstIova & ~pageMask, lastIova | pageMask) >> pageShift;
+}
+
+bool ExtentTree::hasMappings(IOVA firstIova, IOVA lastIova) const {
+    if (lastIova < firstIova) {
+        return false;
+    }
+    
+    // Extents are disjoint and sorted: if the last one starting at or before
+    // lastIova ends before firstIova, every earlier one does too
+    ExtentMap::const_iterator it = extents.upper_bound(lastIova);
+    if (it == extents.begin()) {
+        return false;
+    }
+    --it;
+    return it->first + (it->second.size - 1) >= firstIova;
+}
+
+std::vector<AddressRange> ExtentTree::getMappedRanges() const {
+    std::vector<AddressRange> ranges;
+    for (ExtentMap::const_iterator it = extents.begin(); it != extents.end(); ++it) {
+        IOVA extentLast = it->first + (it->second.size - 1);
+        if (!ranges.empty() && ranges.back().endAddress + 1 == it->first) {
+            ranges.back().endAddress = extentLast;
+        } else {
+            ranges.push_back(AddressRange(it->first, extentLast));
+        }
+    }
+    return ranges;
+}
+
+bool ExtentTree::getBounds(IOVA& lowest, IOVA& highest) const {
+    if (extents.empty()) {
+        return false;
+    }
+    lowest = extents.begin()->first;
+    highest = extents.rbegin()->first + (extents.rbegin()->second.size - 1);
+    return true;
+}
+
+uint64_t ExtentTree::getPageCount() const {
+    return mappedBytes >> pageShift;
+}
+
+size_t ExtentTree::getExtentCount() const {
+    return extents.size();
+}
+
+void ExtentTree::clear() {
+    extents.clear();
+    mappedBytes = 0;
+}
+
+// Adjacent in IOVA and PA with identical attributes
+bool ExtentTree::canMerge(const ExtentMap::value_type& lower, const ExtentMap::value_type& upper) {
+    const PageEntry& a = lower.second.entry;
+    const PageEntry& b = upper.second.entry;
+    return lower.first + lower.second.size == upper.first &&
+           a.physicalAddress + lower.second.size == b.physicalAddress &&
+           a.permissions.read == b.permissions.read &&
+           a.permissions.write == b.permissions.write &&
+           a.permissions.execute == b.permissions.execute &&
+           a.securityState == b.securityState;
+}
+
+// Remove [firstIova, lastIova] from the tree, keeping the parts of extents
+// outside it. Returns the bytes removed.
+uint64_t ExtentTree::carve(IOVA firstIova, IOVA lastIova) {
+    uint64_t removed = 0;
+    
+    // An extent starting before the range may reach into it, or across it
+    ExtentMap::iterator it = extents.upper_bound(firstIova);
+    if (it != extents.begin()) {
+        ExtentMap::iterator prev = it;
+        --prev;
+        IOVA prevLast = prev->first + (prev->second.size - 1);
+        if (prev->first < firstIova && prevLast >= firstIova) {
+            if (prevLast > lastIova) {
+                PageEntry tail = prev->second.entry;
+                tail.physicalAddress += lastIova + 1 - prev->first;
+                extents.insert(it, std::make_pair(lastIova + 1, Extent(prevLast - lastIova, tail)));
+            }
+            removed += (prevLast < lastIova ? prevLast : lastIova) - firstIova + 1;
+            prev->second.size = firstIova - prev->first;
+        }
+    }
+    
+    // Extents starting inside the range go, except for a tail past its end
+    it = extents.lower_bound(firstIova);
+    while (it != extents.end() && it->first <= lastIova) {
+        IOVA extentLast = it->first + (it->second.size - 1);
+        if (extentLast > lastIova) {
+            uint64_t headSize = lastIova + 1 - it->first;
+            PageEntry tail = it->second.entry;
+            tail.physicalAddress += headSize;
+            extents.insert(std::make_pair(lastIova + 1, Extent(extentLast - lastIova, tail)));
+            removed += headSize;
+        } else {
+            removed += it->second.size;
+        }
+        extents.erase(it++);
+    }
+    
+    mappedBytes -= removed;
+    return removed;
+}
+
+void ExtentTree::mergeNeighbours(ExtentMap::iterator it) {
+    if (it != extents.begin()) {
+        ExtentMap::iterator prev = it;
+        --prev;
+        if (canMerge(*prev, *it)) {
+            prev->second.size += it->second.size;
+            extents.erase(it);
+            it = prev;
+        }
+    }
+    
+    ExtentMap::iterator next = it;
+    ++next;
+    if (next != extents.end() && canMerge(*it, *next)) {
+        it->second.size += next->second.size;
+        extents.erase(next);
+    }
+}
+
+} // namespace smmu
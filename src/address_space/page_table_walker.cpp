@@ -0,0 +1,355 @@
+// ARM SMMU v3 Translation Table Walker Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/page_table_walker.h"
+#include "smmu/address_space.h"
+
+namespace smmu {
+
+namespace {
+
+// VMSAv8-64 descriptor fields
+const uint64_t VALID_BIT = 1ULL << 0;
+const uint64_t TABLE_BIT = 1ULL << 1;            // Table at levels 0-2, page at level 3; clear for a block
+const uint64_t NS_BIT = 1ULL << 5;
+const uint64_t AP2_BIT = 1ULL << 7;              // Read-only
+const uint64_t AF_BIT = 1ULL << 10;
+const uint64_t PXN_BIT = 1ULL << 53;
+const uint64_t PXN_TABLE_BIT = 1ULL << 59;
+const uint64_t AP_TABLE_READ_ONLY_BIT = 1ULL << 62;  // APTable[1]
+const uint64_t OUTPUT_ADDRESS_MASK = 0x0000FFFFFFFFF000ULL;  // OA[47:12]
+const int LEAF_LEVEL = 3;
+
+unsigned addressBits(AddressSpaceSize size) {
+    switch (size) {
+        case AddressSpaceSize::Size32Bit:
+            return 32;
+        case AddressSpaceSize::Size52Bit:
+            return 52;
+        case AddressSpaceSize::Size48Bit:
+        default:
+            return 48;
+    }
+}
+
+bool permits(const PagePermissions& permissions, AccessType accessType) {
+    switch (accessType) {
+        case AccessType::Read:
+            return permissions.read;
+        case AccessType::Write:
+            return permissions.write;
+        case AccessType::Execute:
+            return permissions.execute;
+        default:
+            return false;
+    }
+}
+
+} // anonymous namespace
+
+const size_t PageTableWalker::WALK_CACHE_STRIPES;
+
+PageTableWalker::PageTableWalker(std::shared_ptr<PhysicalMemory> physicalMemory, size_t walkCacheEntries)
+    : memory(physicalMemory), walkCacheMask(0), walkCount(0), faultCount(0), totalDepth(0),
+      descriptorReadCount(0), walkCacheHitCount(0), walkCacheMissCount(0) {
+    resizeWalkCache(walkCacheEntries);
+}
+
+TranslationResult PageTableWalker::walk(const ContextDescriptor& context, IOVA iova, AccessType accessType,
+                                        SecurityState securityState, const AddressSpace* stage2, WalkTrace* trace) {
+    WalkTrace local;
+    WalkTrace& current = trace ? *trace : local;
+    current = WalkTrace();
+    
+    TranslationResult result = walkFrom(context, iova, accessType, securityState, stage2, current);
+    
+    walkCount.fetch_add(1, std::memory_order_relaxed);
+    if (result.isError()) {
+        faultCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    totalDepth.fetch_add(current.depth, std::memory_order_relaxed);
+    descriptorReadCount.fetch_add(current.descriptorReads, std::memory_order_relaxed);
+    return result;
+}
+
+void PageTableWalker::invalidateWalkCache() {
+    for (size_t stripe = 0; stripe < WALK_CACHE_STRIPES; ++stripe) {
+        std::lock_guard<std::mutex> lock(walkCacheLocks[stripe]);
+        for (size_t i = stripe; i < walkCache.size(); i += WALK_CACHE_STRIPES) {
+            walkCache[i].valid = false;
+        }
+    }
+}
+
+// ARM SMMU v3 spec: TLBI_NH_ASID also invalidates walk cache entries of the ASID
+void PageTableWalker::invalidateWalkCache(ASID asid) {
+    for (size_t stripe = 0; stripe < WALK_CACHE_STRIPES; ++stripe) {
+        std::lock_guard<std::mutex> lock(walkCacheLocks[stripe]);
+        for (size_t i = stripe; i < walkCache.size(); i += WALK_CACHE_STRIPES) {
+            if (walkCache[i].asid == asid) {
+                walkCache[i].valid = false;
+            }
+        }
+    }
+}
+
+void PageTableWalker::resizeWalkCache(size_t walkCacheEntries) {
+    size_t entries = 0;
+    if (walkCacheEntries != 0) {
+        entries = 1;
+        while (entries < walkCacheEntries) {
+            entries <<= 1;
+        }
+    }
+    
+    std::unique_lock<std::mutex> locks[WALK_CACHE_STRIPES];
+    for (size_t stripe = 0; stripe < WALK_CACHE_STRIPES; ++stripe) {
+        locks[stripe] = std::unique_lock<std::mutex>(walkCacheLocks[stripe]);
+    }
+    if (entries == walkCache.size()) {
+        return;
+    }
+    WalkCacheEntry empty = WalkCacheEntry();
+    walkCache.assign(entries, empty);
+    walkCacheMask.store(entries != 0 ? entries - 1 : 0, std::memory_order_relaxed);
+}
+
+size_t PageTableWalker::getWalkCacheCapacity() const {
+    std::lock_guard<std::mutex> lock(walkCacheLocks[0]);
+    return walkCache.size();
+}
+
+std::shared_ptr<PhysicalMemory> PageTableWalker::getPhysicalMemory() const {
+    return memory;
+}
+
+WalkStatistics PageTableWalker::getStatistics() const {
+    WalkStatistics statistics;
+    statistics.walks = walkCount.load(std::memory_order_relaxed);
+    statistics.faults = faultCount.load(std::memory_order_relaxed);
+    statistics.totalDepth = totalDepth.load(std::memory_order_relaxed);
+    statistics.descriptorReads = descriptorReadCount.load(std::memory_order_relaxed);
+    statistics.walkCacheHits = walkCacheHitCount.load(std::memory_order_relaxed);
+    statistics.walkCacheMisses = walkCacheMissCount.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+void PageTableWalker::resetStatistics() {
+    walkCount.store(0, std::memory_order_relaxed);
+    faultCount.store(0, std::memory_order_relaxed);
+    totalDepth.store(0, std::memory_order_relaxed);
+    descriptorReadCount.store(0, std::memory_order_relaxed);
+    walkCacheHitCount.store(0, std::memory_order_relaxed);
+    walkCacheMissCount.store(0, std::memory_order_relaxed);
+}
+
+// 4KB granule: level 0 resolves bits [47:39], level 3 bits [20:12]
+unsigned PageTableWalker::Geometry::levelShift(int level) const {
+    return static_cast<unsigned>(static_cast<int>(pageShift) + static_cast<int>(bitsPerLevel) * (LEAF_LEVEL - level));
+}
+
+// The start level's table only spans the input bits left above it
+size_t PageTableWalker::Geometry::indexAt(uint64_t inputAddress, int level) const {
+    unsigned shift = levelShift(level);
+    unsigned bits = level == startLevel ? inputBits - shift : bitsPerLevel;
+    return static_cast<size_t>((inputAddress >> shift) & ((1ULL << bits) - 1));
+}
+
+// The start level is the one whose entries first reach the top input bit:
+// level 0 for 48 bits with 4KB pages, level 1 with 64KB pages
+PageTableWalker::Geometry PageTableWalker::geometryFor(const TranslationControlRegister& tcr) {
+    Geometry geometry;
+    geometry.pageShift = granuleShift(tcr.granuleSize);
+    geometry.bitsPerLevel = geometry.pageShift - 3;
+    geometry.inputBits = addressBits(tcr.inputAddressSize);
+    geometry.outputLimit = (1ULL << addressBits(tcr.outputAddressSize)) - 1;
+    geometry.startLevel = LEAF_LEVEL;
+    while (geometry.levelShift(geometry.startLevel) + geometry.bitsPerLevel < geometry.inputBits) {
+        --geometry.startLevel;
+    }
+    return geometry;
+}
+
+PA PageTableWalker::outputAddress(uint64_t descriptor, const Geometry& geometry) {
+    PA address = descriptor & OUTPUT_ADDRESS_MASK & ~((1ULL << geometry.pageShift) - 1);
+    if (geometry.pageShift == 16 && geometry.outputLimit > 0x0000FFFFFFFFFFFFULL) {
+        address |= ((descriptor >> 12) & 0xF) << 48;  // FEAT_LPA: OA[51:48]
+    }
+    return address;
+}
+
+TranslationResult PageTableWalker::walkFrom(const ContextDescriptor& context, IOVA iova, AccessType accessType,
+                                            SecurityState securityState, const AddressSpace* stage2,
+                                            WalkTrace& trace) {
+    Geometry geometry = geometryFor(context.tcr);
+    trace.startLevel = geometry.startLevel;
+    trace.finalLevel = geometry.startLevel;
+    
+    // TTBR0 covers the bottom of the address space and TTBR1 the top; the
+    // hole between them faults
+    uint64_t regionMask = (1ULL << geometry.inputBits) - 1;
+    PA ttbr = 0;
+    if ((iova & ~regionMask) == 0 && context.ttbr0Valid) {
+        ttbr = context.ttbr0;
+    } else if ((iova & ~regionMask) == ~regionMask && context.ttbr1Valid) {
+        ttbr = context.ttbr1;
+    } else {
+        return makeTranslationError(SMMUError::PageNotMapped);
+    }
+    uint64_t inputAddress = iova & regionMask;
+    PA root = ttbr & ~((1ULL << geometry.pageShift) - 1);
+    if (root > geometry.outputLimit) {
+        return makeTranslationError(FaultType::AddressSizeFault);
+    }
+    
+    PA table = root;
+    int level = geometry.startLevel;
+    uint8_t restrictions = 0;
+    WalkContext walkContext = { root, stage2, context.asid };
+    const bool useWalkCache = !context.tcr.walkCacheDisable;
+    if (useWalkCache && lookupWalkCache(walkContext, geometry, inputAddress, table, level, restrictions)) {
+        trace.startLevel = level;
+    }
+    
+    for (;;) {
+        trace.finalLevel = level;
+        trace.depth = static_cast<unsigned>(level - geometry.startLevel + 1);
+        
+        // In a nested walk the table address is an IPA
+        PA descriptorAddress = table + geometry.indexAt(inputAddress, level) * sizeof(uint64_t);
+        if (stage2) {
+            TranslationResult stage2Result = stage2->translatePage(descriptorAddress, AccessType::Read, securityState);
+            if (stage2Result.isError()) {
+                return stage2Result;
+            }
+            descriptorAddress = stage2Result.getValue().physicalAddress;
+        }
+        
+        ++trace.descriptorReads;
+        Result<uint64_t> fetched = memory->read64(descriptorAddress);
+        if (fetched.isError()) {
+            return makeTranslationError(SMMUError::TranslationTableError);  // External abort on the walk
+        }
+        uint64_t descriptor = fetched.getValue();
+        if ((descriptor & VALID_BIT) == 0) {
+            return makeTranslationError(SMMUError::PageNotMapped);
+        }
+        
+        if (level < LEAF_LEVEL && (descriptor & TABLE_BIT) != 0) {
+            table = outputAddress(descriptor, geometry);
+            if (table > geometry.outputLimit) {
+                return makeTranslationError(FaultType::AddressSizeFault);
+            }
+            // Gathered regardless of hierarchicalPermDisable so cached
+            // tables serve every context that shares them
+            if ((descriptor & AP_TABLE_READ_ONLY_BIT) != 0) {
+                restrictions |= TABLE_NO_WRITE;
+            }
+            if ((descriptor & PXN_TABLE_BIT) != 0) {
+                restrictions |= TABLE_NO_EXECUTE;
+            }
+            ++level;
+            if (useWalkCache) {
+                fillWalkCache(walkContext, geometry, inputAddress, table, level, restrictions);
+            }
+            continue;
+        }
+        
+        // Pages at level 3; blocks at level 2, and level 1 with 4KB pages
+        bool leaf = level == LEAF_LEVEL ? (descriptor & TABLE_BIT) != 0
+                                        : level == 2 || (level == 1 && geometry.pageShift == 12);
+        if (!leaf) {
+            return makeTranslationError(SMMUError::TranslationTableError);
+        }
+        if ((descriptor & AF_BIT) == 0) {
+            return makeTranslationError(SMMUError::AccessFlagFault);
+        }
+        
+        uint64_t mappingSize = 1ULL << geometry.levelShift(level);
+        PA base = outputAddress(descriptor, geometry) & ~(mappingSize - 1);
+        if (base > geometry.outputLimit) {
+            return makeTranslationError(FaultType::AddressSizeFault);
+        }
+        
+        if (context.tcr.hierarchicalPermDisable) {
+            restrictions = 0;
+        }
+        PagePermissions permissions(true,
+                                    (descriptor & AP2_BIT) == 0 && (restrictions & TABLE_NO_WRITE) == 0,
+                                    (descriptor & PXN_BIT) == 0 && (restrictions & TABLE_NO_EXECUTE) == 0);
+        if (!permits(permissions, accessType)) {
+            return makeTranslationError(SMMUError::PagePermissionViolation);
+        }
+        
+        // Secure contexts may map non-secure memory
+        SecurityState outputState = securityState;
+        if (securityState == SecurityState::Secure && (descriptor & NS_BIT) != 0) {
+            outputState = SecurityState::NonSecure;
+        }
+        return makeTranslationSuccess(base | (inputAddress & (mappingSize - 1)), permissions, outputState, mappingSize);
+    }
+}
+
+size_t PageTableWalker::walkCacheIndex(const WalkContext& context, int level, uint64_t prefix, size_t mask) {
+    uint64_t hash = (context.root >> 12) ^ (static_cast<uint64_t>(context.asid) << 40) ^ static_cast<uint64_t>(level);
+    hash = (hash + prefix * 0x9E3779B97F4A7C15ULL) * 0xFF51AFD7ED558CCDULL;  // MurmurHash3-style mixing
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return static_cast<size_t>(hash) & mask;
+}
+
+// Deepest cached table on the path to inputAddress, if any. Each probe
+// holds only its entry's stripe; a mask that changed under it means the
+// cache was resized, and the walk starts at the root.
+bool PageTableWalker::lookupWalkCache(const WalkContext& context, const Geometry& geometry, uint64_t inputAddress,
+                                      PA& table, int& level, uint8_t& restrictions) {
+    size_t mask = walkCacheMask.load(std::memory_order_relaxed);
+    for (int candidate = LEAF_LEVEL; candidate > geometry.startLevel; --candidate) {
+        uint64_t prefix = inputAddress >> geometry.levelShift(candidate - 1);
+        size_t index = walkCacheIndex(context, candidate, prefix, mask);
+        std::lock_guard<std::mutex> lock(walkCacheLocks[index % WALK_CACHE_STRIPES]);
+        if (walkCache.empty()) {
+            return false;
+        }
+        if (walkCacheMask.load(std::memory_order_relaxed) != mask) {
+            break;
+        }
+        const WalkCacheEntry& entry = walkCache[index];
+        if (entry.valid && entry.root == context.root && entry.stage2 == context.stage2 &&
+            entry.asid == context.asid && entry.level == candidate && entry.prefix == prefix &&
+            entry.pageShift == geometry.pageShift) {
+            table = entry.table;
+            level = candidate;
+            restrictions = entry.restrictions;
+            walkCacheHitCount.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    walkCacheMissCount.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void PageTableWalker::fillWalkCache(const WalkContext& context, const Geometry& geometry, uint64_t inputAddress,
+                                    PA table, int level, uint8_t restrictions) {
+    uint64_t prefix = inputAddress >> geometry.levelShift(level - 1);
+    size_t mask = walkCacheMask.load(std::memory_order_relaxed);
+    size_t index = walkCacheIndex(context, level, prefix, mask);
+    std::lock_guard<std::mutex> lock(walkCacheLocks[index % WALK_CACHE_STRIPES]);
+    if (walkCache.empty() || walkCacheMask.load(std::memory_order_relaxed) != mask) {
+        return;
+    }
+    
+    WalkCacheEntry& entry = walkCache[index];
+    entry.root = context.root;
+    entry.stage2 = context.stage2;
+    entry.asid = context.asid;
+    entry.prefix = prefix;
+    entry.table = table;
+    entry.level = static_cast<int8_t>(level);
+    entry.pageShift = static_cast<uint8_t>(geometry.pageShift);
+    entry.restrictions = restrictions;
+    entry.valid = true;
+}
+
+} // namespace smmu
@@ -0,0 +1,513 @@
+// ARM SMMU v3 Radix Page Table Storage Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/radix_page_table.h"
+
+namespace smmu {
+
+// Slots start empty; every level uses the same word array
+RadixPageTable::Node::Node(size_t entryCount)
+    : slots(new std::atomic<uint64_t>[entryCount]), slotCount(entryCount), live(0), pages(0), refs(1) {
+    for (size_t i = 0; i < entryCount; ++i) {
+        slots[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// The root is the highest level needed for a 52-bit IOVA
+RadixPageTable::RadixPageTable(TranslationGranule granule)
+    : root(nullptr), nodeCount(0), pageShift(granuleShift(granule)), bitsPerLevel(granuleShift(granule) - 3),
+      rootLevel(LEAF_LEVEL) {
+    while (levelShift(rootLevel) + bitsPerLevel < 52) {
+        --rootLevel;
+    }
+}
+
+// No reader may still be walking a table being destroyed; nodes shared
+// with a copy stay alive for it
+RadixPageTable::~RadixPageTable() {
+    Node* top = root.load(std::memory_order_relaxed);
+    if (top) {
+        releaseTable(top);
+    }
+}
+
+// O(1): the copy shares other's root until either side writes through it
+RadixPageTable::RadixPageTable(const RadixPageTable& other)
+    : root(nullptr), nodeCount(other.nodeCount), pageShift(other.pageShift), bitsPerLevel(other.bitsPerLevel),
+      rootLevel(other.rootLevel) {
+    Node* otherRoot = other.root.load(std::memory_order_acquire);
+    if (otherRoot) {
+        otherRoot->refs.fetch_add(1, std::memory_order_relaxed);
+        root.store(otherRoot, std::memory_order_release);
+    }
+}
+
+RadixPageTable& RadixPageTable::operator=(const RadixPageTable& other) {
+    if (this != &other) {
+        clear();
+        pageShift = other.pageShift;
+        bitsPerLevel = other.bitsPerLevel;
+        rootLevel = other.rootLevel;
+        Node* otherRoot = other.root.load(std::memory_order_acquire);
+        if (otherRoot) {
+            otherRoot->refs.fetch_add(1, std::memory_order_relaxed);
+            nodeCount = other.nodeCount;
+            root.store(otherRoot, std::memory_order_release);
+        }
+    }
+    return *this;
+}
+
+// 4KB granule: level -1 resolves bits [51:48], level 3 bits [20:12]
+unsigned RadixPageTable::levelShift(int level) const {
+    return static_cast<unsigned>(static_cast<int>(pageShift) + static_cast<int>(bitsPerLevel) * (LEAF_LEVEL - level));
+}
+
+// The root only spans the bits left below bit 52
+size_t RadixPageTable::entryCount(int level) const {
+    return level == rootLevel ? static_cast<size_t>(1) << (52 - levelShift(level)) : static_cast<size_t>(1) << bitsPerLevel;
+}
+
+size_t RadixPageTable::indexAt(IOVA iova, int level) const {
+    return static_cast<size_t>((iova >> levelShift(level)) & (entryCount(level) - 1));
+}
+
+// Granule pages covered by one entry at a level
+uint64_t RadixPageTable::pagesPerEntry(int level) const {
+    return 1ULL << (levelShift(level) - pageShift);
+}
+
+// Descriptors have the valid bit set; table pointers are word aligned, so
+// theirs is clear, and an empty slot is zero
+bool RadixPageTable::isDescriptor(uint64_t slot) {
+    return (slot & DESCRIPTOR_VALID) != 0;
+}
+
+RadixPageTable::Node* RadixPageTable::tableOf(uint64_t slot) {
+    return isDescriptor(slot) ? nullptr : reinterpret_cast<Node*>(static_cast<uintptr_t>(slot));
+}
+
+uint64_t RadixPageTable::tableSlot(const Node* table) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(table));
+}
+
+// Acquire pairs with the release that published the slot, so a table read
+// from it is seen fully built
+uint64_t RadixPageTable::slotAt(const Node& node, size_t index) {
+    return node.slots[index].load(std::memory_order_acquire);
+}
+
+int RadixPageTable::levelForSize(uint64_t size) const {
+    if (size == 1ULL << levelShift(1)) {
+        return 1;
+    }
+    return size == 1ULL << levelShift(2) ? 2 : LEAF_LEVEL;
+}
+
+void RadixPageTable::map(IOVA iova, uint64_t size, const PageDescriptor& descriptor) {
+    if (!descriptor.isValid()) {
+        return;  // Would read as a table pointer
+    }
+    
+    Node* top = writableRoot();
+    if (!top) {
+        top = newNode(rootLevel);
+        root.store(top, std::memory_order_release);
+    }
+    mapAt(*top, rootLevel, iova, levelForSize(size), descriptor);
+    reclaimer.reclaim();
+}
+
+// Walk from the root; a block descriptor ends the walk early. Each slot is
+// read once, so a concurrent change is seen wholly before or wholly after.
+PageDescriptor RadixPageTable::find(IOVA iova, uint64_t& mappingSize) const {
+    PageDescriptor descriptor;
+    if (iova > MAX_VIRTUAL_ADDRESS) {
+        return descriptor;
+    }
+    
+    EpochGuard guard;
+    const Node* node = root.load(std::memory_order_acquire);
+    for (int level = rootLevel; node; ++level) {
+        uint64_t slot = slotAt(*node, indexAt(iova, level));
+        if (isDescriptor(slot)) {
+            descriptor.bits = slot;
+            mappingSize = 1ULL << levelShift(level);
+            break;
+        }
+        node = tableOf(slot);
+    }
+    return descriptor;
+}
+
+uint64_t RadixPageTable::unmap(IOVA firstIova, IOVA lastIova) {
+    Node* top = root.load(std::memory_order_relaxed);
+    if (!top || firstIova > MAX_VIRTUAL_ADDRESS || lastIova < firstIova) {
+        return 0;
+    }
+    if (lastIova > MAX_VIRTUAL_ADDRESS) {
+        lastIova = MAX_VIRTUAL_ADDRESS;
+    }
+    
+    top = writableRoot();
+    uint64_t pageMask = (1ULL << pageShift) - 1;
+    uint64_t removed = unmapAt(*top, rootLevel, 0, firstIova & ~pageMask, lastIova | pageMask);
+    if (top->live == 0) {
+        root.store(nullptr, std::memory_order_release);
+        retireTable(top);
+    }
+    reclaimer.reclaim();
+    return removed;
+}
+
+bool RadixPageTable::hasMappings(IOVA firstIova, IOVA lastIova) const {
+    const Node* top = root.load(std::memory_order_acquire);
+    if (!top || firstIova > MAX_VIRTUAL_ADDRESS || lastIova < firstIova) {
+        return false;
+    }
+    if (lastIova > MAX_VIRTUAL_ADDRESS) {
+        lastIova = MAX_VIRTUAL_ADDRESS;
+    }
+    uint64_t pageMask = (1ULL << pageShift) - 1;
+    return hasMappingsAt(*top, rootLevel, 0, firstIova & ~pageMask, lastIova | pageMask);
+}
+
+// In-order walk, so ranges come out sorted without a sort pass
+std::vector<AddressRange> RadixPageTable::getMappedRanges() const {
+    std::vector<AddressRange> ranges;
+    const Node* top = root.load(std::memory_order_acquire);
+    if (top) {
+        collectRanges(*top, rootLevel, 0, ranges);
+    }
+    return ranges;
+}
+
+// Every live node leads to a mapping, so the first (last) live slot at each
+// level is on the path to the lowest (highest) mapping
+bool RadixPageTable::getBounds(IOVA& lowest, IOVA& highest) const {
+    const Node* top = root.load(std::memory_order_acquire);
+    if (!top) {
+        return false;
+    }
+    
+    const Node* node = top;
+    IOVA base = 0;
+    for (int level = rootLevel; node; ++level) {
+        size_t index = 0;
+        while (slotAt(*node, index) == 0) {
+            ++index;
+        }
+        base += static_cast<IOVA>(index) << levelShift(level);
+        uint64_t slot = slotAt(*node, index);
+        if (isDescriptor(slot)) {
+            lowest = base;
+            break;
+        }
+        node = tableOf(slot);
+    }
+    
+    node = top;
+    base = 0;
+    for (int level = rootLevel; node; ++level) {
+        size_t index = entryCount(level) - 1;
+        while (slotAt(*node, index) == 0) {
+            --index;
+        }
+        base += static_cast<IOVA>(index) << levelShift(level);
+        uint64_t slot = slotAt(*node, index);
+        if (isDescriptor(slot)) {
+            highest = base + (1ULL << levelShift(level)) - 1;
+            break;
+        }
+        node = tableOf(slot);
+    }
+    return true;
+}
+
+uint64_t RadixPageTable::getPageCount() const {
+    const Node* top = root.load(std::memory_order_acquire);
+    return top ? top->pages : 0;
+}
+
+size_t RadixPageTable::getNodeCount() const {
+    return nodeCount;
+}
+
+size_t RadixPageTable::getMemoryFootprint() const {
+    size_t bytes = 0;
+    std::vector<const Node*> pending;
+    const Node* top = root.load(std::memory_order_acquire);
+    if (top) {
+        pending.push_back(top);
+    }
+    while (!pending.empty()) {
+        const Node* node = pending.back();
+        pending.pop_back();
+        
+        bytes += sizeof(Node) + node->slotCount * sizeof(std::atomic<uint64_t>);
+        for (size_t i = 0; i < node->slotCount; ++i) {
+            const Node* table = tableOf(slotAt(*node, i));
+            if (table) {
+                pending.push_back(table);
+            }
+        }
+    }
+    return bytes;
+}
+
+void RadixPageTable::clear() {
+    Node* top = root.load(std::memory_order_relaxed);
+    if (top) {
+        root.store(nullptr, std::memory_order_release);
+        retireTable(top);
+        reclaimer.reclaim();
+    }
+}
+
+RadixPageTable::Node* RadixPageTable::newNode(int level) {
+    ++nodeCount;
+    return new Node(entryCount(level));
+}
+
+// One level deep: the copy takes a reference on each child table instead
+// of duplicating it
+RadixPageTable::Node* RadixPageTable::copyNode(const Node& node, int level) {
+    Node* copy = newNode(level);
+    for (size_t i = 0; i < node.slotCount; ++i) {
+        uint64_t slot = slotAt(node, i);
+        Node* table = tableOf(slot);
+        if (table) {
+            table->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        copy->slots[i].store(slot, std::memory_order_relaxed);
+    }
+    copy->live = node.live;
+    copy->pages = node.pages;
+    return copy;
+}
+
+// A node is exclusive once only this table links it. Acquire pairs with
+// the release of the last other reference, ordering its readers' accesses
+// before our writes.
+bool RadixPageTable::isShared(const Node& node) {
+    return node.refs.load(std::memory_order_acquire) > 1;
+}
+
+// Drop one reference to a table; nodes left without any are freed along
+// with the references they hold
+void RadixPageTable::releaseTable(void* table) {
+    std::vector<Node*> pending(1, static_cast<Node*>(table));
+    while (!pending.empty()) {
+        Node* node = pending.back();
+        pending.pop_back();
+        if (node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            continue;
+        }
+        for (size_t i = 0; i < node->slotCount; ++i) {
+            Node* child = tableOf(node->slots[i].load(std::memory_order_relaxed));
+            if (child) {
+                pending.push_back(child);
+            }
+        }
+        delete node;
+    }
+}
+
+// The root, copied first if a copy of this table shares it. The shared
+// node keeps its subtree: only its reference from here is retired.
+RadixPageTable::Node* RadixPageTable::writableRoot() {
+    Node* top = root.load(std::memory_order_relaxed);
+    if (top && isShared(*top)) {
+        Node* copy = copyNode(*top, rootLevel);
+        root.store(copy, std::memory_order_release);
+        --nodeCount;
+        reclaimer.retire(top, &releaseTable);
+        top = copy;
+    }
+    return top;
+}
+
+// The table in a slot of a writable node, copied first if it is shared
+RadixPageTable::Node* RadixPageTable::writableTable(Node& node, int level, size_t index) {
+    Node* table = tableOf(slotAt(node, index));
+    if (table && isShared(*table)) {
+        Node* copy = copyNode(*table, level + 1);
+        node.slots[index].store(tableSlot(copy), std::memory_order_release);
+        --nodeCount;
+        reclaimer.retire(table, &releaseTable);
+        table = copy;
+    }
+    return table;
+}
+
+// Account for a table the caller has just unlinked, with everything below
+// it, and drop its reference once no find() can still be walking it
+void RadixPageTable::retireTable(Node* table) {
+    std::vector<const Node*> pending(1, table);
+    while (!pending.empty()) {
+        const Node* node = pending.back();
+        pending.pop_back();
+        --nodeCount;
+        for (size_t i = 0; i < node->slotCount; ++i) {
+            const Node* child = tableOf(slotAt(*node, i));
+            if (child) {
+                pending.push_back(child);
+            }
+        }
+    }
+    reclaimer.retire(table, &releaseTable);
+}
+
+// Replace a block descriptor with a full table of next-level descriptors
+// covering the same range; the node's live and page counts are unchanged.
+// The table is complete before it takes the block's place.
+void RadixPageTable::splitBlock(Node& node, int level, size_t index) {
+    PageDescriptor block;
+    block.bits = slotAt(node, index);
+    Node* table = newNode(level + 1);
+    unsigned childShift = levelShift(level + 1);
+    for (size_t i = 0; i < table->slotCount; ++i) {
+        table->slots[i].store(block.offsetBy(static_cast<uint64_t>(i) << childShift).bits, std::memory_order_relaxed);
+    }
+    table->live = table->slotCount;
+    table->pages = pagesPerEntry(level);
+    
+    node.slots[index].store(tableSlot(table), std::memory_order_release);
+}
+
+// Returns the change in mapped pages below node
+int64_t RadixPageTable::mapAt(Node& node, int level, IOVA iova, int targetLevel, const PageDescriptor& descriptor) {
+    size_t index = indexAt(iova, level);
+    uint64_t slot = slotAt(node, index);
+    int64_t delta = 0;
+    
+    if (level == targetLevel) {
+        // The new descriptor replaces whatever table or descriptor was here
+        Node* table = tableOf(slot);
+        if (table) {
+            delta -= static_cast<int64_t>(table->pages);
+        } else if (isDescriptor(slot)) {
+            delta -= static_cast<int64_t>(pagesPerEntry(level));
+        } else {
+            ++node.live;
+        }
+        node.slots[index].store(descriptor.bits, std::memory_order_release);
+        if (table) {
+            retireTable(table);
+        }
+        delta += static_cast<int64_t>(pagesPerEntry(level));
+    } else {
+        if (isDescriptor(slot)) {
+            splitBlock(node, level, index);
+        } else if (slot == 0) {
+            node.slots[index].store(tableSlot(newNode(level + 1)), std::memory_order_release);
+            ++node.live;
+        }
+        delta = mapAt(*writableTable(node, level, index), level + 1, iova, targetLevel, descriptor);
+    }
+    
+    node.pages = static_cast<uint64_t>(static_cast<int64_t>(node.pages) + delta);
+    return delta;
+}
+
+// Remove mappings in [firstIova, lastIova] below a node starting at nodeBase;
+// the caller guarantees the node overlaps the range
+uint64_t RadixPageTable::unmapAt(Node& node, int level, IOVA nodeBase, IOVA firstIova, IOVA lastIova) {
+    unsigned shift = levelShift(level);
+    uint64_t span = 1ULL << shift;
+    size_t lastIndex = entryCount(level) - 1;
+    size_t first = firstIova > nodeBase ? static_cast<size_t>((firstIova - nodeBase) >> shift) : 0;
+    size_t last = lastIndex;
+    if (lastIova - nodeBase < (static_cast<uint64_t>(lastIndex) << shift)) {
+        last = static_cast<size_t>((lastIova - nodeBase) >> shift);
+    }
+    
+    uint64_t removed = 0;
+    for (size_t index = first; index <= last; ++index) {
+        IOVA slotBase = nodeBase + (static_cast<IOVA>(index) << shift);
+        bool covered = slotBase >= firstIova && slotBase + (span - 1) <= lastIova;
+        uint64_t slot = slotAt(node, index);
+        
+        if (isDescriptor(slot)) {
+            if (covered) {
+                node.slots[index].store(0, std::memory_order_release);
+                --node.live;
+                removed += pagesPerEntry(level);
+                continue;
+            }
+            // Pages always fall wholly inside the range, so this is a block
+            splitBlock(node, level, index);
+            slot = slotAt(node, index);
+        }
+        
+        Node* table = tableOf(slot);
+        if (table) {
+            if (!covered) {
+                table = writableTable(node, level, index);
+                removed += unmapAt(*table, level + 1, slotBase, firstIova, lastIova);
+                if (table->live != 0) {
+                    continue;
+                }
+            } else {
+                removed += table->pages;
+            }
+            node.slots[index].store(0, std::memory_order_release);
+            --node.live;
+            retireTable(table);
+        }
+    }
+    
+    node.pages -= removed;
+    return removed;
+}
+
+bool RadixPageTable::hasMappingsAt(const Node& node, int level, IOVA nodeBase, IOVA firstIova, IOVA lastIova) const {
+    unsigned shift = levelShift(level);
+    uint64_t span = 1ULL << shift;
+    size_t lastIndex = entryCount(level) - 1;
+    size_t first = firstIova > nodeBase ? static_cast<size_t>((firstIova - nodeBase) >> shift) : 0;
+    size_t last = lastIndex;
+    if (lastIova - nodeBase < (static_cast<uint64_t>(lastIndex) << shift)) {
+        last = static_cast<size_t>((lastIova - nodeBase) >> shift);
+    }
+    
+    for (size_t index = first; index <= last; ++index) {
+        uint64_t slot = slotAt(node, index);
+        if (isDescriptor(slot)) {
+            return true;
+        }
+        const Node* table = tableOf(slot);
+        if (table) {
+            IOVA slotBase = nodeBase + (static_cast<IOVA>(index) << shift);
+            // A live table wholly inside the range holds at least one mapping
+            if (slotBase >= firstIova && slotBase + (span - 1) <= lastIova) {
+                return true;
+            }
+            if (hasMappingsAt(*table, level + 1, slotBase, firstIova, lastIova)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void RadixPageTable::collectRanges(const Node& node, int level, IOVA nodeBase, std::vector<AddressRange>& ranges) const {
+    unsigned shift = levelShift(level);
+    size_t count = entryCount(level);
+    for (size_t index = 0; index < count; ++index) {
+        IOVA slotBase = nodeBase + (static_cast<IOVA>(index) << shift);
+        uint64_t slot = slotAt(node, index);
+        if (isDescriptor(slot)) {
+            IOVA slotEnd = slotBase + ((1ULL << shift) - 1);
+            if (!ranges.empty() && ranges.back().endAddress + 1 == slotBase) {
+                ranges.back().endAddress = slotEnd;
+            } else {
+                ranges.push_back(AddressRange(slotBase, slotEnd));
+            }
+        } else if (slot != 0) {
+            collectRanges(*tableOf(slot), level + 1, slotBase, ranges);
+        }
+    }
+}
+
+} // namespace smmu
@@ -0,0 +1,256 @@
+// ARM SMMU v3 Set-Associative TLB Storage Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/set_associative_tlb.h"
+#include <new>
+
+namespace smmu {
+
+namespace {
+
+// Ways are tracked with an 8-bit CLOCK hand; 64 ways is already a full-scan cache
+const size_t MAX_WAYS = 64;
+
+} // anonymous namespace
+
+SetAssociativeTLB::SetAssociativeTLB(size_t capacity, size_t requestedWays)
+    : tags(nullptr), entries(nullptr), configuredWays(1), ways(1), setMask(0), validCount(0) {
+    configuredWays = requestedWays > 0 ? requestedWays : DEFAULT_WAYS;
+    if (configuredWays > MAX_WAYS) {
+        configuredWays = MAX_WAYS;
+    }
+    allocate(capacity);
+}
+
+SetAssociativeTLB::~SetAssociativeTLB() {
+}
+
+uint64_t SetAssociativeTLB::hashKey(StreamID streamID, PASID pasid, IOVA iova) {
+    // Multiply-xorshift mix of the key words (MurmurHash3 finalizer), so that
+    // both the low bits (set index) and the high bits (shard index) are usable
+    uint64_t hash = ((static_cast<uint64_t>(streamID) << 32) | pasid) * 0x9E3779B97F4A7C15ULL;
+    hash ^= (iova >> 12) * 0xC2B2AE3D27D4EB4FULL;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+TLBEntry* SetAssociativeTLB::find(uint64_t hash, StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState) {
+    if (pasid > MAX_PASID) {
+        return nullptr;
+    }
+    
+    size_t base = setIndex(hash) * ways;
+    size_t way = findWay(base, streamID, iova, makeTagBits(pasid, securityState));
+    if (way == ways) {
+        return nullptr;
+    }
+    
+    // Second chance for the next CLOCK sweep
+    tags[base + way].pasidAndFlags |= REFERENCED_FLAG;
+    return &entries[base + way];
+}
+
+void SetAssociativeTLB::insert(uint64_t hash, const TLBEntry& entry) {
+    // Tags only hold a 20-bit PASID; out-of-range keys are never cached
+    if (entry.pasid > MAX_PASID) {
+        return;
+    }
+    
+    size_t set = setIndex(hash);
+    size_t base = set * ways;
+    uint32_t tagBits = makeTagBits(entry.pasid, entry.securityState);
+    
+    size_t way = findWay(base, entry.streamID, entry.iova, tagBits);
+    if (way == ways) {
+        way = chooseVictim(set);
+        if ((tags[base + way].pasidAndFlags & VALID_FLAG) == 0) {
+            ++validCount;
+        }
+    }
+    
+    WayTag& tag = tags[base + way];
+    tag.iova = entry.iova;
+    tag.streamID = entry.streamID;
+    tag.pasidAndFlags = tagBits;
+    entries[base + way] = entry;
+}
+
+bool SetAssociativeTLB::erase(uint64_t hash, StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState) {
+    if (pasid > MAX_PASID) {
+        return false;
+    }
+    
+    size_t base = setIndex(hash) * ways;
+    size_t way = findWay(base, streamID, iova, makeTagBits(pasid, securityState));
+    if (way == ways) {
+        return false;
+    }
+    
+    tags[base + way].pasidAndFlags = 0;
+    --validCount;
+    return true;
+}
+
+size_t SetAssociativeTLB::eraseRange(StreamID streamID, PASID pasid, IOVA firstPage, IOVA lastIova) {
+    uint32_t pasidBits = pasid & PASID_FIELD_MASK;
+    if (pasid > MAX_PASID) {
+        return 0;
+    }
+    // Block entries are tagged with their base, so test for overlap
+    return eraseMatching([streamID, pasidBits, firstPage, lastIova](const WayTag& tag, const TLBEntry& entry) {
+        return tag.streamID == streamID && (tag.pasidAndFlags & PASID_FIELD_MASK) == pasidBits &&
+               tag.iova + (entry.blockSize - 1) >= firstPage && tag.iova <= lastIova;
+    });
+}
+
+size_t SetAssociativeTLB::erasePage(uint64_t hash, StreamID streamID, PASID pasid, IOVA iova) {
+    if (pasid > MAX_PASID) {
+        return 0;
+    }
+    
+    // Same key in a different security state lands in the same set
+    WayTag* setTags = tags + setIndex(hash) * ways;
+    size_t erased = 0;
+    for (size_t way = 0; way < ways; ++way) {
+        if ((setTags[way].pasidAndFlags & VALID_FLAG) && setTags[way].iova == iova &&
+            setTags[way].streamID == streamID && (setTags[way].pasidAndFlags & PASID_FIELD_MASK) == pasid) {
+            setTags[way].pasidAndFlags = 0;
+            ++erased;
+        }
+    }
+    validCount -= erased;
+    return erased;
+}
+
+size_t SetAssociativeTLB::eraseSecurityState(SecurityState securityState) {
+    uint32_t securityBits = static_cast<uint32_t>(securityState) << SECURITY_SHIFT;
+    uint32_t securityMask = 3u << SECURITY_SHIFT;
+    return eraseMatching([securityBits, securityMask](const WayTag& tag, const TLBEntry&) {
+        return (tag.pasidAndFlags & securityMask) == securityBits;
+    });
+}
+
+void SetAssociativeTLB::clear() {
+    size_t slots = (setMask + 1) * ways;
+    for (size_t i = 0; i < slots; ++i) {
+        tags[i].pasidAndFlags = 0;
+    }
+    validCount = 0;
+}
+
+void SetAssociativeTLB::resize(size_t newCapacity) {
+    // Collect live entries, rebuild the geometry and re-insert what still fits
+    std::vector<TLBEntry> live;
+    live.reserve(validCount);
+    size_t slots = (setMask + 1) * ways;
+    for (size_t i = 0; i < slots; ++i) {
+        if (tags[i].pasidAndFlags & VALID_FLAG) {
+            live.push_back(entries[i]);
+        }
+    }
+    
+    allocate(newCapacity);
+    for (size_t i = 0; i < live.size(); ++i) {
+        insert(hashKey(live[i].streamID, live[i].pasid, live[i].iova), live[i]);
+    }
+}
+
+size_t SetAssociativeTLB::size() const {
+    return validCount;
+}
+
+size_t SetAssociativeTLB::capacity() const {
+    return (setMask + 1) * ways;
+}
+
+size_t SetAssociativeTLB::getWays() const {
+    return ways;
+}
+
+size_t SetAssociativeTLB::getSetCount() const {
+    return setMask + 1;
+}
+
+// Helper methods
+void SetAssociativeTLB::allocate(size_t newCapacity) {
+    // Tiny caches become a single fully associative set
+    ways = configuredWays;
+    if (newCapacity < ways) {
+        ways = newCapacity > 0 ? newCapacity : 1;
+    }
+    
+    // Largest power-of-two set count that keeps sets * ways within capacity
+    size_t setCount = 1;
+    while (setCount * 2 * ways <= newCapacity) {
+        setCount *= 2;
+    }
+    setMask = setCount - 1;
+    size_t slots = setCount * ways;
+    
+    // One allocation: [alignment slack][tags][entries], both arrays 64-byte aligned
+    size_t tagBytes = (slots * sizeof(WayTag) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+    size_t entryBytes = slots * sizeof(TLBEntry);
+    storage.assign(tagBytes + entryBytes + CACHE_LINE_SIZE, 0);
+    
+    uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+    uintptr_t aligned = (address + CACHE_LINE_SIZE - 1) & ~static_cast<uintptr_t>(CACHE_LINE_SIZE - 1);
+    unsigned char* base = storage.data() + (aligned - address);
+    
+    tags = reinterpret_cast<WayTag*>(base);
+    entries = reinterpret_cast<TLBEntry*>(base + tagBytes);
+    for (size_t i = 0; i < slots; ++i) {
+        tags[i].iova = 0;
+        tags[i].streamID = 0;
+        tags[i].pasidAndFlags = 0;
+        new (&entries[i]) TLBEntry();
+    }
+    
+    clockHands.assign(setCount, 0);
+    validCount = 0;
+}
+
+size_t SetAssociativeTLB::setIndex(uint64_t hash) const {
+    return static_cast<size_t>(hash) & setMask;
+}
+
+uint32_t SetAssociativeTLB::makeTagBits(PASID pasid, SecurityState securityState) {
+    return (pasid & PASID_FIELD_MASK) |
+           (static_cast<uint32_t>(securityState) << SECURITY_SHIFT) |
+           VALID_FLAG;
+}
+
+size_t SetAssociativeTLB::findWay(size_t base, StreamID streamID, IOVA iova, uint32_t tagBits) const {
+    const WayTag* setTags = tags + base;
+    for (size_t way = 0; way < ways; ++way) {
+        if (setTags[way].iova == iova && setTags[way].streamID == streamID &&
+            (setTags[way].pasidAndFlags & MATCH_MASK) == tagBits) {
+            return way;
+        }
+    }
+    return ways;
+}
+
+size_t SetAssociativeTLB::chooseVictim(size_t set) {
+    WayTag* setTags = tags + set * ways;
+    
+    // Prefer a free way
+    for (size_t way = 0; way < ways; ++way) {
+        if ((setTags[way].pasidAndFlags & VALID_FLAG) == 0) {
+            return way;
+        }
+    }
+    
+    // CLOCK: clear referenced bits until an unreferenced way comes round;
+    // terminates within two sweeps of the set
+    size_t hand = clockHands[set];
+    while (setTags[hand].pasidAndFlags & REFERENCED_FLAG) {
+        setTags[hand].pasidAndFlags &= ~REFERENCED_FLAG;
+        hand = (hand + 1) % ways;
+    }
+    clockHands[set] = static_cast<uint8_t>((hand + 1) % ways);
+    return hand;
+}
+
+} // namespace smmu
@@ -9,9 +9,55 @@
 
 namespace smmu {
 
+namespace {
+
+// Upper bound on lock stripes - beyond this the per-shard LRU becomes too coarse
+const size_t MAX_SHARD_COUNT = 256;
+
+size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value && result < MAX_SHARD_COUNT) {
+        result <<= 1;
+    }
+    return result;
+}
+
+// Entry sizes above 4KB the cache can hold, ascending: the 16KB and 64KB
+// granule pages and the level 2 and level 1 blocks of all three granules.
+// Bit i of blockSizesPresent stands for entry i.
+const uint64_t CACHED_BLOCK_SIZES[] = {
+    16ULL << 10, 64ULL << 10, BLOCK_SIZE_2MB, 32ULL << 20, 512ULL << 20, BLOCK_SIZE_1GB, 64ULL << 30, 4ULL << 40
+};
+const size_t CACHED_BLOCK_SIZE_COUNT = sizeof(CACHED_BLOCK_SIZES) / sizeof(CACHED_BLOCK_SIZES[0]);
+
+} // anonymous namespace
+
+const PASID TLBCache::VMID_KEY_PASID;
+
 // Constructor
-TLBCache::TLBCache(size_t maxSize) 
-    : maxSize(maxSize > 0 ? maxSize : 1024), hitCount(0), missCount(0) {
+TLBCache::TLBCache(size_t maxSize)
+    : budget(MemoryBudget::defaultBudget()), shardMask(0), maxSize(maxSize > 0 ? maxSize : 1024), backend(TLBBackend::LRUList), blockSizesPresent(0),
+      generationBumps(0) {
+    shards.push_back(std::unique_ptr<Shard>(new Shard(this->maxSize, budget.get())));
+    initializeGenerations();
+}
+
+// Constructor for the sharded (lock-striped) cache
+TLBCache::TLBCache(size_t maxSize, size_t shardCount, TLBBackend backend, std::shared_ptr<MemoryBudget> budget)
+    : budget(budget), shardMask(0), maxSize(maxSize > 0 ? maxSize : 1024), backend(backend), blockSizesPresent(0),
+      generationBumps(0) {
+    initializeGenerations();
+    size_t count = roundUpToPowerOfTwo(shardCount > 0 ? shardCount : 1);
+    shardMask = count - 1;
+    
+    size_t perShard = shardCapacity(this->maxSize);
+    shards.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        shards.push_back(std::unique_ptr<Shard>(new Shard(perShard, budget.get())));
+        if (backend == TLBBackend::SetAssociative) {
+            shards.back()->flatStore.reset(new SetAssociativeTLB(perShard));
+        }
+    }
 }
 
 // Destructor
@@ -21,45 +67,35 @@ TLBCache::~TLBCache() {
 
 // Cache operations - Result<T> error handling pattern
 Result<TLBEntry> TLBCache::lookupEntry(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    
     // Validate input parameters
     if (streamID > MAX_STREAM_ID) {
-        missCount.fetch_add(1, std::memory_order_relaxed);
+        shardFor(SetAssociativeTLB::hashKey(streamID, pasid, iova)).missCount.fetch_add(1, std::memory_order_relaxed);
         return makeError<TLBEntry>(SMMUError::InvalidStreamID);
     }
     
     if (pasid > MAX_PASID) {
-        missCount.fetch_add(1, std::memory_order_relaxed);
+        shardFor(SetAssociativeTLB::hashKey(streamID, pasid, iova)).missCount.fetch_add(1, std::memory_order_relaxed);
         return makeError<TLBEntry>(SMMUError::InvalidPASID);
     }
     
-    CacheKey key = makeKey(streamID, pasid, iova, securityState);
-    auto it = tlbCacheMap.find(key);
-    
-    if (it == tlbCacheMap.end()) {
-        missCount.fetch_add(1, std::memory_order_relaxed);
+    // Create a copy of the TLBEntry under the shard lock to avoid reference issues
+    TLBEntry entryCopy;
+    if (!findCovering(streamID, pasid, iova, securityState, &entryCopy)) {
         return makeError<TLBEntry>(SMMUError::CacheEntryNotFound);
     }
     
-    // Move to front (LRU)
-    moveToFront(it->second);
-    hitCount.fetch_add(1, std::memory_order_relaxed);
-    
-    // Create a copy of the TLBEntry to avoid reference issues
-    TLBEntry entryCopy = it->second->second;
     return Result<TLBEntry>(entryCopy);
 }
 
 Result<CacheEntry> TLBCache::lookupCacheEntry(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState) {
     // Validate input parameters without updating statistics yet
     if (streamID > MAX_STREAM_ID) {
-        missCount.fetch_add(1, std::memory_order_relaxed);
+        shardFor(SetAssociativeTLB::hashKey(streamID, pasid, iova)).missCount.fetch_add(1, std::memory_order_relaxed);
         return makeError<CacheEntry>(SMMUError::InvalidStreamID);
     }
     
     if (pasid > MAX_PASID) {
-        missCount.fetch_add(1, std::memory_order_relaxed);
+        shardFor(SetAssociativeTLB::hashKey(streamID, pasid, iova)).missCount.fetch_add(1, std::memory_order_relaxed);
         return makeError<CacheEntry>(SMMUError::InvalidPASID);
     }
     
@@ -82,59 +118,55 @@ Result<CacheEntry> TLBCache::lookupCacheEntry(StreamID streamID, PASID pasid, IO
     return Result<CacheEntry>(std::move(entry));
 }
 
+bool TLBCache::lookup(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState, uint64_t minTimestamp,
+                      TLBEntry& entry) {
+    return findCovering(streamID, pasid, iova, securityState, &entry, minTimestamp) != nullptr;
+}
+
 // Legacy interfaces for backward compatibility - deprecated
-TLBEntry* TLBCache::lookup(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    CacheKey key = makeKey(streamID, pasid, iova, securityState);
-    auto it = tlbCacheMap.find(key);
-    
-    if (it == tlbCacheMap.end()) {
-        missCount.fetch_add(1, std::memory_order_relaxed);
-        return nullptr;
-    }
-    
-    // Move to front (LRU)
-    moveToFront(it->second);
-    hitCount.fetch_add(1, std::memory_order_relaxed);
-    
-    return &(it->second->second);
+TLBEntry* TLBCache::lookup(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState, uint64_t minTimestamp) {
+    return findCovering(streamID, pasid, iova, securityState, nullptr, minTimestamp);
 }
 
 void TLBCache::insert(const TLBEntry& entry) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    CacheKey key = makeKey(entry.streamID, entry.pasid, entry.iova, entry.securityState);
+    insert(entry, currentGeneration(entry.streamID, entry.pasid));
+}
+
+void TLBCache::insert(const TLBEntry& entry, const Generation& generation) {
+    TLBEntry stamped = entry;
+    stamped.streamGeneration = generation.stream;
+    stamped.pasidGeneration = generation.pasid;
     
-    // Check if entry already exists
-    auto it = tlbCacheMap.find(key);
-    if (it != tlbCacheMap.end()) {
-        // Update existing entry
-        it->second->second = entry;
-        moveToFront(it->second);
-        return;
-    }
+    uint64_t hash = SetAssociativeTLB::hashKey(entry.streamID, entry.pasid, entry.iova);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<std::mutex> lock(shard.cacheMutex);
     
-    // Check if cache is full
-    if (tlbCacheList.size() >= maxSize) {
-        evictLRU();
+    // Publish the block size before the entry so lookups know to probe for it
+    for (size_t i = 0; i < CACHED_BLOCK_SIZE_COUNT; ++i) {
+        if (entry.blockSize == CACHED_BLOCK_SIZES[i]) {
+            blockSizesPresent.fetch_or(1u << i, std::memory_order_release);
+        }
     }
     
-    // Insert new entry
-    tlbCacheList.push_front(std::make_pair(key, entry));
-    auto listIt = tlbCacheList.begin();
-    tlbCacheMap[key] = listIt;
-    
-    // Add to secondary indices for fast invalidation
-    addToSecondaryIndices(key, listIt);
+    CacheKey key = makeKey(entry.streamID, entry.pasid, entry.iova, entry.securityState);
+    insertEntry(shard, hash, key, stamped);
+}
+
+TLBCache::Generation TLBCache::currentGeneration(StreamID streamID, PASID pasid) const {
+    Generation generation;
+    generation.stream = streamGeneration(streamID).load(std::memory_order_acquire);
+    generation.pasid = pasidGeneration(streamID, pasid).load(std::memory_order_acquire);
+    return generation;
 }
 
 bool TLBCache::lookup(StreamID streamID, PASID pasid, IOVA iova, CacheEntry& entry) {
-    TLBEntry* tlbEntry = lookup(streamID, pasid, iova);
-    if (tlbEntry) {
-        entry.iova = tlbEntry->iova;
-        entry.physicalAddress = tlbEntry->physicalAddress;
-        entry.permissions = tlbEntry->permissions;
-        entry.securityState = tlbEntry->securityState;
-        entry.timestamp = tlbEntry->timestamp;
+    TLBEntry tlbEntry;
+    if (lookup(streamID, pasid, iova, SecurityState::NonSecure, 0, tlbEntry)) {
+        entry.iova = tlbEntry.iova;
+        entry.physicalAddress = tlbEntry.physicalAddress;
+        entry.permissions = tlbEntry.permissions;
+        entry.securityState = tlbEntry.securityState;
+        entry.timestamp = tlbEntry.timestamp;
         return true;
     }
     return false;
@@ -154,29 +186,29 @@ void TLBCache::insert(StreamID streamID, PASID pasid, const CacheEntry& entry) {
 }
 
 void TLBCache::remove(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    CacheKey key = makeKey(streamID, pasid, iova, securityState);
-    auto it = tlbCacheMap.find(key);
-    
-    if (it != tlbCacheMap.end()) {
-        // Remove from secondary indices first
-        removeFromSecondaryIndices(key, it->second);
-        
-        // Remove from primary structures
-        tlbCacheList.erase(it->second);
-        tlbCacheMap.erase(it);
-    }
+    invalidate(streamID, pasid, iova, securityState);
 }
 
 // Invalidation operations
 void TLBCache::invalidate(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    CacheKey key = makeKey(streamID, pasid, iova, securityState);
-    auto it = tlbCacheMap.find(key);
+    uint64_t hash = SetAssociativeTLB::hashKey(streamID, pasid, iova);
+    {
+        Shard& shard = shardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.cacheMutex);
+        removeEntry(shard, hash, makeKey(streamID, pasid, iova, securityState));
+    }
     
-    if (it != tlbCacheMap.end()) {
-        tlbCacheList.erase(it->second);
-        tlbCacheMap.erase(it);
+    // A block entry covering the page is cached under the block base
+    uint32_t present = blockSizesPresent.load(std::memory_order_acquire);
+    for (size_t i = 0; i < CACHED_BLOCK_SIZE_COUNT; ++i) {
+        IOVA blockBase = iova & ~(CACHED_BLOCK_SIZES[i] - 1);
+        if ((present & (1u << i)) == 0 || blockBase == iova) {
+            continue;
+        }
+        uint64_t blockHash = SetAssociativeTLB::hashKey(streamID, pasid, blockBase);
+        Shard& blockShard = shardFor(blockHash);
+        std::lock_guard<std::mutex> lock(blockShard.cacheMutex);
+        removeEntry(blockShard, blockHash, makeKey(streamID, pasid, blockBase, securityState));
     }
 }
 
@@ -193,75 +225,130 @@ void TLBCache::invalidateAll() {
 }
 
 void TLBCache::invalidateBySecurityState(SecurityState securityState) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    
-    // Use secondary index for O(k) performance instead of O(n)
-    auto range = securityIndex.equal_range(securityState);
-    std::vector<typename TLBCacheList::iterator> toRemove;
-    
-    // Collect iterators to remove (can't modify while iterating)
-    for (auto secIt = range.first; secIt != range.second; ++secIt) {
-        toRemove.push_back(secIt->second);
-    }
-    
-    // Remove entries from all structures
-    for (auto listIt : toRemove) {
-        // Remove from secondary indices
-        removeFromSecondaryIndices(listIt->first, listIt);
+    // Entries of one security state are spread over every shard
+    for (auto& shardPtr : shards) {
+        Shard& shard = *shardPtr;
+        std::lock_guard<std::mutex> lock(shard.cacheMutex);
+        if (shard.flatStore) {
+            shard.flatStore->eraseSecurityState(securityState);
+            continue;
+        }
         
-        // Remove from primary structures
-        tlbCacheMap.erase(listIt->first);
-        tlbCacheList.erase(listIt);
+        // Use secondary index for O(k) performance instead of O(n)
+        auto range = shard.securityIndex.equal_range(securityState);
+        std::vector<typename TLBCacheList::iterator> toRemove;
+        
+        // Collect iterators to remove (can't modify while iterating)
+        for (auto secIt = range.first; secIt != range.second; ++secIt) {
+            toRemove.push_back(secIt->second);
+        }
+        
+        // Remove entries from all structures
+        for (auto listIt : toRemove) {
+            eraseEntry(shard, listIt);
+        }
     }
 }
 
 void TLBCache::invalidateStream(StreamID streamID) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    
-    // Use secondary index for O(k) performance instead of O(n)
-    auto range = streamIndex.equal_range(streamID);
-    std::vector<typename TLBCacheList::iterator> toRemove;
-    
-    // Collect iterators to remove (can't modify while iterating)
-    for (auto streamIt = range.first; streamIt != range.second; ++streamIt) {
-        toRemove.push_back(streamIt->second);
-    }
-    
-    // Remove entries from all structures
-    for (auto listIt : toRemove) {
-        // Remove from secondary indices
-        removeFromSecondaryIndices(listIt->first, listIt);
-        
-        // Remove from primary structures
-        tlbCacheMap.erase(listIt->first);
-        tlbCacheList.erase(listIt);
-    }
+    // O(1): entries stamped with the old generation miss from now on and are
+    // reclaimed when their shard is swept
+    streamGeneration(streamID).fetch_add(1, std::memory_order_acq_rel);
+    generationBumps.fetch_add(1, std::memory_order_acq_rel);
 }
 
 void TLBCache::invalidatePASID(StreamID streamID, PASID pasid) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
+    pasidGeneration(streamID, pasid).fetch_add(1, std::memory_order_acq_rel);
+    generationBumps.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void TLBCache::invalidateVMID(VMID vmid) {
+    invalidatePASID(vmid, VMID_KEY_PASID);
+}
+
+void TLBCache::invalidateRange(StreamID streamID, PASID pasid, IOVA startIova, IOVA endIova) {
+    if (endIova < startIova) {
+        return;
+    }
+    IOVA firstPage = startIova & ~PAGE_MASK;
+    uint32_t present = blockSizesPresent.load(std::memory_order_acquire);
+    
+    if (backend == TLBBackend::SetAssociative) {
+        // No ordered index here: probe page by page while that is cheaper
+        // than scanning every tag, otherwise scan
+        uint64_t pageCount = ((endIova - firstPage) / PAGE_SIZE) + 1;
+        if (pageCount <= getCapacity() / SetAssociativeTLB::DEFAULT_WAYS) {
+            for (uint64_t i = 0; i < pageCount; ++i) {
+                IOVA page = firstPage + i * PAGE_SIZE;
+                uint64_t hash = SetAssociativeTLB::hashKey(streamID, pasid, page);
+                Shard& shard = shardFor(hash);
+                std::lock_guard<std::mutex> lock(shard.cacheMutex);
+                shard.flatStore->erasePage(hash, streamID, pasid, page);
+            }
+            
+            // Blocks overlapping the range are tagged with their base, which
+            // may lie before the range
+            for (size_t i = 0; i < CACHED_BLOCK_SIZE_COUNT; ++i) {
+                if ((present & (1u << i)) == 0) {
+                    continue;
+                }
+                uint64_t blockSize = CACHED_BLOCK_SIZES[i];
+                for (IOVA blockBase = firstPage & ~(blockSize - 1); blockBase <= endIova; blockBase += blockSize) {
+                    uint64_t hash = SetAssociativeTLB::hashKey(streamID, pasid, blockBase);
+                    Shard& shard = shardFor(hash);
+                    std::lock_guard<std::mutex> lock(shard.cacheMutex);
+                    shard.flatStore->erasePage(hash, streamID, pasid, blockBase);
+                    if (blockBase + blockSize < blockBase) {
+                        break;
+                    }
+                }
+            }
+        } else {
+            for (auto& shardPtr : shards) {
+                std::lock_guard<std::mutex> lock(shardPtr->cacheMutex);
+                shardPtr->flatStore->eraseRange(streamID, pasid, firstPage, endIova);
+            }
+        }
+        return;
+    }
     
-    // Use secondary index for O(k) performance instead of O(n)
     StreamPASIDKey pasidKey;
     pasidKey.streamID = streamID;
     pasidKey.pasid = pasid;
     
-    auto range = pasidIndex.equal_range(pasidKey);
-    std::vector<typename TLBCacheList::iterator> toRemove;
-    
-    // Collect iterators to remove (can't modify while iterating)
-    for (auto pasidIt = range.first; pasidIt != range.second; ++pasidIt) {
-        toRemove.push_back(pasidIt->second);
-    }
-    
-    // Remove entries from all structures
-    for (auto listIt : toRemove) {
-        // Remove from secondary indices
-        removeFromSecondaryIndices(listIt->first, listIt);
+    for (auto& shardPtr : shards) {
+        Shard& shard = *shardPtr;
+        std::lock_guard<std::mutex> lock(shard.cacheMutex);
+        auto found = shard.pasidIndex.find(pasidKey);
+        if (found == shard.pasidIndex.end()) {
+            continue;
+        }
+        
+        // A block starting before the range can only sit at the one base per
+        // size that covers firstPage: one probe per block size cached
+        const PageIndex& pages = found->second;
+        std::vector<typename TLBCacheList::iterator> toRemove;
+        for (size_t i = 0; i < CACHED_BLOCK_SIZE_COUNT; ++i) {
+            IOVA blockBase = firstPage & ~(CACHED_BLOCK_SIZES[i] - 1);
+            if ((present & (1u << i)) == 0 || blockBase == firstPage) {
+                continue;
+            }
+            auto bases = pages.equal_range(blockBase);
+            for (auto pageIt = bases.first; pageIt != bases.second; ++pageIt) {
+                if (pageIt->second->second.blockSize == CACHED_BLOCK_SIZES[i]) {
+                    toRemove.push_back(pageIt->second);
+                }
+            }
+        }
         
-        // Remove from primary structures
-        tlbCacheMap.erase(listIt->first);
-        tlbCacheList.erase(listIt);
+        // Ordered page index: visit only the cached pages inside the range
+        for (auto pageIt = pages.lower_bound(firstPage); pageIt != pages.end() && pageIt->first <= endIova; ++pageIt) {
+            toRemove.push_back(pageIt->second);
+        }
+        
+        for (auto listIt : toRemove) {
+            eraseEntry(shard, listIt);
+        }
     }
 }
 
@@ -270,43 +357,54 @@ void TLBCache::invalidatePage(StreamID streamID, PASID pasid, IOVA iova) {
 }
 
 void TLBCache::clear() {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    tlbCacheMap.clear();
-    tlbCacheList.clear();
-    
-    // Clear all secondary indices
-    streamIndex.clear();
-    pasidIndex.clear();
-    securityIndex.clear();
+    std::vector<std::unique_lock<std::mutex>> locks = lockAllShards();
+    for (auto& shardPtr : shards) {
+        clearShard(*shardPtr);
+    }
+    blockSizesPresent.store(0, std::memory_order_release);
 }
 
 // Statistics
 uint64_t TLBCache::getHitCount() const {
-    return hitCount.load(std::memory_order_relaxed);
+    uint64_t total = 0;
+    for (const auto& shardPtr : shards) {
+        total += shardPtr->hitCount.load(std::memory_order_relaxed);
+    }
+    return total;
 }
 
 uint64_t TLBCache::getMissCount() const {
-    return missCount.load(std::memory_order_relaxed);
+    uint64_t total = 0;
+    for (const auto& shardPtr : shards) {
+        total += shardPtr->missCount.load(std::memory_order_relaxed);
+    }
+    return total;
 }
 
 uint64_t TLBCache::getTotalLookups() const {
-    return hitCount.load(std::memory_order_relaxed) + missCount.load(std::memory_order_relaxed);
+    return getHitCount() + getMissCount();
 }
 
 double TLBCache::getHitRate() const {
-    uint64_t hits = hitCount.load(std::memory_order_relaxed);
-    uint64_t misses = missCount.load(std::memory_order_relaxed);
+    uint64_t hits = getHitCount();
+    uint64_t misses = getMissCount();
     uint64_t total = hits + misses;
     return total > 0 ? static_cast<double>(hits) / static_cast<double>(total) : 0.0;
 }
 
 size_t TLBCache::getSize() const {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    return tlbCacheList.size();
+    size_t total = 0;
+    for (const auto& shardPtr : shards) {
+        std::lock_guard<std::mutex> lock(shardPtr->cacheMutex);
+        reclaimStale(*shardPtr);
+        total += shardSize(*shardPtr);
+    }
+    return total;
 }
 
 size_t TLBCache::getCapacity() const {
-    std::lock_guard<std::mutex> lock(cacheMutex);
+    // maxSize is only written while every shard lock is held
+    std::lock_guard<std::mutex> lock(shards.front()->cacheMutex);
     return maxSize;
 }
 
@@ -314,67 +412,232 @@ size_t TLBCache::getMaxSize() const {
     return getCapacity();
 }
 
+size_t TLBCache::getShardCount() const {
+    return shards.size();
+}
+
+TLBBackend TLBCache::getBackend() const {
+    return backend;
+}
+
 void TLBCache::resetStatistics() {
-    hitCount.store(0, std::memory_order_relaxed);
-    missCount.store(0, std::memory_order_relaxed);
+    for (auto& shardPtr : shards) {
+        shardPtr->hitCount.store(0, std::memory_order_relaxed);
+        shardPtr->missCount.store(0, std::memory_order_relaxed);
+    }
 }
 
 void TLBCache::reset() {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    tlbCacheMap.clear();
-    tlbCacheList.clear();
-    
-    // Clear all secondary indices
-    streamIndex.clear();
-    pasidIndex.clear();
-    securityIndex.clear();
-    
-    hitCount.store(0, std::memory_order_relaxed);
-    missCount.store(0, std::memory_order_relaxed);
+    std::vector<std::unique_lock<std::mutex>> locks = lockAllShards();
+    for (auto& shardPtr : shards) {
+        clearShard(*shardPtr);
+        shardPtr->hitCount.store(0, std::memory_order_relaxed);
+        shardPtr->missCount.store(0, std::memory_order_relaxed);
+    }
+    blockSizesPresent.store(0, std::memory_order_release);
 }
 
 // Configuration
 void TLBCache::setMaxSize(size_t newMaxSize) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    maxSize = newMaxSize;
+    // Every shard lock, so capacity changes atomically
+    std::vector<std::unique_lock<std::mutex>> locks = lockAllShards();
     
-    // Evict entries if current size exceeds new limit
-    while (tlbCacheList.size() > maxSize) {
-        evictLRU();
+    maxSize = newMaxSize;
+    size_t perShard = shardCapacity(newMaxSize);
+    
+    for (auto& shardPtr : shards) {
+        Shard& shard = *shardPtr;
+        shard.maxSize = perShard;
+        if (shard.flatStore) {
+            shard.flatStore->resize(perShard);
+            continue;
+        }
+        
+        // Evict entries if current size exceeds new limit
+        while (shard.tlbCacheList.size() > shard.maxSize) {
+            evictLRU(shard);
+        }
     }
 }
 
 // Helper methods (Note: These are called from already-locked contexts)
-void TLBCache::evictLRU() {
-    if (!tlbCacheList.empty()) {
-        auto last = tlbCacheList.end();
+TLBCache::Shard& TLBCache::shardFor(uint64_t hash) const {
+    // High hash bits pick the shard; the low bits are left to the set index
+    return *shards[static_cast<size_t>(hash >> 48) & shardMask];
+}
+
+size_t TLBCache::shardCapacity(size_t totalSize) const {
+    size_t count = shardMask + 1;
+    size_t perShard = (totalSize + count - 1) / count;
+    return perShard > 0 ? perShard : 1;
+}
+
+// Probe the page itself, then the base of each cached block size that could
+// cover it. Exactly one hit or one miss is counted per call.
+TLBEntry* TLBCache::findCovering(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState, TLBEntry* copy,
+                                 uint64_t minTimestamp) {
+    uint64_t hash = SetAssociativeTLB::hashKey(streamID, pasid, iova);
+    Shard& shard = shardFor(hash);
+    {
+        std::lock_guard<std::mutex> lock(shard.cacheMutex);
+        TLBEntry* found = findFresh(shard, hash, makeKey(streamID, pasid, iova, securityState), minTimestamp);
+        if (found) {
+            shard.hitCount.fetch_add(1, std::memory_order_relaxed);
+            if (copy) {
+                *copy = *found;
+            }
+            return found;
+        }
+    }
+    
+    uint32_t present = blockSizesPresent.load(std::memory_order_acquire);
+    for (size_t i = 0; i < CACHED_BLOCK_SIZE_COUNT && present != 0; ++i) {
+        IOVA blockBase = iova & ~(CACHED_BLOCK_SIZES[i] - 1);
+        if ((present & (1u << i)) == 0 || blockBase == iova) {
+            continue;
+        }
+        uint64_t blockHash = SetAssociativeTLB::hashKey(streamID, pasid, blockBase);
+        Shard& blockShard = shardFor(blockHash);
+        std::lock_guard<std::mutex> lock(blockShard.cacheMutex);
+        TLBEntry* found = findFresh(blockShard, blockHash, makeKey(streamID, pasid, blockBase, securityState), minTimestamp);
+        if (found && found->blockSize == CACHED_BLOCK_SIZES[i]) {
+            blockShard.hitCount.fetch_add(1, std::memory_order_relaxed);
+            if (copy) {
+                *copy = *found;
+            }
+            return found;
+        }
+    }
+    
+    shard.missCount.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+// findEntry() that also drops an entry stamped before minTimestamp or
+// with an outdated stream/PASID generation
+TLBEntry* TLBCache::findFresh(Shard& shard, uint64_t hash, const CacheKey& key, uint64_t minTimestamp) {
+    TLBEntry* found = findEntry(shard, hash, key);
+    if (found && (found->timestamp < minTimestamp || isStale(*found))) {
+        removeEntry(shard, hash, key);
+        return nullptr;
+    }
+    return found;
+}
+
+TLBEntry* TLBCache::findEntry(Shard& shard, uint64_t hash, const CacheKey& key) {
+    if (shard.flatStore) {
+        return shard.flatStore->find(hash, key.streamID, key.pasid, key.iova, key.securityState);
+    }
+    
+    auto it = shard.tlbCacheMap.find(key);
+    if (it == shard.tlbCacheMap.end()) {
+        return nullptr;
+    }
+    
+    // Move to front (LRU)
+    moveToFront(shard, it->second);
+    return &(it->second->second);
+}
+
+void TLBCache::insertEntry(Shard& shard, uint64_t hash, const CacheKey& key, const TLBEntry& entry) {
+    // Reclaim entries of invalidated streams/PASIDs before evicting live ones
+    if (shardSize(shard) >= (shard.flatStore ? shard.flatStore->capacity() : shard.maxSize)) {
+        reclaimStale(shard);
+    }
+    
+    if (shard.flatStore) {
+        shard.flatStore->insert(hash, entry);
+        return;
+    }
+    
+    // Check if entry already exists
+    auto it = shard.tlbCacheMap.find(key);
+    if (it != shard.tlbCacheMap.end()) {
+        // Update existing entry
+        it->second->second = entry;
+        moveToFront(shard, it->second);
+        return;
+    }
+    
+    // Check if shard is full; past the memory budget it stops growing
+    if (shard.tlbCacheList.size() >= shard.maxSize || budget->isExhausted()) {
+        if (shard.tlbCacheList.empty()) {
+            return;
+        }
+        evictLRU(shard);
+    }
+    
+    // Insert new entry
+    shard.tlbCacheList.push_front(std::make_pair(key, entry));
+    auto listIt = shard.tlbCacheList.begin();
+    shard.tlbCacheMap[key] = listIt;
+    
+    // Add to secondary indices for fast invalidation
+    addToSecondaryIndices(shard, key, listIt);
+}
+
+void TLBCache::removeEntry(Shard& shard, uint64_t hash, const CacheKey& key) {
+    if (shard.flatStore) {
+        shard.flatStore->erase(hash, key.streamID, key.pasid, key.iova, key.securityState);
+        return;
+    }
+    
+    auto it = shard.tlbCacheMap.find(key);
+    if (it != shard.tlbCacheMap.end()) {
+        eraseEntry(shard, it->second);
+    }
+}
+
+size_t TLBCache::shardSize(const Shard& shard) const {
+    return shard.flatStore ? shard.flatStore->size() : shard.tlbCacheList.size();
+}
+
+void TLBCache::evictLRU(Shard& shard) {
+    if (!shard.tlbCacheList.empty()) {
+        auto last = shard.tlbCacheList.end();
         --last;
-        
-        // Remove from secondary indices before erasing
-        removeFromSecondaryIndices(last->first, last);
-        
-        // Remove from primary index and list
-        tlbCacheMap.erase(last->first);
-        tlbCacheList.erase(last);
+        eraseEntry(shard, last);
     }
 }
 
-void TLBCache::moveToFront(typename TLBCacheList::iterator it) {
-    if (it != tlbCacheList.begin()) {
-        auto entry = *it;
-        
-        // Remove from secondary indices with old iterator
-        removeFromSecondaryIndices(entry.first, it);
-        
-        // Move to front in list
-        tlbCacheList.erase(it);
-        tlbCacheList.push_front(entry);
-        auto newIt = tlbCacheList.begin();
-        tlbCacheMap[entry.first] = newIt;
-        
-        // Add back to secondary indices with new iterator
-        addToSecondaryIndices(entry.first, newIt);
+void TLBCache::moveToFront(Shard& shard, typename TLBCacheList::iterator it) {
+    // splice() relinks the node in place, so the iterators held by the
+    // primary map and the secondary indices stay valid
+    if (it != shard.tlbCacheList.begin()) {
+        shard.tlbCacheList.splice(shard.tlbCacheList.begin(), shard.tlbCacheList, it);
+    }
+}
+
+void TLBCache::eraseEntry(Shard& shard, typename TLBCacheList::iterator it) const {
+    // Remove from secondary indices before erasing
+    removeFromSecondaryIndices(shard, it->first, it);
+    
+    // Remove from primary index and list
+    shard.tlbCacheMap.erase(it->first);
+    shard.tlbCacheList.erase(it);
+}
+
+// Always in index order, so whole-cache operations cannot deadlock
+std::vector<std::unique_lock<std::mutex>> TLBCache::lockAllShards() const {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(shards.size());
+    for (const auto& shardPtr : shards) {
+        locks.push_back(std::unique_lock<std::mutex>(shardPtr->cacheMutex));
     }
+    return locks;
+}
+
+void TLBCache::clearShard(Shard& shard) {
+    if (shard.flatStore) {
+        shard.flatStore->clear();
+    }
+    shard.tlbCacheMap.clear();
+    shard.tlbCacheList.clear();
+    
+    // Clear all secondary indices
+    shard.pasidIndex.clear();
+    shard.sweptBumps = generationBumps.load(std::memory_order_acquire);
+    shard.securityIndex.clear();
 }
 
 uint64_t TLBCache::getCurrentTimestamp() const {
@@ -392,82 +655,132 @@ CacheKey TLBCache::makeKey(StreamID streamID, PASID pasid, IOVA iova, SecuritySt
 }
 
 // Add entry to all secondary indices for fast invalidation
-void TLBCache::addToSecondaryIndices(const CacheKey& key, typename TLBCacheList::iterator it) {
-    // Add to StreamID index
-    streamIndex.insert(std::make_pair(key.streamID, it));
-    
-    // Add to StreamID+PASID compound index
+void TLBCache::addToSecondaryIndices(Shard& shard, const CacheKey& key, typename TLBCacheList::iterator it) {
+    // Add to StreamID+PASID compound index, ordered by IOVA
     StreamPASIDKey pasidKey;
     pasidKey.streamID = key.streamID;
     pasidKey.pasid = key.pasid;
-    pasidIndex.insert(std::make_pair(pasidKey, it));
+    auto pages = shard.pasidIndex.find(pasidKey);
+    if (pages == shard.pasidIndex.end()) {
+        PageIndex index(std::less<IOVA>(), PageIndex::allocator_type(budget.get()));
+        pages = shard.pasidIndex.insert(std::make_pair(pasidKey, std::move(index))).first;
+    }
+    pages->second.insert(std::make_pair(key.iova, it));
     
     // Add to SecurityState index
-    securityIndex.insert(std::make_pair(key.securityState, it));
+    shard.securityIndex.insert(std::make_pair(key.securityState, it));
 }
 
 // Remove entry from all secondary indices
-void TLBCache::removeFromSecondaryIndices(const CacheKey& key, typename TLBCacheList::iterator it) {
-    // Remove from StreamID index
-    auto streamRange = streamIndex.equal_range(key.streamID);
-    for (auto streamIt = streamRange.first; streamIt != streamRange.second; ++streamIt) {
-        if (streamIt->second == it) {
-            streamIndex.erase(streamIt);
-            break;
-        }
-    }
-    
+void TLBCache::removeFromSecondaryIndices(Shard& shard, const CacheKey& key, typename TLBCacheList::iterator it) const {
     // Remove from StreamID+PASID compound index
     StreamPASIDKey pasidKey;
     pasidKey.streamID = key.streamID;
     pasidKey.pasid = key.pasid;
-    auto pasidRange = pasidIndex.equal_range(pasidKey);
-    for (auto pasidIt = pasidRange.first; pasidIt != pasidRange.second; ++pasidIt) {
-        if (pasidIt->second == it) {
-            pasidIndex.erase(pasidIt);
-            break;
+    auto pasidIt = shard.pasidIndex.find(pasidKey);
+    if (pasidIt != shard.pasidIndex.end()) {
+        PageIndex& pages = pasidIt->second;
+        auto pageRange = pages.equal_range(key.iova);
+        for (auto pageIt = pageRange.first; pageIt != pageRange.second; ++pageIt) {
+            if (pageIt->second == it) {
+                pages.erase(pageIt);
+                break;
+            }
+        }
+        if (pages.empty()) {
+            shard.pasidIndex.erase(pasidIt);
         }
     }
     
     // Remove from SecurityState index
-    auto securityRange = securityIndex.equal_range(key.securityState);
+    auto securityRange = shard.securityIndex.equal_range(key.securityState);
     for (auto secIt = securityRange.first; secIt != securityRange.second; ++secIt) {
         if (secIt->second == it) {
-            securityIndex.erase(secIt);
+            shard.securityIndex.erase(secIt);
             break;
         }
     }
 }
 
+// Generation counters
+void TLBCache::initializeGenerations() {
+    streamGenerations.reset(new std::atomic<uint32_t>[1u << STREAM_GENERATION_BITS]);
+    for (size_t i = 0; i < (1u << STREAM_GENERATION_BITS); ++i) {
+        streamGenerations[i].store(0);
+    }
+    pasidGenerations.reset(new std::atomic<uint32_t>[1u << PASID_GENERATION_BITS]);
+    for (size_t i = 0; i < (1u << PASID_GENERATION_BITS); ++i) {
+        pasidGenerations[i].store(0);
+    }
+}
+
+std::atomic<uint32_t>& TLBCache::streamGeneration(StreamID streamID) const {
+    // Multiplicative hashing spreads consecutive StreamIDs over the slots
+    return streamGenerations[(static_cast<uint32_t>(streamID) * 0x9E3779B1u) >> (32 - STREAM_GENERATION_BITS)];
+}
+
+std::atomic<uint32_t>& TLBCache::pasidGeneration(StreamID streamID, PASID pasid) const {
+    uint32_t mixed = (static_cast<uint32_t>(streamID) * 0x85EBCA6Bu) ^ static_cast<uint32_t>(pasid);
+    return pasidGenerations[(mixed * 0x9E3779B1u) >> (32 - PASID_GENERATION_BITS)];
+}
+
+bool TLBCache::isStale(const TLBEntry& entry) const {
+    return entry.streamGeneration != streamGeneration(entry.streamID).load(std::memory_order_acquire) ||
+           entry.pasidGeneration != pasidGeneration(entry.streamID, entry.pasid).load(std::memory_order_acquire);
+}
+
+// Sweep out entries of invalidated streams/PASIDs. Called with the shard lock
+// held; a shard is only scanned if a generation moved since its last sweep.
+void TLBCache::reclaimStale(Shard& shard) const {
+    uint64_t bumps = generationBumps.load(std::memory_order_acquire);
+    if (shard.sweptBumps == bumps) {
+        return;
+    }
+    shard.sweptBumps = bumps;
+    
+    if (shard.flatStore) {
+        shard.flatStore->eraseIf([this](const TLBEntry& entry) {
+            return isStale(entry);
+        });
+        return;
+    }
+    
+    for (auto it = shard.tlbCacheList.begin(); it != shard.tlbCacheList.end(); ) {
+        auto next = it;
+        ++next;
+        if (isStale(it->second)) {
+            eraseEntry(shard, it);
+        }
+        it = next;
+    }
+}
+
 // Thread-safe atomic statistics snapshot
 TLBCache::CacheStatistics TLBCache::getAtomicStatistics() const {
     CacheStatistics stats;
     
     // Use a loop to ensure consistent snapshot of hit/miss counters
     // This addresses the race condition where counters can be modified between individual reads
+    // With sharding, the aggregate over all shards is re-read until it is stable
     uint64_t currentHits, currentMisses;
     do {
-        currentHits = hitCount.load(std::memory_order_relaxed);
-        currentMisses = missCount.load(std::memory_order_relaxed);
+        currentHits = getHitCount();
+        currentMisses = getMissCount();
         // Verify that the values haven't changed during our reads
         // If they have, retry until we get a consistent snapshot
-    } while (currentHits != hitCount.load(std::memory_order_relaxed) || 
-             currentMisses != missCount.load(std::memory_order_relaxed));
+    } while (currentHits != getHitCount() || currentMisses != getMissCount());
     
     stats.hitCount = currentHits;
     stats.missCount = currentMisses;
     stats.totalLookups = stats.hitCount + stats.missCount;
-    stats.hitRate = stats.totalLookups > 0 ? 
+    stats.hitRate = stats.totalLookups > 0 ?
         static_cast<double>(stats.hitCount) / static_cast<double>(stats.totalLookups) : 0.0;
     
-    // For size and maxSize, we need the mutex briefly
-    {
-        std::lock_guard<std::mutex> lock(cacheMutex);
-        stats.currentSize = tlbCacheList.size();
-        stats.maxSize = maxSize;
-    }
+    // For size and maxSize, each shard's mutex is taken briefly
+    stats.currentSize = getSize();
+    stats.maxSize = getCapacity();
     
     return stats;
 }
 
-}
\ No newline at end of file
+}
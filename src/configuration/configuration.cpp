@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <cctype>
 #include <thread>
+#include <stdexcept>
 
 namespace smmu {
 
@@ -174,6 +175,21 @@ Result<SMMUConfiguration> SMMUConfiguration::fromString(const std::string& confi
         if (keyValuePairs.find("enable_caching") != keyValuePairs.end()) {
             config.cacheConfig.enableCaching = parseBoolean(keyValuePairs["enable_caching"]);
         }
+        if (keyValuePairs.find("enable_cache_aging") != keyValuePairs.end()) {
+            config.cacheConfig.enableCacheAging = parseBoolean(keyValuePairs["enable_cache_aging"]);
+        }
+        if (keyValuePairs.find("tlb_shard_count") != keyValuePairs.end()) {
+            config.cacheConfig.tlbShardCount = parseSize(keyValuePairs["tlb_shard_count"]);
+        }
+        if (keyValuePairs.find("tlb_backend") != keyValuePairs.end()) {
+            config.cacheConfig.tlbBackend = parseTLBBackend(keyValuePairs["tlb_backend"]);
+        }
+        if (keyValuePairs.find("micro_tlb_entries") != keyValuePairs.end()) {
+            config.cacheConfig.microTlbEntries = parseSize(keyValuePairs["micro_tlb_entries"]);
+        }
+        if (keyValuePairs.find("walk_cache_entries") != keyValuePairs.end()) {
+            config.cacheConfig.walkCacheEntries = parseSize(keyValuePairs["walk_cache_entries"]);
+        }
         
         // Parse address configuration
         if (keyValuePairs.find("max_iova_size") != keyValuePairs.end()) {
@@ -227,6 +243,11 @@ std::string SMMUConfiguration::toString() const {
     oss << "tlb_cache_size=" << sizeToString(cacheConfig.tlbCacheSize) << "\n";
     oss << "cache_max_age=" << uint32ToString(cacheConfig.cacheMaxAge) << "\n";
     oss << "enable_caching=" << booleanToString(cacheConfig.enableCaching) << "\n";
+    oss << "enable_cache_aging=" << booleanToString(cacheConfig.enableCacheAging) << "\n";
+    oss << "tlb_shard_count=" << sizeToString(cacheConfig.tlbShardCount) << "\n";
+    oss << "tlb_backend=" << tlbBackendToString(cacheConfig.tlbBackend) << "\n";
+    oss << "micro_tlb_entries=" << sizeToString(cacheConfig.microTlbEntries) << "\n";
+    oss << "walk_cache_entries=" << sizeToString(cacheConfig.walkCacheEntries) << "\n";
     
     // Address configuration
     oss << "max_iova_size=" << uint64ToString(addressConfig.maxIOVASize) << "\n";
@@ -250,7 +271,7 @@ SMMUConfiguration SMMUConfiguration::createDefault() {
 
 SMMUConfiguration SMMUConfiguration::createHighPerformance() {
     QueueConfiguration queueConfig(2048, 1024, 512);    // Larger queues
-    CacheConfiguration cacheConfig(8192, 10000, true);  // Larger cache, longer retention
+    CacheConfiguration cacheConfig(8192, 10000, true, 16);  // Larger cache, longer retention, 16 lock stripes
     AddressConfiguration addressConfig(52, 52, 1048576, 1048576); // Maximum addressing
     ResourceLimits resourceLimits(4ULL * 1024 * 1024 * 1024, 16, 5000, true); // 4GB, 16 threads
     
@@ -277,7 +298,7 @@ SMMUConfiguration SMMUConfiguration::createMinimal() {
 
 SMMUConfiguration SMMUConfiguration::createServerProfile() {
     QueueConfiguration queueConfig(4096, 2048, 1024);   // Large queues for high throughput
-    CacheConfiguration cacheConfig(16384, 30000, true); // Very large cache, long retention
+    CacheConfiguration cacheConfig(16384, 30000, true, 32); // Very large cache, long retention, 32 lock stripes
     AddressConfiguration addressConfig(52, 52, 1048576, 1048576); // Full addressing
     ResourceLimits resourceLimits(8ULL * 1024 * 1024 * 1024, 32, 10000, true); // 8GB, 32 threads
     
@@ -309,7 +330,11 @@ VoidResult SMMUConfiguration::updateQueueSizes(size_t eventSize, size_t commandS
 }
 
 VoidResult SMMUConfiguration::updateCacheSettings(size_t cacheSize, uint32_t maxAge, bool enableCaching) {
-    CacheConfiguration newConfig(cacheSize, maxAge, enableCaching);
+    CacheConfiguration newConfig(cacheSize, maxAge, enableCaching, cacheConfig.tlbShardCount);
+    newConfig.tlbBackend = cacheConfig.tlbBackend;
+    newConfig.microTlbEntries = cacheConfig.microTlbEntries;
+    newConfig.walkCacheEntries = cacheConfig.walkCacheEntries;
+    newConfig.enableCacheAging = cacheConfig.enableCacheAging;
     return setCacheConfiguration(newConfig);
 }
 
@@ -331,6 +356,11 @@ bool SMMUConfiguration::operator==(const SMMUConfiguration& other) const {
            cacheConfig.tlbCacheSize == other.cacheConfig.tlbCacheSize &&
            cacheConfig.cacheMaxAge == other.cacheConfig.cacheMaxAge &&
            cacheConfig.enableCaching == other.cacheConfig.enableCaching &&
+           cacheConfig.enableCacheAging == other.cacheConfig.enableCacheAging &&
+           cacheConfig.tlbShardCount == other.cacheConfig.tlbShardCount &&
+           cacheConfig.tlbBackend == other.cacheConfig.tlbBackend &&
+           cacheConfig.microTlbEntries == other.cacheConfig.microTlbEntries &&
+           cacheConfig.walkCacheEntries == other.cacheConfig.walkCacheEntries &&
            addressConfig.maxIOVASize == other.addressConfig.maxIOVASize &&
            addressConfig.maxPASize == other.addressConfig.maxPASize &&
            addressConfig.maxStreamCount == other.addressConfig.maxStreamCount &&
@@ -396,6 +426,18 @@ SMMUConfiguration::ValidationResult SMMUConfiguration::validate() const {
         if (cacheConfig.cacheMaxAge < 100 || cacheConfig.cacheMaxAge > 3600000) {
             result.errors.push_back("Cache max age out of range [100ms, 1 hour]");
         }
+        if (cacheConfig.tlbShardCount < 1 || cacheConfig.tlbShardCount > 256 ||
+            (cacheConfig.tlbShardCount & (cacheConfig.tlbShardCount - 1)) != 0) {
+            result.errors.push_back("TLB shard count must be a power of two in [1, 256]");
+        }
+        if (cacheConfig.microTlbEntries != 0 &&
+            (cacheConfig.microTlbEntries < 16 || cacheConfig.microTlbEntries > 64)) {
+            result.errors.push_back("Micro-TLB entries must be 0 (disabled) or in [16, 64]");
+        }
+        if (cacheConfig.walkCacheEntries != 0 &&
+            (cacheConfig.walkCacheEntries < 16 || cacheConfig.walkCacheEntries > 65536)) {
+            result.errors.push_back("Walk cache entries must be 0 (disabled) or in [16, 65536]");
+        }
     }
     
     // Validate address configuration
@@ -495,6 +537,18 @@ size_t SMMUConfiguration::parseSize(const std::string& value) {
     return static_cast<size_t>(std::stoull(value));
 }
 
+TLBBackend SMMUConfiguration::parseTLBBackend(const std::string& value) {
+    std::string lowercaseValue = value;
+    std::transform(lowercaseValue.begin(), lowercaseValue.end(), lowercaseValue.begin(), ::tolower);
+    if (lowercaseValue == "lru") {
+        return TLBBackend::LRUList;
+    }
+    if (lowercaseValue == "set_associative") {
+        return TLBBackend::SetAssociative;
+    }
+    throw std::invalid_argument("Unknown TLB backend: " + value);
+}
+
 // Helper methods for string serialization
 std::string SMMUConfiguration::booleanToString(bool value) const {
     return value ? "true" : "false";
@@ -512,4 +566,8 @@ std::string SMMUConfiguration::sizeToString(size_t value) const {
     return std::to_string(value);
 }
 
+std::string SMMUConfiguration::tlbBackendToString(TLBBackend value) const {
+    return value == TLBBackend::SetAssociative ? "set_associative" : "lru";
+}
+
 } // namespace smmu
\ No newline at end of file
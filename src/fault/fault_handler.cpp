@@ -7,7 +7,8 @@
 
 namespace smmu {
 
-FaultHandler::FaultHandler() : maxQueueSize(1000), totalFaults(0), translationFaults(0), permissionFaults(0) {
+FaultHandler::FaultHandler(std::shared_ptr<MemoryBudget> budget)
+    : budget(budget), eventQueue(PoolAllocator<FaultRecord>(budget.get())), maxQueueSize(1000), totalFaults(0), translationFaults(0), permissionFaults(0) {
 }
 
 FaultHandler::~FaultHandler() {
@@ -15,6 +16,11 @@ FaultHandler::~FaultHandler() {
 
 void FaultHandler::recordFault(const FaultRecord& fault) {
     std::lock_guard<std::mutex> lock(queueMutex);
+    
+    // Past the memory budget the queue stops growing and drops its oldest record
+    if (budget->isExhausted() && !eventQueue.empty()) {
+        eventQueue.pop_front();
+    }
     eventQueue.push_back(fault);
     
     // Update statistics
@@ -0,0 +1,142 @@
+// ARM SMMU v3 Epoch-Based Memory Reclamation Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/epoch_reclaimer.h"
+#include <atomic>
+
+namespace smmu {
+
+// Per-thread reader state. Records are never freed: when a thread exits its
+// record goes back to the pool for the next thread, so the list only grows to
+// the peak number of threads that took a guard. Padded to a cache line so
+// neighbouring readers do not false-share.
+struct EpochThreadRecord {
+    std::atomic<uint64_t> state;    // (epoch << 1) | 1 inside a guard, 0 outside
+    std::atomic<bool> inUse;
+    EpochThreadRecord* next;        // Fixed once the record is published
+    unsigned depth;                 // Guard nesting, owner thread only
+    char padding[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>) - sizeof(EpochThreadRecord*) -
+                 sizeof(unsigned)];
+    
+    EpochThreadRecord() : state(0), inUse(true), next(nullptr), depth(0) {
+    }
+};
+
+namespace {
+
+std::atomic<uint64_t> globalEpoch(0);
+std::atomic<EpochThreadRecord*> threadRecords(nullptr);
+
+EpochThreadRecord* claimRecord() {
+    for (EpochThreadRecord* record = threadRecords.load(std::memory_order_acquire); record; record = record->next) {
+        bool expected = false;
+        if (!record->inUse.load(std::memory_order_relaxed) &&
+            record->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return record;
+        }
+    }
+    
+    EpochThreadRecord* record = new EpochThreadRecord();
+    record->next = threadRecords.load(std::memory_order_relaxed);
+    while (!threadRecords.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+    }
+    return record;
+}
+
+struct ThreadRecordOwner {
+    EpochThreadRecord* record;
+    
+    ThreadRecordOwner() : record(claimRecord()) {
+    }
+    
+    ~ThreadRecordOwner() {
+        record->state.store(0, std::memory_order_release);
+        record->inUse.store(false, std::memory_order_release);
+    }
+};
+
+EpochThreadRecord* currentThreadRecord() {
+    static thread_local ThreadRecordOwner owner;
+    return owner.record;
+}
+
+// Move the global epoch on if every thread inside a guard has seen the
+// current one. Returns the epoch afterwards.
+uint64_t tryAdvanceEpoch() {
+    uint64_t epoch = globalEpoch.load(std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (EpochThreadRecord* record = threadRecords.load(std::memory_order_acquire); record; record = record->next) {
+        uint64_t state = record->state.load(std::memory_order_relaxed);
+        if ((state & 1) != 0 && (state >> 1) != epoch) {
+            return epoch;
+        }
+    }
+    if (globalEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst)) {
+        return epoch + 1;
+    }
+    return epoch;  // Another writer advanced it; compare_exchange loaded the new value
+}
+
+} // anonymous namespace
+
+// The fence orders the published epoch before every pointer the reader loads,
+// so an advance that missed the guard happened before those loads and the
+// reader cannot reach anything it lets be freed
+EpochGuard::EpochGuard() : record(currentThreadRecord()) {
+    if (record->depth++ == 0) {
+        record->state.store((globalEpoch.load(std::memory_order_relaxed) << 1) | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+EpochGuard::~EpochGuard() {
+    if (--record->depth == 0) {
+        record->state.store(0, std::memory_order_release);
+    }
+}
+
+EpochReclaimer::EpochReclaimer() {
+}
+
+EpochReclaimer::~EpochReclaimer() {
+    for (size_t i = 0; i < pending.size(); ++i) {
+        pending[i].deleter(pending[i].object);
+    }
+}
+
+// The object must already be unlinked, so only readers that were inside a
+// guard at this point can still reach it
+void EpochReclaimer::retire(void* object, Deleter deleter) {
+    Retired retired;
+    retired.object = object;
+    retired.deleter = deleter;
+    retired.epoch = globalEpoch.load(std::memory_order_seq_cst);
+    pending.push_back(retired);
+}
+
+// Two advances free everything retired so far when no reader is active;
+// otherwise objects wait for a later call
+void EpochReclaimer::reclaim() {
+    if (pending.empty()) {
+        return;
+    }
+    tryAdvanceEpoch();
+    uint64_t epoch = tryAdvanceEpoch();
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (pending[i].epoch + 2 <= epoch) {
+            pending[i].deleter(pending[i].object);
+        } else {
+            pending[kept++] = pending[i];
+        }
+    }
+    pending.resize(kept);
+}
+
+size_t EpochReclaimer::getPendingCount() const {
+    return pending.size();
+}
+
+} // namespace smmu
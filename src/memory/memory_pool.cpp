@@ -0,0 +1,247 @@
+// ARM SMMU v3 Memory Pools Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/memory_pool.h"
+#include <atomic>
+
+namespace smmu {
+
+const size_t SlabAllocator::BLOCK_ALIGNMENT;
+const size_t SlabAllocator::MAX_BLOCK_SIZE;
+const size_t SlabAllocator::SLAB_SIZE;
+
+namespace {
+
+std::atomic<uint64_t> reservedBytes(0);
+
+const size_t SIZE_CLASS_COUNT = SlabAllocator::MAX_BLOCK_SIZE / SlabAllocator::BLOCK_ALIGNMENT;
+const size_t THREAD_CACHE_BATCH = 16;   // Blocks moved between a thread and its pool at once
+const size_t THREAD_CACHE_LIMIT = 32;   // Blocks a thread keeps per class before giving a batch back
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+size_t sizeClassFor(size_t bytes) {
+    return bytes == 0 ? 0 : (bytes - 1) / SlabAllocator::BLOCK_ALIGNMENT;
+}
+
+size_t blockSizeOf(size_t sizeClass) {
+    return (sizeClass + 1) * SlabAllocator::BLOCK_ALIGNMENT;
+}
+
+// Shared free list of one size class
+struct SizeClassPool {
+    std::mutex poolMutex;
+    FreeBlock* freeList;
+    
+    SizeClassPool() : freeList(nullptr) {
+    }
+    
+    // Hand out up to `count` blocks as a chain, adding a slab if none are free
+    FreeBlock* take(size_t blockSize, size_t count, size_t& taken) {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (!freeList) {
+            char* slab = static_cast<char*>(::operator new(SlabAllocator::SLAB_SIZE));
+            reservedBytes.fetch_add(SlabAllocator::SLAB_SIZE, std::memory_order_relaxed);
+            for (size_t offset = SlabAllocator::SLAB_SIZE - SlabAllocator::SLAB_SIZE % blockSize; offset != 0;) {
+                offset -= blockSize;
+                FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + offset);
+                block->next = freeList;
+                freeList = block;
+            }
+        }
+        
+        FreeBlock* head = freeList;
+        FreeBlock* tail = head;
+        taken = 1;
+        while (taken < count && tail->next) {
+            tail = tail->next;
+            ++taken;
+        }
+        freeList = tail->next;
+        tail->next = nullptr;
+        return head;
+    }
+    
+    void give(FreeBlock* head, FreeBlock* tail) {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        tail->next = freeList;
+        freeList = head;
+    }
+};
+
+// Never destroyed, so blocks may still be freed during static destruction
+SizeClassPool* sizeClassPools() {
+    static SizeClassPool* pools = new SizeClassPool[SIZE_CLASS_COUNT];
+    return pools;
+}
+
+void giveToPool(size_t sizeClass, FreeBlock* head, FreeBlock* tail) {
+    sizeClassPools()[sizeClass].give(head, tail);
+}
+
+struct ThreadCache {
+    FreeBlock* lists[SIZE_CLASS_COUNT];
+    size_t counts[SIZE_CLASS_COUNT];
+    
+    ThreadCache() {
+        for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+            lists[i] = nullptr;
+            counts[i] = 0;
+        }
+    }
+    
+    ~ThreadCache();
+};
+
+// Plain pointers, so nothing runs for them at thread exit: once the cache is
+// gone, blocks freed by later thread_local destructors go straight to the pools
+thread_local ThreadCache* threadCache = nullptr;
+thread_local bool threadCacheRetired = false;
+
+ThreadCache::~ThreadCache() {
+    threadCache = nullptr;
+    threadCacheRetired = true;
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+        if (lists[i]) {
+            FreeBlock* tail = lists[i];
+            while (tail->next) {
+                tail = tail->next;
+            }
+            giveToPool(i, lists[i], tail);
+        }
+    }
+}
+
+ThreadCache* currentThreadCache() {
+    if (threadCache || threadCacheRetired) {
+        return threadCache;
+    }
+    static thread_local ThreadCache cache;
+    threadCache = &cache;
+    return threadCache;
+}
+
+} // namespace
+
+MemoryBudget::MemoryBudget(uint64_t limit) : limit(limit), usage(0) {
+}
+
+void MemoryBudget::setLimit(uint64_t bytes) {
+    limit.store(bytes, std::memory_order_relaxed);
+}
+
+uint64_t MemoryBudget::getLimit() const {
+    return limit.load(std::memory_order_relaxed);
+}
+
+uint64_t MemoryBudget::getUsage() const {
+    return usage.load(std::memory_order_relaxed);
+}
+
+bool MemoryBudget::isExhausted() const {
+    uint64_t current = limit.load(std::memory_order_relaxed);
+    return current != 0 && usage.load(std::memory_order_relaxed) >= current;
+}
+
+bool MemoryBudget::tryCharge(size_t bytes) {
+    uint64_t used = usage.load(std::memory_order_relaxed);
+    for (;;) {
+        uint64_t current = limit.load(std::memory_order_relaxed);
+        if (current != 0 && (used > current || bytes > current - used)) {
+            return false;
+        }
+        if (usage.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+void MemoryBudget::charge(size_t bytes) {
+    usage.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::credit(size_t bytes) {
+    usage.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+const std::shared_ptr<MemoryBudget>& MemoryBudget::defaultBudget() {
+    static std::shared_ptr<MemoryBudget>* budget = new std::shared_ptr<MemoryBudget>(new MemoryBudget());
+    return *budget;
+}
+
+void* SlabAllocator::allocate(size_t bytes, size_t alignment) {
+    if (bytes > MAX_BLOCK_SIZE || alignment > BLOCK_ALIGNMENT) {
+        return ::operator new(bytes);
+    }
+    
+    size_t sizeClass = sizeClassFor(bytes);
+    ThreadCache* cache = currentThreadCache();
+    if (!cache) {
+        size_t taken;
+        return sizeClassPools()[sizeClass].take(blockSizeOf(sizeClass), 1, taken);
+    }
+    
+    if (!cache->lists[sizeClass]) {
+        size_t taken;
+        cache->lists[sizeClass] = sizeClassPools()[sizeClass].take(blockSizeOf(sizeClass), THREAD_CACHE_BATCH, taken);
+        cache->counts[sizeClass] = taken;
+    }
+    FreeBlock* block = cache->lists[sizeClass];
+    cache->lists[sizeClass] = block->next;
+    --cache->counts[sizeClass];
+    return block;
+}
+
+void SlabAllocator::deallocate(void* block, size_t bytes, size_t alignment) {
+    if (!block) {
+        return;
+    }
+    if (bytes > MAX_BLOCK_SIZE || alignment > BLOCK_ALIGNMENT) {
+        ::operator delete(block);
+        return;
+    }
+    
+    size_t sizeClass = sizeClassFor(bytes);
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    ThreadCache* cache = currentThreadCache();
+    if (!cache) {
+        giveToPool(sizeClass, freed, freed);
+        return;
+    }
+    
+    freed->next = cache->lists[sizeClass];
+    cache->lists[sizeClass] = freed;
+    if (++cache->counts[sizeClass] <= THREAD_CACHE_LIMIT) {
+        return;
+    }
+    
+    // Keep the most recently freed blocks and return the older ones
+    const size_t kept = THREAD_CACHE_LIMIT - THREAD_CACHE_BATCH;
+    FreeBlock* last = freed;
+    for (size_t i = 1; i < kept; ++i) {
+        last = last->next;
+    }
+    FreeBlock* head = last->next;
+    FreeBlock* tail = head;
+    while (tail->next) {
+        tail = tail->next;
+    }
+    last->next = nullptr;
+    giveToPool(sizeClass, head, tail);
+    cache->counts[sizeClass] = kept;
+}
+
+size_t SlabAllocator::blockSize(size_t bytes, size_t alignment) {
+    if (bytes > MAX_BLOCK_SIZE || alignment > BLOCK_ALIGNMENT) {
+        return bytes;
+    }
+    return blockSizeOf(sizeClassFor(bytes));
+}
+
+uint64_t SlabAllocator::getReservedBytes() {
+    return reservedBytes.load(std::memory_order_relaxed);
+}
+
+} // namespace smmu
@@ -0,0 +1,119 @@
+// ARM SMMU v3 Simulated Physical Memory Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/physical_memory.h"
+#include <cstring>
+
+namespace smmu {
+
+PhysicalMemory::PhysicalMemory() {
+}
+
+Result<uint64_t> PhysicalMemory::read64(PA address) const {
+    if ((address & 7) != 0 || !isValidRange(address, 8)) {
+        return makeError<uint64_t>(SMMUError::InvalidAddress);
+    }
+    
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    const uint8_t* frame = findFrame(address >> FRAME_SHIFT);
+    if (!frame) {
+        return Result<uint64_t>(0);
+    }
+    const uint8_t* bytes = frame + (address & (FRAME_SIZE - 1));
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | bytes[i];
+    }
+    return Result<uint64_t>(value);
+}
+
+VoidResult PhysicalMemory::write64(PA address, uint64_t value) {
+    if ((address & 7) != 0 || !isValidRange(address, 8)) {
+        return makeVoidError(SMMUError::InvalidAddress);
+    }
+    
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    uint8_t* bytes = frameForWrite(address >> FRAME_SHIFT) + (address & (FRAME_SIZE - 1));
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+    return makeVoidSuccess();
+}
+
+VoidResult PhysicalMemory::read(PA address, void* buffer, size_t length) const {
+    if (!isValidRange(address, length) || (length != 0 && !buffer)) {
+        return makeVoidError(SMMUError::InvalidAddress);
+    }
+    
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    while (length != 0) {
+        size_t offset = static_cast<size_t>(address & (FRAME_SIZE - 1));
+        size_t chunk = FRAME_SIZE - offset < length ? FRAME_SIZE - offset : length;
+        const uint8_t* frame = findFrame(address >> FRAME_SHIFT);
+        if (frame) {
+            std::memcpy(out, frame + offset, chunk);
+        } else {
+            std::memset(out, 0, chunk);
+        }
+        out += chunk;
+        address += chunk;
+        length -= chunk;
+    }
+    return makeVoidSuccess();
+}
+
+VoidResult PhysicalMemory::write(PA address, const void* data, size_t length) {
+    if (!isValidRange(address, length) || (length != 0 && !data)) {
+        return makeVoidError(SMMUError::InvalidAddress);
+    }
+    
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    while (length != 0) {
+        size_t offset = static_cast<size_t>(address & (FRAME_SIZE - 1));
+        size_t chunk = FRAME_SIZE - offset < length ? FRAME_SIZE - offset : length;
+        std::memcpy(frameForWrite(address >> FRAME_SHIFT) + offset, in, chunk);
+        in += chunk;
+        address += chunk;
+        length -= chunk;
+    }
+    return makeVoidSuccess();
+}
+
+size_t PhysicalMemory::getFrameCount() const {
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    return frames.size();
+}
+
+size_t PhysicalMemory::getResidentBytes() const {
+    return getFrameCount() * FRAME_SIZE;
+}
+
+void PhysicalMemory::clear() {
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    frames.clear();
+}
+
+bool PhysicalMemory::isValidRange(PA address, size_t length) {
+    if (length == 0) {
+        return address <= MAX_PHYSICAL_ADDRESS;
+    }
+    return address <= MAX_PHYSICAL_ADDRESS && length - 1 <= MAX_PHYSICAL_ADDRESS - address;
+}
+
+const uint8_t* PhysicalMemory::findFrame(uint64_t frameNumber) const {
+    auto it = frames.find(frameNumber);
+    return it != frames.end() ? it->second.get() : nullptr;
+}
+
+// Frames start zeroed, matching what reads return before the first write
+uint8_t* PhysicalMemory::frameForWrite(uint64_t frameNumber) {
+    std::unique_ptr<uint8_t[]>& frame = frames[frameNumber];
+    if (!frame) {
+        frame.reset(new uint8_t[FRAME_SIZE]());
+    }
+    return frame.get();
+}
+
+} // namespace smmu
@@ -8,23 +8,84 @@
 
 namespace smmu {
 
+namespace {
+
+// Each thread owns a few micro-TLBs, one per SMMU it translates through, so a
+// thread serving several SMMUs keeps its L0 entries when it alternates them
+const size_t THREAD_MICRO_TLBS = 4;
+thread_local MicroTLB threadMicroTLBs[THREAD_MICRO_TLBS];
+thread_local size_t threadMicroTLBVictim = 0;
+
+void fillMicroTLB(MicroTLB* microTLB, StreamID streamID, PASID pasid, IOVA pageAlignedIOVA,
+                  PA physicalAddress, const PagePermissions& permissions, SecurityState securityState,
+                  uint64_t dirtyEpoch, uint64_t globalEpoch, uint64_t streamEpoch) {
+    MicroTLBEntry entry;
+    entry.page = pageAlignedIOVA;
+    entry.pageBase = physicalAddress & ~PAGE_MASK;
+    entry.streamID = streamID;
+    entry.pasid = pasid;
+    entry.globalEpoch = globalEpoch;
+    entry.streamEpoch = streamEpoch;
+    entry.dirtyEpoch = dirtyEpoch;
+    entry.permissions = permissions;
+    entry.securityState = securityState;
+    microTLB->insert(entry);
+}
+
+// A cached translation serves a write only if dirty logging saw a write to
+// its page in its address space's current dirty-log epoch; otherwise the
+// write walks again
+bool cachedTranslationServes(uint64_t dirtyEpoch, AccessType accessType) {
+    return accessType != AccessType::Write || dirtyEpoch == DIRTY_UNTRACKED ||
+           AddressSpace::isDirtyLogEpochCurrent(dirtyEpoch);
+}
+
+} // anonymous namespace
+
 // Default constructor - Initialize SMMU with default configuration
 SMMU::SMMU() 
-    : faultHandler(std::shared_ptr<FaultHandler>(new FaultHandler())),
-      tlbCache(std::unique_ptr<TLBCache>(new TLBCache(SMMUConfiguration::createDefault().getCacheConfiguration().tlbCacheSize))),
+    : memoryBudget(std::make_shared<MemoryBudget>()),
+      streamTable(SMMUConfiguration::createDefault().getAddressConfiguration().maxStreamCount),
+      faultHandler(std::shared_ptr<FaultHandler>(new FaultHandler(memoryBudget))),
+      tlbCache(std::unique_ptr<TLBCache>(new TLBCache(SMMUConfiguration::createDefault().getCacheConfiguration().tlbCacheSize,
+                                                      SMMUConfiguration::createDefault().getCacheConfiguration().tlbShardCount,
+                                                      SMMUConfiguration::createDefault().getCacheConfiguration().tlbBackend,
+                                                      memoryBudget))),
+      stage2Cache(std::unique_ptr<TLBCache>(new TLBCache(SMMUConfiguration::createDefault().getCacheConfiguration().tlbCacheSize,
+                                                         SMMUConfiguration::createDefault().getCacheConfiguration().tlbShardCount,
+                                                         SMMUConfiguration::createDefault().getCacheConfiguration().tlbBackend,
+                                                         memoryBudget))),
       configuration(SMMUConfiguration::createDefault()),
       globalFaultMode(FaultMode::Terminate),
       cachingEnabled(configuration.getCacheConfiguration().enableCaching),
       translationCount(0),
       cacheHits(0),
       cacheMisses(0),
+      instanceID(0),
+      microTLBEntries(0),
+      globalInvalidationEpoch(0),
+      microTLBRetiredHits(0),
+      microTLBHitBaseline(0),
+      cacheAgeTick(0),
+      cacheAgeTickTime(0),
+      cacheMaxAgeTicks(0),
+      cacheAgingEnabled(false),
+      sharedStage2StreamCount(0),
       // Task 5.3: Initialize event and command processing queues using configuration
+      eventQueue(PoolAllocator<EventEntry>(memoryBudget.get())),
+      commandQueue(PoolAllocator<CommandEntry>(memoryBudget.get())),
+      priQueue(PoolAllocator<PRIEntry>(memoryBudget.get())),
       maxEventQueueSize(configuration.getQueueConfiguration().eventQueueSize),
       maxCommandQueueSize(configuration.getQueueConfiguration().commandQueueSize),
-      maxPRIQueueSize(configuration.getQueueConfiguration().priQueueSize) {
+      maxPRIQueueSize(configuration.getQueueConfiguration().priQueueSize),
+      asyncEngine(nullptr) {
     // Initialize empty stream map - streams will be added via configureStream
     // ARM SMMU v3 spec: Controller starts in disabled state with no streams configured
     
+    initializeMicroTLB();
+    configureCacheAging(configuration.getCacheConfiguration());
+    memoryBudget->setLimit(configuration.getResourceLimits().maxMemoryUsage);
+    
     // Task 5.3: Initialize empty queues for event and command processing
     eventQueue.clear();
     commandQueue.clear();
@@ -33,18 +94,40 @@ SMMU::SMMU()
 
 // Constructor with custom configuration
 SMMU::SMMU(const SMMUConfiguration& config)
-    : faultHandler(std::shared_ptr<FaultHandler>(new FaultHandler())),
-      tlbCache(std::unique_ptr<TLBCache>(new TLBCache(config.getCacheConfiguration().tlbCacheSize))),
+    : memoryBudget(std::make_shared<MemoryBudget>()),
+      streamTable(config.isValid() ? config.getAddressConfiguration().maxStreamCount
+                                   : SMMUConfiguration::createDefault().getAddressConfiguration().maxStreamCount),
+      faultHandler(std::shared_ptr<FaultHandler>(new FaultHandler(memoryBudget))),
+      tlbCache(std::unique_ptr<TLBCache>(new TLBCache(config.getCacheConfiguration().tlbCacheSize,
+                                                      config.getCacheConfiguration().tlbShardCount,
+                                                      config.getCacheConfiguration().tlbBackend, memoryBudget))),
+      stage2Cache(std::unique_ptr<TLBCache>(new TLBCache(config.getCacheConfiguration().tlbCacheSize,
+                                                         config.getCacheConfiguration().tlbShardCount,
+                                                         config.getCacheConfiguration().tlbBackend, memoryBudget))),
       configuration(config),
       globalFaultMode(FaultMode::Terminate),
       cachingEnabled(config.getCacheConfiguration().enableCaching),
       translationCount(0),
       cacheHits(0),
       cacheMisses(0),
+      instanceID(0),
+      microTLBEntries(0),
+      globalInvalidationEpoch(0),
+      microTLBRetiredHits(0),
+      microTLBHitBaseline(0),
+      cacheAgeTick(0),
+      cacheAgeTickTime(0),
+      cacheMaxAgeTicks(0),
+      cacheAgingEnabled(false),
+      sharedStage2StreamCount(0),
       // Task 5.3: Initialize event and command processing queues using configuration
+      eventQueue(PoolAllocator<EventEntry>(memoryBudget.get())),
+      commandQueue(PoolAllocator<CommandEntry>(memoryBudget.get())),
+      priQueue(PoolAllocator<PRIEntry>(memoryBudget.get())),
       maxEventQueueSize(config.getQueueConfiguration().eventQueueSize),
       maxCommandQueueSize(config.getQueueConfiguration().commandQueueSize),
-      maxPRIQueueSize(config.getQueueConfiguration().priQueueSize) {
+      maxPRIQueueSize(config.getQueueConfiguration().priQueueSize),
+      asyncEngine(nullptr) {
     // Validate the provided configuration
     if (!config.isValid()) {
         // Fall back to default configuration if invalid
@@ -54,6 +137,10 @@ SMMU::SMMU(const SMMUConfiguration& config)
     // Initialize empty stream map - streams will be added via configureStream
     // ARM SMMU v3 spec: Controller starts in disabled state with no streams configured
     
+    initializeMicroTLB();
+    configureCacheAging(configuration.getCacheConfiguration());
+    memoryBudget->setLimit(configuration.getResourceLimits().maxMemoryUsage);
+    
     // Task 5.3: Initialize empty queues for event and command processing
     eventQueue.clear();
     commandQueue.clear();
@@ -62,16 +149,294 @@ SMMU::SMMU(const SMMUConfiguration& config)
 
 // Destructor - RAII cleanup
 SMMU::~SMMU() {
-    // Clear all streams (unique_ptr will handle cleanup automatically)
-    streamMap.clear();
-    // faultHandler shared_ptr will handle cleanup automatically
+    // Asynchronous translations still queued complete before anything they use goes
+    delete asyncEngine.load();
+    
+    // The stream table frees its contexts; faultHandler shared_ptr cleans up itself
 }
 
 // Main translate() API - Enhanced with Task 5.2: Two-stage translation and TLBCache integration
 TranslationResult SMMU::translate(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType, SecurityState securityState) {
+    // Per-thread micro-TLB (L0): hits are served from thread-private entries and
+    // only read the invalidation epochs, so they write no shared cache lines
+    MicroTLB* microTLB = nullptr;
+    uint64_t globalEpoch = 0;
+    uint64_t streamEpoch = 0;
+    if (cachingEnabled && streamID <= MAX_STREAM_ID) {
+        microTLB = acquireMicroTLB();
+        if (microTLB) {
+            // Epochs are sampled before any lookup so a racing invalidation makes the fill stale
+            globalEpoch = globalInvalidationEpoch.load(std::memory_order_acquire);
+            streamEpoch = streamInvalidationEpoch(streamID).load(std::memory_order_acquire);
+            TranslationResult hit;
+            if (lookupMicroTLB(microTLB, streamID, pasid, iova, accessType, securityState, globalEpoch, streamEpoch, hit)) {
+                return hit;
+            }
+        }
+    }
+    
     // Update translation statistics (atomic operation for thread safety)
     translationCount.fetch_add(1);
     
+    return translateMiss(streamID, pasid, iova, accessType, securityState, microTLB, globalEpoch, streamEpoch);
+}
+
+// Scatter-gather translation: requests are taken in (StreamID, PASID, page)
+// order so each distinct page is translated once and the requests repeating
+// it reuse the result. Results land at the index of their request.
+void SMMU::translateBatch(const TranslationRequest* requests, TranslationResult* results, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    
+    // Writes lead their page: the one walk then marks it dirty for the reads too
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [requests](size_t a, size_t b) {
+        const TranslationRequest& left = requests[a];
+        const TranslationRequest& right = requests[b];
+        if (left.streamID != right.streamID) {
+            return left.streamID < right.streamID;
+        }
+        if (left.pasid != right.pasid) {
+            return left.pasid < right.pasid;
+        }
+        if (left.securityState != right.securityState) {
+            return left.securityState < right.securityState;
+        }
+        if ((left.iova & ~PAGE_MASK) != (right.iova & ~PAGE_MASK)) {
+            return (left.iova & ~PAGE_MASK) < (right.iova & ~PAGE_MASK);
+        }
+        if ((left.accessType == AccessType::Write) != (right.accessType == AccessType::Write)) {
+            return left.accessType == AccessType::Write;
+        }
+        return a < b;
+    });
+    
+    // One guard and one micro-TLB for the batch; epochs are sampled per stream
+    EpochGuard guard;
+    MicroTLB* microTLB = cachingEnabled ? acquireMicroTLB() : nullptr;
+    uint64_t globalEpoch = microTLB ? globalInvalidationEpoch.load(std::memory_order_acquire) : 0;
+    uint64_t streamEpoch = 0;
+    uint64_t translated = 0;
+    
+    for (size_t first = 0; first < count;) {
+        const TranslationRequest& lead = requests[order[first]];
+        if (microTLB && (first == 0 || requests[order[first - 1]].streamID != lead.streamID)) {
+            streamEpoch = streamInvalidationEpoch(lead.streamID).load(std::memory_order_acquire);
+        }
+        
+        TranslationResult& leadResult = results[order[first]];
+        if (!microTLB || !lookupMicroTLB(microTLB, lead.streamID, lead.pasid, lead.iova, lead.accessType,
+                                         lead.securityState, globalEpoch, streamEpoch, leadResult)) {
+            ++translated;
+            leadResult = translateMiss(lead.streamID, lead.pasid, lead.iova, lead.accessType, lead.securityState,
+                                       microTLB, globalEpoch, streamEpoch);
+        }
+        
+        // The rest of the page shares the lead's translation; anything it does
+        // not cover (a failure, a permission or an unlogged write) goes the
+        // single-request way so its fault is recorded. None of them is a
+        // micro-TLB hit, so each counts as a translation as translate() would.
+        size_t next = first + 1;
+        for (; next < count; ++next) {
+            const TranslationRequest& request = requests[order[next]];
+            if (request.streamID != lead.streamID || request.pasid != lead.pasid ||
+                request.securityState != lead.securityState ||
+                (request.iova & ~PAGE_MASK) != (lead.iova & ~PAGE_MASK)) {
+                break;
+            }
+            
+            ++translated;
+            if (leadResult.isOk() && validateAccessPermissions(leadResult.getValue().permissions, request.accessType) &&
+                cachedTranslationServes(leadResult.getValue().dirtyEpoch, request.accessType)) {
+                TranslationData data = leadResult.getValue();
+                data.physicalAddress += request.iova - lead.iova;
+                results[order[next]] = TranslationResult(data);
+            } else {
+                results[order[next]] = translateMiss(request.streamID, request.pasid, request.iova, request.accessType,
+                                                     request.securityState, microTLB, globalEpoch, streamEpoch);
+            }
+        }
+        first = next;
+    }
+    
+    translationCount.fetch_add(translated);
+}
+
+// One lookup per mapping rather than per page: a TLB hit or walk reports the
+// page, granule or block it came from, and the range steps to that mapping's
+// end. The micro-TLB only knows 4KB pages, so it is filled but not consulted.
+Result<RangeTranslation> SMMU::translateRange(StreamID streamID, PASID pasid, IOVA iova, size_t length,
+                                              AccessType accessType, SecurityState securityState) {
+    // The last byte, iova + length - 1, must not wrap
+    if (length != 0 && static_cast<uint64_t>(length) - 1 > ~iova) {
+        return makeError<RangeTranslation>(SMMUError::InvalidAddress);
+    }
+    
+    RangeTranslation range;
+    EpochGuard guard;
+    MicroTLB* microTLB = cachingEnabled && streamID <= MAX_STREAM_ID ? acquireMicroTLB() : nullptr;
+    uint64_t globalEpoch = microTLB ? globalInvalidationEpoch.load(std::memory_order_acquire) : 0;
+    uint64_t streamEpoch = microTLB ? streamInvalidationEpoch(streamID).load(std::memory_order_acquire) : 0;
+    uint64_t translated = 0;
+    
+    uint64_t remaining = length;
+    IOVA cursor = iova;
+    while (remaining != 0) {
+        ++translated;
+        TranslationResult result = translateMiss(streamID, pasid, cursor, accessType, securityState,
+                                                 microTLB, globalEpoch, streamEpoch);
+        if (result.isError()) {
+            range.faulted = true;
+            range.faultAddress = cursor;
+            range.faultError = result.getError();
+            break;
+        }
+        
+        const TranslationData& data = result.getValue();
+        uint64_t span = data.blockSize - (cursor & (data.blockSize - 1));
+        if (span > remaining) {
+            span = remaining;
+        }
+        if (!range.segments.empty() &&
+            range.segments.back().physicalAddress + range.segments.back().length == data.physicalAddress) {
+            range.segments.back().length += span;
+        } else {
+            range.segments.push_back(TranslationSegment(data.physicalAddress, span));
+        }
+        
+        range.translatedLength += span;
+        cursor += span;
+        remaining -= span;
+    }
+    
+    translationCount.fetch_add(translated);
+    return Result<RangeTranslation>(std::move(range));
+}
+
+// Cache hits are answered before submit returns; only misses wait for a
+// worker, which walks without probing the caches again
+VoidResult SMMU::translateAsync(const TranslationRequest& request, TranslationCallback callback) {
+    if (!callback) {
+        return makeVoidError(SMMUError::InvalidConfiguration);
+    }
+    
+    MicroTLB* microTLB = nullptr;
+    uint64_t globalEpoch = 0;
+    uint64_t streamEpoch = 0;
+    TranslationResult result;
+    if (cachingEnabled && request.streamID <= MAX_STREAM_ID) {
+        microTLB = acquireMicroTLB();
+        if (microTLB) {
+            globalEpoch = globalInvalidationEpoch.load(std::memory_order_acquire);
+            streamEpoch = streamInvalidationEpoch(request.streamID).load(std::memory_order_acquire);
+            if (lookupMicroTLB(microTLB, request.streamID, request.pasid, request.iova, request.accessType,
+                               request.securityState, globalEpoch, streamEpoch, result)) {
+                callback(request, result);
+                return makeVoidSuccess();
+            }
+        }
+    }
+    
+    translationCount.fetch_add(1);
+    if (lookupTLB(request.streamID, request.pasid, request.iova, request.accessType, request.securityState,
+                  microTLB, globalEpoch, streamEpoch, result)) {
+        callback(request, result);
+        return makeVoidSuccess();
+    }
+    
+    acquireAsyncEngine()->submit(request, std::move(callback));
+    return makeVoidSuccess();
+}
+
+void SMMU::waitForAsyncTranslations() {
+    TranslationEngine* engine = asyncEngine.load(std::memory_order_acquire);
+    if (engine) {
+        engine->drain();
+    }
+}
+
+size_t SMMU::getAsyncWorkerCount() const {
+    TranslationEngine* engine = asyncEngine.load(std::memory_order_acquire);
+    return engine ? engine->getWorkerCount() : 0;
+}
+
+TranslationEngine* SMMU::acquireAsyncEngine() {
+    TranslationEngine* engine = asyncEngine.load(std::memory_order_acquire);
+    if (engine) {
+        return engine;
+    }
+    
+    std::lock_guard<std::mutex> lock(sMMUMutex);
+    engine = asyncEngine.load(std::memory_order_relaxed);
+    if (!engine) {
+        // Workers have no micro-TLB of their own to fill: requests reach them
+        // from other threads
+        const ResourceLimits& limits = configuration.getResourceLimits();
+        engine = new TranslationEngine([this](const TranslationRequest& request) {
+            return translateWalk(request.streamID, request.pasid, request.iova, request.accessType,
+                                 request.securityState, nullptr, 0, 0);
+        }, limits.maxThreadCount, limits.timeoutMs);
+        asyncEngine.store(engine, std::memory_order_release);
+    }
+    return engine;
+}
+
+// Called without sMMUMutex: resizing waits for running callbacks, which may
+// configure streams. A pool not started yet reads the limits when it starts.
+void SMMU::configureAsyncEngine() {
+    std::lock_guard<std::mutex> lock(asyncConfigMutex);
+    TranslationEngine* engine = asyncEngine.load(std::memory_order_acquire);
+    if (!engine) {
+        return;
+    }
+    
+    ResourceLimits limits;
+    {
+        std::lock_guard<std::mutex> configLock(sMMUMutex);
+        limits = configuration.getResourceLimits();
+    }
+    engine->setTimeout(limits.timeoutMs);
+    engine->resize(limits.maxThreadCount);
+}
+
+// Per-thread micro-TLB (L0) probe; fills result and returns true on a hit.
+// Permission failures miss so the fault is recorded as usual, and unlogged
+// writes so the walk marks the page dirty.
+bool SMMU::lookupMicroTLB(MicroTLB* microTLB, StreamID streamID, PASID pasid, IOVA iova, AccessType accessType,
+                          SecurityState securityState, uint64_t globalEpoch, uint64_t streamEpoch,
+                          TranslationResult& result) const {
+    const MicroTLBEntry* hit = microTLB->lookup(streamID, pasid, iova & ~PAGE_MASK, securityState,
+                                                globalEpoch, streamEpoch);
+    if (!hit || !validateAccessPermissions(hit->permissions, accessType) ||
+        !cachedTranslationServes(hit->dirtyEpoch, accessType)) {
+        return false;
+    }
+    microTLB->recordHit();
+    result = TranslationResult(TranslationData(hit->pageBase + (iova & PAGE_MASK), hit->permissions, hit->securityState));
+    return true;
+}
+
+// Everything past the micro-TLB: the shared TLB, then the stream's walk.
+// The caller has counted the translation.
+TranslationResult SMMU::translateMiss(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType,
+                                      SecurityState securityState, MicroTLB* microTLB,
+                                      uint64_t globalEpoch, uint64_t streamEpoch) {
+    TranslationResult result;
+    if (lookupTLB(streamID, pasid, iova, accessType, securityState, microTLB, globalEpoch, streamEpoch, result)) {
+        return result;
+    }
+    return translateWalk(streamID, pasid, iova, accessType, securityState, microTLB, globalEpoch, streamEpoch);
+}
+
+// Shared TLB probe; true when result holds the answer, which may be a fault
+// found without walking
+bool SMMU::lookupTLB(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType,
+                     SecurityState securityState, MicroTLB* microTLB,
+                     uint64_t globalEpoch, uint64_t streamEpoch, TranslationResult& result) {
     // ARM SMMU v3 spec: Validate StreamID bounds
     if (streamID > MAX_STREAM_ID) {
         FaultRecord fault;
@@ -86,64 +451,82 @@ TranslationResult SMMU::translate(StreamID streamID, PASID pasid, IOVA iova, Acc
         
         recordFault(fault);
         // No need to record cache miss here - TLBCache handles its own statistics
-        return makeTranslationError(SMMUError::InvalidStreamID);
+        result = makeTranslationError(SMMUError::InvalidStreamID);
+        return true;
     }
     
+    // Stage-2-only streams of a VM use the entries shared under its VMID
+    StreamID keyStreamID = streamID;
+    PASID keyPASID = pasid;
+    resolveCacheKey(streamID, pasid, keyStreamID, keyPASID);
+    
     // Task 5.2: Optimized fast path - Check TLB cache first for maximum performance
     if (cachingEnabled && tlbCache) {
         // Performance optimization: Direct TLB lookup without intermediate method call overhead
         IOVA pageAlignedIOVA = iova & ~PAGE_MASK;
-        TLBEntry* entry = tlbCache->lookup(streamID, pasid, pageAlignedIOVA, securityState);
+        // Entries older than the aging floor count as misses; a hit reads no clock
+        // The entry is copied under the shard lock: another thread may evict or
+        // overwrite the cached one as soon as the lock is released
+        TLBEntry entry;
+        bool hit = tlbCache->lookup(keyStreamID, keyPASID, pageAlignedIOVA, securityState, cacheFreshnessFloor(), entry);
         
-        if (entry && entry->valid) {
+        // Writes the dirty log has not seen this epoch are left to the walk
+        if (hit && entry.valid && cachedTranslationServes(entry.dirtyEpoch, accessType)) {
             // Security validation: Ensure TLB entry SecurityState matches request
-            if (entry->securityState != securityState) {
+            if (entry.securityState != securityState) {
                 // Security state mismatch - invalidate entry and continue to full translation
-                tlbCache->invalidate(streamID, pasid, pageAlignedIOVA, securityState);
+                tlbCache->invalidate(keyStreamID, keyPASID, pageAlignedIOVA, securityState);
             } else {
-                // Fast path: Validate cache entry age inline for speed
-                uint64_t currentTime = std::chrono::duration_cast<std::chrono::microseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count();
+                // Cache hit - validate access permissions against requested access type
+                if (!validateAccessPermissions(entry.permissions, accessType)) {
+                    // Permission fault - record fault and return error
+                    FaultRecord fault;
+                    fault.streamID = streamID;
+                    fault.pasid = pasid;
+                    fault.address = iova;
+                    fault.faultType = FaultType::PermissionFault;
+                    fault.accessType = accessType;
+                    fault.securityState = securityState;
+                    fault.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
                 
-                const uint64_t MAX_CACHE_AGE_US = 1000000; // 1 second max age
-                if (currentTime - entry->timestamp <= MAX_CACHE_AGE_US) {
-                    // Cache hit - validate access permissions against requested access type
-                    if (!validateAccessPermissions(entry->permissions, accessType)) {
-                        // Permission fault - record fault and return error
-                        FaultRecord fault;
-                        fault.streamID = streamID;
-                        fault.pasid = pasid;
-                        fault.address = iova;
-                        fault.faultType = FaultType::PermissionFault;
-                        fault.accessType = accessType;
-                        fault.securityState = securityState;
-                        fault.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
-                            std::chrono::steady_clock::now().time_since_epoch()).count();
+                    recordFault(fault);
+                    result = makeTranslationError(SMMUError::PagePermissionViolation);
+                    return true;
+                }
                         
-                        recordFault(fault);
-                        return makeTranslationError(SMMUError::PagePermissionViolation);
-                    }
-                    
-                    // TLBCache already recorded hit statistics
-                    // No need for additional recordCacheHit() here
+                // TLBCache already recorded hit statistics
+                // No need for additional recordCacheHit() here
                     
-                    PA finalPA = entry->physicalAddress + (iova & PAGE_MASK);
-                    TranslationData data(finalPA, entry->permissions, entry->securityState);
-                    return TranslationResult(data);
-                } else {
-                    // Entry expired - invalidate and continue to full translation
-                    tlbCache->invalidate(streamID, pasid, pageAlignedIOVA, securityState);
+                // Block entries cover many pages; offset from the block base
+                if (microTLB) {
+                    fillMicroTLB(microTLB, streamID, pasid, pageAlignedIOVA,
+                                 entry.physicalAddress + (pageAlignedIOVA - entry.iova),
+                                 entry.permissions, entry.securityState, entry.dirtyEpoch, globalEpoch, streamEpoch);
                 }
+                    
+                PA finalPA = entry.physicalAddress + (iova - entry.iova);
+                TranslationData data(finalPA, entry.permissions, entry.securityState, entry.blockSize);
+                result = TranslationResult(data);
+                return true;
             }
         }
         // Cache miss - TLBCache already recorded miss statistics
         // No need for additional recordCacheMiss() here
     }
+    return false;
+}
     
-    // Check if stream is configured (protect streamMap access)
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+// Find the stream and walk, caching what the walk returns
+TranslationResult SMMU::translateWalk(StreamID streamID, PASID pasid, IOVA iova, AccessType accessType,
+                                      SecurityState securityState, MicroTLB* microTLB,
+                                      uint64_t globalEpoch, uint64_t streamEpoch) {
+    // The stream table is read without a lock. The guard keeps the context
+    // alive through the walk even if the stream is removed meanwhile, so
+    // misses on different streams walk in parallel.
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         // Stream not configured - record translation fault
         FaultRecord fault;
         fault.streamID = streamID;
@@ -160,15 +543,32 @@ TranslationResult SMMU::translate(StreamID streamID, PASID pasid, IOVA iova, Acc
         return makeTranslationError(SMMUError::StreamNotConfigured);
     }
     
-    StreamContext* streamContext = streamIt->second.get();
+    // Resolve the key now that the stream is known; a sharing change racing
+    // with the walk is, like any STE change, followed by an invalidation
+    StreamID keyStreamID = streamID;
+    PASID keyPASID = pasid;
+    resolveCacheKey(streamID, pasid, keyStreamID, keyPASID);
+    
+    // Snapshot generations before the walk so a concurrent stream/PASID
+    // invalidation leaves the fill below already stale
+    TLBCache::Generation generation = {0, 0};
+    if (tlbCache) {
+        generation = tlbCache->currentGeneration(keyStreamID, keyPASID);
+    }
     
     // Task 5.2: Enhanced two-stage translation with comprehensive error handling
     TranslationResult result = performTwoStageTranslation(streamID, pasid, iova, accessType, securityState, streamContext);
     
     // Task 5.2: Cache successful translations for future lookups
     if (result.isOk() && isTranslationCacheable(result) && cachingEnabled && tlbCache) {
-        cacheTranslationResult(streamID, pasid, iova, result);
+        cacheTranslationResult(keyStreamID, keyPASID, iova, result, generation);
         // No need to record cache hit here - this is cache storage, not a hit
+        
+        if (microTLB) {
+            const TranslationData& data = result.getValue();
+            fillMicroTLB(microTLB, streamID, pasid, iova & ~PAGE_MASK, data.physicalAddress,
+                         data.permissions, data.securityState, data.dirtyEpoch, globalEpoch, streamEpoch);
+        }
     } else if (result.isError()) {
         // Task 5.2: Enhanced fault handling and recovery mechanisms
         // ARM SMMU v3 spec: Comprehensive fault classification and recovery
@@ -194,23 +594,25 @@ VoidResult SMMU::configureStream(StreamID streamID, const StreamConfig& config)
     }
     
     std::lock_guard<std::mutex> lock(sMMUMutex);
+    std::lock_guard<std::mutex> streamLockGuard(streamLock(streamID));
     // Check if stream already exists
-    if (streamMap.find(streamID) != streamMap.end()) {
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (streamContext) {
         // Update existing stream configuration
-        StreamContext* streamContext = streamMap[streamID].get();
         VoidResult updateResult = streamContext->updateConfiguration(config);
         if (updateResult.isError()) {
             return updateResult;
         }
+        bumpStreamInvalidationEpoch(streamID);
         
         // Note: Stream enable/disable is managed separately from configuration
         // ARM SMMU v3 spec: Configuration and stream enabling are separate operations
     } else {
         // Create new StreamContext
-        std::unique_ptr<StreamContext> streamContext(new StreamContext());
+        std::unique_ptr<StreamContext> newContext(new StreamContext(memoryBudget));
         
         // Configure the stream context with provided configuration
-        VoidResult configResult = streamContext->updateConfiguration(config);
+        VoidResult configResult = newContext->updateConfiguration(config);
         if (configResult.isError()) {
             return configResult;
         }
@@ -219,11 +621,13 @@ VoidResult SMMU::configureStream(StreamID streamID, const StreamConfig& config)
         // ARM SMMU v3 spec: Configuration and stream enabling are separate operations
         
         // Set fault handler for the stream
-        streamContext->setFaultHandler(faultHandler);
+        newContext->setFaultHandler(faultHandler);
+        newContext->setTableWalker(std::atomic_load(&tableWalker));
         
-        // Add to stream map
-        streamMap[streamID] = std::move(streamContext);
+        // Publish in the stream table; translations see it from here on
+        streamContext = streamTable.insert(streamID, std::move(newContext));
     }
+    updateSharedStage2(streamID, streamContext);
     
     return makeVoidSuccess();
 }
@@ -236,20 +640,31 @@ VoidResult SMMU::removeStream(StreamID streamID) {
     }
     
     std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    std::lock_guard<std::mutex> streamLockGuard(streamLock(streamID));
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return makeVoidError(SMMUError::StreamNotFound);
     }
     
     // Disable stream before removal
-    VoidResult disableResult = streamIt->second->disableStream();
+    VoidResult disableResult = streamContext->disableStream();
     (void)disableResult; // Suppress unused variable warning - continue even if disable fails
     
     // Clear all PASIDs for this stream
-    streamIt->second->clearAllPASIDs();
+    streamContext->clearAllPASIDs();
+    
+    // Unpublish; the context is freed once no translation still uses it
+    streamTable.remove(streamID);
+    updateSharedStage2(streamID, nullptr);
     
-    // Remove from map (unique_ptr will handle cleanup)
-    streamMap.erase(streamIt);
+    // Cached translations must not outlive the stream
+    if (tlbCache) {
+        tlbCache->invalidateStream(streamID);
+    }
+    if (stage2Cache) {
+        stage2Cache->invalidateStream(streamID);
+    }
+    bumpStreamInvalidationEpoch(streamID);
     
     return makeVoidSuccess();
 }
@@ -261,8 +676,8 @@ Result<bool> SMMU::isStreamConfigured(StreamID streamID) const {
         return makeError<bool>(SMMUError::InvalidStreamID);
     }
     
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    bool configured = streamMap.find(streamID) != streamMap.end();
+    EpochGuard guard;
+    bool configured = streamTable.find(streamID) != nullptr;
     return Result<bool>(configured);
 }
 
@@ -273,17 +688,19 @@ VoidResult SMMU::enableStream(StreamID streamID) {
         return makeVoidError(SMMUError::InvalidStreamID);
     }
     
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return makeVoidError(SMMUError::StreamNotFound);
     }
     
     // Delegate to StreamContext
-    VoidResult result = streamIt->second->enableStream();
+    VoidResult result = streamContext->enableStream();
     if (result.isError()) {
         return result;
     }
+    updateSharedStage2(streamID, streamContext);
     
     return makeVoidSuccess();
 }
@@ -294,17 +711,20 @@ VoidResult SMMU::disableStream(StreamID streamID) {
         return makeVoidError(SMMUError::InvalidStreamID);
     }
     
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return makeVoidError(SMMUError::StreamNotFound);
     }
     
     // Delegate to StreamContext
-    VoidResult result = streamIt->second->disableStream();
+    VoidResult result = streamContext->disableStream();
     if (result.isError()) {
         return result;
     }
+    updateSharedStage2(streamID, streamContext);
+    bumpStreamInvalidationEpoch(streamID);
     
     return makeVoidSuccess();
 }
@@ -316,13 +736,13 @@ Result<bool> SMMU::isStreamEnabled(StreamID streamID) const {
         return makeError<bool>(SMMUError::InvalidStreamID);
     }
     
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return makeError<bool>(SMMUError::StreamNotConfigured);
     }
     
-    Result<bool> enabledResult = streamIt->second->isStreamEnabled();
+    Result<bool> enabledResult = streamContext->isStreamEnabled();
     return enabledResult;
 }
 
@@ -338,13 +758,14 @@ VoidResult SMMU::createStreamPASID(StreamID streamID, PASID pasid) {
         return makeVoidError(SMMUError::InvalidStreamID);
     }
     
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return makeVoidError(SMMUError::StreamNotFound);
     }
     
-    return streamIt->second->createPASID(pasid);
+    return streamContext->createPASID(pasid);
 }
 
 // Remove PASID from stream
@@ -354,14 +775,15 @@ VoidResult SMMU::removeStreamPASID(StreamID streamID, PASID pasid) {
         return makeVoidError(SMMUError::InvalidStreamID);
     }
     
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return makeVoidError(SMMUError::StreamNotFound);
     }
     
     // Remove PASID from stream context
-    VoidResult result = streamIt->second->removePASID(pasid);
+    VoidResult result = streamContext->removePASID(pasid);
     
     // ARM SMMU v3 spec: Invalidate all TLB cache entries for removed PASID
     // This ensures subsequent translations to this PASID will fail properly
@@ -372,6 +794,152 @@ VoidResult SMMU::removeStreamPASID(StreamID streamID, PASID pasid) {
     return result;
 }
 
+// Attach a Stage-2 context tagged with a VMID
+// ARM SMMU v3 spec: STE.S2VMID - one VMID names one set of Stage-2 tables
+VoidResult SMMU::setStreamStage2(StreamID streamID, VMID vmid, std::shared_ptr<AddressSpace> stage2AddressSpace) {
+    // Validate StreamID bounds
+    if (streamID > MAX_STREAM_ID) {
+        return makeVoidError(SMMUError::InvalidStreamID);
+    }
+    if (!stage2AddressSpace) {
+        return makeVoidError(SMMUError::StreamConfigurationError);
+    }
+    
+    std::lock_guard<std::mutex> lock(sMMUMutex);
+    std::lock_guard<std::mutex> streamLockGuard(streamLock(streamID));
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
+        return makeVoidError(SMMUError::StreamNotFound);
+    }
+    
+    // Streams sharing a VMID share its TLB entries, so they must share its tables
+    bool vmidInUse = false;
+    bool tablesConflict = false;
+    streamTable.forEach([&](StreamID otherID, StreamContext* otherContext) {
+        if (otherID == streamID || !otherContext->hasVMID() || otherContext->getVMID() != vmid) {
+            return;
+        }
+        if (otherContext->getStage2AddressSpace() != stage2AddressSpace.get()) {
+            tablesConflict = true;
+        }
+        vmidInUse = true;
+    });
+    if (tablesConflict) {
+        return makeVoidError(SMMUError::StreamConfigurationError);
+    }
+    
+    streamContext->setStage2AddressSpace(stage2AddressSpace);
+    streamContext->setVMID(vmid);
+    
+    // Drop what the stream cached under its old context; a VMID nobody else
+    // uses may have held different tables before
+    if (tlbCache) {
+        tlbCache->invalidateStream(streamID);
+        if (!vmidInUse) {
+            tlbCache->invalidateVMID(vmid);
+        }
+    }
+    if (stage2Cache) {
+        stage2Cache->invalidateStream(streamID);
+        if (!vmidInUse) {
+            stage2Cache->invalidateVMID(vmid);
+        }
+    }
+    bumpGlobalInvalidationEpoch();
+    updateSharedStage2(streamID, streamContext);
+    
+    return makeVoidSuccess();
+}
+
+// Tag a PASID's Stage-1 context with an ASID for TLBI_NH_ASID
+// Stage-1 tables are per PASID here, so its entries stay keyed by (StreamID, PASID)
+VoidResult SMMU::setStreamASID(StreamID streamID, PASID pasid, ASID asid) {
+    // ARM SMMU v3 spec: Validate PASID bounds
+    if (pasid > MAX_PASID) {
+        return makeVoidError(SMMUError::InvalidPASID);
+    }
+    
+    // Validate StreamID bounds
+    if (streamID > MAX_STREAM_ID) {
+        return makeVoidError(SMMUError::InvalidStreamID);
+    }
+    
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
+        return makeVoidError(SMMUError::StreamNotFound);
+    }
+    
+    return streamContext->setASID(pasid, asid);
+}
+
+VoidResult SMMU::setStreamGranule(StreamID streamID, TranslationGranule granule) {
+    // Validate StreamID bounds
+    if (streamID > MAX_STREAM_ID) {
+        return makeVoidError(SMMUError::InvalidStreamID);
+    }
+    
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
+        return makeVoidError(SMMUError::StreamNotFound);
+    }
+    
+    streamContext->setStage1Granule(granule);
+    return makeVoidSuccess();
+}
+
+// Attach the memory translation tables are walked in; every stream shares one
+// walker. Cached translations came from the old memory, so they all go.
+void SMMU::setPhysicalMemory(std::shared_ptr<PhysicalMemory> memory) {
+    {
+        std::lock_guard<std::mutex> lock(sMMUMutex);
+        std::shared_ptr<PageTableWalker> walker;
+        if (memory) {
+            walker = std::make_shared<PageTableWalker>(memory, configuration.getCacheConfiguration().walkCacheEntries);
+        }
+        std::atomic_store(&tableWalker, walker);
+        streamTable.forEach([&walker](StreamID, StreamContext* streamContext) {
+            streamContext->setTableWalker(walker);
+        });
+    }
+    invalidateTranslationCache();
+}
+
+std::shared_ptr<PhysicalMemory> SMMU::getPhysicalMemory() const {
+    std::shared_ptr<PageTableWalker> walker = std::atomic_load(&tableWalker);
+    return walker ? walker->getPhysicalMemory() : std::shared_ptr<PhysicalMemory>();
+}
+
+// ARM SMMU v3 spec: CD install followed by CMD_CFGI_CD - the PASID's cached
+// translations belong to its previous context
+VoidResult SMMU::setStreamContextDescriptor(StreamID streamID, PASID pasid, const ContextDescriptor& contextDescriptor) {
+    if (pasid > MAX_PASID) {
+        return makeVoidError(SMMUError::InvalidPASID);
+    }
+    if (streamID > MAX_STREAM_ID) {
+        return makeVoidError(SMMUError::InvalidStreamID);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(streamLock(streamID));
+        EpochGuard guard;
+        StreamContext* streamContext = streamTable.find(streamID);
+        if (!streamContext) {
+            return makeVoidError(SMMUError::StreamNotFound);
+        }
+        
+        VoidResult result = streamContext->setContextDescriptor(pasid, contextDescriptor);
+        if (result.isError()) {
+            return result;
+        }
+    }
+    invalidatePASIDCache(streamID, pasid);
+    return makeVoidSuccess();
+}
+
 // Per-stream per-PASID page operations
 VoidResult SMMU::mapPage(StreamID streamID, PASID pasid, IOVA iova, PA pa, const PagePermissions& permissions, SecurityState securityState) {
     // Validate StreamID bounds
@@ -379,13 +947,49 @@ VoidResult SMMU::mapPage(StreamID streamID, PASID pasid, IOVA iova, PA pa, const
         return makeVoidError(SMMUError::InvalidStreamID);
     }
     
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
+        return makeVoidError(SMMUError::StreamNotFound);
+    }
+    
+    VoidResult result = streamContext->mapPage(pasid, iova, pa, permissions, securityState);
+    
+    // Remapping replaces any cached translation, including a block split by the new page
+    if (result.isOk()) {
+        if (tlbCache) {
+            tlbCache->invalidate(streamID, pasid, iova & ~PAGE_MASK);
+        }
+        bumpStreamInvalidationEpoch(streamID);
+    }
+    
+    return result;
+}
+
+// Map a block (2MB or 1GB with the 4KB granule); cached translations it replaces are invalidated
+VoidResult SMMU::mapBlock(StreamID streamID, PASID pasid, IOVA iova, PA pa, uint64_t blockSize, const PagePermissions& permissions, SecurityState securityState) {
+    // Validate StreamID bounds
+    if (streamID > MAX_STREAM_ID) {
+        return makeVoidError(SMMUError::InvalidStreamID);
+    }
+    
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return makeVoidError(SMMUError::StreamNotFound);
     }
     
-    return streamIt->second->mapPage(pasid, iova, pa, permissions, securityState);
+    VoidResult result = streamContext->mapBlock(pasid, iova, pa, blockSize, permissions, securityState);
+    if (result.isOk()) {
+        if (tlbCache) {
+            tlbCache->invalidateRange(streamID, pasid, iova, iova + blockSize - 1);
+        }
+        bumpStreamInvalidationEpoch(streamID);
+    }
+    
+    return result;
 }
 
 VoidResult SMMU::unmapPage(StreamID streamID, PASID pasid, IOVA iova) {
@@ -394,20 +998,94 @@ VoidResult SMMU::unmapPage(StreamID streamID, PASID pasid, IOVA iova) {
         return makeVoidError(SMMUError::InvalidStreamID);
     }
     
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return makeVoidError(SMMUError::StreamNotFound);
     }
     
     // Unmap page from stream context
-    VoidResult result = streamIt->second->unmapPage(pasid, iova);
+    VoidResult result = streamContext->unmapPage(pasid, iova);
     
     // ARM SMMU v3 spec: Invalidate TLB cache entry for unmapped page
     // This ensures subsequent translations to this page will fail properly
     if (result.isOk() && tlbCache) {
         tlbCache->invalidate(streamID, pasid, iova & ~PAGE_MASK);
     }
+    if (result.isOk()) {
+        bumpStreamInvalidationEpoch(streamID);
+    }
+    
+    return result;
+}
+
+// Range unmap - one ordered-index TLB invalidation instead of one per page
+VoidResult SMMU::unmapRange(StreamID streamID, PASID pasid, IOVA startIova, IOVA endIova) {
+    // Validate StreamID bounds
+    if (streamID > MAX_STREAM_ID) {
+        return makeVoidError(SMMUError::InvalidStreamID);
+    }
+    
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
+        return makeVoidError(SMMUError::StreamNotFound);
+    }
+    
+    VoidResult result = streamContext->unmapRange(pasid, startIova, endIova);
+    if (result.isOk()) {
+        if (tlbCache) {
+            tlbCache->invalidateRange(streamID, pasid, startIova, endIova);
+        }
+        bumpStreamInvalidationEpoch(streamID);
+    }
+    
+    return result;
+}
+
+VoidResult SMMU::unmapPages(StreamID streamID, PASID pasid, const std::vector<IOVA>& iovas) {
+    // Validate StreamID bounds
+    if (streamID > MAX_STREAM_ID) {
+        return makeVoidError(SMMUError::InvalidStreamID);
+    }
+    
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
+        return makeVoidError(SMMUError::StreamNotFound);
+    }
+    
+    VoidResult result = streamContext->unmapPages(pasid, iovas);
+    if (result.isOk()) {
+        if (tlbCache && !iovas.empty()) {
+            // Coalesce the granule pages into contiguous runs, one range invalidation each
+            uint64_t granuleSize = streamContext->getGranuleSize(pasid);
+            uint64_t granuleMask = granuleSize - 1;
+            std::vector<IOVA> pages;
+            pages.reserve(iovas.size());
+            for (size_t i = 0; i < iovas.size(); ++i) {
+                pages.push_back(iovas[i] & ~granuleMask);
+            }
+            std::sort(pages.begin(), pages.end());
+            
+            IOVA runStart = pages[0];
+            IOVA runEnd = pages[0];
+            for (size_t i = 1; i < pages.size(); ++i) {
+                if (pages[i] <= runEnd + granuleSize) {
+                    runEnd = pages[i];
+                } else {
+                    tlbCache->invalidateRange(streamID, pasid, runStart, runEnd + granuleMask);
+                    runStart = pages[i];
+                    runEnd = pages[i];
+                }
+            }
+            tlbCache->invalidateRange(streamID, pasid, runStart, runEnd + granuleMask);
+        }
+        bumpStreamInvalidationEpoch(streamID);
+    }
     
     return result;
 }
@@ -450,17 +1128,17 @@ VoidResult SMMU::setGlobalFaultMode(FaultMode mode) {
     globalFaultMode = mode;
     
     // Apply to all configured streams
-    for (auto& streamPair : streamMap) {
-        StreamConfig config = streamPair.second->getStreamConfiguration();
-        config.faultMode = mode;
-        VoidResult result = streamPair.second->updateConfiguration(config);
+    VoidResult result = makeVoidSuccess();
+    streamTable.forEach([&](StreamID, StreamContext* streamContext) {
         if (result.isError()) {
-            // Continue updating other streams but return error
-            return result;
+            return;
         }
-    }
+        StreamConfig config = streamContext->getStreamConfiguration();
+        config.faultMode = mode;
+        result = streamContext->updateConfiguration(config);
+    });
     
-    return makeVoidSuccess();
+    return result;
 }
 
 // Global caching enable/disable - Enhanced with TLBCache integration (Task 5.2)
@@ -473,9 +1151,13 @@ VoidResult SMMU::enableCaching(bool enable) {
         try {
             // If disabling caching, clear the cache to ensure consistency
             tlbCache->clear();
+            if (stage2Cache) {
+                stage2Cache->clear();
+            }
         } catch (...) {
             return makeVoidError(SMMUError::CacheOperationFailed);
         }
+        bumpGlobalInvalidationEpoch();
     }
     
     return makeVoidSuccess();
@@ -483,11 +1165,11 @@ VoidResult SMMU::enableCaching(bool enable) {
 
 // Statistics and monitoring - System-wide monitoring
 size_t SMMU::getStreamCount() const {
-    return streamMap.size();
+    return streamTable.size();
 }
 
 uint64_t SMMU::getTotalTranslations() const {
-    return translationCount;
+    return translationCount + getMicroTLBHitCount();
 }
 
 uint64_t SMMU::getTotalFaults() const {
@@ -495,7 +1177,7 @@ uint64_t SMMU::getTotalFaults() const {
 }
 
 uint64_t SMMU::getTranslationCount() const {
-    return translationCount;
+    return translationCount + getMicroTLBHitCount();
 }
 
 uint64_t SMMU::getCacheHitCount() const {
@@ -512,9 +1194,27 @@ uint64_t SMMU::getCacheMissCount() const {
     return 0;
 }
 
+// Translations served by the per-thread micro-TLBs; these never reach the TLBCache
+uint64_t SMMU::getMicroTLBHitCount() const {
+    std::lock_guard<std::mutex> lock(microTLBCounterMutex);
+    return sumMicroTLBHits() - microTLBHitBaseline;
+}
+
+uint64_t SMMU::getStage2CacheHitCount() const {
+    return stage2Cache ? stage2Cache->getHitCount() : 0;
+}
+
+uint64_t SMMU::getStage2CacheMissCount() const {
+    return stage2Cache ? stage2Cache->getMissCount() : 0;
+}
+
 // System state management - Enhanced with TLBCache statistics (Task 5.2)
 void SMMU::resetStatistics() {
     translationCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(microTLBCounterMutex);
+        microTLBHitBaseline = sumMicroTLBHits();
+    }
     // Remove local cache statistics - delegate to TLBCache
     faultHandler->resetStatistics();
     
@@ -522,11 +1222,26 @@ void SMMU::resetStatistics() {
     if (tlbCache) {
         tlbCache->resetStatistics();
     }
+    if (stage2Cache) {
+        stage2Cache->resetStatistics();
+    }
+    std::shared_ptr<PageTableWalker> walker = std::atomic_load(&tableWalker);
+    if (walker) {
+        walker->resetStatistics();
+    }
 }
 
 void SMMU::reset() {
     // Complete system reset - Enhanced with TLBCache reset (Task 5.2)
-    streamMap.clear();
+    {
+        std::lock_guard<std::mutex> lock(sMMUMutex);
+        streamTable.clear();
+    }
+    {
+        std::lock_guard<std::mutex> sharedLock(sharedStage2Mutex);
+        sharedStage2Streams.clear();
+        sharedStage2StreamCount.store(0, std::memory_order_release);
+    }
     resetStatistics();
     faultHandler->reset();
     globalFaultMode = FaultMode::Terminate;
@@ -536,6 +1251,10 @@ void SMMU::reset() {
     if (tlbCache) {
         tlbCache->reset();
     }
+    if (stage2Cache) {
+        stage2Cache->reset();
+    }
+    bumpGlobalInvalidationEpoch();
     
     // Task 5.3: Reset event and command processing queues
     clearEventQueue();
@@ -556,6 +1275,230 @@ void SMMU::recordCacheMiss() const {
     cacheMisses.fetch_add(1);
 }
 
+// Micro-TLB helpers
+void SMMU::initializeMicroTLB() {
+    // Never reused, so a thread's L0 can't mistake a new SMMU for a destroyed one
+    static std::atomic<uint64_t> nextInstanceID(1);
+    instanceID = nextInstanceID.fetch_add(1);
+    
+    microTLBEntries = configuration.getCacheConfiguration().microTlbEntries;
+    globalInvalidationEpoch = 0;
+    streamInvalidationEpochs.reset(new std::atomic<uint64_t>[STREAM_EPOCH_SLOTS]);
+    for (size_t i = 0; i < STREAM_EPOCH_SLOTS; ++i) {
+        streamInvalidationEpochs[i].store(0);
+    }
+}
+
+MicroTLB* SMMU::acquireMicroTLB() {
+    size_t entries = microTLBEntries.load(std::memory_order_relaxed);
+    if (entries == 0) {
+        return nullptr;
+    }
+    
+    MicroTLB* microTLB = nullptr;
+    for (size_t i = 0; i < THREAD_MICRO_TLBS; ++i) {
+        if (threadMicroTLBs[i].getOwner() == instanceID) {
+            microTLB = &threadMicroTLBs[i];
+            break;
+        }
+    }
+    if (microTLB != nullptr && microTLB->getCapacity() == entries) {
+        return microTLB;
+    }
+        
+    if (microTLB == nullptr) {
+        // First use of this SMMU on this thread: take an unbound slot, else evict round-robin
+        for (size_t i = 0; i < THREAD_MICRO_TLBS && microTLB == nullptr; ++i) {
+            if (threadMicroTLBs[i].getOwner() == 0) {
+                microTLB = &threadMicroTLBs[i];
+            }
+        }
+        if (microTLB == nullptr) {
+            microTLB = &threadMicroTLBs[threadMicroTLBVictim];
+            threadMicroTLBVictim = (threadMicroTLBVictim + 1) % THREAD_MICRO_TLBS;
+        }
+    }
+    
+    // New slot (or a resized L0): register a fresh hit counter
+    std::shared_ptr<MicroTLBHitCounter> counter(new MicroTLBHitCounter());
+    microTLB->bind(instanceID, entries, counter);
+    
+    std::lock_guard<std::mutex> lock(microTLBCounterMutex);
+    
+    // Fold counters that no thread holds any more so the list stays bounded
+    size_t kept = 0;
+    for (size_t i = 0; i < microTLBCounters.size(); ++i) {
+        if (microTLBCounters[i].use_count() == 1) {
+            microTLBRetiredHits += microTLBCounters[i]->hits.load(std::memory_order_relaxed);
+        } else {
+            microTLBCounters[kept++] = microTLBCounters[i];
+        }
+    }
+    microTLBCounters.resize(kept);
+    microTLBCounters.push_back(counter);
+    return microTLB;
+}
+
+std::atomic<uint64_t>& SMMU::streamInvalidationEpoch(StreamID streamID) const {
+    // Multiplicative hash so StreamIDs differing only in high (bus) bits spread
+    // out; streams sharing a slot only cost each other spurious L0 misses
+    uint32_t slot = (streamID * 0x9E3779B1u) >> (32 - STREAM_EPOCH_SLOT_BITS);
+    return streamInvalidationEpochs[slot];
+}
+
+// Same hash as the epochs; streams sharing a lock only serialize each other's
+// control-plane operations, never translations
+std::mutex& SMMU::streamLock(StreamID streamID) const {
+    uint32_t slot = (streamID * 0x9E3779B1u) >> (32 - STREAM_LOCK_BITS);
+    return streamLocks[slot];
+}
+
+// Called after the TLBCache/page tables have been updated, so any L0 fill that
+// could have observed the old state carries the old epoch
+void SMMU::bumpGlobalInvalidationEpoch() {
+    globalInvalidationEpoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void SMMU::bumpStreamInvalidationEpoch(StreamID streamID) {
+    streamInvalidationEpoch(streamID).fetch_add(1, std::memory_order_acq_rel);
+}
+
+// TLB aging helpers
+void SMMU::configureCacheAging(const CacheConfiguration& cacheConfig) {
+    // Round up so an entry never expires before cacheMaxAge has passed
+    cacheMaxAgeTicks = (static_cast<uint64_t>(cacheConfig.cacheMaxAge) + CACHE_AGE_TICK_MS - 1) / CACHE_AGE_TICK_MS;
+    cacheAgingEnabled = cacheConfig.enableCacheAging;
+    if (cacheAgeTickTime.load() == 0) {
+        cacheAgeTickTime = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+// Without physical memory there is no walker; setPhysicalMemory sizes the new one
+void SMMU::configureWalkCache(const CacheConfiguration& cacheConfig) {
+    std::shared_ptr<PageTableWalker> walker = std::atomic_load(&tableWalker);
+    if (walker) {
+        walker->resizeWalkCache(cacheConfig.walkCacheEntries);
+    }
+}
+
+void SMMU::invalidateWalkCache() {
+    std::shared_ptr<PageTableWalker> walker = std::atomic_load(&tableWalker);
+    if (walker) {
+        walker->invalidateWalkCache();
+    }
+}
+
+// Oldest insertion tick a TLB entry may carry and still hit; 0 when aging is off
+uint64_t SMMU::cacheFreshnessFloor() const {
+    if (!cacheAgingEnabled.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    uint64_t tick = cacheAgeTick.load(std::memory_order_relaxed);
+    uint64_t maxAgeTicks = cacheMaxAgeTicks.load(std::memory_order_relaxed);
+    return tick > maxAgeTicks ? tick - maxAgeTicks : 0;
+}
+
+// Recompute whether a stream shares its VM's TLB entries; the stream's lock held.
+// Only enabled Stage-2-only streams qualify: their translation depends on the
+// Stage-2 tables alone, and a disabled stream must still fault.
+void SMMU::updateSharedStage2(StreamID streamID, StreamContext* streamContext) {
+    bool shared = false;
+    VMID vmid = 0;
+    if (streamContext) {
+        std::shared_ptr<const TranslationDescriptor> descriptor = streamContext->getTranslationDescriptor();
+        shared = descriptor->vmidValid && descriptor->stage2AddressSpace &&
+                 descriptor->mode == TranslationDescriptor::Mode::Stage2Only && descriptor->streamEnabled;
+        vmid = descriptor->vmid;
+    }
+    
+    if (streamContext) {
+        streamContext->setSharedStage2VMID(shared, vmid);
+    }
+    
+    std::lock_guard<std::mutex> lock(sharedStage2Mutex);
+    if (shared) {
+        sharedStage2Streams[streamID] = vmid;
+    } else {
+        sharedStage2Streams.erase(streamID);
+    }
+    sharedStage2StreamCount.store(sharedStage2Streams.size(), std::memory_order_release);
+}
+
+// ARM SMMU v3 spec: CMD_PREFETCH_CONFIG - decode the STE/CDs of one stream
+// now so its first translation does not
+void SMMU::prefetchStreamConfig(StreamID streamID) {
+    std::lock_guard<std::mutex> lock(streamLock(streamID));
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (streamContext) {
+        streamContext->prefetchTranslationDescriptor();
+    }
+}
+
+// Lock-free: the stream table and the context's flag are read under a guard
+bool SMMU::findSharedStage2VMID(StreamID streamID, VMID& vmid) const {
+    if (sharedStage2StreamCount.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    
+    EpochGuard guard;
+    StreamContext* streamContext = streamTable.find(streamID);
+    return streamContext && streamContext->getSharedStage2VMID(vmid);
+}
+
+// TLB key for a translation: the VMID key for streams sharing their VM's
+// entries, otherwise (StreamID, PASID). Invalid PASIDs keep their own key so
+// they still fault.
+void SMMU::resolveCacheKey(StreamID streamID, PASID pasid, StreamID& keyStreamID, PASID& keyPASID) const {
+    keyStreamID = streamID;
+    keyPASID = pasid;
+    
+    VMID vmid = 0;
+    if (pasid <= MAX_PASID && findSharedStage2VMID(streamID, vmid)) {
+        keyStreamID = vmid;
+        keyPASID = TLBCache::VMID_KEY_PASID;
+    }
+}
+
+void SMMU::performCacheMaintenance() {
+    const uint64_t tickUs = static_cast<uint64_t>(CACHE_AGE_TICK_MS) * 1000;
+    uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    uint64_t tickStart = cacheAgeTickTime.load(std::memory_order_relaxed);
+    if (now < tickStart + tickUs) {
+        return;
+    }
+    
+    // Only the thread that moves the tick start forward advances the tick
+    uint64_t elapsedTicks = (now - tickStart) / tickUs;
+    if (cacheAgeTickTime.compare_exchange_strong(tickStart, tickStart + elapsedTicks * tickUs)) {
+        advanceCacheAgeTick(elapsedTicks);
+    }
+}
+
+void SMMU::advanceCacheAgeTick(uint64_t ticks) {
+    cacheAgeTick.fetch_add(ticks, std::memory_order_relaxed);
+    
+    // Micro-TLB entries carry no age; drop them so they cannot outlive aging
+    if (cacheAgingEnabled.load(std::memory_order_relaxed)) {
+        bumpGlobalInvalidationEpoch();
+    }
+}
+
+uint64_t SMMU::getCacheAgeTick() const {
+    return cacheAgeTick.load(std::memory_order_relaxed);
+}
+
+// Caller holds microTLBCounterMutex
+uint64_t SMMU::sumMicroTLBHits() const {
+    uint64_t total = microTLBRetiredHits;
+    for (size_t i = 0; i < microTLBCounters.size(); ++i) {
+        total += microTLBCounters[i]->hits.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
 // Task 5.2: Enhanced cache management operations with comprehensive functionality
 void SMMU::invalidateTranslationCache() {
     // ARM SMMU v3 spec: Global TLB invalidation with enhanced cleanup
@@ -571,9 +1514,16 @@ void SMMU::invalidateTranslationCache() {
         // Performance optimization: Clear internal cache statistics if needed
         // (keeping them for debugging purposes in this implementation)
     }
+    if (stage2Cache) {
+        stage2Cache->invalidateAll();
+    }
+    
+    // Table descriptors may have been rewritten along with the leaves
+    invalidateWalkCache();
     
     // ARM SMMU v3 spec: Global invalidation affects all streams and PASIDs
-    // No additional stream-specific cleanup needed
+    // One epoch bump retires every thread's micro-TLB entries
+    bumpGlobalInvalidationEpoch();
 }
 
 void SMMU::invalidateStreamCache(StreamID streamID) {
@@ -582,14 +1532,33 @@ void SMMU::invalidateStreamCache(StreamID streamID) {
         // ARM SMMU v3 spec: Validate StreamID before invalidation
         if (streamID <= MAX_STREAM_ID) {
             tlbCache->invalidateStream(streamID);
+            if (stage2Cache) {
+                stage2Cache->invalidateStream(streamID);
+            }
+            
+            // Entries the stream shares with its VM go too; other streams'
+            // micro-TLBs may hold copies of them
+            VMID vmid = 0;
+            if (findSharedStage2VMID(streamID, vmid)) {
+                tlbCache->invalidateVMID(vmid);
+                bumpGlobalInvalidationEpoch();
+            }
             
             // Performance optimization: Could update per-stream statistics here
             // For now, rely on global statistics
         }
     }
     
+    // Walk cache entries carry no StreamID; the walker is shared, so all go
+    if (streamID <= MAX_STREAM_ID) {
+        invalidateWalkCache();
+    }
+    
     // ARM SMMU v3 spec: Stream invalidation affects all PASIDs within the stream
     // The TLBCache implementation handles this automatically
+    if (streamID <= MAX_STREAM_ID) {
+        bumpStreamInvalidationEpoch(streamID);
+    }
 }
 
 void SMMU::invalidatePASIDCache(StreamID streamID, PASID pasid) {
@@ -599,6 +1568,12 @@ void SMMU::invalidatePASIDCache(StreamID streamID, PASID pasid) {
         if (streamID <= MAX_STREAM_ID && pasid <= MAX_PASID) {
             tlbCache->invalidatePASID(streamID, pasid);
             
+            VMID vmid = 0;
+            if (findSharedStage2VMID(streamID, vmid)) {
+                tlbCache->invalidateVMID(vmid);
+                bumpGlobalInvalidationEpoch();
+            }
+            
             // ARM SMMU v3 spec: PASID invalidation is surgical - only affects specific context
             // This is the most efficient invalidation operation
         }
@@ -606,6 +1581,71 @@ void SMMU::invalidatePASIDCache(StreamID streamID, PASID pasid) {
     
     // Performance optimization: Could track per-PASID invalidation statistics
     // for cache tuning and debugging purposes
+    
+    // Micro-TLB epochs are per stream, so this retires the stream's other PASIDs too.
+    // The PASID's walk cache entries are not tagged with it and go with the rest.
+    if (streamID <= MAX_STREAM_ID && pasid <= MAX_PASID) {
+        bumpStreamInvalidationEpoch(streamID);
+        invalidateWalkCache();
+    }
+}
+
+// ARM SMMU v3 spec: TLBI_S12_VMALL scoped to one VMID - the VM's shared
+// entries and everything its streams cache per PASID
+void SMMU::invalidateVMIDCache(VMID vmid) {
+    std::lock_guard<std::mutex> lock(sMMUMutex);
+    if (tlbCache) {
+        tlbCache->invalidateVMID(vmid);
+        TLBCache* cache = tlbCache.get();
+        streamTable.forEach([cache, vmid](StreamID streamID, StreamContext* streamContext) {
+            if (streamContext->hasVMID() && streamContext->getVMID() == vmid) {
+                cache->invalidateStream(streamID);
+            }
+        });
+    }
+    if (stage2Cache) {
+        stage2Cache->invalidateVMID(vmid);
+    }
+    invalidateWalkCache();  // Entries are tagged by Stage-2 tables, not VMID
+    
+    // Shared entries may sit in any stream's micro-TLB
+    bumpGlobalInvalidationEpoch();
+}
+
+// ARM SMMU v3 spec: TLBI_S2_IPA - Stage-2-only entries of one VMID by IPA range
+void SMMU::invalidateStage2Cache(VMID vmid, IPA startIpa, IPA endIpa) {
+    if (stage2Cache) {
+        stage2Cache->invalidateRange(vmid, TLBCache::VMID_KEY_PASID, startIpa, endIpa);
+    }
+    
+    // Stage-2-only streams translate IOVA == IPA, so their shared TLB entries are Stage-2-only too
+    if (tlbCache) {
+        tlbCache->invalidateRange(vmid, TLBCache::VMID_KEY_PASID, startIpa, endIpa);
+    }
+    bumpGlobalInvalidationEpoch();
+}
+
+// ARM SMMU v3 spec: TLBI_NH_ASID - Stage-1 entries of one ASID within a VMID
+void SMMU::invalidateASIDCache(VMID vmid, ASID asid) {
+    std::lock_guard<std::mutex> lock(sMMUMutex);
+    streamTable.forEach([&](StreamID streamID, StreamContext* streamContext) {
+        if (streamContext->hasVMID() && streamContext->getVMID() != vmid) {
+            return;
+        }
+        
+        std::vector<PASID> pasids = streamContext->getPASIDsWithASID(asid);
+        for (size_t i = 0; i < pasids.size() && tlbCache; ++i) {
+            tlbCache->invalidatePASID(streamID, pasids[i]);
+        }
+        if (!pasids.empty()) {
+            bumpStreamInvalidationEpoch(streamID);
+        }
+    });
+    
+    std::shared_ptr<PageTableWalker> walker = std::atomic_load(&tableWalker);
+    if (walker) {
+        walker->invalidateWalkCache(asid);
+    }
 }
 
 // Task 5.2: Enhanced cache statistics with performance monitoring
@@ -614,11 +1654,13 @@ CacheStatistics SMMU::getCacheStatistics() const {
     
     if (tlbCache) {
         // Performance optimization: Get all cache statistics in one call to avoid multiple method calls
-        stats.hitCount = tlbCache->getHitCount();
-        stats.missCount = tlbCache->getMissCount();
-        stats.totalLookups = tlbCache->getTotalLookups();
-        stats.currentSize = tlbCache->getSize();
-        stats.maxSize = tlbCache->getCapacity();
+        // (aggregated over every TLB shard)
+        TLBCache::CacheStatistics tlbStats = tlbCache->getAtomicStatistics();
+        stats.hitCount = tlbStats.hitCount;
+        stats.missCount = tlbStats.missCount;
+        stats.totalLookups = tlbStats.totalLookups;
+        stats.currentSize = tlbStats.currentSize;
+        stats.maxSize = tlbStats.maxSize;
         stats.evictionCount = 0; // TLBCache doesn't expose eviction count yet
         
         // Calculate hit rate with enhanced precision
@@ -642,6 +1684,19 @@ CacheStatistics SMMU::getCacheStatistics() const {
     return stats;
 }
 
+uint64_t SMMU::getWalkCacheHitCount() const {
+    return getWalkStatistics().walkCacheHits;
+}
+
+uint64_t SMMU::getWalkCacheMissCount() const {
+    return getWalkStatistics().walkCacheMisses;
+}
+
+WalkStatistics SMMU::getWalkStatistics() const {
+    std::shared_ptr<PageTableWalker> walker = std::atomic_load(&tableWalker);
+    return walker ? walker->getStatistics() : WalkStatistics();
+}
+
 // Task 5.2: Enhanced two-stage translation logic with sophisticated coordination
 TranslationResult SMMU::performTwoStageTranslation(StreamID streamID, PASID pasid, IOVA iova, 
                                                   AccessType accessType, SecurityState securityState, StreamContext* streamContext) {
@@ -665,42 +1720,48 @@ TranslationResult SMMU::performTwoStageTranslation(StreamID streamID, PASID pasi
         return makeTranslationError(SMMUError::StreamNotConfigured);
     }
     
-    // ARM SMMU v3 spec: Get stream configuration to determine translation stages
-    StreamConfig config = streamContext->getStreamConfiguration();
+    // ARM SMMU v3 spec: Stage selection comes from the pre-decoded STE/CD
+    // descriptor - an atomic load, no StreamConfig copy and no context lock
+    std::shared_ptr<const TranslationDescriptor> descriptor = streamContext->getTranslationDescriptor();
     
     TranslationResult result = makeTranslationError(SMMUError::InternalError);
     
     // ARM SMMU v3 spec: Handle different stage combinations
-    if (!config.translationEnabled) {
-        // Translation disabled - bypass mode (IOVA = PA)
-        PagePermissions bypassPerms(true, true, true); // Full permissions in bypass
-        TranslationData data(iova, bypassPerms, securityState);
-        return TranslationResult(data);
-    }
+    switch (descriptor->mode) {
+        case TranslationDescriptor::Mode::Bypass: {
+            // Translation disabled - bypass mode (IOVA = PA)
+            PagePermissions bypassPerms(true, true, true); // Full permissions in bypass
+            TranslationData data(iova, bypassPerms, securityState);
+            return TranslationResult(data);
+        }
+        case TranslationDescriptor::Mode::BothStages:
+            // Two-stage translation: IOVA -> IPA -> PA
+            result = performBothStagesTranslation(streamID, pasid, iova, accessType, securityState, *descriptor);
+            break;
+        case TranslationDescriptor::Mode::Stage1Only:
+            // Stage-1 only: IOVA -> PA directly
+            result = performStage1OnlyTranslation(streamID, pasid, iova, accessType, securityState, streamContext, *descriptor);
+            break;
+        case TranslationDescriptor::Mode::Stage2Only:
+            // Stage-2 only: IPA -> PA (IOVA = IPA)
+            result = performStage2OnlyTranslation(streamID, pasid, iova, accessType, securityState, streamContext, *descriptor);
+            break;
+        case TranslationDescriptor::Mode::NoStages:
+        default: {
+            // No stages enabled but translation enabled - configuration error
+            FaultRecord fault;
+            fault.streamID = streamID;
+            fault.pasid = pasid;
+            fault.address = iova;
+            fault.faultType = FaultType::TranslationFault;
+            fault.accessType = accessType;
+            fault.securityState = securityState;
+            fault.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
     
-    if (config.stage1Enabled && config.stage2Enabled) {
-        // Two-stage translation: IOVA -> IPA -> PA
-        result = performBothStagesTranslation(streamID, pasid, iova, accessType, securityState, streamContext);
-    } else if (config.stage1Enabled && !config.stage2Enabled) {
-        // Stage-1 only: IOVA -> PA directly
-        result = performStage1OnlyTranslation(streamID, pasid, iova, accessType, securityState, streamContext);
-    } else if (!config.stage1Enabled && config.stage2Enabled) {
-        // Stage-2 only: IPA -> PA (IOVA = IPA)
-        result = performStage2OnlyTranslation(streamID, pasid, iova, accessType, securityState, streamContext);
-    } else {
-        // No stages enabled but translation enabled - configuration error
-        FaultRecord fault;
-        fault.streamID = streamID;
-        fault.pasid = pasid;
-        fault.address = iova;
-        fault.faultType = FaultType::TranslationFault;
-        fault.accessType = accessType;
-        fault.securityState = securityState;
-        fault.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()).count();
-        
-        recordFault(fault);
-        return makeTranslationError(SMMUError::ConfigurationError);
+            recordFault(fault);
+            return makeTranslationError(SMMUError::ConfigurationError);
+        }
     }
     
     // ARM SMMU v3 spec: Enhanced validation of translation results
@@ -757,16 +1818,17 @@ bool SMMU::isTranslationCacheable(const TranslationResult& result) const {
 }
 
 void SMMU::cacheTranslationResult(StreamID streamID, PASID pasid, IOVA iova, 
-                                 const TranslationResult& result) {
+                                 const TranslationResult& result, const TLBCache::Generation& generation) {
     if (!tlbCache || result.isError() || !cachingEnabled) {
         return; // Caching disabled or invalid result
     }
     
     TranslationData data = result.getValue();
     
-    // ARM SMMU v3 spec: Only cache page-aligned translations for efficiency
-    IOVA pageAlignedIOVA = iova & ~PAGE_MASK; // Page-align the IOVA
-    PA pageAlignedPA = data.physicalAddress & ~PAGE_MASK; // Page-align the PA
+    // ARM SMMU v3 spec: Cache one entry per page or block, aligned to its size
+    uint64_t blockMask = data.blockSize - 1;
+    IOVA pageAlignedIOVA = iova & ~blockMask; // Align the IOVA to the mapping
+    PA pageAlignedPA = data.physicalAddress & ~blockMask; // Align the PA to the mapping
     
     // Validate that the translation is cacheable
     if (pageAlignedPA == 0 && pageAlignedIOVA != 0) {
@@ -783,14 +1845,38 @@ void SMMU::cacheTranslationResult(StreamID streamID, PASID pasid, IOVA iova,
     entry.pasid = pasid;
     entry.iova = pageAlignedIOVA; // Store page-aligned IOVA
     entry.physicalAddress = pageAlignedPA; // Store page-aligned PA
+    entry.blockSize = data.blockSize;
     entry.permissions = data.permissions;
     entry.securityState = data.securityState;
+    entry.dirtyEpoch = data.dirtyEpoch;
     entry.valid = true;
-    entry.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count();
+    
+    // Fills are the slow path, so the age tick is brought up to date here
+    performCacheMaintenance();
+    entry.timestamp = cacheAgeTick.load(std::memory_order_relaxed);
     
     // ARM SMMU v3 spec: Insert into TLB with LRU eviction if needed
-    tlbCache->insert(entry);
+    tlbCache->insert(entry, generation);
+}
+
+// Insert one IPA -> PA page or block into the Stage-2 cache
+void SMMU::cacheStage2Translation(StreamID keyStreamID, PASID keyPASID, IPA ipa, const TranslationData& data,
+                                  const TLBCache::Generation& generation) {
+    uint64_t blockMask = data.blockSize - 1;
+    
+    TLBEntry entry;
+    entry.streamID = keyStreamID;
+    entry.pasid = keyPASID;
+    entry.iova = ipa & ~blockMask;
+    entry.physicalAddress = data.physicalAddress & ~blockMask;
+    entry.blockSize = data.blockSize;
+    entry.permissions = data.permissions;
+    entry.securityState = data.securityState;
+    entry.dirtyEpoch = data.dirtyEpoch;
+    entry.valid = true;
+    entry.timestamp = cacheAgeTick.load(std::memory_order_relaxed);
+    
+    stage2Cache->insert(entry, generation);
 }
 
 TranslationResult SMMU::lookupTranslationCache(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState) {
@@ -801,31 +1887,20 @@ TranslationResult SMMU::lookupTranslationCache(StreamID streamID, PASID pasid, I
     // ARM SMMU v3 spec: Perform optimized TLB lookup with page alignment
     IOVA pageAlignedIOVA = iova & ~PAGE_MASK; // Page-align the IOVA for lookup
     
-    TLBEntry* entry = tlbCache->lookup(streamID, pasid, pageAlignedIOVA, securityState);
-    if (!entry || !entry->valid) {
+    // ARM SMMU v3 spec: Validate cache entry freshness - expired entries are dropped as misses
+    TLBEntry entry;
+    if (!tlbCache->lookup(streamID, pasid, pageAlignedIOVA, securityState, cacheFreshnessFloor(), entry) || !entry.valid) {
         return makeTranslationError(SMMUError::CacheEntryNotFound); // Cache miss
     }
     
     // Security state validation
-    if (entry->securityState != securityState) {
+    if (entry.securityState != securityState) {
         return makeTranslationError(FaultType::SecurityFault);
     }
     
-    // ARM SMMU v3 spec: Validate cache entry freshness and coherency
-    uint64_t currentTime = std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count();
-    
-    // Check if the cache entry is still valid (simple aging mechanism)
-    const uint64_t MAX_CACHE_AGE_US = 1000000; // 1 second max age
-    if (currentTime - entry->timestamp > MAX_CACHE_AGE_US) {
-        // Entry is too old, invalidate and return cache miss
-        tlbCache->invalidate(streamID, pasid, pageAlignedIOVA, securityState);
-        return makeTranslationError(SMMUError::CacheEntryNotFound); // Cache miss due to age
-    }
-    
     // Convert TLBEntry back to TranslationResult with page offset preservation
-    PA finalPhysicalAddress = entry->physicalAddress + (iova & PAGE_MASK); // Add back page offset
-    return makeTranslationSuccess(finalPhysicalAddress, entry->permissions, entry->securityState);
+    PA finalPhysicalAddress = entry.physicalAddress + (iova - entry.iova); // Add back page/block offset
+    return makeTranslationSuccess(finalPhysicalAddress, entry.permissions, entry.securityState);
 }
 
 void SMMU::generateCacheKey(StreamID streamID, PASID pasid, IOVA iova, SecurityState securityState, uint64_t& cacheKey) const {
@@ -839,15 +1914,14 @@ void SMMU::generateCacheKey(StreamID streamID, PASID pasid, IOVA iova, SecurityS
 
 // Task 5.2: Enhanced stage-specific translation methods
 TranslationResult SMMU::performBothStagesTranslation(StreamID streamID, PASID pasid, IOVA iova, 
-                                                    AccessType accessType, SecurityState securityState, StreamContext* streamContext) {
+                                                    AccessType accessType, SecurityState securityState,
+                                                    const TranslationDescriptor& descriptor) {
     // ARM SMMU v3 spec: Two-stage translation IOVA -> IPA -> PA
     // This provides comprehensive coordination between Stage-1 and Stage-2 translations
     // with proper fault handling and permission intersection
     
-    // Get stream configuration to validate stage setup
-    StreamConfig config = streamContext->getStreamConfiguration();
-    
     // Validate that both stages are properly configured
+    const StreamConfig& config = descriptor.config;
     if (!config.stage1Enabled || !config.stage2Enabled) {
         // Configuration error - both stages should be enabled for this method
         recordComprehensiveFault(streamID, pasid, iova, FaultType::TranslationFault,
@@ -855,17 +1929,15 @@ TranslationResult SMMU::performBothStagesTranslation(StreamID streamID, PASID pa
         return makeTranslationError(SMMUError::ConfigurationError);
     }
     
-    // Stage 1: IOVA -> IPA translation (using per-PASID address space)
-    AddressSpace* stage1AddressSpace = streamContext->getPASIDAddressSpace(pasid);
-    if (!stage1AddressSpace) {
+    // Stage 1: IOVA -> IPA translation (per-PASID address space, or a walk of
+    // the PASID's tables whose descriptor fetches go through Stage-2)
+    TranslationResult stage1Result = descriptor.translateStage1(pasid, iova, accessType, securityState);
+    if (stage1Result.isError() && stage1Result.getError() == SMMUError::PASIDNotFound) {
         // PASID not configured - Stage-1 translation fault
         recordComprehensiveFault(streamID, pasid, iova, FaultType::TranslationFault,
                                accessType, securityState, FaultStage::Stage1Only, 0, 0);
-        return makeTranslationError(SMMUError::PASIDNotFound);
+        return stage1Result;
     }
-    
-    // Perform Stage-1 translation: IOVA -> IPA
-    TranslationResult stage1Result = stage1AddressSpace->translatePage(iova, accessType, securityState);
     if (stage1Result.isError()) {
         // Stage-1 translation failed - record fault with comprehensive syndrome
         // Convert SMMUError back to FaultType for fault recording
@@ -888,7 +1960,7 @@ TranslationResult SMMU::performBothStagesTranslation(StreamID streamID, PASID pa
     
     // Stage 2: IPA -> PA translation (using stream's Stage-2 address space)
     // ARM SMMU v3 spec: Stage-2 uses shared address space across stream
-    AddressSpace* stage2AddressSpace = streamContext->getStage2AddressSpace();
+    AddressSpace* stage2AddressSpace = descriptor.stage2AddressSpace.get();
     if (!stage2AddressSpace) {
         // Stage-2 address space not configured - Stage-2 translation fault
         recordComprehensiveFault(streamID, pasid, iova, FaultType::TranslationFault,
@@ -896,17 +1968,57 @@ TranslationResult SMMU::performBothStagesTranslation(StreamID streamID, PASID pa
         return makeTranslationError(SMMUError::AddressSpaceExhausted);
     }
     
-    // Perform Stage-2 translation: IPA -> PA
-    // ARM SMMU v3 spec: Stage-2 translates the IPA from Stage-1 to final PA
-    TranslationResult stage2Result = stage2AddressSpace->translatePage(intermediatePA, accessType, securityState);
-    if (stage2Result.isError()) {
-        // Stage-2 translation failed - record fault with comprehensive syndrome
-        FaultType stage2FaultType = (stage2Result.getError() == SMMUError::PageNotMapped) ? 
-                                   FaultType::Stage2TranslationFault : FaultType::Stage2PermissionFault;
+    // Stage-2 cache: a Stage-1 miss whose IPA is resident skips the Stage-2 walk.
+    // Tagged contexts share entries across every stream of the VMID.
+    StreamID stage2KeyStreamID = streamID;
+    PASID stage2KeyPASID = 0;
+    if (descriptor.vmidValid) {
+        stage2KeyStreamID = descriptor.vmid;
+        stage2KeyPASID = TLBCache::VMID_KEY_PASID;
+    }
+    bool useStage2Cache = cachingEnabled && stage2Cache;
+        
+    TranslationResult stage2Result = makeTranslationError(SMMUError::PageNotMapped);
+    bool stage2Hit = false;
+    if (useStage2Cache) {
+        TLBEntry cached;
+        bool hit = stage2Cache->lookup(stage2KeyStreamID, stage2KeyPASID, intermediatePA & ~PAGE_MASK,
+                                       securityState, cacheFreshnessFloor(), cached);
+        // Anything the walk would fault on is left to the walk so the fault is reported as usual,
+        // as are writes the Stage-2 dirty log has not seen this epoch
+        if (hit && cached.securityState == securityState &&
+            validateAccessPermissions(cached.permissions, accessType) &&
+            cachedTranslationServes(cached.dirtyEpoch, accessType)) {
+            TranslationData cachedData(cached.physicalAddress + (intermediatePA - cached.iova),
+                                       cached.permissions, cached.securityState, cached.blockSize);
+            cachedData.dirtyEpoch = cached.dirtyEpoch;
+            stage2Result = TranslationResult(cachedData);
+            stage2Hit = true;
+        }
+    }
+    
+    if (!stage2Hit) {
+        TLBCache::Generation generation = {0, 0};
+        if (useStage2Cache) {
+            generation = stage2Cache->currentGeneration(stage2KeyStreamID, stage2KeyPASID);
+        }
+        
+        // Perform Stage-2 translation: IPA -> PA
+        // ARM SMMU v3 spec: Stage-2 translates the IPA from Stage-1 to final PA
+        stage2Result = stage2AddressSpace->translatePage(intermediatePA, accessType, securityState);
+        if (stage2Result.isError()) {
+            // Stage-2 translation failed - record fault with comprehensive syndrome
+            FaultType stage2FaultType = (stage2Result.getError() == SMMUError::PageNotMapped) ? 
+                                       FaultType::Stage2TranslationFault : FaultType::Stage2PermissionFault;
+            
+            recordComprehensiveFault(streamID, pasid, iova, stage2FaultType,
+                                   accessType, securityState, FaultStage::Stage2Only, 2, 0);
+            return stage2Result;
+        }
         
-        recordComprehensiveFault(streamID, pasid, iova, stage2FaultType,
-                               accessType, securityState, FaultStage::Stage2Only, 2, 0);
-        return stage2Result;
+        if (useStage2Cache) {
+            cacheStage2Translation(stage2KeyStreamID, stage2KeyPASID, intermediatePA, stage2Result.getValue(), generation);
+        }
     }
     
     // Both stages successful - create final translation result
@@ -944,14 +2056,19 @@ TranslationResult SMMU::performBothStagesTranslation(StreamID streamID, PASID pa
         return makeTranslationError(SMMUError::InvalidSecurityState);
     }
     
-    // Create successful final translation result
-    return makeTranslationSuccess(stage2Data.physicalAddress, finalPermissions, stage2Data.securityState);
+    // Create successful final translation result; the TLB may only cache the
+    // part of the translation both stages map contiguously
+    uint64_t blockSize = stage1Data.blockSize < stage2Data.blockSize ? stage1Data.blockSize : stage2Data.blockSize;
+    TranslationData data(stage2Data.physicalAddress, finalPermissions, stage2Data.securityState, blockSize);
+    data.dirtyEpoch = combineDirtyEpochs(stage1Data.dirtyEpoch, stage2Data.dirtyEpoch);
+    return TranslationResult(data);
 }
 
 TranslationResult SMMU::performStage1OnlyTranslation(StreamID streamID, PASID pasid, IOVA iova, 
-                                                    AccessType accessType, SecurityState securityState, StreamContext* streamContext) {
+                                                    AccessType accessType, SecurityState securityState, StreamContext* streamContext,
+                                                    const TranslationDescriptor& descriptor) {
     // ARM SMMU v3 spec: Stage-1 only translation IOVA -> PA
-    TranslationResult result = streamContext->translate(pasid, iova, accessType, securityState);
+    TranslationResult result = streamContext->translate(descriptor, pasid, iova, accessType, securityState);
     
     // Record fault if translation failed
     if (result.isError()) {
@@ -988,9 +2105,10 @@ TranslationResult SMMU::performStage1OnlyTranslation(StreamID streamID, PASID pa
 }
 
 TranslationResult SMMU::performStage2OnlyTranslation(StreamID streamID, PASID pasid, IOVA iova, 
-                                                   AccessType accessType, SecurityState securityState, StreamContext* streamContext) {
+                                                   AccessType accessType, SecurityState securityState, StreamContext* streamContext,
+                                                   const TranslationDescriptor& descriptor) {
     // ARM SMMU v3 spec: Stage-2 only translation IPA -> PA (IOVA treated as IPA)
-    TranslationResult result = streamContext->translate(pasid, iova, accessType, securityState);
+    TranslationResult result = streamContext->translate(descriptor, pasid, iova, accessType, securityState);
     
     // Record fault if translation failed
     if (result.isError()) {
@@ -1055,6 +2173,9 @@ void SMMU::handleTranslationFailure(StreamID streamID, PASID pasid, IOVA iova,
             case SMMUError::PagePermissionViolation:
                 faultType = FaultType::PermissionFault;
                 break;
+            case SMMUError::AccessFlagFault:
+                faultType = FaultType::AccessFlagFault;
+                break;
             case SMMUError::InvalidAddress:
                 faultType = FaultType::AddressSizeFault;
                 break;
@@ -1146,8 +2267,8 @@ FaultType SMMU::classifyTranslationFault(StreamID streamID, PASID pasid, IOVA io
     // ARM SMMU v3 spec: Intelligent fault classification based on context
     
     // Check if stream exists
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return FaultType::TranslationFault; // Stream not configured
     }
     
@@ -1311,6 +2432,9 @@ VoidResult SMMU::submitCommand(const CommandEntry& command) {
         generateEvent(EventType::INTERNAL_ERROR, command.streamID, command.pasid, command.startAddress, SecurityState::NonSecure);
         return makeVoidError(SMMUError::CommandQueueFull);
     }
+    if (memoryBudget->isExhausted()) {
+        return makeVoidError(SMMUError::ResourceExhausted);
+    }
     
     // Add timestamp to command
     CommandEntry timestampedCommand = command;
@@ -1365,8 +2489,8 @@ void SMMU::clearCommandQueue() {
 // Task 5.3: PRI Queue for Page Requests (Task 5.3.3)
 void SMMU::submitPageRequest(const PRIEntry& request) {
     // ARM SMMU v3 spec: Validate PRI queue capacity
-    if (priQueue.size() >= maxPRIQueueSize) {
-        // PRI queue full - drop oldest request (simple overflow handling)
+    if (priQueue.size() >= maxPRIQueueSize || (memoryBudget->isExhausted() && !priQueue.empty())) {
+        // PRI queue full or out of memory - drop oldest request (simple overflow handling)
         priQueue.pop_front();
     }
     
@@ -1455,6 +2579,25 @@ void SMMU::executeInvalidationCommand(const CommandEntry& command) {
             executeTLBInvalidationCommand(command.type, command.streamID, command.pasid);
             break;
             
+        case CommandType::TLBI_S12_VMID:
+            // TLB invalidation by VMID tag
+            invalidateVMIDCache(command.vmid);
+            break;
+            
+        case CommandType::TLBI_NH_ASID:
+            // TLB invalidation by ASID tag
+            invalidateASIDCache(command.vmid, command.asid);
+            break;
+            
+        case CommandType::TLBI_S2_IPA:
+            // Stage-2 invalidation by IPA range; an empty range means the whole VMID
+            if (command.startAddress == 0 && command.endAddress == 0) {
+                invalidateStage2Cache(command.vmid, 0, ~static_cast<IPA>(0));
+            } else {
+                invalidateStage2Cache(command.vmid, command.startAddress, command.endAddress);
+            }
+            break;
+            
         case CommandType::ATC_INV:
             // Address Translation Cache invalidation
             executeATCInvalidationCommand(command.streamID, command.pasid, 
@@ -1514,18 +2657,15 @@ void SMMU::executeATCInvalidationCommand(StreamID streamID, PASID pasid, IOVA st
         } else {
             // Range-specific invalidation
             // ARM SMMU v3 spec: Invalidate specific address range
-            IOVA currentAddr = startAddr & ~PAGE_MASK; // Page-align start
-            IOVA alignedEndAddr = (endAddr + PAGE_SIZE - 1) & ~PAGE_MASK; // Page-align end
+            // The ordered page index makes this proportional to the cached
+            // entries in the range rather than the range length
+            tlbCache->invalidateRange(streamID, pasid, startAddr, endAddr);
+            bumpStreamInvalidationEpoch(streamID);
             
-            // Invalidate each page in the range
-            while (currentAddr <= alignedEndAddr && currentAddr >= startAddr) {
-                tlbCache->invalidate(streamID, pasid, currentAddr);
-                currentAddr += PAGE_SIZE;
-                
-                // Prevent infinite loop on address overflow
-                if (currentAddr < startAddr) {
-                    break;
-                }
+            VMID vmid = 0;
+            if (findSharedStage2VMID(streamID, vmid)) {
+                tlbCache->invalidateRange(vmid, TLBCache::VMID_KEY_PASID, startAddr, endAddr);
+                bumpGlobalInvalidationEpoch();
             }
         }
     }
@@ -1537,7 +2677,8 @@ void SMMU::processCommand(const CommandEntry& command) {
     switch (command.type) {
         case CommandType::PREFETCH_CONFIG:
             // Configuration prefetch - ARM SMMU v3 optimization
-            // Could implement stream table entry prefetching
+            // Warms the stream's translation descriptor ahead of traffic
+            prefetchStreamConfig(command.streamID);
             break;
             
         case CommandType::PREFETCH_ADDR:
@@ -1550,6 +2691,9 @@ void SMMU::processCommand(const CommandEntry& command) {
         case CommandType::TLBI_NH_ALL:
         case CommandType::TLBI_EL2_ALL:
         case CommandType::TLBI_S12_VMALL:
+        case CommandType::TLBI_S12_VMID:
+        case CommandType::TLBI_NH_ASID:
+        case CommandType::TLBI_S2_IPA:
         case CommandType::ATC_INV:
             // Cache invalidation commands
             executeInvalidationCommand(command);
@@ -1584,8 +2728,8 @@ void SMMU::generateEvent(EventType type, StreamID streamID, PASID pasid, IOVA ad
     // ARM SMMU v3 spec: Generate event for event queue processing
     
     // Check event queue capacity
-    if (eventQueue.size() >= maxEventQueueSize) {
-        // Event queue full - drop oldest event
+    if (eventQueue.size() >= maxEventQueueSize || (memoryBudget->isExhausted() && !eventQueue.empty())) {
+        // Event queue full or out of memory - drop oldest event
         eventQueue.pop_front();
     }
     
@@ -1675,8 +2819,8 @@ SecurityState SMMU::determineContextSecurityState(StreamID streamID, PASID pasid
     // In this implementation, we default to NonSecure unless configured otherwise
     // A real implementation would consult stream configuration tables
     
-    auto streamIt = streamMap.find(streamID);
-    if (streamIt == streamMap.end()) {
+    StreamContext* streamContext = streamTable.find(streamID);
+    if (!streamContext) {
         return SecurityState::NonSecure;  // Default for unconfigured streams
     }
     
@@ -1887,30 +3031,33 @@ const SMMUConfiguration& SMMU::getConfiguration() const {
 }
 
 VoidResult SMMU::updateConfiguration(const SMMUConfiguration& config) {
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    
-    // Validate the configuration
-    VoidResult validationResult = validateConfigurationUpdate(config);
-    if (!validationResult.isOk()) {
-        return validationResult;
-    }
+    {
+        std::lock_guard<std::mutex> lock(sMMUMutex);
     
-    // Store old configuration for potential rollback
-    SMMUConfiguration oldConfig = configuration;
-    
-    try {
-        configuration = config;
-        
-        // Apply the new configuration
-        applyConfiguration();
+        // Validate the configuration
+        VoidResult validationResult = validateConfigurationUpdate(config);
+        if (!validationResult.isOk()) {
+            return validationResult;
+        }
         
-        return makeVoidSuccess();
+        // Store old configuration for potential rollback
+        SMMUConfiguration oldConfig = configuration;
         
-    } catch (const std::exception&) {
-        // Rollback on failure
-        configuration = oldConfig;
-        return makeVoidError(SMMUError::ConfigurationError);
+        try {
+            configuration = config;
+            
+            // Apply the new configuration
+            applyConfiguration();
+            
+        } catch (const std::exception&) {
+            // Rollback on failure
+            configuration = oldConfig;
+            return makeVoidError(SMMUError::ConfigurationError);
+        }
     }
+    
+    configureAsyncEngine();
+    return makeVoidSuccess();
 }
 
 VoidResult SMMU::updateQueueConfiguration(const QueueConfiguration& queueConfig) {
@@ -1959,6 +3106,15 @@ VoidResult SMMU::updateCacheConfiguration(const CacheConfiguration& cacheConfig)
         if (tlbCache->getCapacity() != cacheConfig.tlbCacheSize) {
             tlbCache->setMaxSize(cacheConfig.tlbCacheSize);
         }
+        if (stage2Cache->getCapacity() != cacheConfig.tlbCacheSize) {
+            stage2Cache->setMaxSize(cacheConfig.tlbCacheSize);
+        }
+        
+        // Threads rebind their micro-TLB on the next translation if the size changed
+        microTLBEntries = cacheConfig.microTlbEntries;
+        configureCacheAging(cacheConfig);
+        configureWalkCache(cacheConfig);
+        bumpGlobalInvalidationEpoch();
     }
     
     return result;
@@ -1971,19 +3127,38 @@ VoidResult SMMU::updateAddressConfiguration(const AddressConfiguration& addressC
         return makeVoidError(SMMUError::InvalidConfiguration);
     }
     
-    // Update the configuration
-    return configuration.setAddressConfiguration(addressConfig);
+    // Update the configuration; the stream table is re-laid for the new size
+    VoidResult result = configuration.setAddressConfiguration(addressConfig);
+    if (result.isOk()) {
+        streamTable.resize(addressConfig.maxStreamCount);
+    }
+    return result;
 }
 
 VoidResult SMMU::updateResourceLimits(const ResourceLimits& resourceLimits) {
-    std::lock_guard<std::mutex> lock(sMMUMutex);
-    
     if (!resourceLimits.isValid()) {
         return makeVoidError(SMMUError::InvalidConfiguration);
     }
     
-    // Update the configuration
-    return configuration.setResourceLimits(resourceLimits);
+    VoidResult result = makeVoidSuccess();
+    {
+        std::lock_guard<std::mutex> lock(sMMUMutex);
+        
+        // Update the configuration; the pools enforce the memory limit
+        result = configuration.setResourceLimits(resourceLimits);
+        if (result.isOk()) {
+            memoryBudget->setLimit(resourceLimits.maxMemoryUsage);
+        }
+    }
+    
+    if (result.isOk()) {
+        configureAsyncEngine();
+    }
+    return result;
+}
+
+const MemoryBudget& SMMU::getMemoryBudget() const {
+    return *memoryBudget;
 }
 
 // Configuration helper methods
@@ -2002,6 +3177,16 @@ void SMMU::applyConfiguration() {
     if (tlbCache->getCapacity() != cacheConfig.tlbCacheSize) {
         tlbCache->setMaxSize(cacheConfig.tlbCacheSize);
     }
+    if (stage2Cache->getCapacity() != cacheConfig.tlbCacheSize) {
+        stage2Cache->setMaxSize(cacheConfig.tlbCacheSize);
+    }
+    microTLBEntries = cacheConfig.microTlbEntries;
+    configureCacheAging(cacheConfig);
+    configureWalkCache(cacheConfig);
+    bumpGlobalInvalidationEpoch();
+    
+    memoryBudget->setLimit(configuration.getResourceLimits().maxMemoryUsage);
+    streamTable.resize(configuration.getAddressConfiguration().maxStreamCount);
     
     // Trim queues if they exceed new limits
     while (eventQueue.size() > maxEventQueueSize) {
@@ -0,0 +1,278 @@
+// ARM SMMU v3 Asynchronous Translation Engine Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/translation_engine.h"
+#include <vector>
+
+namespace smmu {
+
+const size_t TranslationEngine::MAX_WORKERS;
+
+namespace {
+
+std::atomic<size_t> nextSubmitterSlot(0);
+
+// Fixed per thread, so a thread's submissions stay in one queue
+size_t submitterSlot() {
+    static thread_local size_t slot = nextSubmitterSlot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+size_t clampWorkerCount(size_t workerCount) {
+    if (workerCount == 0) {
+        return 1;
+    }
+    return workerCount > TranslationEngine::MAX_WORKERS ? TranslationEngine::MAX_WORKERS : workerCount;
+}
+
+} // anonymous namespace
+
+TranslationEngine::TranslationEngine(Translator translator, size_t workerCount, uint32_t timeoutMs)
+    : translator(translator), timeoutMs(timeoutMs), activeWorkers(0), queueLimit(0),
+      sleepingWorkers(0), retiring(false), sweeperIdle(false), sweeperStopping(false), queuedCount(0),
+      pendingCount(0), completedCount(0), timeoutCount(0), stealCount(0) {
+    std::lock_guard<std::mutex> lock(resizeMutex);
+    startWorkers(clampWorkerCount(workerCount));
+    sweeper = std::thread(&TranslationEngine::sweeperLoop, this);
+}
+
+TranslationEngine::~TranslationEngine() {
+    drain();
+    {
+        std::lock_guard<std::mutex> lock(resizeMutex);
+        stopWorkers();
+    }
+    {
+        std::lock_guard<std::mutex> lock(sweepMutex);
+        sweeperStopping = true;
+        sweepWake.notify_all();
+    }
+    sweeper.join();
+}
+
+void TranslationEngine::submit(const TranslationRequest& request, TranslationCallback callback) {
+    Job job;
+    job.request = request;
+    job.callback = std::move(callback);
+    job.submitted = std::chrono::steady_clock::now();
+    
+    // Counted before it is visible so neither drain() nor a retiring worker misses it
+    pendingCount.fetch_add(1);
+    queuedCount.fetch_add(1);
+    WorkQueue& queue = *queues[submitterSlot() % activeWorkers.load(std::memory_order_acquire)];
+    {
+        std::lock_guard<std::mutex> lock(queue.queueMutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    
+    if (sleepingWorkers.load() != 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        workAvailable.notify_one();
+    }
+    if (sweeperIdle.load()) {
+        std::lock_guard<std::mutex> lock(sweepMutex);
+        sweepWake.notify_all();
+    }
+}
+
+void TranslationEngine::drain() {
+    std::unique_lock<std::mutex> lock(drainMutex);
+    drained.wait(lock, [this]() { return pendingCount.load() == 0; });
+}
+
+void TranslationEngine::resize(size_t workerCount) {
+    workerCount = clampWorkerCount(workerCount);
+    std::lock_guard<std::mutex> lock(resizeMutex);
+    if (workerCount == workers.size()) {
+        return;
+    }
+    stopWorkers();
+    startWorkers(workerCount);
+}
+
+void TranslationEngine::setTimeout(uint32_t timeout) {
+    timeoutMs.store(timeout, std::memory_order_relaxed);
+    
+    // Deadlines move, so the deadline thread recomputes its sleep
+    std::lock_guard<std::mutex> lock(sweepMutex);
+    sweepWake.notify_all();
+}
+
+size_t TranslationEngine::getWorkerCount() const {
+    return activeWorkers.load(std::memory_order_acquire);
+}
+
+uint64_t TranslationEngine::getCompletedCount() const {
+    return completedCount.load(std::memory_order_relaxed);
+}
+
+uint64_t TranslationEngine::getTimeoutCount() const {
+    return timeoutCount.load(std::memory_order_relaxed);
+}
+
+uint64_t TranslationEngine::getStealCount() const {
+    return stealCount.load(std::memory_order_relaxed);
+}
+
+// resizeMutex held
+void TranslationEngine::startWorkers(size_t workerCount) {
+    size_t limit = queueLimit.load(std::memory_order_relaxed);
+    for (size_t i = limit; i < workerCount; ++i) {
+        queues[i].reset(new WorkQueue());
+    }
+    if (workerCount > limit) {
+        queueLimit.store(workerCount, std::memory_order_release);
+    }
+    activeWorkers.store(workerCount, std::memory_order_release);
+    
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&TranslationEngine::workerLoop, this, i);
+    }
+}
+
+// resizeMutex held. Workers finish the job they are running and leave the
+// rest queued for their successors.
+void TranslationEngine::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        retiring.store(true);
+        workAvailable.notify_all();
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+    workers.clear();
+    retiring.store(false);
+}
+
+void TranslationEngine::workerLoop(size_t index) {
+    Job job;
+    while (!retiring.load()) {
+        if (takeJob(index, job)) {
+            runJob(job);
+            continue;
+        }
+        
+        // Announce the sleep before the last check: a submitter either sees a
+        // sleeper and notifies under the lock, or its job is seen here
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingWorkers.fetch_add(1);
+        if (queuedCount.load() == 0 && !retiring.load()) {
+            workAvailable.wait(lock);
+        }
+        sleepingWorkers.fetch_sub(1);
+    }
+}
+
+// Own queue first, then the oldest job of another
+bool TranslationEngine::takeJob(size_t index, Job& job) {
+    size_t limit = queueLimit.load(std::memory_order_acquire);
+    for (size_t i = 0; i < limit; ++i) {
+        WorkQueue& queue = *queues[(index + i) % limit];
+        std::lock_guard<std::mutex> lock(queue.queueMutex);
+        if (queue.jobs.empty()) {
+            continue;
+        }
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        queuedCount.fetch_sub(1);
+        if (i != 0) {
+            stealCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+    return false;
+}
+
+void TranslationEngine::runJob(Job& job) {
+    TranslationResult result;
+    uint32_t timeout = timeoutMs.load(std::memory_order_relaxed);
+    if (timeout != 0 && std::chrono::steady_clock::now() - job.submitted > std::chrono::milliseconds(timeout)) {
+        timeoutCount.fetch_add(1, std::memory_order_relaxed);
+        result = makeTranslationError(SMMUError::Timeout);
+    } else {
+        result = translator(job.request);
+    }
+    completeJob(job, result);
+}
+
+void TranslationEngine::completeJob(Job& job, const TranslationResult& result) {
+    job.callback(job.request, result);
+    job.callback = TranslationCallback();  // Drop what it captured before reporting completion
+    
+    completedCount.fetch_add(1, std::memory_order_relaxed);
+    if (pendingCount.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(drainMutex);
+        drained.notify_all();
+    }
+}
+
+// Jobs submitted later cannot expire before those already queued, so the
+// thread only wakes at the earliest queued deadline, when the timeout
+// changes, or when a job arrives while nothing was queued
+void TranslationEngine::sweeperLoop() {
+    std::unique_lock<std::mutex> lock(sweepMutex);
+    while (!sweeperStopping) {
+        lock.unlock();
+        std::chrono::steady_clock::time_point nextDeadline;
+        bool waiting = expireJobs(nextDeadline);
+        lock.lock();
+        if (sweeperStopping) {
+            break;
+        }
+        if (waiting) {
+            sweepWake.wait_until(lock, nextDeadline);
+            continue;
+        }
+        
+        // Announce the sleep before the last check, as workers do
+        sweeperIdle.store(true);
+        uint32_t timeout = timeoutMs.load(std::memory_order_relaxed);
+        if (timeout == 0 || queuedCount.load() == 0) {
+            sweepWake.wait(lock);
+        } else {
+            // Counted but not queued yet; its deadline is at least a timeout away
+            sweepWake.wait_for(lock, std::chrono::milliseconds(timeout));
+        }
+        sweeperIdle.store(false);
+    }
+}
+
+// Complete every queued job past its deadline with SMMUError::Timeout.
+// Returns whether jobs remain queued, with the earliest of their deadlines.
+bool TranslationEngine::expireJobs(std::chrono::steady_clock::time_point& nextDeadline) {
+    uint32_t timeout = timeoutMs.load(std::memory_order_relaxed);
+    if (timeout == 0) {
+        return false;
+    }
+    
+    std::chrono::milliseconds limit(timeout);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::vector<Job> expired;
+    bool waiting = false;
+    size_t count = queueLimit.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        WorkQueue& queue = *queues[i];
+        std::lock_guard<std::mutex> lock(queue.queueMutex);
+        while (!queue.jobs.empty() && queue.jobs.front().submitted + limit <= now) {
+            expired.push_back(std::move(queue.jobs.front()));
+            queue.jobs.pop_front();
+            queuedCount.fetch_sub(1);
+        }
+        if (!queue.jobs.empty()) {
+            std::chrono::steady_clock::time_point deadline = queue.jobs.front().submitted + limit;
+            if (!waiting || deadline < nextDeadline) {
+                nextDeadline = deadline;
+            }
+            waiting = true;
+        }
+    }
+    
+    for (size_t i = 0; i < expired.size(); ++i) {
+        timeoutCount.fetch_add(1, std::memory_order_relaxed);
+        completeJob(expired[i], makeTranslationError(SMMUError::Timeout));
+    }
+    return waiting;
+}
+
+} // namespace smmu
@@ -0,0 +1,134 @@
+// ARM SMMU v3 PASID Table Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/pasid_table.h"
+
+namespace smmu {
+
+const unsigned PASIDTable::SPLIT;
+
+namespace {
+
+const size_t LEVEL2_ENTRIES = static_cast<size_t>(1) << PASIDTable::SPLIT;
+
+} // anonymous namespace
+
+PASIDTable::Level1::Level1(size_t count) : count(count), tables(new std::atomic<Slot*>[count]) {
+    for (size_t i = 0; i < count; ++i) {
+        tables[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+PASIDTable::PASIDTable() : level1(nullptr) {
+}
+
+// L2 tables belong to the newest L1 table; older ones only shared them
+PASIDTable::~PASIDTable() {
+    Level1* table = level1.load(std::memory_order_relaxed);
+    if (!table) {
+        return;
+    }
+    for (size_t i = 0; i < table->count; ++i) {
+        Slot* level2 = table->tables[i].load(std::memory_order_relaxed);
+        for (size_t j = 0; level2 && j < LEVEL2_ENTRIES; ++j) {
+            delete level2[j].load(std::memory_order_relaxed);
+        }
+        delete[] level2;
+    }
+    delete table;
+}
+
+// Lock-free: two dependent loads after the L1 table
+const PASIDTable::Entry* PASIDTable::find(PASID pasid) const {
+    const Level1* table = level1.load(std::memory_order_acquire);
+    size_t index = pasid >> SPLIT;
+    if (!table || index >= table->count) {
+        return nullptr;
+    }
+    Slot* level2 = table->tables[index].load(std::memory_order_acquire);
+    return level2 ? level2[pasid & (LEVEL2_ENTRIES - 1)].load(std::memory_order_acquire) : nullptr;
+}
+
+void PASIDTable::publish(PASID pasid, std::shared_ptr<AddressSpace> addressSpace) {
+    Entry* entry = new Entry();
+    entry->addressSpace = addressSpace;
+    store(pasid, entry);
+}
+
+void PASIDTable::publish(PASID pasid, const ContextDescriptor& contextDescriptor) {
+    Entry* entry = new Entry();
+    entry->contextDescriptor = contextDescriptor;
+    store(pasid, entry);
+}
+
+void PASIDTable::remove(PASID pasid) {
+    if (find(pasid)) {
+        store(pasid, nullptr);
+    }
+}
+
+void PASIDTable::clear() {
+    Level1* table = level1.load(std::memory_order_relaxed);
+    for (size_t i = 0; table && i < table->count; ++i) {
+        Slot* level2 = table->tables[i].load(std::memory_order_relaxed);
+        for (size_t j = 0; level2 && j < LEVEL2_ENTRIES; ++j) {
+            const Entry* entry = level2[j].exchange(nullptr, std::memory_order_acq_rel);
+            if (entry) {
+                reclaimer.retire(const_cast<Entry*>(entry), &releaseEntry);
+            }
+        }
+    }
+    reclaimer.reclaim();
+}
+
+// Writers are serialized, so tables are built and published without CAS. An
+// outgrown L1 table is copied into one twice the size, so growth is amortized
+// constant per PASID.
+PASIDTable::Slot* PASIDTable::slotForWrite(PASID pasid) {
+    size_t index = pasid >> SPLIT;
+    Level1* table = level1.load(std::memory_order_relaxed);
+    if (!table || index >= table->count) {
+        size_t count = table ? table->count : 1;
+        while (count <= index) {
+            count *= 2;
+        }
+        Level1* grown = new Level1(count);
+        for (size_t i = 0; table && i < table->count; ++i) {
+            grown->tables[i].store(table->tables[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        level1.store(grown, std::memory_order_release);
+        if (table) {
+            reclaimer.retire(table, &releaseLevel1);
+        }
+        table = grown;
+    }
+    
+    std::atomic<Slot*>& descriptor = table->tables[index];
+    Slot* level2 = descriptor.load(std::memory_order_relaxed);
+    if (!level2) {
+        level2 = new Slot[LEVEL2_ENTRIES];
+        for (size_t i = 0; i < LEVEL2_ENTRIES; ++i) {
+            level2[i].store(nullptr, std::memory_order_relaxed);
+        }
+        descriptor.store(level2, std::memory_order_release);
+    }
+    return &level2[pasid & (LEVEL2_ENTRIES - 1)];
+}
+
+void PASIDTable::store(PASID pasid, const Entry* entry) {
+    const Entry* previous = slotForWrite(pasid)->exchange(entry, std::memory_order_acq_rel);
+    if (previous) {
+        reclaimer.retire(const_cast<Entry*>(previous), &releaseEntry);
+    }
+    reclaimer.reclaim();
+}
+
+void PASIDTable::releaseEntry(void* object) {
+    delete static_cast<Entry*>(object);
+}
+
+void PASIDTable::releaseLevel1(void* object) {
+    delete static_cast<Level1*>(object);
+}
+
+} // namespace smmu
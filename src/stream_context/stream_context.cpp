@@ -7,6 +7,8 @@
 
 namespace smmu {
 
+const uint32_t StreamContext::SHARED_STAGE2_BIT;
+
 // Helper function to get current timestamp
 static uint64_t getCurrentTimestamp() {
     auto now = std::chrono::steady_clock::now();
@@ -14,13 +16,50 @@ static uint64_t getCurrentTimestamp() {
     return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
 }
 
+// Stage-1 context descriptor lookup
+std::shared_ptr<AddressSpace> TranslationDescriptor::findStage1AddressSpace(PASID pasid) const {
+    EpochGuard guard;
+    const PASIDTable::Entry* entry = pasidTable->find(pasid);
+    return entry ? entry->addressSpace : std::shared_ptr<AddressSpace>();
+}
+
+// A PASID bound to a context descriptor walks its tables; nested walks send
+// descriptor fetches through Stage-2. The guard keeps the CD, and the
+// AddressSpace it holds, alive if the PASID is removed during the walk.
+TranslationResult TranslationDescriptor::translateStage1(PASID pasid, IOVA iova, AccessType accessType,
+                                                         SecurityState securityState) const {
+    EpochGuard guard;
+    const PASIDTable::Entry* entry = pasidTable->find(pasid);
+    if (!entry) {
+        return makeTranslationError(SMMUError::PASIDNotFound);
+    }
+    if (entry->addressSpace) {
+        return entry->addressSpace->translatePage(iova, accessType, securityState);
+    }
+    
+    if (!tableWalker) {
+        return makeTranslationError(SMMUError::ConfigurationError);  // No memory to walk
+    }
+    const AddressSpace* stage2 = stage2Enabled ? stage2AddressSpace.get() : nullptr;
+    return tableWalker->walk(entry->contextDescriptor, iova, accessType, securityState, stage2);
+}
+
 // Constructor - initializes stream context with ARM SMMU v3 defaults
-StreamContext::StreamContext() 
-    : stage1Enabled(true),     // ARM SMMU v3: Stage-1 typically enabled by default
+StreamContext::StreamContext(std::shared_ptr<MemoryBudget> budget)
+    : pasidTable(std::make_shared<PASIDTable>()),
+      stage1Enabled(true),     // ARM SMMU v3: Stage-1 typically enabled by default
       stage2Enabled(false),    // ARM SMMU v3: Stage-2 disabled until configured
       faultMode(FaultMode::Terminate),  // Default to immediate DMA termination
+      vmidValid(false),        // Untagged until a Stage-2 context is attached
+      vmid(0),
+      stage1Granule(TranslationGranule::Size4KB),
+      budget(budget),
       streamEnabled(false),    // Stream disabled by default per ARM SMMU v3
-      configurationChanged(false) {  // Configuration initially unchanged
+      configurationChanged(false),  // Configuration initially unchanged
+      translationCounter(0),
+      translationFaultCounter(0),
+      lastTranslationTimestamp(0),
+      sharedStage2Key(0) {
     
     // Initialize default configuration
     currentConfiguration.translationEnabled = false;  // Default: translation disabled
@@ -32,6 +71,9 @@ StreamContext::StreamContext()
     streamStatistics.creationTimestamp = getCurrentTimestamp();
     streamStatistics.lastAccessTimestamp = streamStatistics.creationTimestamp;
     
+    // Publish the default descriptor so the first translation needs no rebuild
+    publishDescriptor();
+    
     // Empty PASID map - sparse allocation for efficient memory usage
     // Stage-2 AddressSpace remains null until explicitly configured
     // Fault handler initially null
@@ -56,19 +98,20 @@ VoidResult StreamContext::createPASID(PASID pasid) {
     }
     
     // Check if PASID already exists to prevent accidental overwrites
-    if (pasidMap.find(pasid) != pasidMap.end()) {
+    if (pasidMap.find(pasid) != pasidMap.end() || contextDescriptors.find(pasid) != contextDescriptors.end()) {
         return makeVoidError(SMMUError::PASIDAlreadyExists);  // PASID already exists - use addPASID to replace
     }
     
     // Create new AddressSpace for this PASID
     // ARM SMMU v3: Each PASID gets independent Stage-1 address space
-    std::shared_ptr<AddressSpace> addressSpace = std::make_shared<AddressSpace>();
+    std::shared_ptr<AddressSpace> addressSpace = std::make_shared<AddressSpace>(PageTableBackend::Hash, stage1Granule, budget);
     
     // Insert into PASID map with efficient O(1) average case performance
     pasidMap[pasid] = addressSpace;
+    pasidTable->publish(pasid, addressSpace);
     
     // Update PASID count statistics
-    streamStatistics.pasidCount = pasidMap.size();
+    streamStatistics.pasidCount = pasidMap.size() + contextDescriptors.size();
     
     return makeVoidSuccess();  // Successful PASID creation
 }
@@ -84,18 +127,16 @@ VoidResult StreamContext::removePASID(PASID pasid) {
         return makeVoidError(SMMUError::InvalidPASID);  // Invalid PASID value
     }
     
-    // Find PASID in map
-    auto it = pasidMap.find(pasid);
-    if (it == pasidMap.end()) {
-        return makeVoidError(SMMUError::PASIDNotFound);  // PASID does not exist
-    }
-    
     // Remove from map - AddressSpace will be destroyed when last reference released
     // ARM SMMU v3: All translations for this PASID become invalid
-    pasidMap.erase(it);
+    if (pasidMap.erase(pasid) == 0 && contextDescriptors.erase(pasid) == 0) {
+        return makeVoidError(SMMUError::PASIDNotFound);  // PASID does not exist
+    }
+    asidMap.erase(pasid);
+    pasidTable->remove(pasid);
     
     // Update PASID count statistics
-    streamStatistics.pasidCount = pasidMap.size();
+    streamStatistics.pasidCount = pasidMap.size() + contextDescriptors.size();
     
     // Note: Actual TLB invalidation is coordinated at higher SMMU level
     // where StreamID context is available for complete cache coherence
@@ -122,14 +163,78 @@ void StreamContext::addPASID(PASID pasid, std::shared_ptr<AddressSpace> addressS
     // Insert or replace existing PASID mapping
     // ARM SMMU v3: Allows multiple PASIDs to share same address space
     pasidMap[pasid] = addressSpace;
+    contextDescriptors.erase(pasid);
+    pasidTable->publish(pasid, addressSpace);
     
     // Update PASID count statistics
-    streamStatistics.pasidCount = pasidMap.size();
+    streamStatistics.pasidCount = pasidMap.size() + contextDescriptors.size();
     
     // Note: If replacing existing PASID, old AddressSpace reference count
     // decrements and may trigger automatic cleanup via shared_ptr
 }
 
+// Give targetPasid its own copy of sourcePasid's address space, as for a
+// forked process. The copy shares the source's page tables, so this is
+// O(1); the two diverge as either is written.
+VoidResult StreamContext::clonePASID(PASID sourcePasid, PASID targetPasid) {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    
+    if (sourcePasid > MAX_PASID || targetPasid > MAX_PASID) {
+        return makeVoidError(SMMUError::InvalidPASID);
+    }
+    
+    if (pasidMap.find(targetPasid) != pasidMap.end() || contextDescriptors.find(targetPasid) != contextDescriptors.end()) {
+        return makeVoidError(SMMUError::PASIDAlreadyExists);
+    }
+    
+    // Tables in memory belong to software, so a clone of a bound PASID
+    // simply points at them
+    auto cdIt = contextDescriptors.find(sourcePasid);
+    if (cdIt != contextDescriptors.end()) {
+        ContextDescriptor copy = cdIt->second;
+        contextDescriptors[targetPasid] = copy;  // Insertion may rehash, invalidating cdIt
+        pasidTable->publish(targetPasid, copy);
+    } else {
+        auto sourceIt = pasidMap.find(sourcePasid);
+        if (sourceIt == pasidMap.end()) {
+            return makeVoidError(SMMUError::PASIDNotFound);
+        }
+        std::shared_ptr<AddressSpace> copy = std::make_shared<AddressSpace>(*sourceIt->second);
+        pasidMap[targetPasid] = copy;  // Insertion may rehash, invalidating sourceIt
+        pasidTable->publish(targetPasid, copy);
+    }
+    
+    streamStatistics.pasidCount = pasidMap.size() + contextDescriptors.size();
+    
+    return makeVoidSuccess();
+}
+
+// Bind a PASID to Stage-1 tables in physical memory
+// ARM SMMU v3 spec: CD.TTB0/TTB1 - tables are owned and edited by software
+VoidResult StreamContext::setContextDescriptor(PASID pasid, const ContextDescriptor& contextDescriptor) {
+    // Validation takes contextMutex itself
+    Result<bool> valid = validateContextDescriptor(contextDescriptor, pasid, 0);
+    if (valid.isError() || !valid.getValue()) {
+        return makeVoidError(SMMUError::InvalidConfiguration);
+    }
+    
+    std::lock_guard<std::mutex> lock(contextMutex);
+    pasidMap.erase(pasid);
+    contextDescriptors[pasid] = contextDescriptor;
+    asidMap[pasid] = contextDescriptor.asid;
+    pasidTable->publish(pasid, contextDescriptor);
+    
+    streamStatistics.pasidCount = pasidMap.size() + contextDescriptors.size();
+    
+    return makeVoidSuccess();
+}
+
+void StreamContext::setTableWalker(std::shared_ptr<PageTableWalker> walker) {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    tableWalker = walker;
+    invalidateDescriptor();
+}
+
 // Map page within specific PASID address space
 // ARM SMMU v3 spec: Per-PASID page mapping with isolation enforcement
 VoidResult StreamContext::mapPage(PASID pasid, IOVA iova, PA pa, const PagePermissions& permissions, SecurityState securityState) {
@@ -163,6 +268,27 @@ VoidResult StreamContext::mapPage(PASID pasid, IOVA iova, PA pa, const PagePermi
     return makeVoidSuccess();  // Successful page mapping
 }
 
+// Map a 2MB or 1GB block into a PASID's address space
+VoidResult StreamContext::mapBlock(PASID pasid, IOVA iova, PA pa, uint64_t blockSize, const PagePermissions& permissions, SecurityState securityState) {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    
+    if (pasid > MAX_PASID) {
+        return makeVoidError(SMMUError::InvalidPASID);
+    }
+    
+    auto it = pasidMap.find(pasid);
+    if (it == pasidMap.end()) {
+        return makeVoidError(SMMUError::PASIDNotFound);
+    }
+    
+    std::shared_ptr<AddressSpace> addressSpace = it->second;
+    if (!addressSpace) {
+        return makeVoidError(SMMUError::InternalError);
+    }
+    
+    return addressSpace->mapBlock(iova, pa, blockSize, permissions, securityState);
+}
+
 // Unmap page from specific PASID address space
 // ARM SMMU v3 spec: Per-PASID page unmapping with proper cleanup
 VoidResult StreamContext::unmapPage(PASID pasid, IOVA iova) {
@@ -199,14 +325,71 @@ VoidResult StreamContext::unmapPage(PASID pasid, IOVA iova) {
     return makeVoidSuccess();
 }
 
+// Unmap an inclusive IOVA range from a PASID's address space
+VoidResult StreamContext::unmapRange(PASID pasid, IOVA startIova, IOVA endIova) {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    
+    if (pasid > MAX_PASID) {
+        return makeVoidError(SMMUError::InvalidPASID);
+    }
+    
+    auto it = pasidMap.find(pasid);
+    if (it == pasidMap.end()) {
+        return makeVoidError(SMMUError::PASIDNotFound);
+    }
+    
+    std::shared_ptr<AddressSpace> addressSpace = it->second;
+    if (!addressSpace) {
+        return makeVoidError(SMMUError::InternalError);
+    }
+    
+    // TLB invalidation is left to the SMMU, as for unmapPage
+    return addressSpace->unmapRange(startIova, endIova);
+}
+
+// Unmap a batch of pages from a PASID's address space
+VoidResult StreamContext::unmapPages(PASID pasid, const std::vector<IOVA>& iovas) {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    
+    if (pasid > MAX_PASID) {
+        return makeVoidError(SMMUError::InvalidPASID);
+    }
+    
+    auto it = pasidMap.find(pasid);
+    if (it == pasidMap.end()) {
+        return makeVoidError(SMMUError::PASIDNotFound);
+    }
+    
+    std::shared_ptr<AddressSpace> addressSpace = it->second;
+    if (!addressSpace) {
+        return makeVoidError(SMMUError::InternalError);
+    }
+    
+    // TLB invalidation is left to the SMMU, as for unmapPage
+    return addressSpace->unmapPages(iovas);
+}
+
 // Perform two-stage address translation with ARM SMMU v3 semantics
 // ARM SMMU v3 spec: Stage-1 (per-PASID) + Stage-2 (shared) translation
+// AddressSpaces synchronize their own lookups against mapping changes, so
+// the walk holds no context lock; contextMutex is only taken to rebuild a
+// dropped descriptor
 TranslationResult StreamContext::translate(PASID pasid, IOVA iova, AccessType accessType, SecurityState securityState) {
-    std::lock_guard<std::mutex> lock(contextMutex);
+    std::shared_ptr<const TranslationDescriptor> current = getTranslationDescriptor();
+    return translate(*current, pasid, iova, accessType, securityState);
+}
+
+// Translate against a descriptor from getTranslationDescriptor() without
+// taking contextMutex. The descriptor's shared_ptrs keep its AddressSpaces
+// alive even if their PASIDs are removed during the walk.
+TranslationResult StreamContext::translate(const TranslationDescriptor& descriptor, PASID pasid, IOVA iova,
+                                           AccessType accessType, SecurityState securityState) {
+    const bool stage1Enabled = descriptor.stage1Enabled;
+    const bool stage2Enabled = descriptor.stage2Enabled;
     
     // Update translation statistics
-    streamStatistics.translationCount++;
-    streamStatistics.lastAccessTimestamp = getCurrentTimestamp();
+    translationCounter.fetch_add(1, std::memory_order_relaxed);
+    lastTranslationTimestamp.store(getCurrentTimestamp(), std::memory_order_relaxed);
     
     // ARM SMMU v3: Check if any translation stage is enabled
     if (!stage1Enabled && !stage2Enabled) {
@@ -216,103 +399,166 @@ TranslationResult StreamContext::translate(PASID pasid, IOVA iova, AccessType ac
     
     // ARM SMMU v3: Check stream enabled state only for active translation contexts
     // Stream must be enabled if translation is configured and requested
-    if ((stage1Enabled || stage2Enabled) && currentConfiguration.translationEnabled && !streamEnabled) {
+    if ((stage1Enabled || stage2Enabled) && descriptor.config.translationEnabled && !descriptor.streamEnabled) {
         // Translation is configured but stream is disabled - fail translation
-        streamStatistics.faultCount++;  // Track fault
+        translationFaultCounter.fetch_add(1, std::memory_order_relaxed);  // Track fault
         return makeTranslationError(SMMUError::StreamDisabled);
     }
     
     // Validate PASID within ARM SMMU v3 specification limits
     // PASID 0 is valid and commonly used for kernel/hypervisor contexts per ARM SMMU v3 specification
     if (pasid > MAX_PASID) {
-        streamStatistics.faultCount++;  // Track fault
+        translationFaultCounter.fetch_add(1, std::memory_order_relaxed);  // Track fault
         // Note: Fault will be recorded by SMMU controller with proper StreamID
         return makeTranslationError(SMMUError::InvalidPASID);
     }
     
     IPA intermediatePA = iova;  // Start with input address
+    TranslationData stage1Data;
     
     // ARM SMMU v3: Stage-1 translation (per-PASID address space)
     if (stage1Enabled) {
-        // Find PASID in map
-        auto it = pasidMap.find(pasid);
-        if (it == pasidMap.end()) {
-            // PASID not found - return proper PASID error
-            streamStatistics.faultCount++;  // Track fault
-            // Note: Fault will be recorded by SMMU controller with proper StreamID
-            return makeTranslationError(SMMUError::PASIDNotFound);
-        }
-        
-        // Get AddressSpace for this PASID
-        std::shared_ptr<AddressSpace> stage1AddressSpace = it->second;
-        if (!stage1AddressSpace) {
-            // Null AddressSpace - translation fault
-            streamStatistics.faultCount++;  // Track fault
-            // Note: Fault will be recorded by SMMU controller with proper StreamID
-            return makeTranslationError(SMMUError::InternalError);
-        }
-        
-        // Perform Stage-1 translation (IOVA -> IPA)
-        TranslationResult stage1Result = stage1AddressSpace->translatePage(iova, accessType, securityState);
+        // Perform Stage-1 translation (IOVA -> IPA) through the cached
+        // context descriptors; an unknown PASID fails with PASIDNotFound
+        TranslationResult stage1Result = descriptor.translateStage1(pasid, iova, accessType, securityState);
         if (stage1Result.isError()) {
             // Stage-1 translation failed - propagate fault
-            streamStatistics.faultCount++;  // Track fault
+            translationFaultCounter.fetch_add(1, std::memory_order_relaxed);  // Track fault
             // Note: Fault will be recorded by SMMU controller with proper StreamID
             return stage1Result;
         }
         
         // Use Stage-1 output as input to Stage-2
-        intermediatePA = stage1Result.getValue().physicalAddress;
+        stage1Data = stage1Result.getValue();
+        intermediatePA = stage1Data.physicalAddress;
     }
     
     // ARM SMMU v3: Stage-2 translation (shared across stream)
     if (stage2Enabled) {
         // Validate Stage-2 AddressSpace is configured
-        if (!stage2AddressSpace) {
+        if (!descriptor.stage2AddressSpace) {
             // Stage-2 enabled but not configured - no pages are mapped
-            streamStatistics.faultCount++;  // Track fault
+            translationFaultCounter.fetch_add(1, std::memory_order_relaxed);  // Track fault
             // Note: Fault will be recorded by SMMU controller with proper StreamID
             return makeTranslationError(SMMUError::PageNotMapped);
         }
         
         // Perform Stage-2 translation (IPA -> PA)
-        TranslationResult stage2Result = stage2AddressSpace->translatePage(intermediatePA, accessType, securityState);
+        TranslationResult stage2Result = descriptor.stage2AddressSpace->translatePage(intermediatePA, accessType, securityState);
         if (stage2Result.isError()) {
             // Stage-2 translation failed - propagate fault
-            streamStatistics.faultCount++;  // Track fault
+            translationFaultCounter.fetch_add(1, std::memory_order_relaxed);  // Track fault
             // Note: Fault will be recorded by SMMU controller with proper StreamID
             return stage2Result;
         }
         
-        // Stage-2 success - return final physical address
-        return makeTranslationSuccess(stage2Result.getValue().physicalAddress, 
-                                    stage2Result.getValue().permissions, 
-                                    stage2Result.getValue().securityState);
+        // Stage-2 success - return final physical address; the combined
+        // mapping is only as large as the smaller of the two stages
+        uint64_t blockSize = stage2Result.getValue().blockSize;
+        if (stage1Enabled && stage1Data.blockSize < blockSize) {
+            blockSize = stage1Data.blockSize;
+        }
+        TranslationData data(stage2Result.getValue().physicalAddress,
+                             stage2Result.getValue().permissions,
+                             stage2Result.getValue().securityState,
+                             blockSize);
+        data.dirtyEpoch = combineDirtyEpochs(stage1Data.dirtyEpoch, stage2Result.getValue().dirtyEpoch);
+        return TranslationResult(data);
     }
     
     // Only Stage-1 enabled case - intermediatePA already contains translated address
     if (stage1Enabled) {
-        // Find the Stage-1 result to get permissions info
-        auto it = pasidMap.find(pasid);
-        if (it != pasidMap.end() && it->second) {
-            TranslationResult stage1Result = it->second->translatePage(iova, accessType, securityState);
-            if (stage1Result.isOk()) {
-                return makeTranslationSuccess(intermediatePA, 
-                                            stage1Result.getValue().permissions, 
-                                            stage1Result.getValue().securityState);
-            }
-        }
+        return TranslationResult(stage1Data);
     }
     
     // Identity mapping case - no permissions validation
     return makeTranslationSuccess(intermediatePA, PagePermissions(), securityState);
 }
 
+// ============================================================================
+// Translation Descriptor Cache
+// ============================================================================
+
+// Current descriptor, rebuilt on demand after a change that dropped it
+std::shared_ptr<const TranslationDescriptor> StreamContext::getTranslationDescriptor() const {
+    std::shared_ptr<const TranslationDescriptor> current = std::atomic_load(&descriptor);
+    if (current) {
+        return current;
+    }
+    
+    std::lock_guard<std::mutex> lock(contextMutex);
+    current = std::atomic_load(&descriptor);  // Another reader may have rebuilt it
+    if (!current) {
+        current = buildDescriptor();
+        std::atomic_store(&descriptor, current);
+    }
+    return current;
+}
+
+// ARM SMMU v3 spec: CMD_PREFETCH_CONFIG - load the STE/CDs ahead of traffic
+void StreamContext::prefetchTranslationDescriptor() const {
+    getTranslationDescriptor();
+}
+
+bool StreamContext::isTranslationDescriptorCached() const {
+    return std::atomic_load(&descriptor) != nullptr;
+}
+
+void StreamContext::setSharedStage2VMID(bool shared, VMID vmid) {
+    sharedStage2Key.store(shared ? SHARED_STAGE2_BIT | vmid : 0, std::memory_order_release);
+}
+
+bool StreamContext::getSharedStage2VMID(VMID& vmid) const {
+    uint32_t key = sharedStage2Key.load(std::memory_order_acquire);
+    vmid = static_cast<VMID>(key);
+    return (key & SHARED_STAGE2_BIT) != 0;
+}
+
+// Decode the current configuration - caller holds contextMutex
+std::shared_ptr<const TranslationDescriptor> StreamContext::buildDescriptor() const {
+    std::shared_ptr<TranslationDescriptor> built = std::make_shared<TranslationDescriptor>();
+    built->config = currentConfiguration;
+    built->stage1Enabled = stage1Enabled;
+    built->stage2Enabled = stage2Enabled;
+    built->streamEnabled = streamEnabled;
+    built->vmidValid = vmidValid;
+    built->vmid = vmid;
+    built->stage2AddressSpace = stage2AddressSpace;
+    built->pasidTable = pasidTable;
+    built->tableWalker = tableWalker;
+    
+    // Same precedence the SMMU used when it decoded StreamConfig per translation
+    if (!currentConfiguration.translationEnabled) {
+        built->mode = TranslationDescriptor::Mode::Bypass;
+    } else if (currentConfiguration.stage1Enabled && currentConfiguration.stage2Enabled) {
+        built->mode = TranslationDescriptor::Mode::BothStages;
+    } else if (currentConfiguration.stage1Enabled) {
+        built->mode = TranslationDescriptor::Mode::Stage1Only;
+    } else if (currentConfiguration.stage2Enabled) {
+        built->mode = TranslationDescriptor::Mode::Stage2Only;
+    } else {
+        built->mode = TranslationDescriptor::Mode::NoStages;
+    }
+    return built;
+}
+
+// Configuration updates publish eagerly - caller holds contextMutex
+void StreamContext::publishDescriptor() {
+    std::atomic_store(&descriptor, buildDescriptor());
+}
+
+// Stage changes only drop the descriptor, so a burst of them costs one
+// rebuild at the next translation - caller holds contextMutex
+void StreamContext::invalidateDescriptor() {
+    std::atomic_store(&descriptor, std::shared_ptr<const TranslationDescriptor>());
+}
+
 // Configure Stage-1 translation enable
 // ARM SMMU v3 spec: Per-PASID address translation control
 void StreamContext::setStage1Enabled(bool enabled) {
     std::lock_guard<std::mutex> lock(contextMutex);
     stage1Enabled = enabled;
+    invalidateDescriptor();
     
     // Note: Actual hardware configuration would be coordinated at SMMU level
     // where StreamID context and hardware registers are accessible
@@ -323,6 +569,7 @@ void StreamContext::setStage1Enabled(bool enabled) {
 void StreamContext::setStage2Enabled(bool enabled) {
     std::lock_guard<std::mutex> lock(contextMutex);
     stage2Enabled = enabled;
+    invalidateDescriptor();
     
     // Note: Stage-2 requires configured AddressSpace to be meaningful
     // Hardware configuration coordinated at SMMU controller level
@@ -333,11 +580,37 @@ void StreamContext::setStage2Enabled(bool enabled) {
 void StreamContext::setStage2AddressSpace(std::shared_ptr<AddressSpace> addressSpace) {
     std::lock_guard<std::mutex> lock(contextMutex);
     stage2AddressSpace = addressSpace;
+    invalidateDescriptor();
     
     // ARM SMMU v3: Stage-2 AddressSpace can be shared across multiple streams
     // for efficient memory usage and consistent address translation
 }
 
+// Tag the Stage-2 context with a VMID
+// ARM SMMU v3 spec: STE.S2VMID - streams of one VM share Stage-2 TLB entries
+void StreamContext::setVMID(VMID vmidValue) {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    vmid = vmidValue;
+    vmidValid = true;
+    invalidateDescriptor();
+}
+
+// Tag a PASID's Stage-1 context with an ASID
+// ARM SMMU v3 spec: CD.ASID
+VoidResult StreamContext::setASID(PASID pasid, ASID asid) {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    
+    if (pasid > MAX_PASID) {
+        return makeVoidError(SMMUError::InvalidPASID);
+    }
+    if (pasidMap.find(pasid) == pasidMap.end() && contextDescriptors.find(pasid) == contextDescriptors.end()) {
+        return makeVoidError(SMMUError::PASIDNotFound);
+    }
+    
+    asidMap[pasid] = asid;
+    return makeVoidSuccess();
+}
+
 // Configure fault handling mode
 // ARM SMMU v3 spec: Fault response behavior configuration
 void StreamContext::setFaultMode(FaultMode mode) {
@@ -361,7 +634,7 @@ bool StreamContext::hasPASID(PASID pasid) const {
     }
     
     // Check if PASID exists in map
-    return pasidMap.find(pasid) != pasidMap.end();
+    return pasidMap.find(pasid) != pasidMap.end() || contextDescriptors.find(pasid) != contextDescriptors.end();
 }
 
 // Query Stage-1 translation enable status
@@ -382,7 +655,7 @@ bool StreamContext::isStage2Enabled() const {
 // ARM SMMU v3 spec: Resource utilization and management
 size_t StreamContext::getPASIDCount() const {
     std::lock_guard<std::mutex> lock(contextMutex);
-    return pasidMap.size();
+    return pasidMap.size() + contextDescriptors.size();
 }
 
 // Get AddressSpace for specific PASID (raw pointer for performance)
@@ -418,6 +691,64 @@ AddressSpace* StreamContext::getStage2AddressSpace() {
     return stage2AddressSpace.get();
 }
 
+// Query the Stage-2 VMID tag
+bool StreamContext::hasVMID() const {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    return vmidValid;
+}
+
+VMID StreamContext::getVMID() const {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    return vmid;
+}
+
+void StreamContext::setStage1Granule(TranslationGranule granule) {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    stage1Granule = granule;
+}
+
+TranslationGranule StreamContext::getStage1Granule() const {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    return stage1Granule;
+}
+
+// A translation of this PASID never covers less than this, so TLB
+// invalidation can step through a range one granule page at a time
+uint64_t StreamContext::getGranuleSize(PASID pasid) const {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    
+    uint64_t granuleSize = 0;
+    if (stage1Enabled) {
+        auto it = pasidMap.find(pasid);
+        auto cdIt = contextDescriptors.find(pasid);
+        if (it != pasidMap.end() && it->second) {
+            granuleSize = it->second->getGranuleSize();
+        } else if (cdIt != contextDescriptors.end()) {
+            granuleSize = granulePageSize(cdIt->second.tcr.granuleSize);
+        }
+    }
+    if (stage2Enabled && stage2AddressSpace) {
+        uint64_t stage2Size = stage2AddressSpace->getGranuleSize();
+        if (granuleSize == 0 || stage2Size < granuleSize) {
+            granuleSize = stage2Size;
+        }
+    }
+    return granuleSize != 0 ? granuleSize : PAGE_SIZE;
+}
+
+// PASIDs whose Stage-1 context carries the given ASID
+std::vector<PASID> StreamContext::getPASIDsWithASID(ASID asid) const {
+    std::lock_guard<std::mutex> lock(contextMutex);
+    
+    std::vector<PASID> pasids;
+    for (const auto& asidPair : asidMap) {
+        if (asidPair.second == asid) {
+            pasids.push_back(asidPair.first);
+        }
+    }
+    return pasids;
+}
+
 // Clear all PASIDs and associated address spaces
 // ARM SMMU v3 spec: Complete stream context invalidation
 VoidResult StreamContext::clearAllPASIDs() {
@@ -427,6 +758,9 @@ VoidResult StreamContext::clearAllPASIDs() {
         // Clear entire PASID map
         // ARM SMMU v3: All translations for this stream become invalid
         pasidMap.clear();
+        contextDescriptors.clear();
+        asidMap.clear();
+        pasidTable->clear();
         
         // Update PASID count statistics
         streamStatistics.pasidCount = 0;
@@ -466,6 +800,7 @@ VoidResult StreamContext::updateConfiguration(const StreamConfig& config) {
     stage2Enabled = config.stage2Enabled;
     faultMode = config.faultMode;
     // Note: streamEnabled state is independent and managed by enableStream/disableStream methods
+    publishDescriptor();
     
     // Mark configuration as changed
     configurationChanged = true;
@@ -523,6 +858,7 @@ VoidResult StreamContext::applyConfigurationChanges(const StreamConfig& newConfi
     stage2Enabled = mergedConfig.stage2Enabled;
     faultMode = mergedConfig.faultMode;
     // Note: streamEnabled state is independent and managed by enableStream/disableStream methods
+    publishDescriptor();
     configurationChanged = true;
     streamStatistics.configurationUpdateCount++;
     streamStatistics.lastAccessTimestamp = getCurrentTimestamp();
@@ -598,6 +934,7 @@ VoidResult StreamContext::enableStream() {
     // Enable stream - ARM SMMU v3: Stream enabled/disabled is independent of translation configuration  
     streamEnabled = true;
     // Note: currentConfiguration.translationEnabled remains unchanged - configuration vs stream state are separate
+    publishDescriptor();
     configurationChanged = true;
     streamStatistics.lastAccessTimestamp = getCurrentTimestamp();
     
@@ -612,6 +949,7 @@ VoidResult StreamContext::disableStream() {
     // Disable stream - ARM SMMU v3: Stream enabled/disabled is independent of translation configuration
     streamEnabled = false;
     // Note: currentConfiguration.translationEnabled remains unchanged - configuration vs stream state are separate
+    publishDescriptor();
     configurationChanged = true;
     streamStatistics.lastAccessTimestamp = getCurrentTimestamp();
     
@@ -647,7 +985,16 @@ StreamConfig StreamContext::getStreamConfiguration() const {
 // ARM SMMU v3 spec: Performance and usage monitoring
 StreamStatistics StreamContext::getStreamStatistics() const {
     std::lock_guard<std::mutex> lock(contextMutex);
-    return streamStatistics;
+    
+    // Fold in the counters the lock-free translate path maintains
+    StreamStatistics statistics = streamStatistics;
+    statistics.translationCount += translationCounter.load(std::memory_order_relaxed);
+    statistics.faultCount += translationFaultCounter.load(std::memory_order_relaxed);
+    uint64_t lastTranslation = lastTranslationTimestamp.load(std::memory_order_relaxed);
+    if (lastTranslation > statistics.lastAccessTimestamp) {
+        statistics.lastAccessTimestamp = lastTranslation;
+    }
+    return statistics;
 }
 
 // Get comprehensive stream state information
@@ -662,7 +1009,8 @@ StreamConfig StreamContext::getStreamState() const {
 bool StreamContext::isTranslationActive() const {
     std::lock_guard<std::mutex> lock(contextMutex);
     // Translation is active if stream is enabled, translation is enabled in config, at least one stage is enabled, and has PASIDs configured
-    return streamEnabled && currentConfiguration.translationEnabled && (stage1Enabled || stage2Enabled) && !pasidMap.empty();
+    return streamEnabled && currentConfiguration.translationEnabled && (stage1Enabled || stage2Enabled) &&
+           (!pasidMap.empty() || !contextDescriptors.empty());
 }
 
 // Check if configuration has been modified
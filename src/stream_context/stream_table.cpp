@@ -0,0 +1,249 @@
+// ARM SMMU v3 Stream Table Implementation
+// Copyright (c) 2024 John Greninger
+
+#include "smmu/stream_table.h"
+
+namespace smmu {
+
+const unsigned StreamTable::SPLIT;
+const uint32_t StreamTable::LINEAR_MAX_STREAMS;
+
+namespace {
+
+const size_t LEVEL2_ENTRIES = static_cast<size_t>(1) << StreamTable::SPLIT;
+
+void releaseContext(void* object) {
+    delete static_cast<StreamContext*>(object);
+}
+
+} // anonymous namespace
+
+StreamTable::Layout::Layout(uint32_t tableSize)
+    : format(StreamTable::formatFor(tableSize)), tableSize(tableSize), level1Count(0) {
+    if (format == StreamTableFormat::Linear) {
+        level1Count = tableSize;
+        linear.reset(new Entry[level1Count]);
+        for (size_t i = 0; i < level1Count; ++i) {
+            linear[i].store(nullptr, std::memory_order_relaxed);
+        }
+    } else {
+        level1Count = (static_cast<size_t>(tableSize) + LEVEL2_ENTRIES - 1) / LEVEL2_ENTRIES;
+        level1.reset(new std::atomic<Entry*>[level1Count]);
+        for (size_t i = 0; i < level1Count; ++i) {
+            level1[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+}
+
+// L2 tables live as long as their layout
+StreamTable::Layout::~Layout() {
+    for (size_t i = 0; level1 && i < level1Count; ++i) {
+        delete[] level1[i].load(std::memory_order_relaxed);
+    }
+}
+
+StreamTable::StreamTable(uint32_t streamCount)
+    : layout(new Layout(streamCount)), configuredCount(0) {
+}
+
+StreamTable::~StreamTable() {
+    delete layout.load(std::memory_order_relaxed);
+    for (auto it = streams.begin(); it != streams.end(); ++it) {
+        delete it->second;
+    }
+}
+
+StreamTableFormat StreamTable::formatFor(uint32_t streamCount) {
+    return streamCount <= LINEAR_MAX_STREAMS ? StreamTableFormat::Linear : StreamTableFormat::TwoLevel;
+}
+
+// Lock-free: one or two dependent loads for StreamIDs the table covers.
+// An overflow miss is only final if the layout did not change meanwhile: a
+// grow moves streams from the overflow map into the new layout.
+StreamContext* StreamTable::find(StreamID streamID) const {
+    const Layout* table = layout.load(std::memory_order_acquire);
+    for (;;) {
+        if (streamID < table->tableSize) {
+            Entry* entry = findEntry(table, streamID);
+            return entry ? entry->load(std::memory_order_acquire) : nullptr;
+        }
+        
+        std::shared_ptr<const OverflowMap> map = std::atomic_load(&overflow);
+        if (map) {
+            auto it = map->find(streamID);
+            if (it != map->end()) {
+                return it->second;
+            }
+        }
+        
+        const Layout* latest = layout.load(std::memory_order_acquire);
+        if (latest == table) {
+            return nullptr;
+        }
+        table = latest;
+    }
+}
+
+StreamContext* StreamTable::insert(StreamID streamID, std::unique_ptr<StreamContext> streamContext) {
+    StreamContext* added = streamContext.release();
+    StreamContext* previous = nullptr;
+    auto it = streams.find(streamID);
+    if (it != streams.end()) {
+        previous = it->second;
+        it->second = added;
+    } else {
+        streams[streamID] = added;
+        configuredCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    publish(streamID, added);
+    if (previous) {
+        retireContext(previous);
+    }
+    return added;
+}
+
+bool StreamTable::remove(StreamID streamID) {
+    auto it = streams.find(streamID);
+    if (it == streams.end()) {
+        return false;
+    }
+    StreamContext* removed = it->second;
+    streams.erase(it);
+    configuredCount.fetch_sub(1, std::memory_order_relaxed);
+    
+    publish(streamID, nullptr);
+    retireContext(removed);
+    return true;
+}
+
+void StreamTable::clear() {
+    Layout* table = layout.load(std::memory_order_relaxed);
+    for (auto it = streams.begin(); it != streams.end(); ++it) {
+        if (it->first < table->tableSize) {
+            entryForWrite(table, it->first)->store(nullptr, std::memory_order_release);
+        }
+    }
+    std::atomic_store(&overflow, std::shared_ptr<const OverflowMap>());
+    
+    for (auto it = streams.begin(); it != streams.end(); ++it) {
+        reclaimer.retire(it->second, &releaseContext);
+    }
+    streams.clear();
+    configuredCount.store(0, std::memory_order_relaxed);
+    reclaimer.reclaim();
+}
+
+// Readers may hold either layout while this runs, so both must find every
+// stream: the overflow map briefly covers the StreamIDs of both layouts. A
+// reader of the old layout that misses in the final map has loaded it after
+// the new layout was published, and find() retries with that layout.
+void StreamTable::resize(uint32_t streamCount) {
+    Layout* current = layout.load(std::memory_order_relaxed);
+    if (streamCount == current->tableSize) {
+        return;
+    }
+    
+    Layout* resized = new Layout(streamCount);
+    for (auto it = streams.begin(); it != streams.end(); ++it) {
+        if (it->first < streamCount) {
+            entryForWrite(resized, it->first)->store(it->second, std::memory_order_relaxed);
+        }
+    }
+    
+    publishOverflow(streamCount < current->tableSize ? streamCount : current->tableSize);
+    layout.store(resized, std::memory_order_release);
+    publishOverflow(streamCount);
+    
+    reclaimer.retire(current, &releaseLayout);
+    reclaimer.reclaim();
+}
+
+size_t StreamTable::size() const {
+    return configuredCount.load(std::memory_order_relaxed);
+}
+
+uint32_t StreamTable::getTableSize() const {
+    return layout.load(std::memory_order_acquire)->tableSize;
+}
+
+StreamTableFormat StreamTable::getFormat() const {
+    return layout.load(std::memory_order_acquire)->format;
+}
+
+size_t StreamTable::getLevel2TableCount() const {
+    const Layout* table = layout.load(std::memory_order_acquire);
+    size_t count = 0;
+    for (size_t i = 0; table->level1 && i < table->level1Count; ++i) {
+        if (table->level1[i].load(std::memory_order_acquire)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+StreamTable::Entry* StreamTable::findEntry(const Layout* table, StreamID streamID) const {
+    if (table->format == StreamTableFormat::Linear) {
+        return &table->linear[streamID];
+    }
+    Entry* level2 = table->level1[streamID >> SPLIT].load(std::memory_order_acquire);
+    return level2 ? &level2[streamID & (LEVEL2_ENTRIES - 1)] : nullptr;
+}
+
+// Writers are serialized, so an L2 table is built and published without CAS
+StreamTable::Entry* StreamTable::entryForWrite(Layout* table, StreamID streamID) {
+    if (table->format == StreamTableFormat::Linear) {
+        return &table->linear[streamID];
+    }
+    std::atomic<Entry*>& descriptor = table->level1[streamID >> SPLIT];
+    Entry* level2 = descriptor.load(std::memory_order_relaxed);
+    if (!level2) {
+        level2 = new Entry[LEVEL2_ENTRIES];
+        for (size_t i = 0; i < LEVEL2_ENTRIES; ++i) {
+            level2[i].store(nullptr, std::memory_order_relaxed);
+        }
+        descriptor.store(level2, std::memory_order_release);
+    }
+    return &level2[streamID & (LEVEL2_ENTRIES - 1)];
+}
+
+void StreamTable::publish(StreamID streamID, StreamContext* streamContext) {
+    Layout* table = layout.load(std::memory_order_relaxed);
+    if (streamID < table->tableSize) {
+        entryForWrite(table, streamID)->store(streamContext, std::memory_order_release);
+        return;
+    }
+    
+    // Copy-on-write: readers keep whichever map they loaded
+    std::shared_ptr<const OverflowMap> current = std::atomic_load(&overflow);
+    std::shared_ptr<OverflowMap> updated(current ? new OverflowMap(*current) : new OverflowMap());
+    if (streamContext) {
+        (*updated)[streamID] = streamContext;
+    } else {
+        updated->erase(streamID);
+    }
+    std::atomic_store(&overflow, updated->empty() ? std::shared_ptr<const OverflowMap>()
+                                                  : std::shared_ptr<const OverflowMap>(updated));
+}
+
+void StreamTable::publishOverflow(uint32_t firstStreamID) {
+    std::shared_ptr<OverflowMap> updated(new OverflowMap());
+    for (auto it = streams.begin(); it != streams.end(); ++it) {
+        if (it->first >= firstStreamID) {
+            (*updated)[it->first] = it->second;
+        }
+    }
+    std::atomic_store(&overflow, updated->empty() ? std::shared_ptr<const OverflowMap>()
+                                                  : std::shared_ptr<const OverflowMap>(updated));
+}
+
+void StreamTable::retireContext(StreamContext* streamContext) {
+    reclaimer.retire(streamContext, &releaseContext);
+    reclaimer.reclaim();
+}
+
+void StreamTable::releaseLayout(void* object) {
+    delete static_cast<Layout*>(object);
+}
+
+} // namespace smmu
@@ -0,0 +1,147 @@
+// ARM SMMU v3 Page Table Memory Benchmark
+// Measures heap bytes per mapped page for each AddressSpace backend
+// Copyright (c) 2024 John Greninger
+
+#include <cstdlib>
+#include <cstddef>
+#include <iostream>
+#include <iomanip>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "smmu/address_space.h"
+#include "smmu/types.h"
+
+using namespace smmu;
+
+// Live heap bytes, tracked by the global operator new/delete below. Each
+// block carries its size in a header so delete can subtract it.
+static size_t liveHeapBytes = 0;
+static const size_t HEADER_SIZE = 16;  // Keeps the returned block 16-byte aligned
+
+void* operator new(size_t size) {
+    void* block = std::malloc(size + HEADER_SIZE);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    *static_cast<size_t*>(block) = size;
+    liveHeapBytes += size;
+    return static_cast<char*>(block) + HEADER_SIZE;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (!pointer) {
+        return;
+    }
+    void* block = static_cast<char*>(pointer) - HEADER_SIZE;
+    liveHeapBytes -= *static_cast<size_t*>(block);
+    std::free(block);
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void* pointer) noexcept {
+    operator delete(pointer);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+#endif
+
+class PageTableMemoryBenchmark {
+public:
+    void runBenchmarks() {
+        std::cout << "ARM SMMU v3 Page Table Memory Benchmark\n";
+        std::cout << "=======================================\n\n";
+        std::cout << "sizeof(PageEntry)      = " << sizeof(PageEntry) << " bytes\n";
+        std::cout << "sizeof(PageDescriptor) = " << sizeof(PageDescriptor) << " bytes\n\n";
+        
+        // Same layouts as the backend benchmark, at a size the radix table
+        // can hold for scattered pages
+        std::vector<IOVA> dense;
+        for (size_t i = 0; i < PAGE_COUNT; ++i) {
+            dense.push_back(0x10000000ULL + i * PAGE_SIZE);
+        }
+        
+        std::vector<IOVA> sparse;
+        for (size_t i = 0; i < PAGE_COUNT; ++i) {
+            sparse.push_back(((i / 16) << 30) + (i % 16) * PAGE_SIZE);
+        }
+        
+        std::vector<IOVA> random;
+        std::mt19937_64 gen(42);
+        for (size_t i = 0; i < PAGE_COUNT; ++i) {
+            random.push_back(gen() & 0x0000FFFFFFFFF000ULL);
+        }
+        
+        runLayout("dense", dense);
+        runLayout("sparse", sparse);
+        runLayout("random", random);
+        
+        std::cout << "Benchmark completed.\n";
+    }
+
+private:
+    static const size_t PAGE_COUNT = 16384;
+    
+    void runLayout(const std::string& name, const std::vector<IOVA>& iovas) {
+        std::cout << "Layout: " << name << " (" << iovas.size() << " pages)\n";
+        std::cout << "  " << std::left << std::setw(14) << "storage"
+                  << std::right << std::setw(14) << "heap KB"
+                  << std::setw(14) << "bytes/page" << "\n";
+        
+        runLegacyBaseline(iovas);
+        runBackend("hash", PageTableBackend::Hash, iovas);
+        runBackend("radix", PageTableBackend::Radix, iovas);
+        runBackend("extent", PageTableBackend::Extent, iovas);
+        std::cout << "\n";
+    }
+    
+    // The hash backend's layout before descriptors were packed: one full
+    // PageEntry per page
+    void runLegacyBaseline(const std::vector<IOVA>& iovas) {
+        size_t before = liveHeapBytes;
+        {
+            std::unordered_map<uint64_t, PageEntry> pageTable;
+            PagePermissions perms(true, true, false);
+            for (size_t i = 0; i < iovas.size(); ++i) {
+                pageTable[iovas[i] >> 12] = PageEntry(0x40000000ULL + i * PAGE_SIZE, perms);
+            }
+            report("hash (legacy)", liveHeapBytes - before, iovas.size());
+        }
+    }
+    
+    void runBackend(const std::string& name, PageTableBackend backend, const std::vector<IOVA>& iovas) {
+        size_t before = liveHeapBytes;
+        {
+            AddressSpace addressSpace(backend);
+            PagePermissions perms(true, true, false);
+            for (size_t i = 0; i < iovas.size(); ++i) {
+                addressSpace.mapPage(iovas[i], 0x40000000ULL + i * PAGE_SIZE, perms);
+            }
+            report(name, liveHeapBytes - before, iovas.size());
+        }
+    }
+    
+    void report(const std::string& name, size_t bytes, size_t pages) {
+        std::cout << "  " << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << bytes / 1024.0
+                  << std::setw(14) << static_cast<double>(bytes) / pages << "\n";
+    }
+};
+
+int main() {
+    PageTableMemoryBenchmark benchmark;
+    benchmark.runBenchmarks();
+    return 0;
+}
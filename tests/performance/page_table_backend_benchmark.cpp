@@ -0,0 +1,119 @@
+// ARM SMMU v3 Page Table Backend Benchmark
+// Compares the hash, radix and extent AddressSpace page table backends
+// Copyright (c) 2024 John Greninger
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <string>
+#include "smmu/address_space.h"
+#include "smmu/types.h"
+
+using namespace smmu;
+using namespace std::chrono;
+
+class PageTableBackendBenchmark {
+public:
+    void runBenchmarks() {
+        std::cout << "ARM SMMU v3 Page Table Backend Benchmark (hash vs radix vs extent)\n";
+        std::cout << "===================================================================\n\n";
+        
+        // Dense: one contiguous run, the NIC ring-buffer case
+        std::vector<IOVA> dense;
+        for (size_t i = 0; i < PAGE_COUNT; ++i) {
+            dense.push_back(0x10000000ULL + i * PAGE_SIZE);
+        }
+        
+        // Sparse: short runs of 16 pages, one run per 1GB
+        std::vector<IOVA> sparse;
+        for (size_t i = 0; i < PAGE_COUNT; ++i) {
+            sparse.push_back(((i / 16) << 30) + (i % 16) * PAGE_SIZE);
+        }
+        
+        // Random: pages scattered over the 48-bit space
+        std::vector<IOVA> random;
+        std::mt19937_64 gen(42);
+        for (size_t i = 0; i < PAGE_COUNT; ++i) {
+            random.push_back(gen() & 0x0000FFFFFFFFF000ULL);
+        }
+        
+        runLayout("dense", dense);
+        runLayout("sparse", sparse);
+        runLayout("random", random);
+        
+        std::cout << "Benchmark completed.\n";
+    }
+
+private:
+    static const size_t PAGE_COUNT = 65536;
+    static const int LOOKUP_ROUNDS = 4;
+    
+    void runLayout(const std::string& name, const std::vector<IOVA>& iovas) {
+        std::cout << "Layout: " << name << " (" << iovas.size() << " pages)\n";
+        std::cout << "  " << std::left << std::setw(8) << "backend"
+                  << std::right << std::setw(12) << "map ns/pg"
+                  << std::setw(14) << "lookup ns/pg"
+                  << std::setw(12) << "ranges us"
+                  << std::setw(12) << "count us"
+                  << std::setw(12) << "unmap us" << "\n";
+        
+        runBackend("hash", PageTableBackend::Hash, iovas);
+        runBackend("radix", PageTableBackend::Radix, iovas);
+        runBackend("extent", PageTableBackend::Extent, iovas);
+        std::cout << "\n";
+    }
+    
+    void runBackend(const std::string& name, PageTableBackend backend, const std::vector<IOVA>& iovas) {
+        AddressSpace addressSpace(backend);
+        PagePermissions perms(true, true, false);
+        
+        auto start = high_resolution_clock::now();
+        for (size_t i = 0; i < iovas.size(); ++i) {
+            addressSpace.mapPage(iovas[i], 0x40000000ULL + i * PAGE_SIZE, perms);
+        }
+        double mapNs = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() /
+                       static_cast<double>(iovas.size());
+        
+        // Lookups in mapping order - sequential for the dense layout
+        size_t translated = 0;
+        start = high_resolution_clock::now();
+        for (int round = 0; round < LOOKUP_ROUNDS; ++round) {
+            for (size_t i = 0; i < iovas.size(); ++i) {
+                if (addressSpace.translatePage(iovas[i] + 0x10, AccessType::Read).isOk()) {
+                    ++translated;
+                }
+            }
+        }
+        double lookupNs = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() /
+                          static_cast<double>(iovas.size() * LOOKUP_ROUNDS);
+        
+        start = high_resolution_clock::now();
+        size_t rangeCount = addressSpace.getMappedRanges().size();
+        double rangesUs = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+        
+        start = high_resolution_clock::now();
+        size_t pageCount = addressSpace.getPageCount().getValue();
+        double countUs = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+        
+        start = high_resolution_clock::now();
+        addressSpace.unmapRange(0, 0x0000FFFFFFFFFFFFULL);
+        double unmapUs = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+        
+        std::cout << "  " << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << mapNs
+                  << std::setw(14) << lookupNs
+                  << std::setw(12) << rangesUs
+                  << std::setw(12) << countUs
+                  << std::setw(12) << unmapUs
+                  << "   (" << translated / LOOKUP_ROUNDS << " translated, " << pageCount << " pages, "
+                  << rangeCount << " ranges)\n";
+    }
+};
+
+int main() {
+    PageTableBackendBenchmark benchmark;
+    benchmark.runBenchmarks();
+    return 0;
+}
@@ -0,0 +1,148 @@
+// ARM SMMU v3 Translation Contention Benchmark
+// Translation throughput while a control thread maps and unmaps on another stream
+// Copyright (c) 2024 John Greninger
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+#include "smmu/smmu.h"
+#include "smmu/types.h"
+
+using namespace smmu;
+using namespace std::chrono;
+
+class TranslationContentionBenchmark {
+public:
+    void runBenchmarks() {
+        std::cout << "ARM SMMU v3 Translation Contention Benchmark\n";
+        std::cout << "============================================\n\n";
+        
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        std::vector<size_t> readerCounts;
+        for (size_t readers = 1; readers <= MAX_READERS; readers *= 2) {
+            if (readers == 1 || readers < hardwareThreads) {
+                readerCounts.push_back(readers);
+            }
+        }
+        
+        // Cached: micro-TLB and TLB hits. Uncached: every translation finds its
+        // stream and walks its page table.
+        runMode("cached", true, readerCounts);
+        runMode("uncached", false, readerCounts);
+        
+        std::cout << "Benchmark completed.\n";
+    }
+
+private:
+    static const size_t MAX_READERS = 8;
+    static const size_t PAGES_PER_STREAM = 256;
+    static const StreamID CONTROL_STREAM = 0x100;
+    static const int RUN_MS = 200;
+    
+    void runMode(const std::string& name, bool caching, const std::vector<size_t>& readerCounts) {
+        std::cout << "Mode: " << name << "\n";
+        std::cout << "  " << std::left << std::setw(9) << "readers"
+                  << std::right << std::setw(16) << "idle Mtrans/s"
+                  << std::setw(16) << "busy Mtrans/s"
+                  << std::setw(10) << "ratio"
+                  << std::setw(16) << "control ops/s" << "\n";
+        
+        for (size_t i = 0; i < readerCounts.size(); ++i) {
+            uint64_t controlOps = 0;
+            double idle = runTranslations(readerCounts[i], caching, false, controlOps);
+            double busy = runTranslations(readerCounts[i], caching, true, controlOps);
+            std::cout << "  " << std::left << std::setw(9) << readerCounts[i]
+                      << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(16) << idle
+                      << std::setw(16) << busy
+                      << std::setw(10) << (idle > 0 ? busy / idle : 0.0)
+                      << std::setw(16) << std::setprecision(0)
+                      << controlOps * 1000.0 / RUN_MS << "\n";
+        }
+        std::cout << "\n";
+    }
+    
+    // Translations per second (millions) across `readers` threads, each on its own stream
+    double runTranslations(size_t readers, bool caching, bool controlBusy, uint64_t& controlOps) {
+        SMMU controller;
+        controller.enableCaching(caching);
+        
+        StreamConfig config;
+        config.translationEnabled = true;
+        config.stage1Enabled = true;
+        PagePermissions perms(true, true, false);
+        auto addStream = [&](StreamID streamID) {
+            controller.configureStream(streamID, config);
+            controller.enableStream(streamID);
+            controller.createStreamPASID(streamID, 1);
+        };
+        addStream(CONTROL_STREAM);
+        for (StreamID streamID = 0; streamID < readers; ++streamID) {
+            addStream(streamID);
+            for (size_t page = 0; page < PAGES_PER_STREAM; ++page) {
+                controller.mapPage(streamID, 1, page * PAGE_SIZE, 0x40000000ULL + page * PAGE_SIZE, perms);
+            }
+        }
+        
+        std::atomic<bool> start(false);
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> translations(0);
+        std::vector<std::thread> threads;
+        for (size_t r = 0; r < readers; ++r) {
+            threads.emplace_back([&, r]() {
+                while (!start.load()) {
+                    std::this_thread::yield();
+                }
+                uint64_t done = 0;
+                size_t page = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    controller.translate(static_cast<StreamID>(r), 1, page * PAGE_SIZE, AccessType::Read);
+                    page = (page + 1) % PAGES_PER_STREAM;
+                    ++done;
+                }
+                translations.fetch_add(done);
+            });
+        }
+        
+        std::atomic<uint64_t> operations(0);
+        if (controlBusy) {
+            threads.emplace_back([&]() {
+                while (!start.load()) {
+                    std::this_thread::yield();
+                }
+                uint64_t done = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    IOVA iova = (done % PAGES_PER_STREAM) * PAGE_SIZE;
+                    controller.mapPage(CONTROL_STREAM, 1, iova, 0x80000000ULL + iova, perms);
+                    controller.unmapPage(CONTROL_STREAM, 1, iova);
+                    done += 2;
+                }
+                operations.fetch_add(done);
+            });
+        }
+        
+        start.store(true);
+        std::this_thread::sleep_for(milliseconds(RUN_MS));
+        stop.store(true);
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+        
+        if (controlBusy) {
+            controlOps = operations.load();
+        }
+        return translations.load() / (RUN_MS * 1000.0);
+    }
+};
+
+const int TranslationContentionBenchmark::RUN_MS;
+
+int main() {
+    TranslationContentionBenchmark benchmark;
+    benchmark.runBenchmarks();
+    return 0;
+}
@@ -17,6 +17,8 @@
 #include "smmu/tlb_cache.h"
 #include "smmu/stream_context.h"
 #include "smmu/address_space.h"
+#include "smmu/epoch_reclaimer.h"
+#include "smmu/smmu.h"
 #include "smmu/types.h"
 
 namespace smmu {
@@ -569,6 +571,407 @@ TEST_F(ThreadSafetyTest, StreamContext_ConfigurationUpdates) {
     EXPECT_GT(totalOperations.load(), 0) << "No operations were performed";
 }
 
+// ============================================================================
+// AddressSpace Multi-threaded Tests
+// ============================================================================
+
+namespace {
+
+void countDeletion(void* counter) {
+    static_cast<std::atomic<int>*>(counter)->fetch_add(1);
+}
+
+} // anonymous namespace
+
+// An object retired while another thread is inside a guard survives until
+// that guard is released
+TEST_F(ThreadSafetyTest, EpochReclaimer_DefersWhileGuarded) {
+    std::atomic<int> deletions{0};
+    std::atomic<bool> guarded{false};
+    std::atomic<bool> release{false};
+    
+    std::thread reader([&guarded, &release]() {
+        EpochGuard guard;
+        guarded.store(true);
+        while (!release.load()) {
+            std::this_thread::yield();
+        }
+    });
+    while (!guarded.load()) {
+        std::this_thread::yield();
+    }
+    
+    EpochReclaimer reclaimer;
+    reclaimer.retire(&deletions, &countDeletion);
+    for (int i = 0; i < 4; ++i) {
+        reclaimer.reclaim();
+    }
+    EXPECT_EQ(deletions.load(), 0);
+    EXPECT_EQ(reclaimer.getPendingCount(), 1);
+    
+    release.store(true);
+    reader.join();
+    reclaimer.reclaim();
+    EXPECT_EQ(deletions.load(), 1);
+    EXPECT_EQ(reclaimer.getPendingCount(), 0);
+}
+
+// Readers translate a Radix address space without locks while one writer
+// keeps remapping part of it as pages and as a block that gets split. Every
+// successful translation must match the one fixed IOVA-to-PA layout.
+TEST_F(ThreadSafetyTest, AddressSpace_RadixReadsDuringRemapping) {
+    const size_t numReaders = 6;
+    const uint64_t stablePages = 64;
+    AddressSpace addressSpace(PageTableBackend::Radix);
+    PagePermissions perms(true, true, false);
+    
+    // Stable pages below the churned 2MB block never change
+    const IOVA blockBase = TEST_IOVA_BASE + BLOCK_SIZE_2MB;
+    for (uint64_t i = 0; i < stablePages; ++i) {
+        ASSERT_TRUE(addressSpace.mapPage(TEST_IOVA_BASE + i * PAGE_SIZE, TEST_PA_BASE + i * PAGE_SIZE, perms).isOk());
+    }
+    
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> mismatches{0};
+    std::atomic<size_t> stableFaults{0};
+    std::atomic<size_t> churnHits{0};
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < numReaders; ++r) {
+        readers.emplace_back([&, r]() {
+            std::mt19937_64 rng(r + 1);
+            while (!stop.load(std::memory_order_relaxed)) {
+                uint64_t page = rng() % stablePages;
+                TranslationResult stable = addressSpace.translatePage(TEST_IOVA_BASE + page * PAGE_SIZE + 0x10, AccessType::Read);
+                if (stable.isError()) {
+                    stableFaults.fetch_add(1);
+                } else if (stable.getValue().physicalAddress != TEST_PA_BASE + page * PAGE_SIZE + 0x10) {
+                    mismatches.fetch_add(1);
+                }
+                
+                uint64_t offset = (rng() % (BLOCK_SIZE_2MB / PAGE_SIZE)) * PAGE_SIZE;
+                TranslationResult churn = addressSpace.translatePage(blockBase + offset, AccessType::Write);
+                if (churn.isOk()) {
+                    churnHits.fetch_add(1, std::memory_order_relaxed);
+                    if (churn.getValue().physicalAddress != TEST_PA_BASE + BLOCK_SIZE_2MB + offset) {
+                        mismatches.fetch_add(1);
+                    }
+                }
+            }
+        });
+    }
+    
+    // Writer: block, split by a page unmap, pages remapped, all removed
+    auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    size_t rounds = 0;
+    while (std::chrono::steady_clock::now() < endTime) {
+        addressSpace.mapBlock(blockBase, TEST_PA_BASE + BLOCK_SIZE_2MB, BLOCK_SIZE_2MB, perms);
+        addressSpace.unmapPage(blockBase + (rounds % 512) * PAGE_SIZE);
+        for (uint64_t i = 0; i < 8; ++i) {
+            addressSpace.mapPage(blockBase + i * PAGE_SIZE, TEST_PA_BASE + BLOCK_SIZE_2MB + i * PAGE_SIZE, perms);
+        }
+        addressSpace.unmapRange(blockBase, blockBase + BLOCK_SIZE_2MB - 1);
+        ++rounds;
+    }
+    stop.store(true);
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    
+    EXPECT_GT(rounds, 0);
+    EXPECT_GT(churnHits.load(), 0);
+    EXPECT_EQ(mismatches.load(), 0) << "A reader saw a torn or stale-freed mapping";
+    EXPECT_EQ(stableFaults.load(), 0) << "A reader missed a mapping that never changed";
+    EXPECT_EQ(addressSpace.getPageCount().getValue(), stablePages);
+}
+
+// StreamContext::translate no longer holds contextMutex across the walk, so
+// it runs against concurrent mapPage/unmapPage on the same PASID
+TEST_F(ThreadSafetyTest, StreamContext_TranslateDuringMapping) {
+    const size_t numReaders = 4;
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> mismatches{0};
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < numReaders; ++r) {
+        readers.emplace_back([&, r]() {
+            std::mt19937 rng(static_cast<unsigned>(r + 1));
+            while (!stop.load(std::memory_order_relaxed)) {
+                uint64_t page = 0x100 + rng() % 256;
+                TranslationResult result = streamContext->translate(TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE,
+                                                                    AccessType::Read);
+                if (result.isOk() && result.getValue().physicalAddress != TEST_PA_BASE + page * PAGE_SIZE) {
+                    mismatches.fetch_add(1);
+                }
+            }
+        });
+    }
+    
+    PagePermissions perms(true, true, false);
+    auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    while (std::chrono::steady_clock::now() < endTime) {
+        for (uint64_t page = 0x100; page < 0x200; ++page) {
+            streamContext->mapPage(TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE, TEST_PA_BASE + page * PAGE_SIZE, perms);
+        }
+        for (uint64_t page = 0x100; page < 0x200; ++page) {
+            streamContext->unmapPage(TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE);
+        }
+    }
+    stop.store(true);
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    
+    EXPECT_EQ(mismatches.load(), 0);
+    EXPECT_TRUE(streamContext->translate(TEST_PASID_1, TEST_IOVA_BASE, AccessType::Read).isOk());
+}
+
+TEST_F(ThreadSafetyTest, SMMU_TranslateDuringStreamChurn) {
+    SMMU controller;
+    ASSERT_TRUE(controller.enableCaching(false).isOk());  // Every translation looks up its stream
+    
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    PagePermissions perms(true, true, false);
+    auto addStream = [&](StreamID streamID) {
+        controller.configureStream(streamID, config);
+        controller.enableStream(streamID);
+        controller.createStreamPASID(streamID, TEST_PASID_1);
+        controller.mapPage(streamID, TEST_PASID_1, TEST_IOVA_BASE, TEST_PA_BASE + streamID * PAGE_SIZE, perms);
+    };
+    const StreamID stableStreams = 4;
+    for (StreamID streamID = 0; streamID < stableStreams; ++streamID) {
+        addStream(streamID);
+    }
+    
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> stableFailures{0};
+    std::atomic<size_t> mismatches{0};
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < 4; ++r) {
+        readers.emplace_back([&, r]() {
+            std::mt19937 rng(static_cast<unsigned>(r + 1));
+            while (!stop.load(std::memory_order_relaxed)) {
+                StreamID streamID = rng() % 2 ? rng() % stableStreams : 0x1000 + rng() % 0x200;
+                TranslationResult result = controller.translate(streamID, TEST_PASID_1, TEST_IOVA_BASE, AccessType::Read);
+                if (!result.isOk()) {
+                    if (streamID < stableStreams) {
+                        stableFailures.fetch_add(1);
+                    }
+                } else if (result.getValue().physicalAddress != TEST_PA_BASE + streamID * PAGE_SIZE) {
+                    mismatches.fetch_add(1);
+                }
+            }
+        });
+    }
+    
+    // Configure and remove streams, switching between linear and 2-level tables
+    uint32_t streamCounts[] = {65536, 4096, 256};
+    size_t round = 0;
+    auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    while (std::chrono::steady_clock::now() < endTime) {
+        AddressConfiguration addressConfig;
+        addressConfig.maxStreamCount = streamCounts[round++ % 3];
+        ASSERT_TRUE(controller.updateAddressConfiguration(addressConfig).isOk());
+        for (StreamID streamID = 0x1000; streamID < 0x1200; streamID += 3) {
+            addStream(streamID);
+        }
+        for (StreamID streamID = 0x1000; streamID < 0x1200; streamID += 3) {
+            controller.removeStream(streamID);
+        }
+    }
+    stop.store(true);
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    
+    EXPECT_EQ(stableFailures.load(), 0);
+    EXPECT_EQ(mismatches.load(), 0);
+    EXPECT_EQ(controller.getStreamCount(), stableStreams);
+}
+
+TEST_F(ThreadSafetyTest, SMMU_PerStreamControlDuringTranslation) {
+    SMMU controller;
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    PagePermissions perms(true, true, false);
+    const StreamID writerStreams = 4;
+    for (StreamID streamID = 0; streamID <= writerStreams; ++streamID) {
+        ASSERT_TRUE(controller.configureStream(streamID, config).isOk());
+        ASSERT_TRUE(controller.enableStream(streamID).isOk());
+        ASSERT_TRUE(controller.createStreamPASID(streamID, TEST_PASID_1).isOk());
+    }
+    const StreamID readStream = writerStreams;
+    for (uint64_t page = 0; page < 64; ++page) {
+        ASSERT_TRUE(controller.mapPage(readStream, TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE,
+                                       TEST_PA_BASE + page * PAGE_SIZE, perms).isOk());
+    }
+    
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> readFailures{0};
+    std::thread reader([&]() {
+        uint64_t page = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            TranslationResult result = controller.translate(readStream, TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE,
+                                                            AccessType::Read);
+            if (!result.isOk() || result.getValue().physicalAddress != TEST_PA_BASE + page * PAGE_SIZE) {
+                readFailures.fetch_add(1);
+            }
+            page = (page + 1) % 64;
+        }
+    });
+    
+    // Each writer owns a stream; what it maps must translate right after
+    std::atomic<size_t> writeFailures{0};
+    std::vector<std::thread> writers;
+    for (StreamID w = 0; w < writerStreams; ++w) {
+        writers.emplace_back([&, w]() {
+            for (int round = 0; round < 200; ++round) {
+                PASID pasid = TEST_PASID_2 + round % 4;
+                IOVA iova = TEST_IOVA_BASE + round * PAGE_SIZE;
+                PA pa = TEST_PA_BASE + (w << 24) + round * PAGE_SIZE;
+                bool ok = controller.createStreamPASID(w, pasid).isOk() &&
+                          controller.mapPage(w, pasid, iova, pa, perms).isOk();
+                TranslationResult result = controller.translate(w, pasid, iova, AccessType::Read);
+                if (!ok || !result.isOk() || result.getValue().physicalAddress != pa ||
+                    controller.unmapPage(w, pasid, iova).isError() ||
+                    controller.translate(w, pasid, iova, AccessType::Read).isOk() ||
+                    controller.removeStreamPASID(w, pasid).isError()) {
+                    writeFailures.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    stop.store(true);
+    reader.join();
+    
+    EXPECT_EQ(readFailures.load(), 0);
+    EXPECT_EQ(writeFailures.load(), 0);
+}
+
+TEST_F(ThreadSafetyTest, SMMU_TranslateThroughEvictingTLB) {
+    // A small single-shard TLB: every miss evicts an entry another thread may
+    // have just looked up
+    SMMUConfiguration smmuConfig = SMMUConfiguration::createDefault();
+    CacheConfiguration cacheConfig = smmuConfig.getCacheConfiguration();
+    cacheConfig.tlbCacheSize = 64;  // The smallest allowed
+    cacheConfig.tlbShardCount = 1;
+    smmuConfig.setCacheConfiguration(cacheConfig);
+    SMMU controller(smmuConfig);
+    
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    PagePermissions perms(true, true, false);
+    const StreamID streams = 4;
+    const uint64_t pages = 256;
+    for (StreamID streamID = 0; streamID < streams; ++streamID) {
+        ASSERT_TRUE(controller.configureStream(streamID, config).isOk());
+        ASSERT_TRUE(controller.enableStream(streamID).isOk());
+        ASSERT_TRUE(controller.createStreamPASID(streamID, TEST_PASID_1).isOk());
+        for (uint64_t page = 0; page < pages; ++page) {
+            ASSERT_TRUE(controller.mapPage(streamID, TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE,
+                                           TEST_PA_BASE + (static_cast<uint64_t>(streamID) << 24) + page * PAGE_SIZE,
+                                           perms).isOk());
+        }
+    }
+    
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(static_cast<unsigned>(t));
+            for (int i = 0; i < 20000; ++i) {
+                StreamID streamID = static_cast<StreamID>(rng() % streams);
+                uint64_t page = rng() % pages;
+                TranslationResult result = controller.translate(streamID, TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE,
+                                                                AccessType::Read);
+                if (!result.isOk() || result.getValue().physicalAddress !=
+                    TEST_PA_BASE + (static_cast<uint64_t>(streamID) << 24) + page * PAGE_SIZE) {
+                    failures.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    EXPECT_EQ(failures.load(), 0u);
+}
+
+TEST_F(ThreadSafetyTest, SMMU_AsyncTranslationFromManySubmitters) {
+    SMMU controller;
+    controller.enableCaching(false);  // Every request goes through the pool
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    PagePermissions perms(true, true, false);
+    const size_t submitters = 4;
+    const size_t requestsPerSubmitter = 500;
+    for (StreamID streamID = 0; streamID < submitters; ++streamID) {
+        ASSERT_TRUE(controller.configureStream(streamID, config).isOk());
+        ASSERT_TRUE(controller.enableStream(streamID).isOk());
+        ASSERT_TRUE(controller.createStreamPASID(streamID, TEST_PASID_1).isOk());
+        for (uint64_t page = 0; page < 32; ++page) {
+            ASSERT_TRUE(controller.mapPage(streamID, TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE,
+                                           TEST_PA_BASE + (streamID << 24) + page * PAGE_SIZE, perms).isOk());
+        }
+    }
+    
+    // Submitters race each other and a thread resizing the pool
+    std::atomic<size_t> completions{0};
+    std::atomic<size_t> failures{0};
+    std::atomic<bool> stop{false};
+    std::thread resizer([&]() {
+        ResourceLimits limits;
+        uint32_t workers = 1;
+        while (!stop.load()) {
+            limits.maxThreadCount = workers;
+            if (controller.updateResourceLimits(limits).isError()) {
+                failures.fetch_add(1);
+            }
+            workers = workers % 4 + 1;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    
+    std::vector<std::thread> threads;
+    for (StreamID s = 0; s < submitters; ++s) {
+        threads.emplace_back([&, s]() {
+            for (size_t i = 0; i < requestsPerSubmitter; ++i) {
+                uint64_t page = i % 32;
+                TranslationRequest request(s, TEST_PASID_1, TEST_IOVA_BASE + page * PAGE_SIZE, AccessType::Read);
+                PA expected = TEST_PA_BASE + (static_cast<uint64_t>(s) << 24) + page * PAGE_SIZE;
+                VoidResult submitted = controller.translateAsync(request,
+                    [&, expected](const TranslationRequest&, const TranslationResult& result) {
+                        // A request left queued through a long resize may time out
+                        if ((result.isOk() && result.getValue().physicalAddress != expected) ||
+                            (result.isError() && result.getError() != SMMUError::Timeout)) {
+                            failures.fetch_add(1);
+                        }
+                        completions.fetch_add(1);
+                    });
+                if (submitted.isError()) {
+                    failures.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    controller.waitForAsyncTranslations();
+    stop.store(true);
+    resizer.join();
+    
+    EXPECT_EQ(completions.load(), submitters * requestsPerSubmitter);
+    EXPECT_EQ(failures.load(), 0u);
+}
+
 // ============================================================================
 // Combined Integration Tests
 // ============================================================================
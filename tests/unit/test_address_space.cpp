@@ -3,7 +3,11 @@
 
 #include <gtest/gtest.h>
 #include "smmu/address_space.h"
+#include "smmu/radix_page_table.h"
+#include "smmu/dirty_bitmap.h"
 #include "smmu/types.h"
+#include <random>
+#include <thread>
 
 namespace smmu {
 namespace test {
@@ -1612,5 +1616,570 @@ TEST_F(AddressSpaceTest, Task32ErrorHandlingAndEdgeCases) {
     EXPECT_TRUE(addressSpace->hasOverlappingMappings(0x000FFFFFFFFFF000ULL, 0x000FFFFFFFFFF000ULL));
 }
 
+// Test 2MB/1GB block mappings
+TEST_F(AddressSpaceTest, BlockMappings) {
+    PagePermissions perms(true, true, false);
+    
+    // Misaligned or unsupported sizes are rejected
+    EXPECT_EQ(addressSpace->mapBlock(TEST_IOVA_1 + PAGE_SIZE, TEST_PA_1, BLOCK_SIZE_2MB, perms).getError(), SMMUError::InvalidAddress);
+    EXPECT_EQ(addressSpace->mapBlock(TEST_IOVA_1, TEST_PA_1 + PAGE_SIZE, BLOCK_SIZE_2MB, perms).getError(), SMMUError::InvalidAddress);
+    EXPECT_EQ(addressSpace->mapBlock(TEST_IOVA_1, TEST_PA_1, 64 * 1024, perms).getError(), SMMUError::InvalidAddress);
+    
+    // One descriptor covers the whole block
+    addressSpace->mapPage(TEST_IOVA_1 + 3 * PAGE_SIZE, TEST_PA_2, perms);
+    ASSERT_TRUE(addressSpace->mapBlock(TEST_IOVA_1, TEST_PA_1, BLOCK_SIZE_2MB, perms).isOk());
+    EXPECT_EQ(addressSpace->getPageCount().getValue(), 512);
+    
+    TranslationResult result = addressSpace->translatePage(TEST_IOVA_1 + 0x123456, AccessType::Read);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA_1 + 0x123456);
+    EXPECT_EQ(result.getValue().blockSize, BLOCK_SIZE_2MB);
+    
+    // The page mapped before the block was replaced by it
+    result = addressSpace->translatePage(TEST_IOVA_1 + 3 * PAGE_SIZE, AccessType::Read);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA_1 + 3 * PAGE_SIZE);
+    
+    std::vector<AddressRange> ranges = addressSpace->getMappedRanges();
+    ASSERT_EQ(ranges.size(), 1);
+    EXPECT_EQ(ranges[0].startAddress, TEST_IOVA_1);
+    EXPECT_EQ(ranges[0].endAddress, TEST_IOVA_1 + BLOCK_SIZE_2MB - 1);
+    EXPECT_EQ(addressSpace->getAddressSpaceSize(), BLOCK_SIZE_2MB);
+    EXPECT_TRUE(addressSpace->hasOverlappingMappings(TEST_IOVA_1 + 0x100000, TEST_IOVA_1 + 0x100000));
+    
+    // Remapping one page splits the block and leaves the rest intact
+    ASSERT_TRUE(addressSpace->mapPage(TEST_IOVA_1 + 5 * PAGE_SIZE, TEST_PA_2, perms).isOk());
+    EXPECT_EQ(addressSpace->translatePage(TEST_IOVA_1 + 5 * PAGE_SIZE + 8, AccessType::Read).getValue().physicalAddress, TEST_PA_2 + 8);
+    result = addressSpace->translatePage(TEST_IOVA_1 + 6 * PAGE_SIZE, AccessType::Read);
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA_1 + 6 * PAGE_SIZE);
+    EXPECT_EQ(result.getValue().blockSize, PAGE_SIZE);
+    EXPECT_EQ(addressSpace->getPageCount().getValue(), 512);
+    
+    // Unmapping a page of a 1GB block splits it down to 4KB around that page
+    ASSERT_TRUE(addressSpace->mapBlock(0x40000000, 0x80000000, BLOCK_SIZE_1GB, perms).isOk());
+    ASSERT_TRUE(addressSpace->unmapPage(0x40000000 + BLOCK_SIZE_2MB + PAGE_SIZE).isOk());
+    EXPECT_TRUE(addressSpace->translatePage(0x40000000 + BLOCK_SIZE_2MB + PAGE_SIZE, AccessType::Read).isError());
+    EXPECT_EQ(addressSpace->translatePage(0x40000000 + BLOCK_SIZE_2MB, AccessType::Read).getValue().blockSize, PAGE_SIZE);
+    result = addressSpace->translatePage(0x40000000 + 2 * BLOCK_SIZE_2MB + 0x10, AccessType::Read);
+    EXPECT_EQ(result.getValue().physicalAddress, 0x80000000 + 2 * BLOCK_SIZE_2MB + 0x10);
+    EXPECT_EQ(result.getValue().blockSize, BLOCK_SIZE_2MB);
+    EXPECT_EQ(addressSpace->getPageCount().getValue(), 512 + 512 * 512 - 1);
+}
+
+// Test that mapRange and unmapRange use and split blocks
+TEST_F(AddressSpaceTest, RangeBlockMappings) {
+    PagePermissions perms(true, false, false);
+    
+    // 4KB head, one 2MB block, 4KB tail
+    IOVA start = TEST_IOVA_1 - PAGE_SIZE;
+    IOVA end = TEST_IOVA_1 + BLOCK_SIZE_2MB + PAGE_SIZE - 1;
+    ASSERT_TRUE(addressSpace->mapRange(start, end, TEST_PA_1 - PAGE_SIZE, perms).isOk());
+    EXPECT_EQ(addressSpace->getPageCount().getValue(), 514);
+    EXPECT_EQ(addressSpace->translatePage(TEST_IOVA_1 + 0x1000, AccessType::Read).getValue().blockSize, BLOCK_SIZE_2MB);
+    EXPECT_EQ(addressSpace->translatePage(start, AccessType::Read).getValue().blockSize, PAGE_SIZE);
+    EXPECT_EQ(addressSpace->translatePage(end, AccessType::Read).getValue().physicalAddress, TEST_PA_1 + BLOCK_SIZE_2MB + PAGE_SIZE - 1);
+    
+    // Mismatched IOVA/PA alignment falls back to pages
+    ASSERT_TRUE(addressSpace->mapRange(TEST_IOVA_2, TEST_IOVA_2 + BLOCK_SIZE_2MB - 1, TEST_PA_2 + PAGE_SIZE, perms).isOk());
+    EXPECT_EQ(addressSpace->translatePage(TEST_IOVA_2, AccessType::Read).getValue().blockSize, PAGE_SIZE);
+    
+    // Unmapping part of the block keeps the remainder mapped
+    ASSERT_TRUE(addressSpace->unmapRange(TEST_IOVA_1, TEST_IOVA_1 + 0x100000 - 1).isOk());
+    EXPECT_FALSE(addressSpace->isPageMapped(TEST_IOVA_1).getValue());
+    EXPECT_TRUE(addressSpace->isPageMapped(TEST_IOVA_1 + 0x100000).getValue());
+    EXPECT_TRUE(addressSpace->isPageMapped(start).getValue());
+    
+    ASSERT_TRUE(addressSpace->unmapRange(start, end).isOk());
+    EXPECT_EQ(addressSpace->unmapRange(start, end).getError(), SMMUError::PageNotMapped);
+    
+    // Copies carry their blocks
+    ASSERT_TRUE(addressSpace->mapBlock(TEST_IOVA_1, TEST_PA_1, BLOCK_SIZE_2MB, perms).isOk());
+    AddressSpace copy(*addressSpace);
+    EXPECT_EQ(copy.translatePage(TEST_IOVA_1 + 0x1F0000, AccessType::Read).getValue().physicalAddress, TEST_PA_1 + 0x1F0000);
+}
+
+// Test that the radix backend gives the same answers as the hash backend
+TEST_F(AddressSpaceTest, RadixBackendMatchesHashBackend) {
+    AddressSpace hash;
+    AddressSpace radix(PageTableBackend::Radix);
+    EXPECT_EQ(hash.getPageTableBackend(), PageTableBackend::Hash);
+    EXPECT_EQ(radix.getPageTableBackend(), PageTableBackend::Radix);
+    
+    // Two 4GB windows: one at the bottom and one at the top of the 52-bit space
+    std::mt19937_64 gen(1234);
+    const IOVA windows[2] = {0, MAX_VIRTUAL_ADDRESS - 0xFFFFFFFFULL};
+    PagePermissions perms(true, true, false);
+    
+    for (int op = 0; op < 400; ++op) {
+        IOVA window = windows[gen() % 2];
+        IOVA iova = window + (gen() % 0x100000000ULL);
+        PA pa = (gen() % 0x100000000ULL) << 8;
+        switch (gen() % 6) {
+            case 0:
+            case 1:
+                EXPECT_EQ(hash.mapPage(iova, pa, perms).isOk(), radix.mapPage(iova, pa, perms).isOk());
+                break;
+            case 2: {
+                uint64_t blockSize = (gen() % 4 == 0) ? BLOCK_SIZE_1GB : BLOCK_SIZE_2MB;
+                iova &= ~(blockSize - 1);
+                pa &= ~(blockSize - 1);
+                EXPECT_EQ(hash.mapBlock(iova, pa, blockSize, perms).isOk(), radix.mapBlock(iova, pa, blockSize, perms).isOk());
+                break;
+            }
+            case 3: {
+                IOVA end = iova + (gen() % (4 * BLOCK_SIZE_2MB));
+                EXPECT_EQ(hash.mapRange(iova, end, pa, perms).isOk(), radix.mapRange(iova, end, pa, perms).isOk());
+                break;
+            }
+            case 4:
+                EXPECT_EQ(hash.unmapPage(iova).isOk(), radix.unmapPage(iova).isOk());
+                break;
+            default: {
+                IOVA end = iova + (gen() % (2 * BLOCK_SIZE_1GB));
+                EXPECT_EQ(hash.unmapRange(iova, end).isOk(), radix.unmapRange(iova, end).isOk());
+                break;
+            }
+        }
+        
+        // Probe around the last operation
+        for (int probe = 0; probe < 8; ++probe) {
+            IOVA address = iova + (gen() % (2 * BLOCK_SIZE_2MB));
+            TranslationResult expected = hash.translatePage(address, AccessType::Read);
+            TranslationResult actual = radix.translatePage(address, AccessType::Read);
+            ASSERT_EQ(expected.isOk(), actual.isOk()) << "op " << op << " address 0x" << std::hex << address;
+            if (expected.isOk()) {
+                EXPECT_EQ(expected.getValue().physicalAddress, actual.getValue().physicalAddress);
+                EXPECT_EQ(expected.getValue().blockSize, actual.getValue().blockSize);
+            }
+        }
+        
+        if (op % 20 == 0) {
+            ASSERT_EQ(hash.getPageCount().getValue(), radix.getPageCount().getValue()) << "op " << op;
+            EXPECT_EQ(hash.getAddressSpaceSize(), radix.getAddressSpaceSize());
+            std::vector<AddressRange> expectedRanges = hash.getMappedRanges();
+            std::vector<AddressRange> actualRanges = radix.getMappedRanges();
+            ASSERT_EQ(expectedRanges.size(), actualRanges.size());
+            for (size_t i = 0; i < expectedRanges.size(); ++i) {
+                EXPECT_EQ(expectedRanges[i].startAddress, actualRanges[i].startAddress);
+                EXPECT_EQ(expectedRanges[i].endAddress, actualRanges[i].endAddress);
+            }
+            EXPECT_EQ(hash.hasOverlappingMappings(window, window + 0xFFFFFFFFULL),
+                      radix.hasOverlappingMappings(window, window + 0xFFFFFFFFULL));
+        }
+    }
+}
+
+// Test the extent backend against the hash backend under random operations
+TEST_F(AddressSpaceTest, ExtentBackendMatchesHashBackend) {
+    AddressSpace hash;
+    AddressSpace extent(PageTableBackend::Extent);
+    EXPECT_EQ(extent.getPageTableBackend(), PageTableBackend::Extent);
+    
+    std::mt19937_64 gen(5678);
+    const IOVA windows[2] = {0, MAX_VIRTUAL_ADDRESS - 0xFFFFFFFFULL};
+    PagePermissions perms(true, true, false);
+    PagePermissions readOnly(true, false, false);
+    
+    for (int op = 0; op < 400; ++op) {
+        IOVA window = windows[gen() % 2];
+        IOVA iova = window + (gen() % 0x100000000ULL);
+        PA pa = (gen() % 0x100000000ULL) << 8;
+        const PagePermissions& opPerms = (gen() % 4 == 0) ? readOnly : perms;
+        switch (gen() % 6) {
+            case 0:
+            case 1:
+                EXPECT_EQ(hash.mapPage(iova, pa, opPerms).isOk(), extent.mapPage(iova, pa, opPerms).isOk());
+                break;
+            case 2: {
+                uint64_t blockSize = (gen() % 4 == 0) ? BLOCK_SIZE_1GB : BLOCK_SIZE_2MB;
+                iova &= ~(blockSize - 1);
+                pa &= ~(blockSize - 1);
+                EXPECT_EQ(hash.mapBlock(iova, pa, blockSize, opPerms).isOk(), extent.mapBlock(iova, pa, blockSize, opPerms).isOk());
+                break;
+            }
+            case 3: {
+                IOVA end = iova + (gen() % (4 * BLOCK_SIZE_2MB));
+                EXPECT_EQ(hash.mapRange(iova, end, pa, opPerms).isOk(), extent.mapRange(iova, end, pa, opPerms).isOk());
+                break;
+            }
+            case 4:
+                EXPECT_EQ(hash.unmapPage(iova).isOk(), extent.unmapPage(iova).isOk());
+                break;
+            default: {
+                IOVA end = iova + (gen() % (2 * BLOCK_SIZE_1GB));
+                EXPECT_EQ(hash.unmapRange(iova, end).isOk(), extent.unmapRange(iova, end).isOk());
+                break;
+            }
+        }
+        
+        // Extents merge what the hash tables keep apart, so the reported
+        // mapping size can only be larger
+        for (int probe = 0; probe < 8; ++probe) {
+            IOVA address = iova + (gen() % (2 * BLOCK_SIZE_2MB));
+            TranslationResult expected = hash.translatePage(address, AccessType::Write);
+            TranslationResult actual = extent.translatePage(address, AccessType::Write);
+            ASSERT_EQ(expected.isOk(), actual.isOk()) << "op " << op << " address 0x" << std::hex << address;
+            if (expected.isOk()) {
+                EXPECT_EQ(expected.getValue().physicalAddress, actual.getValue().physicalAddress);
+                EXPECT_GE(actual.getValue().blockSize, expected.getValue().blockSize);
+            }
+        }
+        
+        if (op % 20 == 0) {
+            ASSERT_EQ(hash.getPageCount().getValue(), extent.getPageCount().getValue()) << "op " << op;
+            EXPECT_EQ(hash.getAddressSpaceSize(), extent.getAddressSpaceSize());
+            std::vector<AddressRange> expectedRanges = hash.getMappedRanges();
+            std::vector<AddressRange> actualRanges = extent.getMappedRanges();
+            ASSERT_EQ(expectedRanges.size(), actualRanges.size());
+            for (size_t i = 0; i < expectedRanges.size(); ++i) {
+                EXPECT_EQ(expectedRanges[i].startAddress, actualRanges[i].startAddress);
+                EXPECT_EQ(expectedRanges[i].endAddress, actualRanges[i].endAddress);
+                EXPECT_TRUE(extent.hasOverlappingMappings(expectedRanges[i].endAddress, expectedRanges[i].endAddress));
+                EXPECT_FALSE(extent.hasOverlappingMappings(expectedRanges[i].endAddress + 1, expectedRanges[i].endAddress + 1));
+            }
+        }
+    }
+}
+
+// Test extent splitting, merging and page accounting
+TEST_F(AddressSpaceTest, ExtentTreeIntervals) {
+    ExtentTree tree;
+    PageEntry entry(TEST_PA_1, PagePermissions(true, true, false));
+    
+    // A 1GB window is one extent; mapping its PA-contiguous neighbour extends it
+    tree.map(TEST_IOVA_1, BLOCK_SIZE_1GB, entry);
+    PageEntry next = entry;
+    next.physicalAddress += BLOCK_SIZE_1GB;
+    tree.map(TEST_IOVA_1 + BLOCK_SIZE_1GB, PAGE_SIZE, next);
+    EXPECT_EQ(tree.getExtentCount(), 1);
+    EXPECT_EQ(tree.getPageCount(), BLOCK_SIZE_1GB / PAGE_SIZE + 1);
+    
+    // Unmapping the middle leaves two extents with the right PA offsets
+    EXPECT_EQ(tree.unmap(TEST_IOVA_1 + 0x1000, TEST_IOVA_1 + 0x2FFF), 2);
+    EXPECT_EQ(tree.getExtentCount(), 2);
+    IOVA base = 0;
+    uint64_t size = 0;
+    const PageEntry* found = tree.find(TEST_IOVA_1 + 0x3000, base, size);
+    ASSERT_NE(found, nullptr);
+    EXPECT_EQ(base, TEST_IOVA_1 + 0x3000);
+    EXPECT_EQ(found->physicalAddress, TEST_PA_1 + 0x3000);
+    EXPECT_EQ(size, BLOCK_SIZE_1GB + PAGE_SIZE - 0x3000);
+    EXPECT_EQ(tree.find(TEST_IOVA_1 + 0x2000, base, size), nullptr);
+    EXPECT_FALSE(tree.hasMappings(TEST_IOVA_1 + 0x1000, TEST_IOVA_1 + 0x2FFF));
+    EXPECT_TRUE(tree.hasMappings(TEST_IOVA_1 + 0x1000, TEST_IOVA_1 + 0x3000));
+    
+    // Refilling the hole with different permissions keeps three extents;
+    // with the original ones they merge back into one
+    PageEntry readOnly(TEST_PA_1 + 0x1000, PagePermissions(true, false, false));
+    tree.map(TEST_IOVA_1 + 0x1000, 0x2000, readOnly);
+    EXPECT_EQ(tree.getExtentCount(), 3);
+    PageEntry hole(TEST_PA_1 + 0x1000, entry.permissions);
+    tree.map(TEST_IOVA_1 + 0x1000, 0x2000, hole);
+    EXPECT_EQ(tree.getExtentCount(), 1);
+    EXPECT_EQ(tree.getMappedRanges().size(), 1);
+    
+    // A translation reports the largest block the extent covers whole
+    AddressSpace space(PageTableBackend::Extent);
+    ASSERT_TRUE(space.mapRange(BLOCK_SIZE_2MB - PAGE_SIZE, 2 * BLOCK_SIZE_2MB + PAGE_SIZE - 1, TEST_PA_2 - PAGE_SIZE,
+                               PagePermissions(true, false, false)).isOk());
+    EXPECT_EQ(space.translatePage(BLOCK_SIZE_2MB - 1, AccessType::Read).getValue().blockSize, PAGE_SIZE);
+    TranslationResult block = space.translatePage(BLOCK_SIZE_2MB + 0x1234, AccessType::Read);
+    ASSERT_TRUE(block.isOk());
+    EXPECT_EQ(block.getValue().blockSize, BLOCK_SIZE_2MB);
+    EXPECT_EQ(block.getValue().physicalAddress, TEST_PA_2 + 0x1234);
+    EXPECT_EQ(space.getPageCount().getValue(), BLOCK_SIZE_2MB / PAGE_SIZE + 2);
+}
+
+// Test radix table node allocation, pruning and copying
+TEST_F(AddressSpaceTest, RadixPageTableNodes) {
+    RadixPageTable table;
+    PageDescriptor entry(TEST_PA_1, PagePermissions(true, false, false));
+    
+    // A page needs one node per level; a 2MB block stops a level early
+    table.map(TEST_IOVA_1, PAGE_SIZE, entry);
+    EXPECT_EQ(table.getNodeCount(), 5);
+    EXPECT_EQ(table.getPageCount(), 1);
+    table.map(MAX_VIRTUAL_ADDRESS & ~(BLOCK_SIZE_2MB - 1), BLOCK_SIZE_2MB, entry);
+    EXPECT_EQ(table.getNodeCount(), 8);
+    EXPECT_EQ(table.getPageCount(), 513);
+    EXPECT_GT(table.getMemoryFootprint(), 0);
+    
+    IOVA lowest = 0;
+    IOVA highest = 0;
+    ASSERT_TRUE(table.getBounds(lowest, highest));
+    EXPECT_EQ(lowest, TEST_IOVA_1);
+    EXPECT_EQ(highest, MAX_VIRTUAL_ADDRESS);
+    
+    // Copies share nodes until written, and stay independent
+    RadixPageTable copy(table);
+    EXPECT_EQ(copy.getNodeCount(), 8);
+    EXPECT_EQ(table.unmap(TEST_IOVA_1, TEST_IOVA_1), 1);
+    EXPECT_EQ(table.getNodeCount(), 4);  // Emptied tables are freed
+    uint64_t mappingSize = 0;
+    EXPECT_FALSE(table.find(TEST_IOVA_1, mappingSize).isValid());
+    ASSERT_TRUE(copy.find(TEST_IOVA_1 + 0x10, mappingSize).isValid());
+    EXPECT_EQ(mappingSize, PAGE_SIZE);
+    EXPECT_EQ(copy.getNodeCount(), 8);
+    
+    // Unmapping part of a block splits it; unmapping the rest frees everything
+    EXPECT_EQ(table.unmap(MAX_VIRTUAL_ADDRESS - PAGE_SIZE + 1, MAX_VIRTUAL_ADDRESS), 1);
+    EXPECT_EQ(table.getPageCount(), 511);
+    EXPECT_EQ(table.getNodeCount(), 5);
+    EXPECT_EQ(table.unmap(0, MAX_VIRTUAL_ADDRESS), 511);
+    EXPECT_EQ(table.getNodeCount(), 0);
+    EXPECT_FALSE(table.getBounds(lowest, highest));
+    EXPECT_TRUE(table.getMappedRanges().empty());
+}
+
+// Copies and snapshots share storage with their source but never see its
+// later changes, nor it theirs, on every backend
+TEST_F(AddressSpaceTest, CopyOnWriteClones) {
+    const PageTableBackend backends[3] = {PageTableBackend::Hash, PageTableBackend::Radix, PageTableBackend::Extent};
+    PagePermissions perms(true, true, false);
+    
+    for (size_t b = 0; b < 3; ++b) {
+        SCOPED_TRACE(static_cast<int>(backends[b]));
+        AddressSpace original(backends[b]);
+        for (uint64_t i = 0; i < 16; ++i) {
+            ASSERT_TRUE(original.mapPage(TEST_IOVA_1 + i * PAGE_SIZE, TEST_PA_1 + i * PAGE_SIZE, perms).isOk());
+        }
+        ASSERT_TRUE(original.mapBlock(0x40000000, 0x80000000, BLOCK_SIZE_2MB, perms).isOk());
+        std::vector<AddressRange> before = original.getMappedRanges();
+        
+        AddressSpace clone(original);
+        std::shared_ptr<const AddressSpace> snapshot = original.snapshot();
+        EXPECT_EQ(clone.getPageTableBackend(), backends[b]);
+        EXPECT_EQ(clone.getPageCount().getValue(), 16 + 512);
+        
+        // Writes to the original, including a block split, stay there
+        EXPECT_TRUE(original.unmapPage(TEST_IOVA_1).isOk());
+        EXPECT_TRUE(original.unmapPage(0x40000000 + PAGE_SIZE).isOk());
+        EXPECT_TRUE(original.mapPage(TEST_IOVA_2, TEST_PA_2, perms).isOk());
+        EXPECT_FALSE(original.isPageMapped(TEST_IOVA_1).getValue());
+        EXPECT_TRUE(clone.isPageMapped(TEST_IOVA_1).getValue());
+        EXPECT_FALSE(clone.isPageMapped(TEST_IOVA_2).getValue());
+        TranslationResult block = clone.translatePage(0x40000000 + PAGE_SIZE, AccessType::Read);
+        ASSERT_TRUE(block.isOk());
+        EXPECT_EQ(block.getValue().physicalAddress, 0x80000000 + PAGE_SIZE);
+        
+        // ...and writes to the clone stay in the clone
+        EXPECT_TRUE(clone.mapPage(TEST_IOVA_1, TEST_PA_2, perms).isOk());
+        EXPECT_FALSE(original.isPageMapped(TEST_IOVA_1).getValue());
+        EXPECT_EQ(clone.translatePage(TEST_IOVA_1, AccessType::Read).getValue().physicalAddress, TEST_PA_2);
+        
+        // The snapshot still shows the state it was taken in
+        std::vector<AddressRange> seen = snapshot->getMappedRanges();
+        ASSERT_EQ(seen.size(), before.size());
+        for (size_t i = 0; i < seen.size(); ++i) {
+            EXPECT_EQ(seen[i].startAddress, before[i].startAddress);
+            EXPECT_EQ(seen[i].endAddress, before[i].endAddress);
+        }
+        EXPECT_EQ(snapshot->getPageCount().getValue(), 16 + 512);
+        
+        // Clearing the source leaves its copies intact
+        EXPECT_TRUE(original.clear().isOk());
+        EXPECT_EQ(original.getPageCount().getValue(), 0);
+        EXPECT_EQ(clone.getPageCount().getValue(), 16 + 512);
+        EXPECT_TRUE(snapshot->isPageMapped(TEST_IOVA_1 + PAGE_SIZE).getValue());
+        
+        // Assignment shares too
+        original = clone;
+        EXPECT_TRUE(clone.unmapRange(TEST_IOVA_1, TEST_IOVA_1 + 16 * PAGE_SIZE - 1).isOk());
+        EXPECT_EQ(original.getPageCount().getValue(), 16 + 512);
+        EXPECT_EQ(clone.getPageCount().getValue(), 512);
+    }
+}
+
+// 16KB and 64KB granules: one entry per granule page, and blocks of the
+// granule's own level 2 and level 1 sizes, on both backends
+TEST_F(AddressSpaceTest, LargeGranules) {
+    const PageTableBackend backends[] = { PageTableBackend::Hash, PageTableBackend::Radix };
+    const TranslationGranule granules[] = { TranslationGranule::Size16KB, TranslationGranule::Size64KB };
+    PagePermissions perms(true, true, false);
+    
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t g = 0; g < 2; ++g) {
+            AddressSpace space(backends[b], granules[g]);
+            uint64_t pageSize = granulePageSize(granules[g]);
+            uint64_t blockSize = pageSize * (pageSize / 8);  // 32MB or 512MB
+            EXPECT_EQ(space.getGranule(), granules[g]);
+            EXPECT_EQ(space.getGranuleSize(), pageSize);
+            
+            // A page maps the whole granule page containing the IOVA
+            ASSERT_TRUE(space.mapPage(TEST_IOVA_1 + PAGE_SIZE, TEST_PA_1, perms).isOk());
+            EXPECT_EQ(space.getPageCount().getValue(), 1);
+            TranslationResult result = space.translatePage(TEST_IOVA_1 + pageSize - 1, AccessType::Read);
+            ASSERT_TRUE(result.isOk());
+            EXPECT_EQ(result.getValue().physicalAddress, TEST_PA_1 + pageSize - 1);
+            EXPECT_EQ(result.getValue().blockSize, pageSize);
+            
+            // 4KB blocks are not blocks of this granule; its own level 2 block is
+            EXPECT_TRUE(space.mapBlock(0, 0, BLOCK_SIZE_2MB, perms).isError());
+            ASSERT_TRUE(space.mapBlock(blockSize, 2 * blockSize, blockSize, perms).isOk());
+            result = space.translatePage(blockSize + 0x1234, AccessType::Write);
+            ASSERT_TRUE(result.isOk());
+            EXPECT_EQ(result.getValue().physicalAddress, 2 * blockSize + 0x1234);
+            EXPECT_EQ(result.getValue().blockSize, blockSize);
+            EXPECT_EQ(space.getPageCount().getValue(), 1 + blockSize / pageSize);
+            
+            // Unmapping any address of a granule page drops the whole page
+            ASSERT_TRUE(space.unmapPage(blockSize + pageSize + 0x10).isOk());
+            EXPECT_EQ(space.getPageCount().getValue(), blockSize / pageSize);
+            EXPECT_FALSE(space.isPageMapped(blockSize + pageSize).getValue());
+            EXPECT_TRUE(space.isPageMapped(blockSize + 2 * pageSize).getValue());
+            
+            // mapRange covers a ragged range with granule pages around a block
+            ASSERT_TRUE(space.clear().isOk());
+            ASSERT_TRUE(space.mapRange(blockSize - pageSize, 2 * blockSize + pageSize - 1, blockSize - pageSize,
+                                       perms).isOk());
+            EXPECT_EQ(space.getPageCount().getValue(), 2 + blockSize / pageSize);
+            EXPECT_EQ(space.translatePage(blockSize, AccessType::Read).getValue().blockSize, blockSize);
+            std::vector<AddressRange> ranges = space.getMappedRanges();
+            ASSERT_EQ(ranges.size(), 1);
+            EXPECT_EQ(ranges[0].startAddress, blockSize - pageSize);
+            EXPECT_EQ(ranges[0].endAddress, 2 * blockSize + pageSize - 1);
+        }
+    }
+}
+
+TEST_F(AddressSpaceTest, RadixPageTableGranuleRoots) {
+    PageDescriptor entry(TEST_PA_1, PagePermissions(true, false, false));
+    
+    // Tables reaching bit 51: 4 levels for 16KB, 3 for 64KB
+    RadixPageTable table16(TranslationGranule::Size16KB);
+    table16.map(MAX_VIRTUAL_ADDRESS & ~0x3FFFULL, 0x4000, entry);
+    EXPECT_EQ(table16.getNodeCount(), 4);
+    RadixPageTable table64(TranslationGranule::Size64KB);
+    table64.map(MAX_VIRTUAL_ADDRESS & ~0xFFFFULL, 0x10000, entry);
+    EXPECT_EQ(table64.getNodeCount(), 3);
+    
+    // A 4TB level 1 block lives in the 64KB root
+    table64.map(0, 4ULL << 40, entry);
+    EXPECT_EQ(table64.getNodeCount(), 3);
+    uint64_t mappingSize = 0;
+    ASSERT_TRUE(table64.find((4ULL << 40) - 1, mappingSize).isValid());
+    EXPECT_EQ(mappingSize, 4ULL << 40);
+    EXPECT_EQ(table64.getPageCount(), 1 + (1ULL << 26));
+    
+    // Unmapping one page splits the block down to a leaf table
+    EXPECT_EQ(table64.unmap(0x10000, 0x1FFFF), 1);
+    EXPECT_EQ(table64.getNodeCount(), 5);
+    ASSERT_TRUE(table64.find(0x20000, mappingSize).isValid());
+    EXPECT_EQ(mappingSize, 0x10000);
+}
+
+TEST_F(AddressSpaceTest, DirtyBitmapCollect) {
+    DirtyBitmap bitmap;
+    bitmap.set(5);
+    bitmap.set(70);
+    bitmap.setRange(126, 4);
+    bitmap.set(1ULL << 36);
+    EXPECT_TRUE(bitmap.test(70));
+    EXPECT_TRUE(bitmap.test(129));
+    EXPECT_FALSE(bitmap.test(130));
+    
+    // An unaligned start shifts bits across word boundaries
+    std::vector<uint64_t> words = bitmap.collect(3, 200);
+    ASSERT_EQ(words.size(), 4u);
+    EXPECT_EQ(words[0], 1ULL << 2);
+    EXPECT_EQ(words[1], (1ULL << (67 - 64)) | (0xFULL << (123 - 64)));
+    EXPECT_EQ(words[2], 0u);
+    EXPECT_FALSE(bitmap.test(5));
+    EXPECT_FALSE(bitmap.test(127));
+    
+    // Only the collected range is cleared
+    EXPECT_TRUE(bitmap.test(1ULL << 36));
+    words = bitmap.collect((1ULL << 36) - 1, 2);
+    ASSERT_EQ(words.size(), 1u);
+    EXPECT_EQ(words[0], 2u);
+    EXPECT_EQ(bitmap.collect(0, 1ULL << 20)[0], 0u);
+}
+
+TEST_F(AddressSpaceTest, DirtyBitmapConcurrentCollect) {
+    // Every page set exactly once is collected exactly once
+    DirtyBitmap bitmap;
+    const uint64_t pageCount = 1 << 16;
+    std::vector<std::thread> writers;
+    for (uint64_t t = 0; t < 4; ++t) {
+        writers.push_back(std::thread([&bitmap, t, pageCount]() {
+            for (uint64_t page = t; page < pageCount; page += 4) {
+                bitmap.set(page);
+            }
+        }));
+    }
+    
+    std::vector<uint64_t> seen(pageCount / 64, 0);
+    uint64_t collected = 0;
+    while (collected < pageCount) {
+        std::vector<uint64_t> words = bitmap.collect(0, pageCount);
+        for (size_t i = 0; i < words.size(); ++i) {
+            EXPECT_EQ(seen[i] & words[i], 0u);
+            seen[i] |= words[i];
+            collected += __builtin_popcountll(words[i]);
+        }
+    }
+    for (size_t t = 0; t < writers.size(); ++t) {
+        writers[t].join();
+    }
+    EXPECT_EQ(collected, pageCount);
+}
+
+TEST_F(AddressSpaceTest, DirtyTrackingLogsWrites) {
+    for (int backend = 0; backend < 3; ++backend) {
+        AddressSpace space(static_cast<PageTableBackend>(backend));
+        PagePermissions readWrite(true, true, false);
+        ASSERT_TRUE(space.mapRange(TEST_IOVA_1, TEST_IOVA_1 + 0x7FFF, TEST_PA_1, readWrite).isOk());
+        
+        // Nothing is logged until tracking is enabled
+        ASSERT_TRUE(space.translatePage(TEST_IOVA_1, AccessType::Write).isOk());
+        space.setDirtyTracking(true);
+        EXPECT_TRUE(space.isDirtyTrackingEnabled());
+        
+        TranslationResult read = space.translatePage(TEST_IOVA_1 + 0x1000, AccessType::Read);
+        ASSERT_TRUE(read.isOk());
+        EXPECT_EQ(read.getValue().dirtyEpoch, DIRTY_CLEAN);
+        TranslationResult write = space.translatePage(TEST_IOVA_1 + 0x2010, AccessType::Write);
+        ASSERT_TRUE(write.isOk());
+        EXPECT_EQ(write.getValue().dirtyEpoch, space.getDirtyLogEpoch());
+        EXPECT_TRUE(AddressSpace::isDirtyLogEpochCurrent(write.getValue().dirtyEpoch));
+        uint64_t otherEpoch = addressSpace->getDirtyLogEpoch();
+        ASSERT_TRUE(space.translatePage(TEST_IOVA_1 + 0x5000, AccessType::Write).isOk());
+        
+        // A failed write marks nothing
+        EXPECT_TRUE(space.translatePage(TEST_IOVA_2, AccessType::Write).isError());
+        
+        Result<std::vector<uint64_t>> bitmap = space.getAndClearDirtyBitmap(TEST_IOVA_1, TEST_IOVA_1 + 0x7FFF);
+        ASSERT_TRUE(bitmap.isOk());
+        ASSERT_EQ(bitmap.getValue().size(), 1u);
+        EXPECT_EQ(bitmap.getValue()[0], (1ULL << 2) | (1ULL << 5));
+        
+        // Collecting bits moved this space's epoch on, and only its; the bits are gone
+        EXPECT_NE(write.getValue().dirtyEpoch, space.getDirtyLogEpoch());
+        EXPECT_FALSE(AddressSpace::isDirtyLogEpochCurrent(write.getValue().dirtyEpoch));
+        EXPECT_EQ(addressSpace->getDirtyLogEpoch(), otherEpoch);
+        bitmap = space.getAndClearDirtyBitmap(TEST_IOVA_1, TEST_IOVA_1 + 0x7FFF);
+        ASSERT_TRUE(bitmap.isOk());
+        EXPECT_EQ(bitmap.getValue()[0], 0u);
+    }
+    
+    EXPECT_TRUE(addressSpace->getAndClearDirtyBitmap(TEST_IOVA_2, TEST_IOVA_1).isError());
+    EXPECT_TRUE(addressSpace->getAndClearDirtyBitmap(0, MAX_VIRTUAL_ADDRESS).isError());
+}
+
+TEST_F(AddressSpaceTest, DirtyTrackingMarksWholeBlocks) {
+    AddressSpace space(PageTableBackend::Radix);
+    space.setDirtyTracking(true);
+    ASSERT_TRUE(space.mapBlock(0x200000, 0x40000000, 0x200000, PagePermissions(true, true, false)).isOk());
+    ASSERT_TRUE(space.translatePage(0x234000, AccessType::Write).isOk());
+    
+    // The bitmap has no finer record than the mapping that was written
+    Result<std::vector<uint64_t>> bitmap = space.getAndClearDirtyBitmap(0x200000, 0x3FFFFF);
+    ASSERT_TRUE(bitmap.isOk());
+    ASSERT_EQ(bitmap.getValue().size(), 8u);
+    for (size_t i = 0; i < bitmap.getValue().size(); ++i) {
+        EXPECT_EQ(bitmap.getValue()[i], ~0ULL);
+    }
+}
+
 } // namespace test
 } // namespace smmu
\ No newline at end of file
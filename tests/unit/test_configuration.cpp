@@ -62,6 +62,7 @@ TEST_F(ConfigurationTest, CacheConfigurationDefaults) {
     EXPECT_EQ(cacheConfig.tlbCacheSize, 1024); // Default TLB cache size
     EXPECT_EQ(cacheConfig.cacheMaxAge, 5000);   // 5 seconds default
     EXPECT_TRUE(cacheConfig.enableCaching);
+    EXPECT_EQ(cacheConfig.tlbShardCount, 1);    // Unsharded by default
     
     // Check validation
     EXPECT_TRUE(cacheConfig.isValid());
@@ -80,6 +81,80 @@ TEST_F(ConfigurationTest, CacheConfigurationCustomValues) {
 }
 
 // Test AddressConfiguration functionality
+TEST_F(ConfigurationTest, CacheConfigurationShardCount) {
+    CacheConfiguration cacheConfig(2048, 10000, true, 16);
+    EXPECT_EQ(cacheConfig.tlbShardCount, 16);
+    EXPECT_TRUE(cacheConfig.isValid());
+    
+    // Shard count must be a non-zero power of two
+    cacheConfig.tlbShardCount = 0;
+    EXPECT_FALSE(cacheConfig.isValid());
+    cacheConfig.tlbShardCount = 12;
+    EXPECT_FALSE(cacheConfig.isValid());
+    cacheConfig.tlbShardCount = 512;
+    EXPECT_FALSE(cacheConfig.isValid());
+}
+
+TEST_F(ConfigurationTest, CacheConfigurationMicroTLBEntries) {
+    CacheConfiguration cacheConfig;
+    EXPECT_EQ(cacheConfig.microTlbEntries, 0);  // Disabled by default
+    EXPECT_TRUE(cacheConfig.isValid());
+    
+    cacheConfig.microTlbEntries = 16;
+    EXPECT_TRUE(cacheConfig.isValid());
+    cacheConfig.microTlbEntries = 64;
+    EXPECT_TRUE(cacheConfig.isValid());
+    cacheConfig.microTlbEntries = 8;
+    EXPECT_FALSE(cacheConfig.isValid());
+    cacheConfig.microTlbEntries = 128;
+    EXPECT_FALSE(cacheConfig.isValid());
+    
+    SMMUConfiguration config;
+    cacheConfig.microTlbEntries = 32;
+    EXPECT_TRUE(config.setCacheConfiguration(cacheConfig).isOk());
+    auto parsed = SMMUConfiguration::fromString(config.toString());
+    ASSERT_TRUE(parsed.isOk());
+    EXPECT_EQ(parsed.getValue().getCacheConfiguration().microTlbEntries, 32);
+}
+
+TEST_F(ConfigurationTest, CacheConfigurationWalkCacheEntries) {
+    CacheConfiguration cacheConfig;
+    EXPECT_EQ(cacheConfig.walkCacheEntries, 256);
+    
+    cacheConfig.walkCacheEntries = 0;  // Disabled
+    EXPECT_TRUE(cacheConfig.isValid());
+    cacheConfig.walkCacheEntries = 8;
+    EXPECT_FALSE(cacheConfig.isValid());
+    cacheConfig.walkCacheEntries = 131072;
+    EXPECT_FALSE(cacheConfig.isValid());
+    
+    SMMUConfiguration config;
+    cacheConfig.walkCacheEntries = 1024;
+    EXPECT_TRUE(config.setCacheConfiguration(cacheConfig).isOk());
+    auto parsed = SMMUConfiguration::fromString(config.toString());
+    ASSERT_TRUE(parsed.isOk());
+    EXPECT_EQ(parsed.getValue().getCacheConfiguration().walkCacheEntries, 1024);
+}
+
+TEST_F(ConfigurationTest, CacheConfigurationAging) {
+    CacheConfiguration cacheConfig;
+    EXPECT_TRUE(cacheConfig.enableCacheAging);  // Enabled by default
+    
+    SMMUConfiguration config;
+    cacheConfig.enableCacheAging = false;
+    cacheConfig.cacheMaxAge = 250;
+    EXPECT_TRUE(config.setCacheConfiguration(cacheConfig).isOk());
+    auto parsed = SMMUConfiguration::fromString(config.toString());
+    ASSERT_TRUE(parsed.isOk());
+    EXPECT_FALSE(parsed.getValue().getCacheConfiguration().enableCacheAging);
+    EXPECT_EQ(parsed.getValue().getCacheConfiguration().cacheMaxAge, 250);
+    EXPECT_FALSE(parsed.getValue() == SMMUConfiguration());
+    
+    // Updating the other cache settings keeps aging off
+    EXPECT_TRUE(config.updateCacheSettings(2048, 1000, true).isOk());
+    EXPECT_FALSE(config.getCacheConfiguration().enableCacheAging);
+}
+
 TEST_F(ConfigurationTest, AddressConfigurationDefaults) {
     AddressConfiguration addressConfig;
     
@@ -174,6 +249,8 @@ TEST_F(ConfigurationTest, SMMUConfigurationStringSerializationDeserialization) {
                   originalConfig.getQueueConfiguration().eventQueueSize);
         EXPECT_EQ(parsedConfig.getCacheConfiguration().tlbCacheSize,
                   originalConfig.getCacheConfiguration().tlbCacheSize);
+        EXPECT_EQ(parsedConfig.getCacheConfiguration().tlbShardCount,
+                  originalConfig.getCacheConfiguration().tlbShardCount);
     }
 }
 
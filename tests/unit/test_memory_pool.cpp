@@ -0,0 +1,300 @@
+// ARM SMMU v3 Memory Pool Unit Tests
+// Copyright (c) 2024 John Greninger
+
+#include <gtest/gtest.h>
+#include "smmu/memory_pool.h"
+#include "smmu/tlb_cache.h"
+#include "smmu/address_space.h"
+#include "smmu/fault_handler.h"
+#include "smmu/smmu.h"
+#include "smmu/types.h"
+#include <list>
+#include <deque>
+#include <thread>
+#include <vector>
+
+namespace smmu {
+namespace test {
+
+class MemoryPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        budget = std::make_shared<MemoryBudget>();
+    }
+    
+    // Leave no room for anything not already charged
+    void exhaustBudget() {
+        budget->setLimit(budget->getUsage());
+        ASSERT_TRUE(budget->isExhausted());
+    }
+    
+    // Map pages until the SMMU's budget refuses one; returns the count mapped
+    size_t mapUntilExhausted(SMMU& smmu, StreamID streamID) {
+        StreamConfig config;
+        config.translationEnabled = true;
+        config.stage1Enabled = true;
+        config.stage2Enabled = false;
+        config.faultMode = FaultMode::Terminate;
+        EXPECT_TRUE(smmu.configureStream(streamID, config).isOk());
+        EXPECT_TRUE(smmu.enableStream(streamID).isOk());
+        EXPECT_TRUE(smmu.createStreamPASID(streamID, 1).isOk());
+        
+        PagePermissions permissions(true, true, false);
+        for (size_t page = 0; page < 1000000; ++page) {
+            VoidResult result = smmu.mapPage(streamID, 1, page * PAGE_SIZE, 0x40000000 + page * PAGE_SIZE, permissions);
+            if (result.isError()) {
+                EXPECT_EQ(result.getError(), SMMUError::ResourceExhausted);
+                return page;
+            }
+        }
+        return 0;
+    }
+    
+    std::shared_ptr<MemoryBudget> budget;
+};
+
+TEST_F(MemoryPoolTest, SlabAllocatorReusesFreedBlocks) {
+    void* first = SlabAllocator::allocate(40, 8);
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(first) % SlabAllocator::BLOCK_ALIGNMENT, 0u);
+    EXPECT_GE(SlabAllocator::getReservedBytes(), SlabAllocator::SLAB_SIZE);
+    
+    // The thread cache hands the block straight back
+    SlabAllocator::deallocate(first, 40, 8);
+    void* second = SlabAllocator::allocate(48, 8);
+    EXPECT_EQ(first, second);
+    SlabAllocator::deallocate(second, 48, 8);
+    
+    // Requests above the largest class bypass the slabs
+    void* large = SlabAllocator::allocate(SlabAllocator::MAX_BLOCK_SIZE + 1, 8);
+    ASSERT_NE(large, nullptr);
+    SlabAllocator::deallocate(large, SlabAllocator::MAX_BLOCK_SIZE + 1, 8);
+    EXPECT_EQ(SlabAllocator::blockSize(40, 8), 48u);
+    EXPECT_EQ(SlabAllocator::blockSize(SlabAllocator::MAX_BLOCK_SIZE + 1, 8), SlabAllocator::MAX_BLOCK_SIZE + 1);
+}
+
+TEST_F(MemoryPoolTest, PoolAllocatorChargesItsBudget) {
+    PoolAllocator<char> allocator(budget.get());
+    char* small = allocator.allocate(40);
+    EXPECT_EQ(budget->getUsage(), 48u);
+    char* large = allocator.allocate(SlabAllocator::MAX_BLOCK_SIZE + 1);
+    EXPECT_EQ(budget->getUsage(), 48u + SlabAllocator::MAX_BLOCK_SIZE + 1);
+    allocator.deallocate(large, SlabAllocator::MAX_BLOCK_SIZE + 1);
+    allocator.deallocate(small, 40);
+    EXPECT_EQ(budget->getUsage(), 0u);
+    
+    // Containers keep the budget through rebinding, copies and moves
+    std::list<uint64_t, PoolAllocator<uint64_t>> list{PoolAllocator<uint64_t>(budget.get())};
+    list.push_back(1);
+    EXPECT_GT(budget->getUsage(), 0u);
+    std::list<uint64_t, PoolAllocator<uint64_t>> copy(list);
+    std::list<uint64_t, PoolAllocator<uint64_t>> moved;
+    moved = std::move(copy);
+    EXPECT_EQ(moved.get_allocator(), list.get_allocator());
+    list.clear();
+    moved.clear();
+    EXPECT_EQ(budget->getUsage(), 0u);
+    EXPECT_EQ(MemoryBudget::defaultBudget()->getLimit(), 0u);
+}
+
+TEST_F(MemoryPoolTest, PoolAllocatorContainersAcrossThreads) {
+    // Nodes allocated on one thread and freed on another go back through the pools
+    std::list<uint64_t, PoolAllocator<uint64_t>> shared;
+    std::vector<std::thread> threads;
+    std::vector<std::list<uint64_t, PoolAllocator<uint64_t>>> perThread(4);
+    for (size_t t = 0; t < perThread.size(); ++t) {
+        threads.push_back(std::thread([&perThread, t]() {
+            std::deque<uint64_t, PoolAllocator<uint64_t>> scratch;
+            for (uint64_t i = 0; i < 5000; ++i) {
+                perThread[t].push_back(i);
+                scratch.push_back(i);
+                if (scratch.size() > 100) {
+                    scratch.pop_front();
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    
+    for (size_t t = 0; t < perThread.size(); ++t) {
+        ASSERT_EQ(perThread[t].size(), 5000u);
+        EXPECT_EQ(perThread[t].back(), 4999u);
+        shared.splice(shared.end(), perThread[t]);
+    }
+    EXPECT_EQ(shared.size(), 20000u);
+    shared.clear();
+}
+
+TEST_F(MemoryPoolTest, MemoryPoolGrowthRespectsBudget) {
+    MemoryPool<PageEntry> pool(4, 4, budget);
+    EXPECT_EQ(pool.getTotalCapacity(), 4u);
+    
+    std::vector<PageEntry*> entries;
+    for (int i = 0; i < 4; ++i) {
+        entries.push_back(pool.acquire(0x1000 * i, PagePermissions(true, false, false)));
+        ASSERT_NE(entries.back(), nullptr);
+    }
+    EXPECT_EQ(pool.getUsedCount(), 4u);
+    EXPECT_EQ(pool.getFreeCount(), 0u);
+    
+    // Growing would pass the limit, so the pool refuses
+    exhaustBudget();
+    EXPECT_EQ(pool.acquire(0x5000, PagePermissions(true, false, false)), nullptr);
+    EXPECT_EQ(pool.getTotalCapacity(), 4u);
+    
+    // Released slots are reused without growing
+    pool.release(entries.back());
+    entries.pop_back();
+    PageEntry* reused = pool.acquire(0x6000, PagePermissions(false, true, false), SecurityState::Secure);
+    ASSERT_NE(reused, nullptr);
+    EXPECT_EQ(reused->physicalAddress, 0x6000u);
+    EXPECT_EQ(reused->securityState, SecurityState::Secure);
+    entries.push_back(reused);
+    
+    budget->setLimit(0);
+    PageEntry* grown = pool.acquire(0x7000, PagePermissions(true, false, false));
+    ASSERT_NE(grown, nullptr);
+    EXPECT_EQ(pool.getTotalCapacity(), 8u);
+    entries.push_back(grown);
+    
+    for (size_t i = 0; i < entries.size(); ++i) {
+        pool.release(entries[i]);
+    }
+    EXPECT_EQ(pool.getUsedCount(), 0u);
+}
+
+TEST_F(MemoryPoolTest, MemoryPoolCreditsBudgetOnDestruction) {
+    {
+        MemoryPool<PageEntry> pool(4, 4, budget);
+        EXPECT_GT(budget->getUsage(), 0u);
+    }
+    EXPECT_EQ(budget->getUsage(), 0u);
+}
+
+TEST_F(MemoryPoolTest, TLBCacheStopsGrowingWhenBudgetExhausted) {
+    TLBCache cache(64, 1, TLBBackend::LRUList, budget);
+    for (IOVA i = 0; i < 8; ++i) {
+        TLBEntry entry;
+        entry.streamID = 1;
+        entry.pasid = 1;
+        entry.iova = 0x100000 + i * PAGE_SIZE;
+        entry.physicalAddress = 0x200000 + i * PAGE_SIZE;
+        entry.permissions = PagePermissions(true, true, false);
+        entry.valid = true;
+        cache.insert(entry);
+    }
+    ASSERT_EQ(cache.getSize(), 8u);
+    
+    // New entries now replace the least recently used ones
+    exhaustBudget();
+    TLBEntry entry;
+    entry.streamID = 1;
+    entry.pasid = 1;
+    entry.iova = 0x900000;
+    entry.physicalAddress = 0xA00000;
+    entry.permissions = PagePermissions(true, true, false);
+    entry.valid = true;
+    cache.insert(entry);
+    EXPECT_EQ(cache.getSize(), 8u);
+    EXPECT_TRUE(cache.lookupEntry(1, 1, 0x900000).isOk());
+    EXPECT_FALSE(cache.lookupEntry(1, 1, 0x100000).isOk());
+    
+    budget->setLimit(0);
+    entry.iova = 0x901000;
+    cache.insert(entry);
+    EXPECT_EQ(cache.getSize(), 9u);
+}
+
+TEST_F(MemoryPoolTest, HashAddressSpaceRefusesMappingsWhenBudgetExhausted) {
+    AddressSpace addressSpace(PageTableBackend::Hash, TranslationGranule::Size4KB, budget);
+    ASSERT_TRUE(addressSpace.mapPage(0x1000, 0x10000, PagePermissions(true, true, false)).isOk());
+    
+    exhaustBudget();
+    VoidResult result = addressSpace.mapPage(0x2000, 0x20000, PagePermissions(true, true, false));
+    ASSERT_TRUE(result.isError());
+    EXPECT_EQ(result.getError(), SMMUError::ResourceExhausted);
+    EXPECT_TRUE(addressSpace.mapRange(0x3000, 0x4FFF, 0x30000, PagePermissions(true, false, false)).isError());
+    
+    // Existing mappings still translate
+    EXPECT_TRUE(addressSpace.translatePage(0x1000, AccessType::Read).isOk());
+    
+    budget->setLimit(0);
+    EXPECT_TRUE(addressSpace.mapPage(0x2000, 0x20000, PagePermissions(true, true, false)).isOk());
+}
+
+TEST_F(MemoryPoolTest, FaultQueueDropsOldestWhenBudgetExhausted) {
+    FaultHandler handler(budget);
+    handler.recordTranslationFault(1, 0, 0x1000, AccessType::Read);
+    handler.recordTranslationFault(2, 0, 0x2000, AccessType::Read);
+    
+    exhaustBudget();
+    handler.recordTranslationFault(3, 0, 0x3000, AccessType::Write);
+    std::vector<FaultRecord> events = handler.getEvents();
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].streamID, 2u);
+    EXPECT_EQ(events[1].streamID, 3u);
+    EXPECT_EQ(handler.getTotalFaultCount(), 3u);
+}
+
+TEST_F(MemoryPoolTest, SMMUAppliesMaxMemoryUsage) {
+    SMMU smmu;
+    EXPECT_EQ(smmu.getMemoryBudget().getLimit(), smmu.getConfiguration().getResourceLimits().maxMemoryUsage);
+    
+    ResourceLimits limits = smmu.getConfiguration().getResourceLimits();
+    limits.maxMemoryUsage = 1024 * 1024;  // Smallest limit allowed
+    ASSERT_TRUE(smmu.updateResourceLimits(limits).isOk());
+    EXPECT_EQ(smmu.getMemoryBudget().getLimit(), limits.maxMemoryUsage);
+    
+    // Commands are refused rather than queued past the limit
+    EXPECT_GT(mapUntilExhausted(smmu, 1), 0u);
+    EXPECT_TRUE(smmu.getMemoryBudget().isExhausted());
+    CommandEntry command;
+    command.type = CommandType::SYNC;
+    VoidResult result = smmu.submitCommand(command);
+    ASSERT_TRUE(result.isError());
+    EXPECT_EQ(result.getError(), SMMUError::ResourceExhausted);
+    EXPECT_EQ(smmu.getCommandQueueSize(), 0u);
+}
+
+TEST_F(MemoryPoolTest, SMMUBudgetsAreIndependent) {
+    SMMU roomy;
+    
+    // A small limit on one instance leaves the other's mappings and queues alone
+    std::unique_ptr<SMMU> small(new SMMU());
+    ResourceLimits limits = small->getConfiguration().getResourceLimits();
+    limits.maxMemoryUsage = 1024 * 1024;  // Smallest limit allowed
+    ASSERT_TRUE(small->updateResourceLimits(limits).isOk());
+    size_t smallPages = mapUntilExhausted(*small, 1);
+    EXPECT_GT(smallPages, 0u);
+    EXPECT_FALSE(roomy.getMemoryBudget().isExhausted());
+    EXPECT_EQ(roomy.getMemoryBudget().getLimit(), roomy.getConfiguration().getResourceLimits().maxMemoryUsage);
+    
+    uint64_t roomyUsage = roomy.getMemoryBudget().getUsage();
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    config.stage2Enabled = false;
+    config.faultMode = FaultMode::Terminate;
+    ASSERT_TRUE(roomy.configureStream(2, config).isOk());
+    ASSERT_TRUE(roomy.enableStream(2).isOk());
+    ASSERT_TRUE(roomy.createStreamPASID(2, 1).isOk());
+    PagePermissions permissions(true, true, false);
+    for (size_t page = 0; page < smallPages * 2; ++page) {
+        ASSERT_TRUE(roomy.mapPage(2, 1, page * PAGE_SIZE, 0x80000000 + page * PAGE_SIZE, permissions).isOk());
+    }
+    EXPECT_GT(roomy.getMemoryBudget().getUsage(), roomyUsage);
+    
+    CommandEntry command;
+    command.type = CommandType::SYNC;
+    EXPECT_TRUE(small->submitCommand(command).isError());
+    EXPECT_TRUE(roomy.submitCommand(command).isOk());
+    
+    small.reset();
+    EXPECT_FALSE(roomy.getMemoryBudget().isExhausted());
+    EXPECT_TRUE(roomy.translate(2, 1, 0, AccessType::Read).isOk());
+}
+
+} // namespace test
+} // namespace smmu
@@ -0,0 +1,384 @@
+// ARM SMMU v3 Translation Table Walker Unit Tests
+// Copyright (c) 2024 John Greninger
+
+#include <gtest/gtest.h>
+#include "smmu/page_table_walker.h"
+#include "smmu/physical_memory.h"
+#include "smmu/address_space.h"
+#include "smmu/types.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace smmu {
+namespace test {
+
+// VMSAv8-64 descriptor bits used to build tables
+static const uint64_t DESC_TABLE = 0x3;
+static const uint64_t DESC_PAGE = 0x3;
+static const uint64_t DESC_BLOCK = 0x1;
+static const uint64_t DESC_AF = 1ULL << 10;
+static const uint64_t DESC_AP_READ_ONLY = 1ULL << 7;
+static const uint64_t DESC_PXN = 1ULL << 53;
+static const uint64_t DESC_AP_TABLE_READ_ONLY = 1ULL << 62;
+static const uint64_t DESC_NS = 1ULL << 5;
+
+class PageTableWalkerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        memory = std::make_shared<PhysicalMemory>();
+        walker = std::make_shared<PageTableWalker>(memory);
+        nextTable = TABLE_REGION;
+        tableOffset = 0;
+        pageShift = 12;
+        startLevel = 0;
+        root = allocateTable();
+    }
+    
+    // Tables come from a bump allocator starting at TABLE_REGION
+    PA allocateTable() {
+        PA table = nextTable;
+        nextTable += 1ULL << pageShift;
+        return table;
+    }
+    
+    size_t indexAt(IOVA iova, int level) const {
+        unsigned bits = pageShift - 3;
+        unsigned shift = pageShift + bits * (3 - level);
+        return static_cast<size_t>(((iova & 0x0000FFFFFFFFFFFFULL) >> shift) & ((1ULL << bits) - 1));
+    }
+    
+    // Write a leaf descriptor at leafLevel, creating tables above it. Table
+    // descriptors hold addresses tableOffset below the tables' PAs, so a
+    // nested test can place them at IPAs Stage-2 maps back up.
+    void install(IOVA iova, int leafLevel, uint64_t leaf, uint64_t tableAttributes = 0) {
+        PA table = root;
+        for (int level = startLevel; level < leafLevel; ++level) {
+            PA slot = table + indexAt(iova, level) * sizeof(uint64_t);
+            uint64_t descriptor = memory->read64(slot).getValue();
+            if ((descriptor & 1) == 0) {
+                descriptor = (allocateTable() - tableOffset) | DESC_TABLE | tableAttributes;
+                ASSERT_TRUE(memory->write64(slot, descriptor).isOk());
+            }
+            table = (descriptor & 0x0000FFFFFFFFF000ULL & ~((1ULL << pageShift) - 1)) + tableOffset;
+        }
+        ASSERT_TRUE(memory->write64(table + indexAt(iova, leafLevel) * sizeof(uint64_t), leaf).isOk());
+    }
+    
+    ContextDescriptor context() const {
+        ContextDescriptor cd(root - tableOffset, 1, SecurityState::NonSecure);
+        if (pageShift == 16) {
+            cd.tcr.granuleSize = TranslationGranule::Size64KB;
+        }
+        return cd;
+    }
+    
+    static constexpr PA TABLE_REGION = 0x100000;
+    static constexpr IOVA TEST_IOVA = 0x12345000;
+    static constexpr PA TEST_PA = 0x80000000;
+    
+    std::shared_ptr<PhysicalMemory> memory;
+    std::shared_ptr<PageTableWalker> walker;
+    PA nextTable;
+    PA tableOffset;
+    unsigned pageShift;
+    int startLevel;
+    PA root;
+};
+
+constexpr PA PageTableWalkerTest::TABLE_REGION;
+constexpr IOVA PageTableWalkerTest::TEST_IOVA;
+constexpr PA PageTableWalkerTest::TEST_PA;
+
+// Unwritten memory reads zero; 64-bit accesses are aligned little-endian
+TEST(PhysicalMemoryTest, ReadWrite) {
+    PhysicalMemory memory;
+    EXPECT_EQ(memory.read64(0x1000).getValue(), 0u);
+    EXPECT_EQ(memory.getFrameCount(), 0u);
+    
+    ASSERT_TRUE(memory.write64(0x1008, 0x0123456789ABCDEFULL).isOk());
+    EXPECT_EQ(memory.read64(0x1008).getValue(), 0x0123456789ABCDEFULL);
+    uint8_t low = 0;
+    ASSERT_TRUE(memory.read(0x1008, &low, 1).isOk());
+    EXPECT_EQ(low, 0xEF);
+    EXPECT_EQ(memory.read64(0x1004).getError(), SMMUError::InvalidAddress);
+    EXPECT_EQ(memory.write64(MAX_PHYSICAL_ADDRESS + 1, 0).getError(), SMMUError::InvalidAddress);
+    
+    // Byte ranges may cross frames
+    const char text[] = "spans two frames";
+    ASSERT_TRUE(memory.write(0x2FF8, text, sizeof(text)).isOk());
+    char back[sizeof(text)] = {};
+    ASSERT_TRUE(memory.read(0x2FF8, back, sizeof(back)).isOk());
+    EXPECT_STREQ(back, text);
+    EXPECT_EQ(memory.getFrameCount(), 3u);
+    EXPECT_EQ(memory.getResidentBytes(), 3u * 4096);
+    
+    memory.clear();
+    EXPECT_EQ(memory.read64(0x1008).getValue(), 0u);
+    EXPECT_EQ(memory.getFrameCount(), 0u);
+}
+
+// A 4KB page walks all four levels from level 0
+TEST_F(PageTableWalkerTest, FourLevelPageWalk) {
+    install(TEST_IOVA, 3, TEST_PA | DESC_PAGE | DESC_AF);
+    
+    WalkTrace trace;
+    TranslationResult result = walker->walk(context(), TEST_IOVA + 0x123, AccessType::Write,
+                                            SecurityState::NonSecure, nullptr, &trace);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x123);
+    EXPECT_EQ(result.getValue().blockSize, 4096u);
+    EXPECT_TRUE(result.getValue().permissions.read);
+    EXPECT_TRUE(result.getValue().permissions.write);
+    EXPECT_TRUE(result.getValue().permissions.execute);
+    EXPECT_EQ(trace.startLevel, 0);
+    EXPECT_EQ(trace.finalLevel, 3);
+    EXPECT_EQ(trace.depth, 4u);
+    EXPECT_EQ(trace.descriptorReads, 4u);
+    
+    EXPECT_EQ(walker->walk(context(), TEST_IOVA + 0x1000, AccessType::Read, SecurityState::NonSecure).getError(),
+              SMMUError::PageNotMapped);
+    
+    WalkStatistics statistics = walker->getStatistics();
+    EXPECT_EQ(statistics.walks, 2u);
+    EXPECT_EQ(statistics.faults, 1u);
+}
+
+// Blocks end the walk at level 2 (2MB) or level 1 (1GB)
+TEST_F(PageTableWalkerTest, BlockDescriptors) {
+    const IOVA blockIova = 0x40200000;
+    install(blockIova, 2, TEST_PA | DESC_BLOCK | DESC_AF);
+    install(0x80000000, 1, 0x100000000ULL | DESC_BLOCK | DESC_AF);
+    
+    WalkTrace trace;
+    TranslationResult result = walker->walk(context(), blockIova + 0x12345, AccessType::Read,
+                                            SecurityState::NonSecure, nullptr, &trace);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x12345);
+    EXPECT_EQ(result.getValue().blockSize, 2u * 1024 * 1024);
+    EXPECT_EQ(trace.finalLevel, 2);
+    
+    result = walker->walk(context(), 0x80000000 + 0x3456789, AccessType::Read, SecurityState::NonSecure);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, 0x100000000ULL + 0x3456789);
+    EXPECT_EQ(result.getValue().blockSize, 1024u * 1024 * 1024);
+    
+    // 0b01 at level 3 is reserved
+    install(TEST_IOVA, 3, TEST_PA | DESC_BLOCK | DESC_AF);
+    EXPECT_EQ(walker->walk(context(), TEST_IOVA, AccessType::Read, SecurityState::NonSecure).getError(),
+              SMMUError::TranslationTableError);
+}
+
+// AF, AP[2], PXN and the hierarchical table bits
+TEST_F(PageTableWalkerTest, DescriptorPermissions) {
+    const ContextDescriptor cd = context();
+    install(TEST_IOVA, 3, TEST_PA | DESC_PAGE);
+    EXPECT_EQ(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure).getError(),
+              SMMUError::AccessFlagFault);
+    
+    install(TEST_IOVA, 3, TEST_PA | DESC_PAGE | DESC_AF | DESC_AP_READ_ONLY | DESC_PXN);
+    EXPECT_TRUE(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure).isOk());
+    EXPECT_EQ(walker->walk(cd, TEST_IOVA, AccessType::Write, SecurityState::NonSecure).getError(),
+              SMMUError::PagePermissionViolation);
+    EXPECT_EQ(walker->walk(cd, TEST_IOVA, AccessType::Execute, SecurityState::NonSecure).getError(),
+              SMMUError::PagePermissionViolation);
+    
+    // APTable[1] on a table makes everything below it read-only
+    const IOVA restrictedIova = 0x4000000000ULL;
+    install(restrictedIova, 3, TEST_PA | DESC_PAGE | DESC_AF, DESC_AP_TABLE_READ_ONLY);
+    EXPECT_EQ(walker->walk(cd, restrictedIova, AccessType::Write, SecurityState::NonSecure).getError(),
+              SMMUError::PagePermissionViolation);
+    
+    ContextDescriptor flat = cd;
+    flat.tcr.hierarchicalPermDisable = true;
+    EXPECT_TRUE(walker->walk(flat, restrictedIova, AccessType::Write, SecurityState::NonSecure).isOk());
+    
+    // A secure context may map non-secure memory
+    install(TEST_IOVA, 3, TEST_PA | DESC_PAGE | DESC_AF | DESC_NS);
+    TranslationResult result = walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::Secure);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().securityState, SecurityState::NonSecure);
+}
+
+// The top of the address space walks TTBR1; the hole between the two faults
+TEST_F(PageTableWalkerTest, TTBR1Selection) {
+    const IOVA kernelIova = 0xFFFF800000001000ULL;
+    PA lowRoot = root;
+    root = allocateTable();
+    install(kernelIova, 3, TEST_PA | DESC_PAGE | DESC_AF);
+    
+    ContextDescriptor cd(lowRoot, root, 1, TranslationControlRegister(), MemoryAttributeRegister(),
+                         SecurityState::NonSecure);
+    TranslationResult result = walker->walk(cd, kernelIova + 8, AccessType::Read, SecurityState::NonSecure);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 8);
+    EXPECT_EQ(walker->walk(cd, 0x0001000000000000ULL, AccessType::Read, SecurityState::NonSecure).getError(),
+              SMMUError::PageNotMapped);
+    
+    cd.ttbr1Valid = false;
+    EXPECT_EQ(walker->walk(cd, kernelIova, AccessType::Read, SecurityState::NonSecure).getError(),
+              SMMUError::PageNotMapped);
+}
+
+// Walks under a cached table prefix only fetch the levels below it
+TEST_F(PageTableWalkerTest, WalkCacheSkipsUpperLevels) {
+    install(TEST_IOVA, 3, TEST_PA | DESC_PAGE | DESC_AF);
+    install(TEST_IOVA + 0x1000, 3, (TEST_PA + 0x1000) | DESC_PAGE | DESC_AF);
+    
+    WalkTrace trace;
+    ASSERT_TRUE(walker->walk(context(), TEST_IOVA, AccessType::Read, SecurityState::NonSecure, nullptr, &trace).isOk());
+    EXPECT_EQ(trace.descriptorReads, 4u);
+    
+    TranslationResult result = walker->walk(context(), TEST_IOVA + 0x1000, AccessType::Read,
+                                            SecurityState::NonSecure, nullptr, &trace);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x1000);
+    EXPECT_EQ(trace.startLevel, 3);
+    EXPECT_EQ(trace.depth, 4u);
+    EXPECT_EQ(trace.descriptorReads, 1u);
+    
+    walker->invalidateWalkCache();
+    ASSERT_TRUE(walker->walk(context(), TEST_IOVA, AccessType::Read, SecurityState::NonSecure, nullptr, &trace).isOk());
+    EXPECT_EQ(trace.descriptorReads, 4u);
+    
+    PageTableWalker uncached(memory, 0);
+    ASSERT_TRUE(uncached.walk(context(), TEST_IOVA, AccessType::Read, SecurityState::NonSecure).isOk());
+    ASSERT_TRUE(uncached.walk(context(), TEST_IOVA, AccessType::Read, SecurityState::NonSecure, nullptr, &trace).isOk());
+    EXPECT_EQ(trace.descriptorReads, 4u);
+    EXPECT_EQ(uncached.getStatistics().descriptorReads, 8u);
+}
+
+// The walk cache is tagged by ASID, skipped under walkCacheDisable and resizable
+TEST_F(PageTableWalkerTest, WalkCacheContextsAndCounters) {
+    install(TEST_IOVA, 3, TEST_PA | DESC_PAGE | DESC_AF);
+    ContextDescriptor cd = context();
+    
+    ASSERT_TRUE(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure).isOk());
+    ASSERT_TRUE(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure).isOk());
+    EXPECT_EQ(walker->getStatistics().walkCacheMisses, 1u);
+    EXPECT_EQ(walker->getStatistics().walkCacheHits, 1u);
+    
+    // Another ASID over the same tables fills its own entries
+    ContextDescriptor other = cd;
+    other.asid = 2;
+    WalkTrace trace;
+    ASSERT_TRUE(walker->walk(other, TEST_IOVA, AccessType::Read, SecurityState::NonSecure, nullptr, &trace).isOk());
+    EXPECT_EQ(trace.descriptorReads, 4u);
+    
+    walker->invalidateWalkCache(other.asid);
+    ASSERT_TRUE(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure, nullptr, &trace).isOk());
+    EXPECT_EQ(trace.descriptorReads, 1u);
+    ASSERT_TRUE(walker->walk(other, TEST_IOVA, AccessType::Read, SecurityState::NonSecure, nullptr, &trace).isOk());
+    EXPECT_EQ(trace.descriptorReads, 4u);
+    
+    // walkCacheDisable neither probes nor fills the cache
+    walker->resetStatistics();
+    walker->invalidateWalkCache();
+    cd.tcr.walkCacheDisable = true;
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure, nullptr, &trace).isOk());
+        EXPECT_EQ(trace.descriptorReads, 4u);
+    }
+    EXPECT_EQ(walker->getStatistics().walkCacheHits + walker->getStatistics().walkCacheMisses, 0u);
+    
+    walker->resizeWalkCache(100);
+    EXPECT_EQ(walker->getWalkCacheCapacity(), 128u);
+    walker->resizeWalkCache(0);
+    EXPECT_EQ(walker->getWalkCacheCapacity(), 0u);
+    cd.tcr.walkCacheDisable = false;
+    ASSERT_TRUE(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure).isOk());
+    EXPECT_EQ(walker->getStatistics().walkCacheMisses, 0u);
+}
+
+// Walks on many threads share the striped walk cache while it is
+// invalidated and resized underneath them
+TEST_F(PageTableWalkerTest, WalkCacheConcurrentWalksAndResize) {
+    const uint64_t pages = 256;
+    for (uint64_t i = 0; i < pages; ++i) {
+        install(TEST_IOVA + i * 0x1000, 3, (TEST_PA + i * 0x1000) | DESC_PAGE | DESC_AF);
+    }
+    ContextDescriptor cd = context();
+    
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> mismatches(0);
+    std::vector<std::thread> walkers;
+    for (size_t t = 0; t < 4; ++t) {
+        walkers.emplace_back([&, t]() {
+            for (uint64_t i = t; !stop.load(std::memory_order_relaxed); i += 7) {
+                uint64_t page = i % pages;
+                TranslationResult result = walker->walk(cd, TEST_IOVA + page * 0x1000, AccessType::Read,
+                                                        SecurityState::NonSecure);
+                if (result.isError() || result.getValue().physicalAddress != TEST_PA + page * 0x1000) {
+                    mismatches.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (size_t round = 0; round < 200; ++round) {
+        walker->resizeWalkCache(round % 3 == 0 ? 64 : 1024);
+        walker->invalidateWalkCache(cd.asid);
+        std::this_thread::yield();
+    }
+    stop.store(true);
+    for (auto& thread : walkers) {
+        thread.join();
+    }
+    
+    EXPECT_EQ(mismatches.load(), 0u);
+    EXPECT_EQ(walker->getWalkCacheCapacity(), 1024u);
+    WalkTrace trace;
+    ASSERT_TRUE(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure).isOk());
+    ASSERT_TRUE(walker->walk(cd, TEST_IOVA, AccessType::Read, SecurityState::NonSecure, nullptr, &trace).isOk());
+    EXPECT_EQ(trace.descriptorReads, 1u);
+}
+
+// 64KB granule: 48-bit inputs start at level 1
+TEST_F(PageTableWalkerTest, Granule64KB) {
+    pageShift = 16;
+    startLevel = 1;
+    nextTable = 0x1000000;
+    root = allocateTable();
+    install(0x12340000, 3, 0x80010000ULL | DESC_PAGE | DESC_AF);
+    install(0x40000000, 2, 0xA0000000ULL | DESC_BLOCK | DESC_AF);
+    
+    WalkTrace trace;
+    TranslationResult result = walker->walk(context(), 0x1234ABCD, AccessType::Read, SecurityState::NonSecure,
+                                            nullptr, &trace);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, 0x8001ABCDULL);
+    EXPECT_EQ(result.getValue().blockSize, 64u * 1024);
+    EXPECT_EQ(trace.startLevel, 1);
+    EXPECT_EQ(trace.depth, 3u);
+    
+    result = walker->walk(context(), 0x41234567, AccessType::Read, SecurityState::NonSecure);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, 0xA1234567ULL);
+    EXPECT_EQ(result.getValue().blockSize, 512u * 1024 * 1024);
+}
+
+// Nested walks fetch each descriptor through Stage-2
+TEST_F(PageTableWalkerTest, NestedStage2Walk) {
+    tableOffset = 0x40000000;
+    nextTable = TABLE_REGION + tableOffset;
+    root = allocateTable();
+    install(TEST_IOVA, 3, TEST_PA | DESC_PAGE | DESC_AF);
+    
+    AddressSpace stage2;
+    for (PA table = TABLE_REGION + tableOffset; table < nextTable; table += PAGE_SIZE) {
+        ASSERT_TRUE(stage2.mapPage(table - tableOffset, table, PagePermissions(true, false, false)).isOk());
+    }
+    
+    TranslationResult result = walker->walk(context(), TEST_IOVA + 4, AccessType::Read, SecurityState::NonSecure,
+                                            &stage2);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 4);
+    
+    // The tables are unreachable once their IPAs lose their Stage-2 mapping
+    walker->invalidateWalkCache();
+    ASSERT_TRUE(stage2.unmapPage(root - tableOffset).isOk());
+    EXPECT_EQ(walker->walk(context(), TEST_IOVA, AccessType::Read, SecurityState::NonSecure, &stage2).getError(),
+              SMMUError::PageNotMapped);
+}
+
+} // namespace test
+} // namespace smmu
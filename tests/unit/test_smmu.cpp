@@ -3177,5 +3177,966 @@ TEST_F(SMMUTest, Task81_ARMSMMUv3SpecificationCompliance) {
     EXPECT_TRUE(smmuController->enableStream(0xb001).isOk());
 }
 
+// Per-thread micro-TLB (L0) in front of the TLBCache
+static std::unique_ptr<SMMU> createMicroTLBSMMU(size_t entries) {
+    SMMUConfiguration config = SMMUConfiguration::createDefault();
+    CacheConfiguration cacheConfig = config.getCacheConfiguration();
+    cacheConfig.microTlbEntries = entries;
+    config.setCacheConfiguration(cacheConfig);
+    return std::unique_ptr<SMMU>(new SMMU(config));
+}
+
+static void setUpMappedStream(SMMU& controller, StreamID streamID, PASID pasid, IOVA iova, PA pa) {
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    config.stage2Enabled = false;
+    config.faultMode = FaultMode::Terminate;
+    ASSERT_TRUE(controller.configureStream(streamID, config).isOk());
+    ASSERT_TRUE(controller.enableStream(streamID).isOk());
+    ASSERT_TRUE(controller.createStreamPASID(streamID, pasid).isOk());
+    ASSERT_TRUE(controller.mapPage(streamID, pasid, iova, pa, PagePermissions(true, true, false)).isOk());
+}
+
+TEST_F(SMMUTest, MicroTLBDisabledByDefault) {
+    setUpMappedStream(*smmuController, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    }
+    EXPECT_EQ(smmuController->getMicroTLBHitCount(), 0);
+    EXPECT_EQ(smmuController->getTranslationCount(), 4);
+}
+
+TEST_F(SMMUTest, MicroTLBHitsAndUnmap) {
+    std::unique_ptr<SMMU> controller = createMicroTLBSMMU(16);
+    setUpMappedStream(*controller, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    
+    // First translation fills the L0, the rest hit it
+    for (int i = 0; i < 3; ++i) {
+        TranslationResult result = controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x123, AccessType::Read);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x123);
+    }
+    EXPECT_EQ(controller->getMicroTLBHitCount(), 2);
+    EXPECT_EQ(controller->getTranslationCount(), 3);
+    
+    // A permission failure still faults even though the page is in the L0
+    EXPECT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Execute).isError());
+    
+    // Unmap must not be hidden by a stale L0 entry
+    EXPECT_TRUE(controller->unmapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA).isOk());
+    EXPECT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isError());
+    
+    EXPECT_TRUE(controller->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA + 0x10000, PagePermissions(true, false, false)).isOk());
+    TranslationResult remapped = controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read);
+    ASSERT_TRUE(remapped.isOk());
+    EXPECT_EQ(remapped.getValue().physicalAddress, TEST_PA + 0x10000);
+    
+    controller->resetStatistics();
+    EXPECT_EQ(controller->getMicroTLBHitCount(), 0);
+    EXPECT_EQ(controller->getTranslationCount(), 0);
+}
+
+TEST_F(SMMUTest, MicroTLBInvalidationCoherence) {
+    std::unique_ptr<SMMU> controller = createMicroTLBSMMU(32);
+    setUpMappedStream(*controller, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    setUpMappedStream(*controller, TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, TEST_PA + 0x100000);
+    
+    // Warm both streams' L0 entries
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    
+    // Each invalidation must force the next translation past the L0
+    uint64_t hits = controller->getMicroTLBHitCount();
+    controller->invalidateStreamCache(TEST_STREAM_ID_1);
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getMicroTLBHitCount(), hits);
+    
+    // Other streams are unaffected by a stream-scoped invalidation
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getMicroTLBHitCount(), hits + 1);
+    
+    hits = controller->getMicroTLBHitCount();
+    controller->invalidatePASIDCache(TEST_STREAM_ID_1, TEST_PASID_1);
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getMicroTLBHitCount(), hits);
+    
+    controller->executeATCInvalidationCommand(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_IOVA + PAGE_SIZE - 1);
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getMicroTLBHitCount(), hits);
+    
+    controller->executeTLBInvalidationCommand(CommandType::TLBI_NH_ALL, 0, 0);
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getMicroTLBHitCount(), hits);
+    
+    // Removing the stream must not leave a translatable L0 entry behind
+    EXPECT_TRUE(controller->removeStream(TEST_STREAM_ID_2).isOk());
+    EXPECT_TRUE(controller->translate(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, AccessType::Read).isError());
+}
+
+TEST_F(SMMUTest, MicroTLBPerThreadCounting) {
+    std::unique_ptr<SMMU> controller = createMicroTLBSMMU(64);
+    setUpMappedStream(*controller, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    
+    const int threadCount = 4;
+    const int translationsPerThread = 100;
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.push_back(std::thread([&controller, &failures, translationsPerThread]() {
+            for (int i = 0; i < translationsPerThread; ++i) {
+                TranslationResult result = controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read);
+                if (result.isError() || result.getValue().physicalAddress != TEST_PA) {
+                    failures.fetch_add(1);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    
+    // Every thread misses its own L0 exactly once
+    EXPECT_EQ(failures.load(), 0);
+    EXPECT_EQ(controller->getTranslationCount(), static_cast<uint64_t>(threadCount * translationsPerThread));
+    EXPECT_EQ(controller->getMicroTLBHitCount(), static_cast<uint64_t>(threadCount * (translationsPerThread - 1)));
+}
+
+// A thread alternating between two SMMUs keeps an L0 for each
+TEST_F(SMMUTest, MicroTLBPerSMMUOnOneThread) {
+    std::unique_ptr<SMMU> first = createMicroTLBSMMU(16);
+    std::unique_ptr<SMMU> second = createMicroTLBSMMU(16);
+    setUpMappedStream(*first, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    setUpMappedStream(*second, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA + 0x100000);
+    
+    for (int i = 0; i < 5; ++i) {
+        TranslationResult result = first->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA);
+        result = second->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x100000);
+    }
+    EXPECT_EQ(first->getMicroTLBHitCount(), 4);
+    EXPECT_EQ(second->getMicroTLBHitCount(), 4);
+}
+
+// Range and batch unmaps must drop exactly the affected cached translations
+TEST_F(SMMUTest, UnmapRangeAndPagesInvalidateTLB) {
+    setUpMappedStream(*smmuController, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    PagePermissions perms(true, true, false);
+    for (int i = 1; i < 16; ++i) {
+        ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + i * PAGE_SIZE, TEST_PA + i * PAGE_SIZE, perms).isOk());
+    }
+    for (int i = 0; i < 16; ++i) {
+        ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + i * PAGE_SIZE, AccessType::Read).isOk());
+    }
+    
+    EXPECT_TRUE(smmuController->unmapRange(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_IOVA + 4 * PAGE_SIZE - 1).isOk());
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + i * PAGE_SIZE, AccessType::Read).isError());
+    }
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 4 * PAGE_SIZE, AccessType::Read).isOk());
+    
+    std::vector<IOVA> batch;
+    batch.push_back(TEST_IOVA + 9 * PAGE_SIZE);
+    batch.push_back(TEST_IOVA + 8 * PAGE_SIZE);
+    batch.push_back(TEST_IOVA + 12 * PAGE_SIZE);
+    EXPECT_TRUE(smmuController->unmapPages(TEST_STREAM_ID_1, TEST_PASID_1, batch).isOk());
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 8 * PAGE_SIZE, AccessType::Read).isError());
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 9 * PAGE_SIZE, AccessType::Read).isError());
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 10 * PAGE_SIZE, AccessType::Read).isOk());
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 12 * PAGE_SIZE, AccessType::Read).isError());
+    
+    EXPECT_EQ(smmuController->unmapRange(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, TEST_IOVA).getError(), SMMUError::StreamNotFound);
+}
+
+// ATC_INV with an unaligned start must still drop the covering page
+TEST_F(SMMUTest, ATCInvalidationUnalignedRange) {
+    setUpMappedStream(*smmuController, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    uint64_t misses = smmuController->getCacheMissCount();
+    
+    smmuController->executeATCInvalidationCommand(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x800, TEST_IOVA + 0x900);
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(smmuController->getCacheMissCount(), misses + 1);
+}
+
+// A 2MB block is cached as one TLB entry and remapping a page inside it is coherent
+TEST_F(SMMUTest, BlockMappingTranslation) {
+    setUpMappedStream(*smmuController, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    const IOVA blockIova = TEST_IOVA + BLOCK_SIZE_2MB;
+    const PA blockPA = TEST_PA + BLOCK_SIZE_2MB;
+    PagePermissions perms(true, true, false);
+    ASSERT_TRUE(smmuController->mapBlock(TEST_STREAM_ID_1, TEST_PASID_1, blockIova, blockPA, BLOCK_SIZE_2MB, perms).isOk());
+    EXPECT_EQ(smmuController->mapBlock(TEST_STREAM_ID_1, TEST_PASID_1, blockIova + PAGE_SIZE, blockPA, BLOCK_SIZE_2MB, perms).getError(),
+              SMMUError::InvalidAddress);
+    
+    uint64_t misses = smmuController->getCacheMissCount();
+    for (uint64_t offset = 0; offset < BLOCK_SIZE_2MB; offset += 0x40000) {
+        TranslationResult result = smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, blockIova + offset + 0x10, AccessType::Read);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, blockPA + offset + 0x10);
+    }
+    EXPECT_EQ(smmuController->getCacheMissCount(), misses + 1);
+    
+    // Mapping a page inside the block splits it and invalidates the cached block
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, blockIova + 0x40000, TEST_PA, perms).isOk());
+    EXPECT_EQ(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, blockIova + 0x40008, AccessType::Read).getValue().physicalAddress,
+              TEST_PA + 8);
+    EXPECT_EQ(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, blockIova + 0x80000, AccessType::Read).getValue().physicalAddress,
+              blockPA + 0x80000);
+    
+    ASSERT_TRUE(smmuController->unmapPage(TEST_STREAM_ID_1, TEST_PASID_1, blockIova + 0x80000).isOk());
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, blockIova + 0x80000, AccessType::Read).isError());
+}
+
+// A 64KB-granule stream maps, caches and invalidates whole 64KB pages
+TEST_F(SMMUTest, LargeGranuleTranslation) {
+    const uint64_t granule = granulePageSize(TranslationGranule::Size64KB);
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    config.stage2Enabled = false;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    EXPECT_EQ(smmuController->setStreamGranule(TEST_STREAM_ID_1 + 1, TranslationGranule::Size64KB).getError(),
+              SMMUError::StreamNotFound);
+    ASSERT_TRUE(smmuController->setStreamGranule(TEST_STREAM_ID_1, TranslationGranule::Size64KB).isOk());
+    ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    
+    PagePermissions perms(true, true, false);
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA, perms).isOk());
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + granule, TEST_PA + granule, perms).isOk());
+    
+    // Every 4KB page of the two 64KB pages translates through one TLB entry each
+    uint64_t misses = smmuController->getCacheMissCount();
+    for (uint64_t offset = 0; offset < 2 * granule; offset += PAGE_SIZE) {
+        TranslationResult result = smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + offset + 8, AccessType::Read);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + offset + 8);
+    }
+    EXPECT_EQ(smmuController->getCacheMissCount(), misses + 2);
+    EXPECT_EQ(smmuController->getCacheStatistics().currentSize, 2);
+    
+    // Unmapping through any 4KB page removes the 64KB page and its TLB entry
+    std::vector<IOVA> iovas(1, TEST_IOVA + granule + 0x5000);
+    ASSERT_TRUE(smmuController->unmapPages(TEST_STREAM_ID_1, TEST_PASID_1, iovas).isOk());
+    EXPECT_EQ(smmuController->getCacheStatistics().currentSize, 1);
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + granule, AccessType::Read).isError());
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0xF000, AccessType::Read).isOk());
+}
+
+static void setUpStage2OnlyStream(SMMU& controller, StreamID streamID, VMID vmid, std::shared_ptr<AddressSpace> stage2) {
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = false;
+    config.stage2Enabled = true;
+    config.faultMode = FaultMode::Terminate;
+    ASSERT_TRUE(controller.configureStream(streamID, config).isOk());
+    ASSERT_TRUE(controller.setStreamStage2(streamID, vmid, stage2).isOk());
+    ASSERT_TRUE(controller.enableStream(streamID).isOk());
+}
+
+// Stage-2-only streams of one VM share their cached translations under its VMID
+TEST_F(SMMUTest, VMIDTaggedStage2Sharing) {
+    const VMID vmid = 7;
+    const StreamID firstStream = 0x100;
+    const size_t streamCount = 8;
+    std::shared_ptr<AddressSpace> stage2 = std::make_shared<AddressSpace>();
+    ASSERT_TRUE(stage2->mapPage(TEST_IOVA, TEST_PA, PagePermissions(true, true, false)).isOk());
+    for (size_t i = 0; i < streamCount; ++i) {
+        setUpStage2OnlyStream(*smmuController, firstStream + i, vmid, stage2);
+    }
+    
+    uint64_t hits = smmuController->getCacheHitCount();
+    uint64_t misses = smmuController->getCacheMissCount();
+    for (size_t i = 0; i < streamCount; ++i) {
+        TranslationResult result = smmuController->translate(firstStream + i, 0, TEST_IOVA + 0x10, AccessType::Read);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x10);
+    }
+    EXPECT_EQ(smmuController->getCacheMissCount(), misses + 1);
+    EXPECT_EQ(smmuController->getCacheHitCount(), hits + streamCount - 1);
+    EXPECT_EQ(smmuController->getCacheStatistics().currentSize, 1);
+    
+    // A VMID names one set of Stage-2 tables
+    std::shared_ptr<AddressSpace> otherStage2 = std::make_shared<AddressSpace>();
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage2Enabled = true;
+    config.stage1Enabled = false;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_2, config).isOk());
+    EXPECT_EQ(smmuController->setStreamStage2(TEST_STREAM_ID_2, vmid, otherStage2).getError(),
+              SMMUError::StreamConfigurationError);
+    EXPECT_TRUE(smmuController->setStreamStage2(TEST_STREAM_ID_2, vmid + 1, otherStage2).isOk());
+    
+    // The hypervisor remaps the page, then invalidates the VM's entries by VMID
+    ASSERT_TRUE(stage2->unmapPage(TEST_IOVA).isOk());
+    ASSERT_TRUE(stage2->mapPage(TEST_IOVA, TEST_PA + PAGE_SIZE, PagePermissions(true, true, false)).isOk());
+    CommandEntry command(CommandType::TLBI_S12_VMID, 0, 0, 0, 0);
+    command.vmid = vmid;
+    ASSERT_TRUE(smmuController->submitCommand(command).isOk());
+    smmuController->processCommandQueue();
+    EXPECT_EQ(smmuController->translate(firstStream + 1, 0, TEST_IOVA, AccessType::Read).getValue().physicalAddress,
+              TEST_PA + PAGE_SIZE);
+    
+    // A disabled stream does not see the VM's entries
+    ASSERT_TRUE(smmuController->disableStream(firstStream + 2).isOk());
+    EXPECT_TRUE(smmuController->translate(firstStream + 2, 0, TEST_IOVA, AccessType::Read).isError());
+}
+
+// TLBI_NH_ASID drops only the Stage-1 contexts carrying that ASID
+TEST_F(SMMUTest, ASIDTaggedInvalidation) {
+    setUpMappedStream(*smmuController, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    setUpMappedStream(*smmuController, TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    ASSERT_TRUE(smmuController->setStreamASID(TEST_STREAM_ID_1, TEST_PASID_1, 5).isOk());
+    ASSERT_TRUE(smmuController->setStreamASID(TEST_STREAM_ID_2, TEST_PASID_1, 6).isOk());
+    EXPECT_EQ(smmuController->setStreamASID(TEST_STREAM_ID_1, TEST_PASID_2, 5).getError(), SMMUError::PASIDNotFound);
+    
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    
+    CommandEntry command(CommandType::TLBI_NH_ASID, 0, 0, 0, 0);
+    command.asid = 5;
+    ASSERT_TRUE(smmuController->submitCommand(command).isOk());
+    smmuController->processCommandQueue();
+    
+    uint64_t misses = smmuController->getCacheMissCount();
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(smmuController->getCacheMissCount(), misses + 1);
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(smmuController->getCacheMissCount(), misses + 1);
+}
+
+// Nested translation reuses cached Stage-2 (IPA -> PA) legs across PASIDs
+TEST_F(SMMUTest, Stage2CacheNestedTranslation) {
+    const VMID vmid = 3;
+    const IPA guestPage = 0x80000000;
+    const size_t pasidCount = 4;
+    std::shared_ptr<AddressSpace> stage2 = std::make_shared<AddressSpace>();
+    ASSERT_TRUE(stage2->mapPage(guestPage, TEST_PA, PagePermissions(true, true, false)).isOk());
+    
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    config.stage2Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->setStreamStage2(TEST_STREAM_ID_1, vmid, stage2).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    for (PASID pasid = 1; pasid <= pasidCount + 1; ++pasid) {
+        ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, pasid).isOk());
+        ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, pasid, TEST_IOVA, guestPage,
+                                            PagePermissions(true, true, false)).isOk());
+    }
+    
+    for (PASID pasid = 1; pasid <= pasidCount; ++pasid) {
+        TranslationResult result = smmuController->translate(TEST_STREAM_ID_1, pasid, TEST_IOVA + 0x20, AccessType::Read);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x20);
+    }
+    EXPECT_EQ(smmuController->getStage2CacheMissCount(), 1);
+    EXPECT_EQ(smmuController->getStage2CacheHitCount(), pasidCount - 1);
+    
+    // TLBI_S2_IPA drops only the Stage-2 leg; a PASID not yet in the TLB walks Stage-2 again
+    CommandEntry command(CommandType::TLBI_S2_IPA, 0, 0, guestPage, guestPage + PAGE_MASK);
+    command.vmid = vmid;
+    ASSERT_TRUE(smmuController->submitCommand(command).isOk());
+    smmuController->processCommandQueue();
+    uint64_t tlbMisses = smmuController->getCacheMissCount();
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, 1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(smmuController->getCacheMissCount(), tlbMisses);
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, pasidCount + 1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(smmuController->getStage2CacheMissCount(), 2);
+    
+    // After remapping the guest page, invalidating the VMID refreshes every leg
+    ASSERT_TRUE(stage2->unmapPage(guestPage).isOk());
+    ASSERT_TRUE(stage2->mapPage(guestPage, TEST_PA + PAGE_SIZE, PagePermissions(true, true, false)).isOk());
+    smmuController->invalidateVMIDCache(vmid);
+    EXPECT_EQ(smmuController->translate(TEST_STREAM_ID_1, 2, TEST_IOVA, AccessType::Read).getValue().physicalAddress,
+              TEST_PA + PAGE_SIZE);
+    EXPECT_EQ(smmuController->getStage2CacheMissCount(), 3);
+}
+
+// A PASID bound to a context descriptor walks its tables in physical memory
+TEST_F(SMMUTest, ContextDescriptorTableWalk) {
+    std::shared_ptr<PhysicalMemory> memory = std::make_shared<PhysicalMemory>();
+    smmuController->setPhysicalMemory(memory);
+    EXPECT_EQ(smmuController->getPhysicalMemory(), memory);
+    
+    // Level 0-2 tables at 0x100000-0x102000, then the level 3 page
+    const PA root = 0x100000;
+    const uint64_t pageDescriptor = TEST_PA | 0x3 | (1ULL << 10);
+    ASSERT_TRUE(memory->write64(root, (root + 0x1000) | 0x3).isOk());
+    ASSERT_TRUE(memory->write64(root + 0x1000, (root + 0x2000) | 0x3).isOk());
+    ASSERT_TRUE(memory->write64(root + 0x2000 + ((TEST_IOVA >> 21) & 0x1FF) * 8, (root + 0x3000) | 0x3).isOk());
+    const PA leafSlot = root + 0x3000 + ((TEST_IOVA >> 12) & 0x1FF) * 8;
+    ASSERT_TRUE(memory->write64(leafSlot, pageDescriptor).isOk());
+    
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    EXPECT_EQ(smmuController->setStreamContextDescriptor(TEST_STREAM_ID_1, TEST_PASID_1, ContextDescriptor()).getError(),
+              SMMUError::InvalidConfiguration);
+    ASSERT_TRUE(smmuController->setStreamContextDescriptor(TEST_STREAM_ID_1, TEST_PASID_1,
+                                                           ContextDescriptor(root, 7, SecurityState::NonSecure)).isOk());
+    
+    TranslationResult result = smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x10, AccessType::Read);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x10);
+    EXPECT_EQ(smmuController->getWalkStatistics().walks, 1u);
+    EXPECT_EQ(smmuController->getWalkStatistics().descriptorReads, 4u);
+    
+    // Table edits need a TLB invalidation before they are seen
+    ASSERT_TRUE(memory->write64(leafSlot, pageDescriptor & ~(1ULL << 10)).isOk());
+    EXPECT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    smmuController->invalidateTranslationCache();
+    result = smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read);
+    EXPECT_EQ(result.getError(), SMMUError::AccessFlagFault);
+}
+
+// TLB misses under a cached table prefix skip the upper levels until a
+// TLBI for the ASID drops the walk cache
+TEST_F(SMMUTest, WalkCacheInvalidatedByCommands) {
+    std::shared_ptr<PhysicalMemory> memory = std::make_shared<PhysicalMemory>();
+    smmuController->setPhysicalMemory(memory);
+    const PA root = 0x100000;
+    const ASID asid = 9;
+    ASSERT_TRUE(memory->write64(root, (root + 0x1000) | 0x3).isOk());
+    ASSERT_TRUE(memory->write64(root + 0x1000, (root + 0x2000) | 0x3).isOk());
+    ASSERT_TRUE(memory->write64(root + 0x2000 + ((TEST_IOVA >> 21) & 0x1FF) * 8, (root + 0x3000) | 0x3).isOk());
+    for (uint64_t page = 0; page < 4; ++page) {
+        const PA slot = root + 0x3000 + (((TEST_IOVA >> 12) + page) & 0x1FF) * 8;
+        ASSERT_TRUE(memory->write64(slot, (TEST_PA + page * PAGE_SIZE) | 0x3 | (1ULL << 10)).isOk());
+    }
+    
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(smmuController->setStreamContextDescriptor(TEST_STREAM_ID_1, TEST_PASID_1,
+                                                           ContextDescriptor(root, asid, SecurityState::NonSecure)).isOk());
+    
+    for (uint64_t page = 0; page < 3; ++page) {
+        ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + page * PAGE_SIZE,
+                                              AccessType::Read).isOk());
+    }
+    EXPECT_EQ(smmuController->getWalkCacheMissCount(), 1u);
+    EXPECT_EQ(smmuController->getWalkCacheHitCount(), 2u);
+    EXPECT_EQ(smmuController->getWalkStatistics().descriptorReads, 6u);
+    
+    CommandEntry command(CommandType::TLBI_NH_ASID, 0, 0, 0, 0);
+    command.asid = asid;
+    ASSERT_TRUE(smmuController->submitCommand(command).isOk());
+    smmuController->processCommandQueue();
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 3 * PAGE_SIZE,
+                                          AccessType::Read).isOk());
+    EXPECT_EQ(smmuController->getWalkCacheMissCount(), 2u);
+    EXPECT_EQ(smmuController->getWalkStatistics().descriptorReads, 10u);
+    
+    // A zero-entry walk cache is never probed
+    CacheConfiguration cacheConfig = smmuController->getConfiguration().getCacheConfiguration();
+    cacheConfig.walkCacheEntries = 0;
+    ASSERT_TRUE(smmuController->updateCacheConfiguration(cacheConfig).isOk());
+    smmuController->invalidateTranslationCache();
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(smmuController->getWalkCacheMissCount(), 2u);
+    EXPECT_EQ(smmuController->getWalkStatistics().descriptorReads, 14u);
+}
+
+static std::unique_ptr<SMMU> createAgingSMMU(uint32_t maxAgeMs, bool agingEnabled) {
+    SMMUConfiguration config = SMMUConfiguration::createDefault();
+    CacheConfiguration cacheConfig = config.getCacheConfiguration();
+    cacheConfig.cacheMaxAge = maxAgeMs;
+    cacheConfig.enableCacheAging = agingEnabled;
+    config.setCacheConfiguration(cacheConfig);
+    return std::unique_ptr<SMMU>(new SMMU(config));
+}
+
+// TLB entries expire after cacheMaxAge, measured in coarse age ticks
+TEST_F(SMMUTest, CacheAgingHonorsMaxAge) {
+    std::unique_ptr<SMMU> controller = createAgingSMMU(300, true);  // Three 100ms ticks
+    setUpMappedStream(*controller, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    uint64_t misses = controller->getCacheMissCount();
+    
+    controller->advanceCacheAgeTick(3);
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getCacheMissCount(), misses);
+    
+    controller->advanceCacheAgeTick();
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getCacheMissCount(), misses + 1);
+    
+    // Shortening the maximum age applies to entries already cached
+    CacheConfiguration cacheConfig = controller->getConfiguration().getCacheConfiguration();
+    cacheConfig.cacheMaxAge = 100;
+    ASSERT_TRUE(controller->updateCacheConfiguration(cacheConfig).isOk());
+    controller->advanceCacheAgeTick(2);
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getCacheMissCount(), misses + 2);
+}
+
+// With aging disabled only explicit invalidation removes entries
+TEST_F(SMMUTest, CacheAgingDisabled) {
+    std::unique_ptr<SMMU> controller = createAgingSMMU(100, false);
+    setUpMappedStream(*controller, TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA);
+    
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    uint64_t misses = controller->getCacheMissCount();
+    uint64_t tick = controller->getCacheAgeTick();
+    
+    controller->advanceCacheAgeTick(1000);
+    EXPECT_EQ(controller->getCacheAgeTick(), tick + 1000);
+    controller->performCacheMaintenance();
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getCacheMissCount(), misses);
+    
+    controller->invalidateStreamCache(TEST_STREAM_ID_1);
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getCacheMissCount(), misses + 1);
+}
+
+// Cached translations must not hide writes from the Stage-2 dirty log
+TEST_F(SMMUTest, DirtyTrackingThroughCachedTranslations) {
+    std::unique_ptr<SMMU> controller = createMicroTLBSMMU(16);
+    const IPA guestPage = 0x80000000;
+    std::shared_ptr<AddressSpace> stage2 = std::make_shared<AddressSpace>();
+    stage2->setDirtyTracking(true);
+    ASSERT_TRUE(stage2->mapPage(guestPage, TEST_PA, PagePermissions(true, true, false)).isOk());
+    
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    config.stage2Enabled = true;
+    ASSERT_TRUE(controller->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(controller->setStreamStage2(TEST_STREAM_ID_1, 1, stage2).isOk());
+    ASSERT_TRUE(controller->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(controller->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    ASSERT_TRUE(controller->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, guestPage,
+                                    PagePermissions(true, true, false)).isOk());
+    
+    // Reads fill the caches without dirtying the page
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    }
+    EXPECT_EQ(controller->getMicroTLBHitCount(), 1);
+    EXPECT_EQ(stage2->getAndClearDirtyBitmap(guestPage, guestPage + PAGE_MASK).getValue()[0], 0u);
+    
+    // The first write walks and marks; later writes in the same epoch hit
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Write).isOk());
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Write).isOk());
+    EXPECT_EQ(controller->getMicroTLBHitCount(), 2);
+    EXPECT_EQ(stage2->getAndClearDirtyBitmap(guestPage, guestPage + PAGE_MASK).getValue()[0], 1u);
+    
+    // After the bits are taken, a cached write walks again and re-marks the page
+    TranslationResult write = controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x40, AccessType::Write);
+    ASSERT_TRUE(write.isOk());
+    EXPECT_EQ(write.getValue().physicalAddress, TEST_PA + 0x40);
+    EXPECT_EQ(controller->getMicroTLBHitCount(), 2);
+    EXPECT_EQ(stage2->getAndClearDirtyBitmap(guestPage, guestPage + PAGE_MASK).getValue()[0], 1u);
+    
+    // Collecting another address space's dirty log leaves these cached writes alone
+    AddressSpace other;
+    other.setDirtyTracking(true);
+    ASSERT_TRUE(other.mapPage(guestPage, TEST_PA, PagePermissions(true, true, false)).isOk());
+    ASSERT_TRUE(other.translatePage(guestPage, AccessType::Write).isOk());
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Write).isOk());
+    EXPECT_EQ(other.getAndClearDirtyBitmap(guestPage, guestPage + PAGE_MASK).getValue()[0], 1u);
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Write).isOk());
+    EXPECT_EQ(controller->getMicroTLBHitCount(), 3);
+    EXPECT_EQ(stage2->getAndClearDirtyBitmap(guestPage, guestPage + PAGE_MASK).getValue()[0], 1u);
+    
+    // Reads keep hitting regardless of the dirty log
+    ASSERT_TRUE(controller->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(controller->getMicroTLBHitCount(), 4);
+}
+
+TEST_F(SMMUTest, TranslateBatchMatchesSingleTranslations) {
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    for (StreamID streamID : {TEST_STREAM_ID_1, TEST_STREAM_ID_2}) {
+        ASSERT_TRUE(smmuController->configureStream(streamID, config).isOk());
+        ASSERT_TRUE(smmuController->enableStream(streamID).isOk());
+        ASSERT_TRUE(smmuController->createStreamPASID(streamID, TEST_PASID_1).isOk());
+    }
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA,
+                                        PagePermissions(true, true, false)).isOk());
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + PAGE_SIZE, TEST_PA + 0x10000,
+                                        PagePermissions(true, false, false)).isOk());
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, TEST_PA + 0x20000,
+                                        PagePermissions(true, true, false)).isOk());
+    
+    // Repeated pages, two streams, a read-only page written, an unmapped page
+    // and an unconfigured stream, deliberately out of order
+    std::vector<TranslationRequest> requests;
+    requests.push_back(TranslationRequest(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA + 0x10, AccessType::Read));
+    requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x100, AccessType::Read));
+    requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + PAGE_SIZE + 8, AccessType::Write));
+    requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x200, AccessType::Write));
+    requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + PAGE_SIZE, AccessType::Read));
+    requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 2 * PAGE_SIZE, AccessType::Read));
+    requests.push_back(TranslationRequest(0x3000, TEST_PASID_1, TEST_IOVA, AccessType::Read));
+    requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0xFFF, AccessType::Execute));
+    
+    std::vector<TranslationResult> results(requests.size());
+    smmuController->translateBatch(requests.data(), results.data(), requests.size());
+    
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const TranslationRequest& request = requests[i];
+        TranslationResult expected = smmuController->translate(request.streamID, request.pasid, request.iova,
+                                                               request.accessType, request.securityState);
+        ASSERT_EQ(results[i].isOk(), expected.isOk()) << "request " << i;
+        if (expected.isOk()) {
+            EXPECT_EQ(results[i].getValue().physicalAddress, expected.getValue().physicalAddress) << "request " << i;
+        } else {
+            EXPECT_EQ(results[i].getError(), expected.getError()) << "request " << i;
+        }
+    }
+    EXPECT_EQ(results[1].getValue().physicalAddress, TEST_PA + 0x100);
+    EXPECT_EQ(results[0].getValue().physicalAddress, TEST_PA + 0x20010);
+    EXPECT_FALSE(results[2].isOk());
+    EXPECT_EQ(results[4].getValue().physicalAddress, TEST_PA + 0x10000);
+}
+
+TEST_F(SMMUTest, TranslateBatchTranslatesRepeatedPagesOnce) {
+    ASSERT_TRUE(smmuController->enableCaching(false).isOk());  // Every translation walks
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    for (uint64_t page = 0; page < 4; ++page) {
+        ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + page * PAGE_SIZE,
+                                            TEST_PA + page * PAGE_SIZE, PagePermissions(true, true, false)).isOk());
+    }
+    
+    // A 64-entry scatter-gather list over four pages
+    std::vector<TranslationRequest> requests;
+    for (uint64_t i = 0; i < 64; ++i) {
+        requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + (i % 4) * PAGE_SIZE + i * 16,
+                                              i % 3 == 0 ? AccessType::Write : AccessType::Read));
+    }
+    std::vector<TranslationResult> results(requests.size());
+    smmuController->translateBatch(requests.data(), results.data(), requests.size());
+    
+    for (uint64_t i = 0; i < 64; ++i) {
+        ASSERT_TRUE(results[i].isOk());
+        EXPECT_EQ(results[i].getValue().physicalAddress, TEST_PA + (i % 4) * PAGE_SIZE + i * 16);
+    }
+    
+    // Reused results still count, as 64 translate() calls would
+    EXPECT_EQ(smmuController->getTranslationCount(), 64);
+    
+    smmuController->translateBatch(requests.data(), results.data(), 0);
+    EXPECT_EQ(smmuController->getTranslationCount(), 64);
+}
+
+TEST_F(SMMUTest, TranslateBatchCountsLikeSingleTranslations) {
+    SMMU single;
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    SMMU* controllers[] = {smmuController.get(), &single};
+    for (SMMU* controller : controllers) {
+        ASSERT_TRUE(controller->configureStream(TEST_STREAM_ID_1, config).isOk());
+        ASSERT_TRUE(controller->enableStream(TEST_STREAM_ID_1).isOk());
+        ASSERT_TRUE(controller->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+        ASSERT_TRUE(controller->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA,
+                                        PagePermissions(true, true, false)).isOk());
+    }
+    
+    // Eight reads of one page
+    std::vector<TranslationRequest> requests;
+    for (uint64_t i = 0; i < 8; ++i) {
+        requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + i * 64, AccessType::Read));
+    }
+    std::vector<TranslationResult> results(requests.size());
+    smmuController->translateBatch(requests.data(), results.data(), requests.size());
+    for (size_t i = 0; i < requests.size(); ++i) {
+        ASSERT_TRUE(results[i].isOk());
+        ASSERT_TRUE(single.translate(TEST_STREAM_ID_1, TEST_PASID_1, requests[i].iova, AccessType::Read).isOk());
+    }
+    EXPECT_EQ(smmuController->getTotalTranslations(), 8u);
+    EXPECT_EQ(single.getTotalTranslations(), 8u);
+    
+    // Requests the micro-TLB serves count once each as well
+    smmuController->translateBatch(requests.data(), results.data(), requests.size());
+    EXPECT_EQ(smmuController->getTotalTranslations(), 16u);
+}
+
+TEST_F(SMMUTest, TranslateRangeCoalescesContiguousPages) {
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    PagePermissions perms(true, true, false);
+    
+    // Pages 0-2 contiguous, page 3 elsewhere, page 4 back after page 2, page 6 unmapped
+    PA frames[] = {TEST_PA, TEST_PA + PAGE_SIZE, TEST_PA + 2 * PAGE_SIZE, TEST_PA + 0x100000,
+                   TEST_PA + 0x101000, TEST_PA + 0x102000};
+    for (uint64_t page = 0; page < 6; ++page) {
+        ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + page * PAGE_SIZE,
+                                            frames[page], perms).isOk());
+    }
+    
+    Result<RangeTranslation> result = smmuController->translateRange(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x800,
+                                                                     5 * PAGE_SIZE, AccessType::Read);
+    ASSERT_TRUE(result.isOk());
+    const RangeTranslation& range = result.getValue();
+    EXPECT_FALSE(range.faulted);
+    EXPECT_EQ(range.translatedLength, 5 * PAGE_SIZE);
+    ASSERT_EQ(range.segments.size(), 2u);
+    EXPECT_EQ(range.segments[0].physicalAddress, TEST_PA + 0x800);
+    EXPECT_EQ(range.segments[0].length, 3 * PAGE_SIZE - 0x800);
+    EXPECT_EQ(range.segments[1].physicalAddress, TEST_PA + 0x100000);
+    EXPECT_EQ(range.segments[1].length, 2 * PAGE_SIZE + 0x800);
+    
+    // Translation stops at the first unmapped byte
+    result = smmuController->translateRange(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 4 * PAGE_SIZE,
+                                            4 * PAGE_SIZE, AccessType::Read);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_TRUE(result.getValue().faulted);
+    EXPECT_EQ(result.getValue().faultAddress, TEST_IOVA + 6 * PAGE_SIZE);
+    EXPECT_EQ(result.getValue().faultError,
+              smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 6 * PAGE_SIZE, AccessType::Read).getError());
+    EXPECT_EQ(result.getValue().translatedLength, 2 * PAGE_SIZE);
+    ASSERT_EQ(result.getValue().segments.size(), 1u);
+    EXPECT_EQ(result.getValue().segments[0].physicalAddress, TEST_PA + 0x101000);
+    
+    // Permission faults stop it too
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + PAGE_SIZE, frames[1],
+                                        PagePermissions(true, false, false)).isOk());
+    result = smmuController->translateRange(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, 3 * PAGE_SIZE, AccessType::Write);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_TRUE(result.getValue().faulted);
+    EXPECT_EQ(result.getValue().faultAddress, TEST_IOVA + PAGE_SIZE);
+    EXPECT_EQ(result.getValue().faultError, SMMUError::PagePermissionViolation);
+    
+    // Empty and wrapping ranges
+    result = smmuController->translateRange(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, 0, AccessType::Read);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_TRUE(result.getValue().segments.empty());
+    EXPECT_FALSE(result.getValue().faulted);
+    EXPECT_TRUE(smmuController->translateRange(TEST_STREAM_ID_1, TEST_PASID_1, ~0ULL - PAGE_SIZE,
+                                               2 * PAGE_SIZE, AccessType::Read).isError());
+}
+
+TEST_F(SMMUTest, TranslateRangeStepsOverBlocks) {
+    ASSERT_TRUE(smmuController->enableCaching(false).isOk());  // Every step walks
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    
+    // A 2MB block followed by two pages that continue it physically
+    const uint64_t blockSize = 2 * 1024 * 1024;
+    PagePermissions perms(true, true, false);
+    ASSERT_TRUE(smmuController->mapBlock(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA, blockSize, perms).isOk());
+    for (uint64_t page = 0; page < 2; ++page) {
+        ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + blockSize + page * PAGE_SIZE,
+                                            TEST_PA + blockSize + page * PAGE_SIZE, perms).isOk());
+    }
+    
+    uint64_t before = smmuController->getTranslationCount();
+    Result<RangeTranslation> result = smmuController->translateRange(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x1000,
+                                                                     blockSize + PAGE_SIZE, AccessType::Read);
+    ASSERT_TRUE(result.isOk());
+    ASSERT_EQ(result.getValue().segments.size(), 1u);
+    EXPECT_EQ(result.getValue().segments[0].physicalAddress, TEST_PA + 0x1000);
+    EXPECT_EQ(result.getValue().segments[0].length, blockSize + PAGE_SIZE);
+    
+    // One lookup for the block, one per page after it
+    EXPECT_EQ(smmuController->getTranslationCount() - before, 3u);
+}
+
+TEST_F(SMMUTest, TranslateAsyncMatchesTranslate) {
+    ASSERT_TRUE(smmuController->enableCaching(false).isOk());  // Every request reaches the pool
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    PagePermissions readOnly(true, false, false);
+    for (uint64_t page = 0; page < 16; ++page) {
+        ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + page * PAGE_SIZE,
+                                            TEST_PA + page * PAGE_SIZE, readOnly).isOk());
+    }
+    EXPECT_EQ(smmuController->getAsyncWorkerCount(), 0u);
+    
+    // Reads and writes over mapped pages, two unmapped pages and an unknown stream
+    std::vector<TranslationRequest> requests;
+    for (uint64_t page = 0; page < 18; ++page) {
+        requests.push_back(TranslationRequest(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + page * PAGE_SIZE + 0x10,
+                                              page % 4 == 3 ? AccessType::Write : AccessType::Read));
+    }
+    requests.push_back(TranslationRequest(TEST_STREAM_ID_2, TEST_PASID_1, TEST_IOVA, AccessType::Read));
+    
+    std::mutex resultsMutex;
+    std::vector<TranslationResult> results(requests.size());
+    std::vector<bool> completed(requests.size(), false);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        ASSERT_TRUE(smmuController->translateAsync(requests[i],
+            [&, i](const TranslationRequest& request, const TranslationResult& result) {
+                EXPECT_EQ(request.iova, requests[i].iova);
+                std::lock_guard<std::mutex> lock(resultsMutex);
+                results[i] = result;
+                completed[i] = true;
+            }).isOk());
+    }
+    smmuController->waitForAsyncTranslations();
+    EXPECT_EQ(smmuController->getAsyncWorkerCount(), smmuController->getConfiguration().getResourceLimits().maxThreadCount);
+    
+    for (size_t i = 0; i < requests.size(); ++i) {
+        ASSERT_TRUE(completed[i]);
+        TranslationResult expected = smmuController->translate(requests[i].streamID, requests[i].pasid,
+                                                               requests[i].iova, requests[i].accessType);
+        ASSERT_EQ(results[i].isOk(), expected.isOk()) << "request " << i;
+        if (expected.isOk()) {
+            EXPECT_EQ(results[i].getValue().physicalAddress, expected.getValue().physicalAddress);
+        } else {
+            EXPECT_EQ(results[i].getError(), expected.getError());
+        }
+    }
+    
+    // The pool follows maxThreadCount
+    ResourceLimits limits;
+    limits.maxThreadCount = 2;
+    ASSERT_TRUE(smmuController->updateResourceLimits(limits).isOk());
+    EXPECT_EQ(smmuController->getAsyncWorkerCount(), 2u);
+    
+    std::atomic<size_t> completions(0);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        ASSERT_TRUE(smmuController->translateAsync(requests[i],
+            [&](const TranslationRequest&, const TranslationResult&) { completions.fetch_add(1); }).isOk());
+    }
+    smmuController->waitForAsyncTranslations();
+    EXPECT_EQ(completions.load(), requests.size());
+}
+
+TEST_F(SMMUTest, TranslateAsyncCompletesCacheHitsInline) {
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    PagePermissions perms(true, true, false);
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA, perms).isOk());
+    ASSERT_TRUE(smmuController->translate(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read).isOk());
+    
+    TranslationRequest request(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA + 0x20, AccessType::Read);
+    EXPECT_EQ(smmuController->translateAsync(request, TranslationCallback()).getError(),
+              SMMUError::InvalidConfiguration);
+    
+    bool completed = false;
+    std::thread::id completedOn;
+    ASSERT_TRUE(smmuController->translateAsync(request,
+        [&](const TranslationRequest&, const TranslationResult& result) {
+            ASSERT_TRUE(result.isOk());
+            EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + 0x20);
+            completed = true;
+            completedOn = std::this_thread::get_id();
+        }).isOk());
+    EXPECT_TRUE(completed);
+    EXPECT_EQ(completedOn, std::this_thread::get_id());
+    EXPECT_EQ(smmuController->getAsyncWorkerCount(), 0u);
+}
+
+TEST_F(SMMUTest, TranslateAsyncTimesOutQueuedRequests) {
+    ASSERT_TRUE(smmuController->enableCaching(false).isOk());
+    ResourceLimits limits;
+    limits.maxThreadCount = 1;
+    limits.timeoutMs = 10;  // The shortest allowed
+    ASSERT_TRUE(smmuController->updateResourceLimits(limits).isOk());
+    
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    PagePermissions perms(true, true, false);
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA, perms).isOk());
+    
+    // The only worker is held by the first callback while the second request waits
+    TranslationRequest request(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read);
+    ASSERT_TRUE(smmuController->translateAsync(request,
+        [](const TranslationRequest&, const TranslationResult&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }).isOk());
+    TranslationResult queued;
+    ASSERT_TRUE(smmuController->translateAsync(request,
+        [&](const TranslationRequest&, const TranslationResult& result) { queued = result; }).isOk());
+    smmuController->waitForAsyncTranslations();
+    
+    ASSERT_TRUE(queued.isError());
+    EXPECT_EQ(queued.getError(), SMMUError::Timeout);
+    EXPECT_EQ(smmuController->getAsyncWorkerCount(), 1u);
+}
+
+TEST_F(SMMUTest, TranslateAsyncTimesOutWhileWorkersAreBusy) {
+    ASSERT_TRUE(smmuController->enableCaching(false).isOk());
+    ResourceLimits limits;
+    limits.maxThreadCount = 1;
+    limits.timeoutMs = 10;
+    ASSERT_TRUE(smmuController->updateResourceLimits(limits).isOk());
+    
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    ASSERT_TRUE(smmuController->configureStream(TEST_STREAM_ID_1, config).isOk());
+    ASSERT_TRUE(smmuController->enableStream(TEST_STREAM_ID_1).isOk());
+    ASSERT_TRUE(smmuController->createStreamPASID(TEST_STREAM_ID_1, TEST_PASID_1).isOk());
+    PagePermissions perms(true, true, false);
+    ASSERT_TRUE(smmuController->mapPage(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, TEST_PA, perms).isOk());
+    
+    // The only worker stays blocked until the queued request has failed, so
+    // the timeout cannot come from the worker dequeuing it
+    std::atomic<bool> release(false);
+    TranslationRequest request(TEST_STREAM_ID_1, TEST_PASID_1, TEST_IOVA, AccessType::Read);
+    ASSERT_TRUE(smmuController->translateAsync(request,
+        [&](const TranslationRequest&, const TranslationResult&) {
+            for (int i = 0; i < 5000 && !release.load(); ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }).isOk());
+    
+    std::atomic<bool> failed(false);
+    TranslationResult queued;
+    std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point completedAt;
+    ASSERT_TRUE(smmuController->translateAsync(request,
+        [&](const TranslationRequest&, const TranslationResult& result) {
+            queued = result;
+            completedAt = std::chrono::steady_clock::now();
+            failed.store(true);
+        }).isOk());
+    for (int i = 0; i < 2000 && !failed.load(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    bool failedWhileBlocked = failed.load();
+    release.store(true);
+    smmuController->waitForAsyncTranslations();
+    
+    ASSERT_TRUE(failedWhileBlocked);
+    ASSERT_TRUE(queued.isError());
+    EXPECT_EQ(queued.getError(), SMMUError::Timeout);
+    EXPECT_GE(completedAt - submitted, std::chrono::milliseconds(10));
+    EXPECT_LT(completedAt - submitted, std::chrono::milliseconds(1000));
+}
+
 } // namespace test
 } // namespace smmu
\ No newline at end of file
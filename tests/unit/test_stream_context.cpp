@@ -3,6 +3,8 @@
 
 #include <gtest/gtest.h>
 #include "smmu/stream_context.h"
+#include "smmu/stream_table.h"
+#include "smmu/pasid_table.h"
 #include "smmu/types.h"
 #include <thread>
 #include <vector>
@@ -164,6 +166,29 @@ TEST_F(StreamContextTest, PageUnmapping) {
     EXPECT_TRUE(afterUnmap.isError());
 }
 
+// Test range and batch unmapping
+TEST_F(StreamContextTest, RangeAndBatchUnmapping) {
+    EXPECT_TRUE(streamContext->createPASID(TEST_PASID_1));
+    PagePermissions perms(true, true, false);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(streamContext->mapPage(TEST_PASID_1, TEST_IOVA + i * PAGE_SIZE, TEST_PA + i * PAGE_SIZE, perms));
+    }
+    
+    // Inclusive end: pages 0-2 go, page 3 stays
+    EXPECT_TRUE(streamContext->unmapRange(TEST_PASID_1, TEST_IOVA, TEST_IOVA + 2 * PAGE_SIZE + 1));
+    EXPECT_TRUE(streamContext->translate(TEST_PASID_1, TEST_IOVA + 2 * PAGE_SIZE, AccessType::Read).isError());
+    EXPECT_TRUE(streamContext->translate(TEST_PASID_1, TEST_IOVA + 3 * PAGE_SIZE, AccessType::Read).isOk());
+    
+    std::vector<IOVA> batch;
+    batch.push_back(TEST_IOVA + 5 * PAGE_SIZE);
+    batch.push_back(TEST_IOVA + 7 * PAGE_SIZE);
+    EXPECT_TRUE(streamContext->unmapPages(TEST_PASID_1, batch));
+    EXPECT_TRUE(streamContext->translate(TEST_PASID_1, TEST_IOVA + 5 * PAGE_SIZE, AccessType::Read).isError());
+    EXPECT_TRUE(streamContext->translate(TEST_PASID_1, TEST_IOVA + 6 * PAGE_SIZE, AccessType::Read).isOk());
+    
+    EXPECT_FALSE(streamContext->unmapRange(TEST_PASID_2, TEST_IOVA, TEST_IOVA + PAGE_SIZE));
+}
+
 // Test unmapping from non-existent PASID
 TEST_F(StreamContextTest, UnmapNonExistentPASID) {
     // Should return false but not crash
@@ -2230,5 +2255,253 @@ TEST_F(StreamContextTest, StatisticsAccuracyValidation) {
     EXPECT_GT(finalStats.lastAccessTimestamp, initialStats.creationTimestamp);
 }
 
+// Test translation descriptor publication, invalidation and prefetch
+TEST_F(StreamContextTest, TranslationDescriptorCache) {
+    // Constructor publishes a bypass descriptor
+    EXPECT_TRUE(streamContext->isTranslationDescriptorCached());
+    std::shared_ptr<const TranslationDescriptor> initial = streamContext->getTranslationDescriptor();
+    EXPECT_EQ(initial->mode, TranslationDescriptor::Mode::Bypass);
+    
+    // Configuration updates publish a new descriptor; the old one is unchanged
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    config.stage2Enabled = false;
+    config.faultMode = FaultMode::Terminate;
+    EXPECT_TRUE(streamContext->updateConfiguration(config));
+    EXPECT_TRUE(streamContext->isTranslationDescriptorCached());
+    std::shared_ptr<const TranslationDescriptor> stage1 = streamContext->getTranslationDescriptor();
+    EXPECT_NE(stage1, initial);
+    EXPECT_EQ(stage1->mode, TranslationDescriptor::Mode::Stage1Only);
+    EXPECT_EQ(initial->mode, TranslationDescriptor::Mode::Bypass);
+    EXPECT_EQ(streamContext->getTranslationDescriptor(), stage1);
+    
+    // PASID changes keep it; they show through its PASID table
+    EXPECT_TRUE(streamContext->createPASID(TEST_PASID_1));
+    EXPECT_TRUE(streamContext->isTranslationDescriptorCached());
+    EXPECT_EQ(streamContext->getTranslationDescriptor(), stage1);
+    EXPECT_NE(stage1->findStage1AddressSpace(TEST_PASID_1), nullptr);
+    EXPECT_EQ(stage1->findStage1AddressSpace(TEST_PASID_2), nullptr);
+    
+    // Stage changes drop it; prefetch rebuilds it
+    streamContext->setStage1Enabled(true);
+    EXPECT_FALSE(streamContext->isTranslationDescriptorCached());
+    streamContext->prefetchTranslationDescriptor();
+    EXPECT_TRUE(streamContext->isTranslationDescriptorCached());
+    std::shared_ptr<const TranslationDescriptor> withPASID = streamContext->getTranslationDescriptor();
+    EXPECT_NE(withPASID, stage1);
+    EXPECT_NE(withPASID->findStage1AddressSpace(TEST_PASID_1), nullptr);
+    
+    // Translation against the descriptor matches the locked path
+    EXPECT_TRUE(streamContext->enableStream());
+    PagePermissions perms(true, false, false);
+    EXPECT_TRUE(streamContext->mapPage(TEST_PASID_1, TEST_IOVA, TEST_PA, perms));
+    std::shared_ptr<const TranslationDescriptor> enabled = streamContext->getTranslationDescriptor();
+    EXPECT_TRUE(enabled->streamEnabled);
+    TranslationResult result = streamContext->translate(*enabled, TEST_PASID_1, TEST_IOVA, AccessType::Read,
+                                                        SecurityState::NonSecure);
+    ASSERT_TRUE(result.isOk());
+    EXPECT_EQ(result.getValue().physicalAddress, TEST_PA);
+    
+    // A disabled stream faults through the descriptor published by disableStream
+    EXPECT_TRUE(streamContext->disableStream());
+    TranslationResult disabled = streamContext->translate(*streamContext->getTranslationDescriptor(), TEST_PASID_1,
+                                                          TEST_IOVA, AccessType::Read, SecurityState::NonSecure);
+    ASSERT_TRUE(disabled.isError());
+    EXPECT_EQ(disabled.getError(), SMMUError::StreamDisabled);
+    
+    StreamStatistics stats = streamContext->getStreamStatistics();
+    EXPECT_EQ(stats.translationCount, 2);
+    EXPECT_EQ(stats.faultCount, 1);
+}
+
+// Cloning a PASID copies its mappings; afterwards the two diverge
+TEST_F(StreamContextTest, ClonePASID) {
+    PagePermissions perms(true, true, false);
+    EXPECT_TRUE(streamContext->createPASID(TEST_PASID_1));
+    EXPECT_TRUE(streamContext->mapPage(TEST_PASID_1, TEST_IOVA, TEST_PA, perms));
+    
+    EXPECT_TRUE(streamContext->clonePASID(TEST_PASID_1, TEST_PASID_2));
+    EXPECT_TRUE(streamContext->hasPASID(TEST_PASID_2));
+    EXPECT_NE(streamContext->getPASIDAddressSpace(TEST_PASID_1), streamContext->getPASIDAddressSpace(TEST_PASID_2));
+    EXPECT_TRUE(streamContext->getPASIDAddressSpace(TEST_PASID_2)->isPageMapped(TEST_IOVA).getValue());
+    
+    EXPECT_TRUE(streamContext->unmapPage(TEST_PASID_1, TEST_IOVA));
+    EXPECT_TRUE(streamContext->mapPage(TEST_PASID_2, TEST_IOVA + PAGE_SIZE, TEST_PA, perms));
+    EXPECT_FALSE(streamContext->getPASIDAddressSpace(TEST_PASID_1)->isPageMapped(TEST_IOVA).getValue());
+    EXPECT_TRUE(streamContext->getPASIDAddressSpace(TEST_PASID_2)->isPageMapped(TEST_IOVA).getValue());
+    EXPECT_FALSE(streamContext->getPASIDAddressSpace(TEST_PASID_1)->isPageMapped(TEST_IOVA + PAGE_SIZE).getValue());
+    
+    // The source must exist and the target must not
+    EXPECT_EQ(streamContext->clonePASID(TEST_PASID_1, TEST_PASID_2).getError(), SMMUError::PASIDAlreadyExists);
+    EXPECT_EQ(streamContext->clonePASID(0x99, 0x9A).getError(), SMMUError::PASIDNotFound);
+    EXPECT_EQ(streamContext->clonePASID(TEST_PASID_1, MAX_PASID + 1).getError(), SMMUError::InvalidPASID);
+    EXPECT_EQ(streamContext->getStreamStatistics().pasidCount, 2);
+}
+
+TEST_F(StreamContextTest, StreamTableFormats) {
+    // Small tables are one linear array of STEs
+    StreamTable linear(64);
+    EXPECT_EQ(linear.getFormat(), StreamTableFormat::Linear);
+    EXPECT_EQ(linear.getTableSize(), 64u);
+    StreamContext* inserted = linear.insert(5, std::unique_ptr<StreamContext>(new StreamContext()));
+    EXPECT_EQ(linear.find(5), inserted);
+    EXPECT_EQ(linear.find(6), nullptr);
+    EXPECT_EQ(linear.getLevel2TableCount(), 0u);
+    
+    // 2-level tables allocate an L2 table per 2^SPLIT StreamIDs in use
+    StreamTable twoLevel(65536);
+    EXPECT_EQ(twoLevel.getFormat(), StreamTableFormat::TwoLevel);
+    EXPECT_EQ(twoLevel.getLevel2TableCount(), 0u);
+    twoLevel.insert(0x1000, std::unique_ptr<StreamContext>(new StreamContext()));
+    twoLevel.insert(0x10FF, std::unique_ptr<StreamContext>(new StreamContext()));
+    twoLevel.insert(0x2000, std::unique_ptr<StreamContext>(new StreamContext()));
+    EXPECT_EQ(twoLevel.getLevel2TableCount(), 2u);
+    EXPECT_NE(twoLevel.find(0x10FF), nullptr);
+    EXPECT_EQ(twoLevel.find(0x1100), nullptr);
+    EXPECT_EQ(twoLevel.find(0x3000), nullptr);
+    EXPECT_EQ(twoLevel.size(), 3u);
+    
+    EXPECT_TRUE(twoLevel.remove(0x1000));
+    EXPECT_FALSE(twoLevel.remove(0x1000));
+    EXPECT_EQ(twoLevel.find(0x1000), nullptr);
+    EXPECT_EQ(twoLevel.size(), 2u);
+}
+
+TEST_F(StreamContextTest, PASIDTableEntries) {
+    PASIDTable table;
+    EXPECT_EQ(table.find(0), nullptr);
+    EXPECT_EQ(table.find(MAX_PASID), nullptr);
+    
+    // PASIDs far apart each get their own L2 table; the L1 table grows to cover them
+    std::shared_ptr<AddressSpace> addressSpace = std::make_shared<AddressSpace>();
+    table.publish(1, addressSpace);
+    ContextDescriptor contextDescriptor(0x80000000ULL, 7, SecurityState::NonSecure);
+    table.publish(MAX_PASID, contextDescriptor);
+    ASSERT_NE(table.find(1), nullptr);
+    EXPECT_EQ(table.find(1)->addressSpace, addressSpace);
+    ASSERT_NE(table.find(MAX_PASID), nullptr);
+    EXPECT_EQ(table.find(MAX_PASID)->addressSpace, nullptr);
+    EXPECT_EQ(table.find(MAX_PASID)->contextDescriptor.asid, 7);
+    EXPECT_EQ(table.find(2), nullptr);
+    EXPECT_EQ(table.find(MAX_PASID - 1), nullptr);
+    
+    // Replacing an entry publishes a new one
+    const PASIDTable::Entry* previous = table.find(1);
+    table.publish(1, contextDescriptor);
+    EXPECT_NE(table.find(1), previous);
+    EXPECT_EQ(table.find(1)->addressSpace, nullptr);
+    
+    table.remove(1);
+    EXPECT_EQ(table.find(1), nullptr);
+    EXPECT_NE(table.find(MAX_PASID), nullptr);
+    table.clear();
+    EXPECT_EQ(table.find(MAX_PASID), nullptr);
+}
+
+// A PASID change costs one CD, not a copy of every PASID of the stream
+TEST_F(StreamContextTest, PASIDChangesKeepTranslationDescriptor) {
+    StreamConfig config;
+    config.translationEnabled = true;
+    config.stage1Enabled = true;
+    EXPECT_TRUE(streamContext->updateConfiguration(config));
+    EXPECT_TRUE(streamContext->enableStream());
+    std::shared_ptr<const TranslationDescriptor> descriptor = streamContext->getTranslationDescriptor();
+    
+    PagePermissions perms(true, false, false);
+    for (PASID pasid = 1; pasid <= 256; ++pasid) {
+        ASSERT_TRUE(streamContext->createPASID(pasid));
+        ASSERT_TRUE(streamContext->mapPage(pasid, TEST_IOVA, TEST_PA + pasid * PAGE_SIZE, perms));
+        TranslationResult result = streamContext->translate(pasid, TEST_IOVA, AccessType::Read);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA + pasid * PAGE_SIZE);
+    }
+    EXPECT_TRUE(streamContext->clonePASID(1, 1000));
+    EXPECT_TRUE(streamContext->removePASID(2));
+    EXPECT_EQ(streamContext->getTranslationDescriptor(), descriptor);
+    
+    EXPECT_TRUE(streamContext->translate(1000, TEST_IOVA, AccessType::Read).isOk());
+    EXPECT_EQ(streamContext->translate(2, TEST_IOVA, AccessType::Read).getError(), SMMUError::PASIDNotFound);
+    
+    // Binding a PASID to tables in memory replaces its AddressSpace
+    ContextDescriptor contextDescriptor(0x80000000ULL, 3, SecurityState::NonSecure);
+    EXPECT_TRUE(streamContext->setContextDescriptor(3, contextDescriptor));
+    EXPECT_EQ(descriptor->findStage1AddressSpace(3), nullptr);
+    EXPECT_EQ(streamContext->translate(3, TEST_IOVA, AccessType::Read).getError(), SMMUError::ConfigurationError);
+    
+    EXPECT_TRUE(streamContext->clearAllPASIDs());
+    EXPECT_EQ(descriptor->findStage1AddressSpace(1), nullptr);
+}
+
+TEST_F(StreamContextTest, StreamTableOverflowAndResize) {
+    StreamTable table(256);
+    StreamContext* low = table.insert(0x10, std::unique_ptr<StreamContext>(new StreamContext()));
+    StreamContext* high = table.insert(0xFFFFFFFF, std::unique_ptr<StreamContext>(new StreamContext()));
+    StreamContext* middle = table.insert(0x8000, std::unique_ptr<StreamContext>(new StreamContext()));
+    
+    // StreamIDs past the table are still found
+    EXPECT_EQ(table.find(0xFFFFFFFF), high);
+    EXPECT_EQ(table.find(0x8000), middle);
+    EXPECT_EQ(table.find(0x8001), nullptr);
+    
+    // Growing moves them into the table; shrinking moves them back out
+    table.resize(1u << 20);
+    EXPECT_EQ(table.getFormat(), StreamTableFormat::TwoLevel);
+    EXPECT_EQ(table.find(0x10), low);
+    EXPECT_EQ(table.find(0x8000), middle);
+    EXPECT_EQ(table.find(0xFFFFFFFF), high);
+    EXPECT_EQ(table.getLevel2TableCount(), 2u);
+    
+    table.resize(16);
+    EXPECT_EQ(table.getFormat(), StreamTableFormat::Linear);
+    EXPECT_EQ(table.find(0x10), low);
+    EXPECT_EQ(table.find(0x8000), middle);
+    
+    std::vector<StreamID> visited;
+    table.forEach([&visited](StreamID streamID, StreamContext*) {
+        visited.push_back(streamID);
+    });
+    EXPECT_EQ(visited.size(), 3u);
+    
+    table.clear();
+    EXPECT_EQ(table.size(), 0u);
+    EXPECT_EQ(table.find(0x10), nullptr);
+    EXPECT_EQ(table.find(0xFFFFFFFF), nullptr);
+}
+
+TEST_F(StreamContextTest, StreamTableFindDuringResize) {
+    // Stream 150 moves between the overflow map and the table on every resize;
+    // a reader must find it whichever layout it loaded
+    StreamTable table(100);
+    StreamContext* moving = table.insert(150, std::unique_ptr<StreamContext>(new StreamContext()));
+    StreamContext* fixed = table.insert(50, std::unique_ptr<StreamContext>(new StreamContext()));
+    
+    std::atomic<bool> done(false);
+    std::atomic<int> misses(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; ++t) {
+        readers.push_back(std::thread([&]() {
+            while (!done.load()) {
+                EpochGuard guard;
+                if (table.find(150) != moving || table.find(50) != fixed) {
+                    misses.fetch_add(1);
+                }
+            }
+        }));
+    }
+    
+    for (int i = 0; i < 2000; ++i) {
+        table.resize(i % 2 == 0 ? 200 : 100);
+        if (i % 64 == 0) {
+            std::this_thread::yield();
+        }
+    }
+    done.store(true);
+    for (size_t t = 0; t < readers.size(); ++t) {
+        readers[t].join();
+    }
+    EXPECT_EQ(misses.load(), 0);
+}
+
 } // namespace test
 } // namespace smmu
\ No newline at end of file
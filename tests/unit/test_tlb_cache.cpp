@@ -357,5 +357,413 @@ TEST_F(TLBCacheTest, CacheReset) {
     EXPECT_EQ(tlbCache->getHitRate(), 0.0);
 }
 
+// Test sharded (lock-striped) cache construction and basic operation
+TEST_F(TLBCacheTest, ShardedCacheOperations) {
+    TLBCache shardedCache(256, 8);
+    PagePermissions perms(true, true, false);
+    
+    EXPECT_EQ(shardedCache.getShardCount(), 8);
+    EXPECT_EQ(shardedCache.getCapacity(), 256);
+    
+    // Spread entries over several streams and PASIDs
+    for (int i = 0; i < 64; ++i) {
+        TLBEntry entry = createTLBEntry(0x1000 + (i % 4), i % 2,
+                                       TEST_IOVA_1 + i * PAGE_SIZE,
+                                       TEST_PA_1 + i * PAGE_SIZE, perms);
+        shardedCache.insert(entry);
+    }
+    EXPECT_EQ(shardedCache.getSize(), 64);
+    
+    for (int i = 0; i < 64; ++i) {
+        Result<TLBEntry> result = shardedCache.lookupEntry(0x1000 + (i % 4), i % 2,
+                                                           TEST_IOVA_1 + i * PAGE_SIZE);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA_1 + i * PAGE_SIZE);
+    }
+    
+    // Stream and PASID invalidation must reach every shard
+    shardedCache.invalidateStream(0x1000);
+    EXPECT_EQ(shardedCache.getSize(), 48);
+    shardedCache.invalidatePASID(0x1001, 1);
+    EXPECT_EQ(shardedCache.getSize(), 32);
+    EXPECT_TRUE(shardedCache.lookupEntry(0x1000, 0, TEST_IOVA_1).isError());
+    EXPECT_TRUE(shardedCache.lookupEntry(0x1001, 1, TEST_IOVA_1 + PAGE_SIZE).isError());
+    EXPECT_TRUE(shardedCache.lookupEntry(0x1002, 0, TEST_IOVA_1 + 2 * PAGE_SIZE).isOk());
+    
+    shardedCache.invalidateBySecurityState(SecurityState::NonSecure);
+    EXPECT_EQ(shardedCache.getSize(), 0);
+}
+
+// Test that aggregate statistics cover all shards
+TEST_F(TLBCacheTest, ShardedCacheAggregateStatistics) {
+    TLBCache shardedCache(128, 4);
+    PagePermissions perms(true, false, false);
+    
+    for (int i = 0; i < 16; ++i) {
+        shardedCache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID,
+                                           TEST_IOVA_1 + i * PAGE_SIZE,
+                                           TEST_PA_1 + i * PAGE_SIZE, perms));
+    }
+    for (int i = 0; i < 16; ++i) {
+        shardedCache.lookupEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + i * PAGE_SIZE);  // Hit
+        shardedCache.lookupEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_2 + i * PAGE_SIZE);  // Miss
+    }
+    
+    TLBCache::CacheStatistics stats = shardedCache.getAtomicStatistics();
+    EXPECT_EQ(stats.hitCount, 16);
+    EXPECT_EQ(stats.missCount, 16);
+    EXPECT_EQ(stats.totalLookups, 32);
+    EXPECT_NEAR(stats.hitRate, 0.5, 0.01);
+    EXPECT_EQ(stats.currentSize, 16);
+    EXPECT_EQ(stats.maxSize, 128);
+    
+    shardedCache.resetStatistics();
+    EXPECT_EQ(shardedCache.getTotalLookups(), 0);
+}
+
+// Test that capacity limits hold across shards, including after resizing
+TEST_F(TLBCacheTest, ShardedCacheCapacity) {
+    TLBCache shardedCache(64, 4);
+    PagePermissions perms(true, true, false);
+    
+    for (int i = 0; i < 1000; ++i) {
+        shardedCache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID,
+                                           TEST_IOVA_1 + i * PAGE_SIZE,
+                                           TEST_PA_1 + i * PAGE_SIZE, perms));
+    }
+    EXPECT_LE(shardedCache.getSize(), 64);
+    
+    shardedCache.setMaxSize(16);
+    EXPECT_EQ(shardedCache.getCapacity(), 16);
+    EXPECT_LE(shardedCache.getSize(), 16);
+    
+    // Shard count is rounded up to a power of two
+    TLBCache roundedCache(64, 3);
+    EXPECT_EQ(roundedCache.getShardCount(), 4);
+}
+
+// Test that single-entry invalidation also drops secondary index references
+TEST_F(TLBCacheTest, InvalidateThenBulkInvalidate) {
+    PagePermissions perms(true, true, false);
+    tlbCache->insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1, TEST_PA_1, perms));
+    tlbCache->insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_2, TEST_PA_2, perms));
+    
+    tlbCache->invalidate(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1);
+    tlbCache->invalidateStream(TEST_STREAM_ID);
+    
+    EXPECT_EQ(tlbCache->getSize(), 0);
+    EXPECT_EQ(tlbCache->lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_2), nullptr);
+}
+
+// Test the flat set-associative backend through the TLBCache interface
+TEST_F(TLBCacheTest, SetAssociativeBackendOperations) {
+    TLBCache flatCache(256, 1, TLBBackend::SetAssociative);
+    PagePermissions perms(true, true, false);
+    
+    EXPECT_EQ(flatCache.getBackend(), TLBBackend::SetAssociative);
+    EXPECT_EQ(flatCache.getCapacity(), 256);
+    
+    for (int i = 0; i < 32; ++i) {
+        flatCache.insert(createTLBEntry(0x1000 + (i % 2), i % 4,
+                                        TEST_IOVA_1 + i * PAGE_SIZE,
+                                        TEST_PA_1 + i * PAGE_SIZE, perms));
+    }
+    EXPECT_EQ(flatCache.getSize(), 32);
+    
+    for (int i = 0; i < 32; ++i) {
+        Result<TLBEntry> result = flatCache.lookupEntry(0x1000 + (i % 2), i % 4,
+                                                        TEST_IOVA_1 + i * PAGE_SIZE);
+        ASSERT_TRUE(result.isOk());
+        EXPECT_EQ(result.getValue().physicalAddress, TEST_PA_1 + i * PAGE_SIZE);
+    }
+    
+    // Re-inserting the same key updates in place
+    flatCache.insert(createTLBEntry(0x1000, 0, TEST_IOVA_1, TEST_PA_2, perms));
+    EXPECT_EQ(flatCache.getSize(), 32);
+    EXPECT_EQ(flatCache.lookup(0x1000, 0, TEST_IOVA_1)->physicalAddress, TEST_PA_2);
+    
+    // Security state is part of the tag
+    EXPECT_EQ(flatCache.lookup(0x1000, 0, TEST_IOVA_1, SecurityState::Secure), nullptr);
+    
+    flatCache.invalidate(0x1000, 0, TEST_IOVA_1);
+    EXPECT_EQ(flatCache.getSize(), 31);
+    EXPECT_EQ(flatCache.lookup(0x1000, 0, TEST_IOVA_1), nullptr);
+}
+
+// Test tag-scan invalidation in the set-associative backend
+TEST_F(TLBCacheTest, SetAssociativeBackendInvalidation) {
+    TLBCache flatCache(512, 4, TLBBackend::SetAssociative);
+    PagePermissions perms(true, false, false);
+    
+    for (int i = 0; i < 64; ++i) {
+        flatCache.insert(createTLBEntry(0x1000 + (i % 4), i % 2,
+                                        TEST_IOVA_1 + i * PAGE_SIZE,
+                                        TEST_PA_1 + i * PAGE_SIZE, perms));
+    }
+    EXPECT_EQ(flatCache.getSize(), 64);
+    
+    flatCache.invalidateStream(0x1000);
+    EXPECT_EQ(flatCache.getSize(), 48);
+    flatCache.invalidatePASID(0x1001, 1);
+    EXPECT_EQ(flatCache.getSize(), 32);
+    EXPECT_TRUE(flatCache.lookupEntry(0x1002, 0, TEST_IOVA_1 + 2 * PAGE_SIZE).isOk());
+    
+    flatCache.invalidateBySecurityState(SecurityState::Secure);
+    EXPECT_EQ(flatCache.getSize(), 32);
+    flatCache.invalidateBySecurityState(SecurityState::NonSecure);
+    EXPECT_EQ(flatCache.getSize(), 0);
+}
+
+// Test range invalidation through the ordered per-(stream, PASID) index
+TEST_F(TLBCacheTest, InvalidateRange) {
+    PagePermissions perms(true, false, false);
+    TLBCache shardedCache(1024, 4);
+    for (int i = 0; i < 32; ++i) {
+        shardedCache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + i * PAGE_SIZE, TEST_PA_1 + i * PAGE_SIZE, perms));
+        shardedCache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID + 1, TEST_IOVA_1 + i * PAGE_SIZE, TEST_PA_1 + i * PAGE_SIZE, perms));
+    }
+    TLBEntry secureEntry = createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 4 * PAGE_SIZE, TEST_PA_2, perms);
+    secureEntry.securityState = SecurityState::Secure;
+    shardedCache.insert(secureEntry);
+    EXPECT_EQ(shardedCache.getSize(), 65);
+    
+    // Unaligned bounds: every page overlapping [start, end] goes, in all security states
+    shardedCache.invalidateRange(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 4 * PAGE_SIZE + 0x10, TEST_IOVA_1 + 11 * PAGE_SIZE + 1);
+    EXPECT_EQ(shardedCache.getSize(), 56);
+    EXPECT_NE(shardedCache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 3 * PAGE_SIZE), nullptr);
+    EXPECT_EQ(shardedCache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 4 * PAGE_SIZE), nullptr);
+    EXPECT_EQ(shardedCache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 11 * PAGE_SIZE), nullptr);
+    EXPECT_NE(shardedCache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 12 * PAGE_SIZE), nullptr);
+    EXPECT_NE(shardedCache.lookup(TEST_STREAM_ID, TEST_PASID + 1, TEST_IOVA_1 + 4 * PAGE_SIZE), nullptr);
+    
+    // A huge range costs only the cached entries it covers
+    shardedCache.invalidateRange(TEST_STREAM_ID, TEST_PASID, 0, 0xFFFFFFFFFFFFULL);
+    EXPECT_EQ(shardedCache.getSize(), 32);
+    shardedCache.invalidatePASID(TEST_STREAM_ID, TEST_PASID + 1);
+    EXPECT_EQ(shardedCache.getSize(), 0);
+    
+    // Set-associative backend: small ranges probe page by page, large ranges scan
+    TLBCache flatCache(512, 4, TLBBackend::SetAssociative);
+    for (int i = 0; i < 32; ++i) {
+        flatCache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + i * PAGE_SIZE, TEST_PA_1 + i * PAGE_SIZE, perms));
+    }
+    flatCache.invalidateRange(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1, TEST_IOVA_1 + 3 * PAGE_SIZE);
+    EXPECT_EQ(flatCache.getSize(), 28);
+    flatCache.invalidateRange(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 16 * PAGE_SIZE, 0xFFFFFFFFFFFFULL);
+    EXPECT_EQ(flatCache.getSize(), 12);
+    EXPECT_NE(flatCache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 15 * PAGE_SIZE), nullptr);
+}
+
+// Test that entries stamped before the freshness floor are dropped as misses
+TEST_F(TLBCacheTest, ExpiredEntriesMiss) {
+    PagePermissions perms(true, false, false);
+    TLBEntry entry = createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1, TEST_PA_1, perms);
+    entry.timestamp = 5;
+    tlbCache->insert(entry);
+    
+    EXPECT_NE(tlbCache->lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1, SecurityState::NonSecure, 5), nullptr);
+    EXPECT_EQ(tlbCache->getHitCount(), 1);
+    
+    EXPECT_EQ(tlbCache->lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1, SecurityState::NonSecure, 6), nullptr);
+    EXPECT_EQ(tlbCache->getMissCount(), 1);
+    EXPECT_EQ(tlbCache->getSize(), 0);
+}
+
+// Test that stream/PASID invalidation is a generation bump with lazy reclaim
+TEST_F(TLBCacheTest, GenerationInvalidation) {
+    PagePermissions perms(true, false, false);
+    
+    TLBCache listCache(1024, 4);
+    TLBCache flatCache(1024, 4, TLBBackend::SetAssociative);
+    TLBCache* caches[] = { &listCache, &flatCache };
+    for (size_t c = 0; c < 2; ++c) {
+        TLBCache& cache = *caches[c];
+        cache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1, TEST_PA_1, perms));
+        cache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID + 1, TEST_IOVA_1, TEST_PA_2, perms));
+        
+        // A fill whose generation was snapshotted before the invalidation is stale on arrival
+        TLBCache::Generation before = cache.currentGeneration(TEST_STREAM_ID, TEST_PASID);
+        cache.invalidatePASID(TEST_STREAM_ID, TEST_PASID);
+        cache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_2, TEST_PA_2, perms), before);
+        
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1), nullptr);
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_2), nullptr);
+        EXPECT_NE(cache.lookup(TEST_STREAM_ID, TEST_PASID + 1, TEST_IOVA_1), nullptr);
+        EXPECT_EQ(cache.getSize(), 1);
+        
+        // Fresh fills after the bump are served normally
+        cache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1, TEST_PA_1, perms));
+        EXPECT_NE(cache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1), nullptr);
+        EXPECT_EQ(cache.getSize(), 2);
+        
+        cache.invalidateStream(TEST_STREAM_ID);
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1), nullptr);
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID + 1, TEST_IOVA_1), nullptr);
+        EXPECT_EQ(cache.getSize(), 0);
+    }
+}
+
+// Test that a block entry serves every page it covers and is dropped by page invalidation
+TEST_F(TLBCacheTest, BlockEntries) {
+    PagePermissions perms(true, false, false);
+    const IOVA blockIova = 0x40000000;
+    
+    TLBCache listCache(1024, 4);
+    TLBCache flatCache(1024, 4, TLBBackend::SetAssociative);
+    TLBCache* caches[] = { &listCache, &flatCache };
+    for (size_t c = 0; c < 2; ++c) {
+        TLBCache& cache = *caches[c];
+        TLBEntry block = createTLBEntry(TEST_STREAM_ID, TEST_PASID, blockIova, TEST_PA_1, perms);
+        block.blockSize = BLOCK_SIZE_2MB;
+        cache.insert(block);
+        EXPECT_EQ(cache.getSize(), 1);
+        
+        TLBEntry* found = cache.lookup(TEST_STREAM_ID, TEST_PASID, blockIova + 0x1FF000);
+        ASSERT_NE(found, nullptr);
+        EXPECT_EQ(found->iova, blockIova);
+        EXPECT_EQ(found->blockSize, BLOCK_SIZE_2MB);
+        EXPECT_TRUE(cache.lookupEntry(TEST_STREAM_ID, TEST_PASID, blockIova + 0x1000).isOk());
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID, blockIova + BLOCK_SIZE_2MB), nullptr);
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID + 1, blockIova + 0x1000), nullptr);
+        EXPECT_EQ(cache.getHitCount(), 2);
+        EXPECT_EQ(cache.getMissCount(), 2);
+        
+        // Invalidating any page inside the block drops the block
+        cache.invalidate(TEST_STREAM_ID, TEST_PASID, blockIova + 0x80000);
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID, blockIova + 0x1000), nullptr);
+        
+        // A range ending inside the block, starting after its base, also drops it
+        cache.insert(block);
+        cache.invalidateRange(TEST_STREAM_ID, TEST_PASID, blockIova + 0x10000, blockIova + 0x10FFF);
+        EXPECT_EQ(cache.getSize(), 0);
+        
+        cache.insert(block);
+        cache.invalidateRange(TEST_STREAM_ID, TEST_PASID, blockIova + 0x10000, blockIova + 0x100000000ULL);
+        EXPECT_EQ(cache.getSize(), 0);
+    }
+}
+
+// Test that a range drops the blocks starting before it, and no page before it
+TEST_F(TLBCacheTest, InvalidateRangeBlocksBeforeRange) {
+    PagePermissions perms(true, false, false);
+    const IOVA base = 0x40000000;
+    
+    TLBCache cache(4096, 4);
+    for (int round = 0; round < 2; ++round) {
+        // A 1GB and a 2MB block share a base; pages sit between it and the range
+        TLBEntry gigabyte = createTLBEntry(TEST_STREAM_ID, TEST_PASID, base, TEST_PA_1, perms);
+        gigabyte.blockSize = BLOCK_SIZE_1GB;
+        cache.insert(gigabyte);
+        TLBEntry twoMegabyte = createTLBEntry(TEST_STREAM_ID, TEST_PASID, base, TEST_PA_2, perms);
+        twoMegabyte.blockSize = BLOCK_SIZE_2MB;
+        twoMegabyte.securityState = SecurityState::Secure;
+        cache.insert(twoMegabyte);
+        for (uint64_t i = 0; i < 512; ++i) {
+            cache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID + 1, base + i * PAGE_SIZE, TEST_PA_1, perms));
+            cache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, base + BLOCK_SIZE_2MB + i * PAGE_SIZE,
+                                        TEST_PA_1, perms));
+        }
+        ASSERT_EQ(cache.getSize(), 1026u);
+        
+        // Starts inside the 1GB block, past the 2MB one and the pages
+        cache.invalidateRange(TEST_STREAM_ID, TEST_PASID, base + 0x10000000, base + 0x10000FFF);
+        EXPECT_EQ(cache.getSize(), 1025u);
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID, base + 0x10000000), nullptr);
+        EXPECT_NE(cache.lookup(TEST_STREAM_ID, TEST_PASID, base + BLOCK_SIZE_2MB), nullptr);
+        
+        // Starts inside the 2MB block: both blocks go, the pages after stay
+        cache.insert(gigabyte);
+        cache.invalidateRange(TEST_STREAM_ID, TEST_PASID, base + 0x1000, base + 0x1FFF);
+        EXPECT_EQ(cache.getSize(), 1024u);
+        
+        // Clearing forgets the block sizes; blocks inserted after are still found
+        cache.clear();
+        EXPECT_EQ(cache.getSize(), 0u);
+    }
+}
+
+// Test that 64KB-granule pages take one entry per 64KB and coexist with 4KB pages
+TEST_F(TLBCacheTest, GranulePageEntries) {
+    PagePermissions perms(true, false, false);
+    const uint64_t granule = granulePageSize(TranslationGranule::Size64KB);
+    
+    TLBCache listCache(1024, 4);
+    TLBCache flatCache(1024, 4, TLBBackend::SetAssociative);
+    TLBCache* caches[] = { &listCache, &flatCache };
+    for (size_t c = 0; c < 2; ++c) {
+        TLBCache& cache = *caches[c];
+        for (uint64_t i = 0; i < 4; ++i) {
+            TLBEntry page = createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + i * granule,
+                                           TEST_PA_1 + i * granule, perms);
+            page.blockSize = granule;
+            cache.insert(page);
+        }
+        cache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID + 1, TEST_IOVA_1, TEST_PA_2, perms));
+        EXPECT_EQ(cache.getSize(), 5);
+        
+        // Every 4KB page of a granule page hits its one entry
+        for (uint64_t offset = 0; offset < 4 * granule; offset += PAGE_SIZE) {
+            TLBEntry* found = cache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + offset);
+            ASSERT_NE(found, nullptr);
+            EXPECT_EQ(found->iova, TEST_IOVA_1 + (offset & ~(granule - 1)));
+        }
+        ASSERT_NE(cache.lookup(TEST_STREAM_ID, TEST_PASID + 1, TEST_IOVA_1), nullptr);
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID + 1, TEST_IOVA_1 + PAGE_SIZE), nullptr);
+        
+        // A range inside the second granule page drops only that entry
+        cache.invalidateRange(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + granule + 0x3000, TEST_IOVA_1 + granule + 0x3FFF);
+        EXPECT_EQ(cache.getSize(), 4);
+        EXPECT_EQ(cache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + granule), nullptr);
+        EXPECT_NE(cache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 2 * granule), nullptr);
+        
+        cache.invalidate(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_1 + 3 * granule + 0xF000);
+        EXPECT_EQ(cache.getSize(), 3);
+    }
+}
+
+// Test that the set-associative backend never exceeds its capacity and keeps hot entries
+TEST_F(TLBCacheTest, SetAssociativeBackendReplacement) {
+    TLBCache flatCache(64, 1, TLBBackend::SetAssociative);
+    PagePermissions perms(true, true, false);
+    
+    flatCache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_2, TEST_PA_2, perms));
+    for (int i = 0; i < 1000; ++i) {
+        flatCache.insert(createTLBEntry(TEST_STREAM_ID, TEST_PASID,
+                                        TEST_IOVA_1 + i * PAGE_SIZE,
+                                        TEST_PA_1 + i * PAGE_SIZE, perms));
+        // Keep one entry referenced so CLOCK gives it a second chance
+        flatCache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_2);
+    }
+    
+    EXPECT_LE(flatCache.getSize(), 64);
+    EXPECT_NE(flatCache.lookup(TEST_STREAM_ID, TEST_PASID, TEST_IOVA_2), nullptr);
+    
+    // Shrinking keeps the cache within the new limit
+    flatCache.setMaxSize(16);
+    EXPECT_LE(flatCache.getSize(), 16);
+    
+    flatCache.clear();
+    EXPECT_EQ(flatCache.getSize(), 0);
+}
+
+// Test set-associative geometry
+TEST_F(TLBCacheTest, SetAssociativeGeometry) {
+    SetAssociativeTLB store(100, 8);
+    EXPECT_EQ(store.getWays(), 8);
+    EXPECT_EQ(store.getSetCount(), 8);   // Largest power of two with 8 * sets <= 100
+    EXPECT_EQ(store.capacity(), 64);
+    
+    SetAssociativeTLB tiny(3, 8);
+    EXPECT_EQ(tiny.getSetCount(), 1);
+    EXPECT_EQ(tiny.capacity(), 3);
+    
+    // Out-of-range PASIDs are never cached
+    TLBEntry entry = createTLBEntry(TEST_STREAM_ID, MAX_PASID + 1, TEST_IOVA_1, TEST_PA_1,
+                                    PagePermissions(true, false, false));
+    uint64_t hash = SetAssociativeTLB::hashKey(entry.streamID, entry.pasid, entry.iova);
+    store.insert(hash, entry);
+    EXPECT_EQ(store.size(), 0);
+}
+
 } // namespace test
 } // namespace smmu
\ No newline at end of file
@@ -132,6 +132,40 @@ TEST_F(TypesTest, PageEntry) {
     EXPECT_FALSE(validEntry.permissions.execute);
 }
 
+// Test PageDescriptor packing and the single-mask permission check
+TEST_F(TypesTest, PageDescriptor) {
+    EXPECT_EQ(sizeof(PageDescriptor), sizeof(uint64_t));
+    
+    PageDescriptor empty;
+    EXPECT_FALSE(empty.isValid());
+    EXPECT_FALSE(empty.permits(AccessType::Read, SecurityState::NonSecure));
+    
+    // Every field survives the round trip, up to the top of the 52-bit PA space
+    PA testPA = MAX_PHYSICAL_ADDRESS & ~(PAGE_SIZE - 1);
+    PageDescriptor descriptor(testPA, PagePermissions(true, false, true), SecurityState::Realm);
+    EXPECT_TRUE(descriptor.isValid());
+    EXPECT_EQ(descriptor.getPhysicalAddress(), testPA);
+    EXPECT_EQ(descriptor.getSecurityState(), SecurityState::Realm);
+    EXPECT_TRUE(descriptor.getPermissions().read);
+    EXPECT_FALSE(descriptor.getPermissions().write);
+    EXPECT_TRUE(descriptor.getPermissions().execute);
+    
+    EXPECT_TRUE(descriptor.permits(AccessType::Read, SecurityState::Realm));
+    EXPECT_TRUE(descriptor.permits(AccessType::Execute, SecurityState::Realm));
+    EXPECT_FALSE(descriptor.permits(AccessType::Write, SecurityState::Realm));
+    EXPECT_FALSE(descriptor.permits(AccessType::Read, SecurityState::Secure));
+    EXPECT_FALSE(descriptor.permits(static_cast<AccessType>(7), SecurityState::Realm));
+    
+    // Converting from PageEntry keeps validity; offsetBy moves only the address
+    PageEntry entry(0x40000000, PagePermissions(true, true, false), SecurityState::Secure);
+    PageDescriptor converted(entry);
+    EXPECT_TRUE(converted.permits(AccessType::Write, SecurityState::Secure));
+    EXPECT_EQ(converted.offsetBy(0x200000).getPhysicalAddress(), 0x40200000);
+    EXPECT_EQ(converted.offsetBy(0x200000).getSecurityState(), SecurityState::Secure);
+    entry.valid = false;
+    EXPECT_FALSE(PageDescriptor(entry).isValid());
+}
+
 // Test FaultRecord structure
 TEST_F(TypesTest, FaultRecord) {
     FaultRecord defaultRecord;